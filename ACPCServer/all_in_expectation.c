@@ -14,9 +14,109 @@ Copyright (C) 2014 by the Computer Poker Research Group, University of Alberta
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <getopt.h>
+#include <pthread.h>
 #include "game.h"
+#include "evaluator.h"
 #include "net.h"
+#include "binary_log.h"
+#include "log_compress.h"
+
+
+/* hands are read in batches, and the all in hands of a batch are rolled
+   out by the worker threads before the batch is printed in order */
+#define MAX_BATCH_HANDS 1024
+
+/* rollouts over at least this many boards are kept in the cache, since
+   the same all in hands (up to the suits) come up again and again */
+#define MIN_CACHED_BOARDS 10000
+#define CACHE_BUCKETS 65536
+
+/* hole cards of every player, the known board cards and a bit mask of
+   the players who folded */
+#define CACHE_KEY_LEN ( MAX_PLAYERS * MAX_HOLE_CARDS + MAX_BOARD_CARDS + 2 )
+
+/* time to wait before looking for more of a log being followed */
+#define FOLLOW_WAIT_MICROS 250000
+
+/* how often each ordering of the players' hands came up over every
+   board of a rollout.  Each outcome has four bits per player, which are
+   zero if the player folded, and otherwise one more than the number of
+   different ranks below the player's hand */
+typedef struct {
+  int numOutcomes;
+  int maxOutcomes;
+  uint64_t *outcome;
+  uint64_t *count;
+  uint64_t numBoards;
+} Rollout;
+
+typedef struct CacheEntryStruct {
+  struct CacheEntryStruct *next;
+  uint8_t key[ CACHE_KEY_LEN ];
+
+  /* zero while a thread is still rolling out the hand */
+  int ready;
+  Rollout rollout;
+} CacheEntry;
+
+/* rollouts shared by all threads */
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  CacheEntry *bucket[ CACHE_BUCKETS ];
+} RolloutCache;
+
+/* a hand from the log, and its values if it is rolled out */
+typedef struct {
+  char line[ MAX_LINE_LEN ];
+
+  /* length of the state at the start of line, or 0 if it has none */
+  int stateEnd;
+  State state;
+
+  /* last round with an action in an all in hand which is rolled out,
+     or -1 if the line is printed as it is */
+  int round;
+  double value[ MAX_PLAYERS ];
+} LogJob;
+
+/* everything the worker threads share */
+typedef struct {
+  const Game *game;
+  RolloutCache *cache;
+
+  LogJob *job;
+  int numRollouts;
+  int rolloutJob[ MAX_BATCH_HANDS ];
+
+  /* next entry of rolloutJob to be done */
+  pthread_mutex_t lock;
+  int nextRollout;
+} Batch;
+
+/* where hands are read from */
+typedef struct {
+  FILE *file;
+  BinaryLog *binaryLog;
+  size_t offset;
 
+  /* non-zero if the reader waits for more of a text log at its end */
+  int follow;
+
+  /* the start of a line at the end of a followed log, which hasn't all
+     been written yet */
+  int partialLen;
+  char partial[ MAX_LINE_LEN ];
+} LogReader;
+
+
+static void printUsage( FILE *file, const char *name )
+{
+  fprintf( file, "usage: %s [-t threads] [-f] game_def log_file\n", name );
+  fprintf( file, "  log_file can be a text or binary log, and can be compressed\n" );
+  fprintf( file, "  -t number of threads [default: one per CPU]\n" );
+  fprintf( file, "  -f follow a text log as it is written, until its final SCORE line\n" );
+}
 
 void getUsedCards( const Game *game,
 		   const State *state,
@@ -45,175 +145,741 @@ void getUsedCards( const Game *game,
   }
 }
 
-int main( int argc, char **argv )
+/* number of ways to choose k items from n, saturating at UINT64_MAX */
+static uint64_t choose( const int n, const int k )
 {
-  int stateEnd, r, i, p, deckSize, numBoards;
-  FILE *file;
-  Game *game;
-  State state;
-  uint8_t deck[ MAX_SUITS * MAX_RANKS ];
-  uint8_t used[ MAX_SUITS * MAX_RANKS ];
-  double value[ MAX_PLAYERS ];
-  char line[ 4096 ];
+  int i;
+  uint64_t r;
 
-  if( argc < 3 ) {
+  if( k < 0 || k > n ) {
+    return 0;
+  }
 
-    fprintf( stderr, "USAGE: %s game_def log_file\n", argv[ 0 ] );
-    exit( EXIT_FAILURE );
+  r = 1;
+  for( i = 1; i <= k; ++i ) {
+
+    if( r > UINT64_MAX / ( n - k + i ) ) {
+      return UINT64_MAX;
+    }
+    r = r * ( n - k + i ) / i;
   }
 
-  /* get the game definition */
-  file = fopen( argv[ 1 ], "r" );
-  if( file == NULL ) {
+  return r;
+}
 
-    fprintf( stderr, "ERROR: could not open game definition %s\n", argv[ 1 ] );
-    exit( EXIT_FAILURE );
+/* put the first numCards of cards into out in increasing order, with
+   their suits renamed by perm, and one added so no card is zero */
+static void sortedCards( const int numCards, const uint8_t *cards,
+			 const uint8_t perm[ MAX_SUITS ], uint8_t *out )
+{
+  int i, j;
+  uint8_t c;
+
+  for( i = 0; i < numCards; ++i ) {
+
+    c = makeCard( rankOfCard( cards[ i ] ), perm[ suitOfCard( cards[ i ] ) ] )
+      + 1;
+    for( j = i; j > 0 && out[ j - 1 ] > c; --j ) {
+      out[ j ] = out[ j - 1 ];
+    }
+    out[ j ] = c;
   }
-  game = readGame( file );
-  if( game == NULL ) {
+}
 
-    fprintf( stderr, "ERROR: could not read game %s\n", argv[ 1 ] );
-    exit( EXIT_FAILURE );
+/* make the cache key for the cards of state up to round, which is the
+   smallest key over every renaming of the suits, so hands which are the
+   same up to the suits share a rollout */
+static void rolloutKey( const Game *game, const State *state,
+			const int round, uint8_t key[ CACHE_KEY_LEN ] )
+{
+  int first, n, p;
+  uint8_t a, b, c, perm[ MAX_SUITS ], k[ CACHE_KEY_LEN ];
+
+  first = 1;
+  for( a = 0; a < MAX_SUITS; ++a ) {
+    for( b = 0; b < MAX_SUITS; ++b ) {
+      for( c = 0; c < MAX_SUITS; ++c ) {
+
+	if( a == b || a == c || b == c ) {
+	  continue;
+	}
+	if( game->numSuits < MAX_SUITS && ( a != 0 || b != 1 || c != 2 ) ) {
+	  /* the deck of a game with fewer suits isn't symmetric */
+
+	  continue;
+	}
+	perm[ 0 ] = a;
+	perm[ 1 ] = b;
+	perm[ 2 ] = c;
+	perm[ 3 ] = 6 - a - b - c;
+
+	memset( k, 0, CACHE_KEY_LEN );
+	n = 0;
+	for( p = 0; p < game->numPlayers; ++p ) {
+
+	  sortedCards( game->numHoleCards, state->holeCards[ p ], perm,
+		       &k[ n ] );
+	  n += MAX_HOLE_CARDS;
+	  if( state->playerFolded[ p ] ) {
+	    k[ CACHE_KEY_LEN - 2 + p / 8 ] |= 1 << ( p % 8 );
+	  }
+	}
+	sortedCards( sumBoardCards( game, round ), state->boardCards, perm,
+		     &k[ n ] );
+
+	if( first || memcmp( k, key, CACHE_KEY_LEN ) < 0 ) {
+
+	  memcpy( key, k, CACHE_KEY_LEN );
+	  first = 0;
+	}
+      }
+    }
   }
-  fclose( file );
+}
 
-  /* get the log file */
-  file = fopen( argv[ 2 ], "r" );
-  if( file == NULL ) {
+/* find the rollout for key in the cache, waiting for it if another
+   thread is rolling it out.  If it isn't there, an entry is added which
+   is not ready, and must be passed to finishCacheEntry() once the
+   caller has rolled out the hand
+   returns NULL on failure */
+static CacheEntry *findCacheEntry( RolloutCache *cache,
+				   const uint8_t key[ CACHE_KEY_LEN ] )
+{
+  int i;
+  uint32_t hash;
+  CacheEntry *entry;
+
+  /* FNV-1a */
+  hash = 2166136261u;
+  for( i = 0; i < CACHE_KEY_LEN; ++i ) {
+    hash = ( hash ^ key[ i ] ) * 16777619u;
+  }
+  hash %= CACHE_BUCKETS;
 
-    fprintf( stderr, "ERROR: could not open log file %s\n", argv[ 2 ] );
-    exit( EXIT_FAILURE );
+  pthread_mutex_lock( &cache->lock );
+  for( entry = cache->bucket[ hash ]; entry != NULL; entry = entry->next ) {
+
+    if( memcmp( entry->key, key, CACHE_KEY_LEN ) == 0 ) {
+
+      while( !entry->ready ) {
+	pthread_cond_wait( &cache->ready, &cache->lock );
+      }
+      pthread_mutex_unlock( &cache->lock );
+      return entry;
+    }
   }
 
-  /* read every line and process all hands */
-  while( fgets( line, 4096, file ) ) {
+  entry = (CacheEntry *)calloc( 1, sizeof( *entry ) );
+  if( entry != NULL ) {
 
-    stateEnd = readState( line, game, &state );
-    if( stateEnd < 0 ) {
-      /* couldn't read a state from the line */
+    memcpy( entry->key, key, CACHE_KEY_LEN );
+    entry->next = cache->bucket[ hash ];
+    cache->bucket[ hash ] = entry;
+  }
+  pthread_mutex_unlock( &cache->lock );
 
-      continue;
+  return entry;
+}
+
+/* let threads waiting for an entry use it.  An entry with no boards
+   is from a failed rollout */
+static void finishCacheEntry( RolloutCache *cache, CacheEntry *entry )
+{
+  pthread_mutex_lock( &cache->lock );
+  entry->ready = 1;
+  pthread_cond_broadcast( &cache->ready );
+  pthread_mutex_unlock( &cache->lock );
+}
+
+static void freeRollout( Rollout *rollout )
+{
+  free( rollout->outcome );
+  free( rollout->count );
+}
+
+/* rank the hands of the players who didn't fold on a full board, and
+   count the outcome
+   returns >= 0 on success, -1 on failure */
+static int addOutcome( const Game *game, const State *state,
+		       const HandPrefix *board, Rollout *rollout )
+{
+  int p, q, numBelow, i;
+  int rank[ MAX_PLAYERS ];
+  uint64_t outcome;
+
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( !state->playerFolded[ p ] ) {
+      rank[ p ] = rankHandPrefix( board, game->numHoleCards,
+				  state->holeCards[ p ] );
     }
+  }
 
-    if( numAllIn( game, &state ) == 0
-	|| numFolded( game, &state ) + 1 >= game->numPlayers ) {
-      /* no one all in, or game didn't end in a showdown */
+  outcome = 0;
+  for( p = 0; p < game->numPlayers; ++p ) {
 
-      printf( "%s", line );
+    if( state->playerFolded[ p ] ) {
       continue;
     }
 
-    /* find last round where someone made an action */
-    for( r = state.round; r > 0; --r ) {
+    /* count the different ranks below p's, using the first player
+       with each rank */
+    numBelow = 0;
+    for( q = 0; q < game->numPlayers; ++q ) {
 
-      if( state.numActions[ r ] ) {
+      if( state->playerFolded[ q ] || rank[ q ] >= rank[ p ] ) {
+	continue;
+      }
+      for( i = 0; i < q; ++i ) {
 
-	break;
+	if( !state->playerFolded[ i ] && rank[ i ] == rank[ q ] ) {
+	  break;
+	}
+      }
+      if( i == q ) {
+	++numBelow;
       }
     }
+    outcome |= (uint64_t)( numBelow + 1 ) << ( p * 4 );
+  }
 
-    if( r + 1 == game->numRounds ) {
-      /* there are no board cards left to roll out on the final round */
+  ++rollout->numBoards;
+  for( i = 0; i < rollout->numOutcomes; ++i ) {
 
-      printf( "%s", line );
-      continue;
+    if( rollout->outcome[ i ] == outcome ) {
+
+      ++rollout->count[ i ];
+      return 0;
     }
+  }
 
-    /* initialise values to 0 */
-    memset( value, 0, sizeof( value ) );
+  if( rollout->numOutcomes == rollout->maxOutcomes ) {
+
+    rollout->maxOutcomes = rollout->maxOutcomes ? rollout->maxOutcomes * 2 : 16;
+    rollout->outcome
+      = (uint64_t *)realloc( rollout->outcome,
+			     sizeof( uint64_t ) * rollout->maxOutcomes );
+    rollout->count
+      = (uint64_t *)realloc( rollout->count,
+			     sizeof( uint64_t ) * rollout->maxOutcomes );
+    if( rollout->outcome == NULL || rollout->count == NULL ) {
+      return -1;
+    }
+  }
+  rollout->outcome[ rollout->numOutcomes ] = outcome;
+  rollout->count[ rollout->numOutcomes ] = 1;
+  ++rollout->numOutcomes;
 
-    /* set up a deck containing all cards up to round r */
-    getUsedCards( game, &state, r, used );
-    deckSize = 0;
-    for( i = 0; i < game->numSuits * game->numRanks; ++i ) {
+  return 0;
+}
 
-      if( !used[ i ] ) {
+/* enumerate all boards with the remaining cards after deck[ start ].
+   The board is built up one card at a time, so each card is only added
+   once for every board it starts
+   returns >= 0 on success, -1 on failure */
+static int enumerateBoards( const Game *game, const State *state,
+			    const uint8_t *deck, const int deckSize,
+			    const HandPrefix *board, const int cardsLeft,
+			    const int start, Rollout *rollout )
+{
+  int i;
+  HandPrefix next;
 
-	deck[ deckSize ] = i;
-	++deckSize;
-      }
+  if( cardsLeft == 0 ) {
+    return addOutcome( game, state, board, rollout );
+  }
+
+  for( i = start; i <= deckSize - cardsLeft; ++i ) {
+
+    extendHandPrefix( board, deck[ i ], &next );
+    if( enumerateBoards( game, state, deck, deckSize, &next,
+			 cardsLeft - 1, i + 1, rollout ) < 0 ) {
+      return -1;
     }
+  }
+
+  return 0;
+}
 
-    /* switch to using used[] as the index into deck[]
-       for the remaining cards used on the board
-       sort hands in ascending order, start with highest indexed hand */
-    const int bcStart = sumBoardCards( game, r );
-    const int numCards = sumBoardCards( game, game->numRounds - 1 ) - bcStart;
-    for( i = 0; i < numCards; ++i ) {
+/* set each player's value in an all in hand to the average over every
+   board which could have come after round.  Big rollouts are shared
+   through the cache
+   returns >= 0 on success, -1 on failure */
+static int rollOutHand( const Game *game, RolloutCache *cache, LogJob *job )
+{
+  int i, p, deckSize, numKnown, numCards;
+  uint8_t deck[ MAX_SUITS * MAX_RANKS ];
+  uint8_t used[ MAX_SUITS * MAX_RANKS ];
+  uint8_t key[ CACHE_KEY_LEN ];
+  int rank[ MAX_PLAYERS ];
+  HandPrefix board;
+  Rollout local, *rollout;
+  CacheEntry *entry;
 
-      used[ i ] = deckSize - numCards + i;
-      state.boardCards[ bcStart + i ] = deck[ used[ i ] ];
+  /* set up a deck containing all cards not used up to the round */
+  getUsedCards( game, &job->state, job->round, used );
+  deckSize = 0;
+  for( i = 0; i < game->numSuits * game->numRanks; ++i ) {
+
+    if( !used[ i ] ) {
+
+      deck[ deckSize ] = i;
+      ++deckSize;
+    }
+  }
+  numKnown = sumBoardCards( game, job->round );
+  numCards = sumBoardCards( game, game->numRounds - 1 ) - numKnown;
+
+  entry = NULL;
+  memset( &local, 0, sizeof( local ) );
+  rollout = &local;
+  if( choose( deckSize, numCards ) >= MIN_CACHED_BOARDS ) {
+
+    rolloutKey( game, &job->state, job->round, key );
+    entry = findCacheEntry( cache, key );
+    if( entry == NULL ) {
+      return -1;
     }
+    rollout = &entry->rollout;
+  }
 
-    /* try every possible board */
-    numBoards = 0;
-    while( 1 ) {
+  if( entry == NULL || !entry->ready ) {
 
-      /* get the values */
-      for( p = 0; p < game->numPlayers; ++p ) {
+    initHandPrefix( &board, numKnown, job->state.boardCards,
+		    game->numHoleCards );
+    if( enumerateBoards( game, &job->state, deck, deckSize, &board,
+			 numCards, 0, rollout ) < 0 ) {
 
-	value[ p ] += valueOfState( game, &state, p );
-      }
+      rollout->numBoards = 0;
+    }
+    if( entry != NULL ) {
+      finishCacheEntry( cache, entry );
+    }
+  }
+  if( rollout->numBoards == 0 ) {
+
+    freeRollout( &local );
+    return -1;
+  }
+
+  /* the values only depend on the order of the hands */
+  memset( job->value, 0, sizeof( job->value ) );
+  for( i = 0; i < rollout->numOutcomes; ++i ) {
+
+    for( p = 0; p < game->numPlayers; ++p ) {
+      rank[ p ] = ( rollout->outcome[ i ] >> ( p * 4 ) ) & 15;
+    }
+    for( p = 0; p < game->numPlayers; ++p ) {
+
+      job->value[ p ] += (double)rollout->count[ i ]
+	* valueOfShowdown( game, &job->state, rank, p );
+    }
+  }
+  for( p = 0; p < game->numPlayers; ++p ) {
+    job->value[ p ] /= (double)rollout->numBoards;
+  }
+
+  freeRollout( &local );
+  return 0;
+}
+
+static void *rolloutThread( void *arg )
+{
+  Batch *batch = (Batch *)arg;
+  int i;
+
+  while( 1 ) {
+
+    pthread_mutex_lock( &batch->lock );
+    i = batch->nextRollout;
+    ++batch->nextRollout;
+    pthread_mutex_unlock( &batch->lock );
+    if( i >= batch->numRollouts ) {
+      break;
+    }
+
+    if( rollOutHand( batch->game, batch->cache,
+		     &batch->job[ batch->rolloutJob[ i ] ] ) < 0 ) {
+      return NULL;
+    }
+  }
+
+  return arg;
+}
+
+/* roll out the all in hands of a batch with numThreads threads
+   returns >= 0 on success, -1 on failure */
+static int rollOutBatch( Batch *batch, int numThreads )
+{
+  int i, r;
+  void *result;
+  pthread_t thread[ 256 ];
+
+  if( numThreads > batch->numRollouts ) {
+    numThreads = batch->numRollouts;
+  }
+  batch->nextRollout = 0;
+  for( i = 0; i < numThreads; ++i ) {
 
-      /* move on to the next board */
-      ++numBoards;
+    if( pthread_create( &thread[ i ], NULL, rolloutThread, batch ) ) {
 
-      /* find position of first card we can decrement */
-      i = 0;
-      while( used[ i ] == i && i < numCards ) {
+      fprintf( stderr, "ERROR: could not start rollout thread\n" );
+      numThreads = i;
+      break;
+    }
+  }
+
+  r = numThreads || batch->numRollouts == 0 ? 0 : -1;
+  for( i = 0; i < numThreads; ++i ) {
+
+    pthread_join( thread[ i ], &result );
+    if( result == NULL ) {
+      r = -1;
+    }
+  }
+  if( r < 0 ) {
+
+    fprintf( stderr, "ERROR: could not roll out hands\n" );
+  }
+
+  return r;
+}
+
+/* print a hand, with the values in the line replaced by the rolled out
+   values if there are any */
+static void printJob( const Game *game, LogJob *job )
+{
+  int i, p, stateEnd;
+  char *line;
+
+  line = job->line;
+  if( job->round < 0 ) {
+
+    printf( "%s", line );
+    return;
+  }
+
+  /* do the printout - start with the state */
+  stateEnd = job->stateEnd;
+  if( line[ stateEnd ] != 0 ) {
+
+    if( line[ stateEnd ] != ':' && line[ stateEnd ] != '\n' ) {
+
+      fprintf( stderr, "ERROR: expected input of STATE:VALUES:PLAYERS\n" );
+      exit( EXIT_FAILURE );
+    }
+    line[ stateEnd ] = 0;
+    ++stateEnd;
+  }
+  printf( "%s:", line );
+
+  /* print out the averaged values */
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    printf( p ? "|%lf" : "%lf", job->value[ p ] );
+  }
+
+  /* find the player names in the state line */
+  for( i = stateEnd; line[ i ] && line[ i ] != ':'; ++i );
+  if( line[ i ] == ':' ) {
+
+    printf( "%s", &line[ i ] );
+  } else {
+
+    printf( "\n" );
+  }
+}
+
+/* get the next line of a text log and the state in it, or the next hand
+   of a binary log and the line the dealer would have put in a text log.
+   A followed log which ends part way through a line is left for later
+   returns the length of the state at the start of line, 0 if the line
+   has no state, or -1 at the end of the log */
+static int nextLogHand( const Game *game, LogReader *reader,
+			char *line, const int maxLen, State *state )
+{
+  int r, c;
+  LogHand hand;
+  const char *text;
+  char *valuesEnd;
 
-	++ i;
+  if( reader->binaryLog == NULL ) {
+
+    memcpy( line, reader->partial, reader->partialLen );
+    if( !fgets( &line[ reader->partialLen ], maxLen - reader->partialLen,
+		reader->file ) ) {
+      return -1;
+    }
+    c = strlen( line );
+    if( reader->follow && line[ c - 1 ] != '\n' && c + 1 < maxLen ) {
+      /* the rest of the line hasn't been written yet */
+
+      memcpy( reader->partial, line, c );
+      reader->partialLen = c;
+      return -1;
+    }
+    reader->partialLen = 0;
+
+    c = readState( line, game, state );
+    return c < 0 ? 0 : c;
+  }
+
+  /* only hands are of interest */
+  while( ( r = readBinaryLogRecord( reader->binaryLog, &reader->offset, 1,
+				    &hand, &text, &c ) ) == BINARY_LOG_TEXT );
+  if( r < 0 ) {
+
+    fprintf( stderr, "ERROR: bad record in binary log\n" );
+    exit( EXIT_FAILURE );
+  }
+  if( r == 0 ) {
+
+    return -1;
+  }
+
+  c = printLogHand( game, &hand, reader->binaryLog->seatName, maxLen - 1,
+		    line );
+  if( c < 0 ) {
+
+    fprintf( stderr, "ERROR: could not print hand %"PRIu32"\n",
+	     hand.state.handId );
+    exit( EXIT_FAILURE );
+  }
+  line[ c ] = '\n';
+  line[ c + 1 ] = 0;
+  *state = hand.state;
+
+  /* the state is followed by :values:names, and names have no colons */
+  valuesEnd = strrchr( line, ':' );
+  *valuesEnd = 0;
+  c = strrchr( line, ':' ) - line;
+  *valuesEnd = ':';
+
+  return c;
+}
+
+int main( int argc, char **argv )
+{
+  int i, r, numJobs, numThreads, atEnd, finished;
+  FILE *file, *logFile;
+  Game *game;
+  LogJob *job;
+  LogReader reader;
+  Batch batch;
+  RolloutCache *cache;
+  char magic[ BINARY_LOG_MAGIC_LEN ];
+
+  numThreads = 0;
+  reader.follow = 0;
+  while( ( i = getopt( argc, argv, "t:f" ) ) >= 0 ) {
+
+    if( i == 't' ) {
+
+      if( sscanf( optarg, "%d", &numThreads ) < 1 ) {
+
+	fprintf( stderr, "ERROR: could not get number of threads from %s\n",
+		 optarg );
+	exit( EXIT_FAILURE );
       }
-      if( i == numCards ) {
-	/* can't decrement any cards, so we're done */
+    } else if( i == 'f' ) {
 
+      reader.follow = 1;
+    } else {
+
+      printUsage( stderr, argv[ 0 ] );
+      exit( EXIT_FAILURE );
+    }
+  }
+  if( optind + 2 > argc ) {
+
+    printUsage( stderr, argv[ 0 ] );
+    exit( EXIT_FAILURE );
+  }
+  if( numThreads <= 0 ) {
+
+    numThreads = sysconf( _SC_NPROCESSORS_ONLN );
+  }
+  if( numThreads < 1 ) {
+    numThreads = 1;
+  } else if( numThreads > 256 ) {
+    numThreads = 256;
+  }
+
+  /* get the game definition */
+  file = fopen( argv[ optind ], "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game definition %s\n",
+	     argv[ optind ] );
+    exit( EXIT_FAILURE );
+  }
+  game = readGame( file );
+  if( game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", argv[ optind ] );
+    exit( EXIT_FAILURE );
+  }
+  fclose( file );
+
+  /* get the log file, which can be a text or binary log, and is read
+     through a decompressing stream if it is compressed */
+  logFile = fopen( argv[ optind + 1 ], "r" );
+  if( logFile == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open log file %s\n",
+	     argv[ optind + 1 ] );
+    exit( EXIT_FAILURE );
+  }
+  if( reader.follow ) {
+    /* a followed log might not have anything in it yet, so wait until
+       there is enough of it to tell what kind of log it is */
+
+    while( fread( magic, 1, sizeof( magic ), logFile ) < sizeof( magic ) ) {
+
+      usleep( FOLLOW_WAIT_MICROS );
+      rewind( logFile );
+    }
+    rewind( logFile );
+  }
+  file = openLogStream( logFile );
+  if( file == NULL ) {
+    /* error messages already handled in function */
+
+    exit( EXIT_FAILURE );
+  }
+  reader.binaryLog = NULL;
+  reader.offset = 0;
+  reader.partialLen = 0;
+  r = fread( magic, 1, BINARY_LOG_MAGIC_LEN, file );
+  if( isBinaryLog( magic, r ) ) {
+
+    if( reader.follow ) {
+
+      fprintf( stderr, "ERROR: -f needs a text log\n" );
+      exit( EXIT_FAILURE );
+    }
+    reader.binaryLog = openBinaryLog( argv[ optind + 1 ], game );
+    if( reader.binaryLog == NULL ) {
+      /* error messages already handled in function */
+
+      exit( EXIT_FAILURE );
+    }
+    reader.offset = reader.binaryLog->start;
+  } else {
+    /* a decompressing stream can't seek, so start a new one */
+
+    if( file != logFile ) {
+      fclose( file );
+    }
+    rewind( logFile );
+    file = openLogStream( logFile );
+    if( file == NULL ) {
+
+      exit( EXIT_FAILURE );
+    }
+  }
+  reader.file = file;
+
+  job = (LogJob *)malloc( sizeof( LogJob ) * MAX_BATCH_HANDS );
+  cache = (RolloutCache *)calloc( 1, sizeof( *cache ) );
+  if( job == NULL || cache == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate hands\n" );
+    exit( EXIT_FAILURE );
+  }
+  pthread_mutex_init( &cache->lock, NULL );
+  pthread_cond_init( &cache->ready, NULL );
+  batch.game = game;
+  batch.cache = cache;
+  batch.job = job;
+  pthread_mutex_init( &batch.lock, NULL );
+
+  /* read every line and process all hands, a batch at a time */
+  finished = 0;
+  while( !finished ) {
+
+    numJobs = 0;
+    batch.numRollouts = 0;
+    atEnd = 0;
+    while( numJobs < MAX_BATCH_HANDS ) {
+
+      job[ numJobs ].stateEnd
+	= nextLogHand( game, &reader, job[ numJobs ].line, MAX_LINE_LEN,
+		       &job[ numJobs ].state );
+      if( job[ numJobs ].stateEnd < 0 ) {
+
+	atEnd = 1;
 	break;
       }
+      if( reader.follow && !strncmp( job[ numJobs ].line, "SCORE:", 6 ) ) {
+	/* the dealer is done with the log */
+
+	finished = 1;
+      }
+      if( job[ numJobs ].stateEnd == 0 ) {
+	/* couldn't read a state from the line */
 
-      /* decrement the card */
-      --used[ i ];
-      state.boardCards[ bcStart + i ] = deck[ used[ i ] ];
+	continue;
+      }
 
-      /* fill in all earlier cards with highest possible index */
-      while( i > 0 ) {
+      job[ numJobs ].round = -1;
+      if( numAllIn( game, &job[ numJobs ].state ) == 0
+	  || numFolded( game, &job[ numJobs ].state ) + 1
+	  >= game->numPlayers ) {
+	/* no one all in, or game didn't end in a showdown */
 
-	/* move to previous card, set index to one lower then current card */
-	--i;
-	used[ i ] = used[ i + 1 ] - 1;
-	state.boardCards[ bcStart + i ] = deck[ used[ i ] ];
+	++numJobs;
+	continue;
       }
-    }
 
-    /* do the printout - start with the state */
-    if( line[ stateEnd ] != 0 ) {
+      /* find last round where someone made an action */
+      for( r = job[ numJobs ].state.round; r > 0; --r ) {
 
-      if( line[ stateEnd ] != ':' && line[ stateEnd ] != '\n' ) {
+	if( job[ numJobs ].state.numActions[ r ] ) {
 
-	fprintf( stderr, "ERROR: expected input of STATE:VALUES:PLAYERS\n" );
-	exit( EXIT_FAILURE );
+	  break;
+	}
       }
-      line[ stateEnd ] = 0;
-      ++stateEnd;
+
+      if( r + 1 < game->numRounds ) {
+	/* there are board cards left to roll out */
+
+	job[ numJobs ].round = r;
+	batch.rolloutJob[ batch.numRollouts ] = numJobs;
+	++batch.numRollouts;
+      }
+      ++numJobs;
     }
-    printf( "%s:", line );
 
-    /* print out the averaged values */
-    for( p = 0; p < game->numPlayers; ++p ) {
+    if( rollOutBatch( &batch, numThreads ) < 0 ) {
+      /* error messages already handled in function */
 
-      printf( p ? "|%lf" : "%lf", value[ p ] / (double)numBoards );
+      exit( EXIT_FAILURE );
+    }
+    for( i = 0; i < numJobs; ++i ) {
+      printJob( game, &job[ i ] );
     }
 
-    /* find the player names in the state line */
-    for( i = stateEnd; line[ i ] && line[ i ] != ':'; ++i );
-    if( line[ i ] == ':' ) {
+    if( atEnd && !finished ) {
 
-      printf( "%s", &line[ i ] );
-    } else {
+      if( !reader.follow ) {
+	break;
+      }
 
-      printf( "\n" );
+      /* wait for the log to grow */
+      fflush( stdout );
+      usleep( FOLLOW_WAIT_MICROS );
+      clearerr( file );
+      clearerr( logFile );
     }
   }
 
-  fclose( file );
+  if( reader.binaryLog != NULL ) {
+    closeBinaryLog( reader.binaryLog );
+  }
+  if( file != logFile ) {
+    fclose( file );
+  }
+  fclose( logFile );
   exit( EXIT_SUCCESS );
 }
@@ -0,0 +1,768 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include "game.h"
+#include "evaluator.h"
+#include "rng.h"
+
+
+/* compiler flags the benchmark was built with, set by the Makefile */
+#ifndef BENCH_CFLAGS
+#define BENCH_CFLAGS "unknown"
+#endif
+
+#define DEFAULT_BENCH_GAME "holdem.nolimit.2p.reverse_blinds.game"
+#define DEFAULT_BENCH_REPS 5
+
+/* number of random cardsets, states, and strings to cycle through */
+#define NUM_BENCH_CARDSETS ( 1 << 20 )
+#define NUM_BENCH_STATES 65536
+
+/* most actions in one hand */
+#define MAX_BENCH_ACTIONS ( MAX_ROUNDS * MAX_NUM_ACTIONS )
+
+
+typedef struct {
+  const Game *game;
+
+  /* random seven card hands, and the same hands in the order they were
+     enumerated in (neighbouring hands share most of their cards) */
+  Cardset *randomCardsets;
+  Cardset *sequentialCardsets;
+  int *ranks;
+
+  /* one board with every hole card pair which doesn't conflict */
+  uint8_t board[ MAX_BOARD_CARDS ];
+  Cardset boardCardset;
+  int numHoles;
+  Cardset holes[ NUM_HOLE_PAIRS ];
+  uint8_t holeCards[ NUM_HOLE_PAIRS ][ 2 ];
+
+  /* finished states, for valueOfState */
+  State *finishedStates;
+
+  /* printed match states, for readMatchState */
+  char **matchStates;
+
+  /* dealt hands and the actions which were played in them
+     the actions for hand i start at actions[ firstAction[ i ] ] */
+  State *dealtStates;
+  Action *actions;
+  int *firstAction;
+  int *numActions;
+
+  /* results are accumulated here so nothing is optimised away */
+  uint64_t sink;
+} BenchData;
+
+/* run one benchmark pass, returning the number of operations done */
+typedef uint64_t (*BenchFunc)( BenchData *data );
+
+typedef struct {
+  const char *name;
+
+  /* what one operation is, for the report */
+  const char *unit;
+
+  BenchFunc func;
+} Benchmark;
+
+typedef struct {
+  const char *name;
+  const char *unit;
+  uint64_t ops;
+  double minNs;
+  double medianNs;
+} BenchResult;
+
+
+static double nowSeconds()
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* deal numCards distinct cards from a full deck */
+static Cardset randomCardset( rng_state_t *rng, const int numCards,
+			      uint8_t *cards )
+{
+  int n;
+  uint8_t card;
+  Cardset c, add;
+
+  c = emptyCardset();
+  for( n = 0; n < numCards; ) {
+
+    card = genrand_int32( rng ) % ( MAX_SUITS * MAX_RANKS );
+    add = cardToCardset( card );
+    if( c.cards & add.cards ) {
+      continue;
+    }
+    c.cards |= add.cards;
+    if( cards ) {
+      cards[ n ] = card;
+    }
+    ++n;
+  }
+
+  return c;
+}
+
+/* play random actions until the hand is over, remembering them */
+static int playRandomHand( const Game *game, rng_state_t *rng, State *state,
+			   Action *actions )
+{
+  int n;
+  int32_t min, max;
+  Action action;
+
+  for( n = 0; !stateFinished( state ); ++n ) {
+
+    action.size = 0;
+    switch( genrand_int32( rng ) % 10 ) {
+    case 0:
+      action.type = a_fold;
+      break;
+
+    case 1:
+    case 2:
+    case 3:
+      action.type = a_raise;
+      if( raiseIsValid( game, state, &min, &max ) ) {
+
+	if( game->bettingType == noLimitBetting ) {
+	  action.size = min + genrand_int32( rng ) % ( max - min + 1 );
+	}
+	break;
+      }
+      /* can't raise, so call instead */
+
+    default:
+      action.type = a_call;
+    }
+    if( !isValidAction( game, state, 0, &action ) ) {
+
+      action.type = a_call;
+      action.size = 0;
+    }
+
+    actions[ n ] = action;
+    doAction( game, &action, state );
+  }
+
+  return n;
+}
+
+static int initBenchData( const Game *game, const uint32_t seed,
+			  BenchData *data )
+{
+  int i, j, n, numActions, maxActions;
+  uint8_t cards[ 7 ], a, b;
+  rng_state_t rng;
+  Cardset c;
+  MatchState matchState;
+  Action actions[ MAX_BENCH_ACTIONS ];
+  char line[ MAX_LINE_LEN ];
+
+  memset( data, 0, sizeof( *data ) );
+  data->game = game;
+  init_genrand( &rng, seed );
+
+  data->randomCardsets = (Cardset *)malloc( sizeof( Cardset )
+					    * NUM_BENCH_CARDSETS );
+  data->sequentialCardsets = (Cardset *)malloc( sizeof( Cardset )
+						* NUM_BENCH_CARDSETS );
+  data->ranks = (int *)malloc( sizeof( int ) * NUM_BENCH_CARDSETS );
+  data->finishedStates = (State *)malloc( sizeof( State )
+					  * NUM_BENCH_STATES );
+  data->matchStates = (char **)calloc( NUM_BENCH_STATES, sizeof( char * ) );
+  data->dealtStates = (State *)malloc( sizeof( State ) * NUM_BENCH_STATES );
+  data->firstAction = (int *)malloc( sizeof( int ) * NUM_BENCH_STATES );
+  data->numActions = (int *)malloc( sizeof( int ) * NUM_BENCH_STATES );
+  if( data->randomCardsets == NULL || data->sequentialCardsets == NULL
+      || data->ranks == NULL || data->finishedStates == NULL
+      || data->matchStates == NULL || data->dealtStates == NULL
+      || data->firstAction == NULL || data->numActions == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate benchmark data\n" );
+    return -1;
+  }
+
+  /* random hands */
+  for( i = 0; i < NUM_BENCH_CARDSETS; ++i ) {
+
+    data->randomCardsets[ i ] = randomCardset( &rng, 7, NULL );
+  }
+
+  /* hands in enumeration order, starting from a random hand and
+     stepping the last card fastest */
+  c = randomCardset( &rng, 7, NULL );
+  n = 0;
+  for( a = 0; a < MAX_SUITS * MAX_RANKS; ++a ) {
+
+    if( c.cards & cardToCardset( a ).cards ) {
+
+      cards[ n ] = a;
+      ++n;
+    }
+  }
+  for( i = 0; i < NUM_BENCH_CARDSETS; ++i ) {
+
+    data->sequentialCardsets[ i ] = cardsToCardset( 7, cards );
+
+    /* next combination of 7 cards out of 52, wrapping around */
+    for( j = 6; j >= 0 && cards[ j ] == MAX_SUITS * MAX_RANKS - 7 + j; --j );
+    if( j < 0 ) {
+
+      for( j = 0; j < 7; ++j ) {
+	cards[ j ] = j;
+      }
+    } else {
+
+      ++cards[ j ];
+      for( ++j; j < 7; ++j ) {
+	cards[ j ] = cards[ j - 1 ] + 1;
+      }
+    }
+  }
+
+  /* a board and all of the hole pairs which can go with it */
+  data->boardCardset = randomCardset( &rng, 5, data->board );
+  for( b = 1; b < MAX_SUITS * MAX_RANKS; ++b ) {
+
+    for( a = 0; a < b; ++a ) {
+
+      if( ( cardToCardset( a ).cards | cardToCardset( b ).cards )
+	  & data->boardCardset.cards ) {
+	continue;
+      }
+      data->holes[ data->numHoles ].cards
+	= cardToCardset( a ).cards | cardToCardset( b ).cards;
+      data->holeCards[ data->numHoles ][ 0 ] = a;
+      data->holeCards[ data->numHoles ][ 1 ] = b;
+      ++data->numHoles;
+    }
+  }
+
+  /* random hands of the game */
+  numActions = 0;
+  maxActions = 0;
+  for( i = 0; i < NUM_BENCH_STATES; ++i ) {
+
+    initState( game, i, &data->dealtStates[ i ] );
+    dealCards( game, &rng, &data->dealtStates[ i ] );
+
+    data->finishedStates[ i ] = data->dealtStates[ i ];
+    data->numActions[ i ] = playRandomHand( game, &rng,
+					    &data->finishedStates[ i ],
+					    actions );
+    data->firstAction[ i ] = numActions;
+    numActions += data->numActions[ i ];
+    if( numActions > maxActions ) {
+
+      maxActions = numActions * 2;
+      data->actions = (Action *)realloc( data->actions,
+					 sizeof( Action ) * maxActions );
+      if( data->actions == NULL ) {
+
+	fprintf( stderr, "ERROR: could not allocate benchmark data\n" );
+	return -1;
+      }
+    }
+    memcpy( &data->actions[ data->firstAction[ i ] ], actions,
+	    sizeof( Action ) * data->numActions[ i ] );
+
+    /* print a match state from somewhere in the middle of the hand */
+    matchState.state = data->dealtStates[ i ];
+    matchState.viewingPlayer = genrand_int32( &rng ) % game->numPlayers;
+    n = genrand_int32( &rng ) % ( data->numActions[ i ] + 1 );
+    for( j = 0; j < n; ++j ) {
+
+      doAction( game, &actions[ j ], &matchState.state );
+    }
+    if( printMatchState( game, &matchState, MAX_LINE_LEN, line ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not print match state\n" );
+      return -1;
+    }
+    data->matchStates[ i ] = strdup( line );
+    if( data->matchStates[ i ] == NULL ) {
+
+      fprintf( stderr, "ERROR: could not allocate benchmark data\n" );
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void freeBenchData( BenchData *data )
+{
+  int i;
+
+  free( data->randomCardsets );
+  free( data->sequentialCardsets );
+  free( data->ranks );
+  free( data->finishedStates );
+  if( data->matchStates ) {
+
+    for( i = 0; i < NUM_BENCH_STATES; ++i ) {
+
+      free( data->matchStates[ i ] );
+    }
+  }
+  free( data->matchStates );
+  free( data->dealtStates );
+  free( data->actions );
+  free( data->firstAction );
+  free( data->numActions );
+}
+
+
+static uint64_t benchRankSequential( BenchData *data )
+{
+  int i;
+
+  for( i = 0; i < NUM_BENCH_CARDSETS; ++i ) {
+
+    data->sink += rankCardset( data->sequentialCardsets[ i ] );
+  }
+
+  return NUM_BENCH_CARDSETS;
+}
+
+static uint64_t benchRankRandom( BenchData *data )
+{
+  int i;
+
+  for( i = 0; i < NUM_BENCH_CARDSETS; ++i ) {
+
+    data->sink += rankCardset( data->randomCardsets[ i ] );
+  }
+
+  return NUM_BENCH_CARDSETS;
+}
+
+static uint64_t benchRankBatchRandom( BenchData *data )
+{
+  rankCardsets( data->randomCardsets, NUM_BENCH_CARDSETS, data->ranks );
+  data->sink += data->ranks[ NUM_BENCH_CARDSETS - 1 ];
+
+  return NUM_BENCH_CARDSETS;
+}
+
+static uint64_t benchRankSharedBoard( BenchData *data )
+{
+  int i;
+  Cardset c;
+
+  for( i = 0; i < data->numHoles; ++i ) {
+
+    c.cards = data->boardCardset.cards | data->holes[ i ].cards;
+    data->sink += rankCardset( c );
+  }
+
+  return data->numHoles;
+}
+
+static uint64_t benchRankHolesOnBoard( BenchData *data )
+{
+  rankHolesOnBoard( data->boardCardset, data->holes, data->numHoles,
+		    data->ranks );
+  data->sink += data->ranks[ data->numHoles - 1 ];
+
+  return data->numHoles;
+}
+
+static uint64_t benchRankHandPrefix( BenchData *data )
+{
+  int i;
+  HandPrefix prefix;
+
+  initHandPrefix( &prefix, 5, data->board, 2 );
+  for( i = 0; i < data->numHoles; ++i ) {
+
+    data->sink += rankHandPrefix( &prefix, 2, data->holeCards[ i ] );
+  }
+
+  return data->numHoles;
+}
+
+static uint64_t benchValueOfState( BenchData *data )
+{
+  int i, p;
+  double sum;
+
+  sum = 0.0;
+  for( i = 0; i < NUM_BENCH_STATES; ++i ) {
+
+    for( p = 0; p < data->game->numPlayers; ++p ) {
+
+      sum += valueOfState( data->game, &data->finishedStates[ i ], p );
+    }
+  }
+  data->sink += (uint64_t)sum;
+
+  return (uint64_t)NUM_BENCH_STATES * data->game->numPlayers;
+}
+
+static uint64_t benchReadMatchState( BenchData *data )
+{
+  int i;
+  MatchState state;
+
+  for( i = 0; i < NUM_BENCH_STATES; ++i ) {
+
+    data->sink += readMatchState( data->matchStates[ i ], data->game,
+				  &state );
+    data->sink += state.state.numActions[ 0 ];
+  }
+
+  return NUM_BENCH_STATES;
+}
+
+static uint64_t benchPrintState( BenchData *data )
+{
+  int i;
+  char line[ MAX_LINE_LEN ];
+
+  for( i = 0; i < NUM_BENCH_STATES; ++i ) {
+
+    data->sink += printState( data->game, &data->finishedStates[ i ],
+			      MAX_LINE_LEN, line );
+  }
+
+  return NUM_BENCH_STATES;
+}
+
+static uint64_t benchDoAction( BenchData *data )
+{
+  int i, j;
+  uint64_t ops;
+  State state;
+
+  ops = 0;
+  for( i = 0; i < NUM_BENCH_STATES; ++i ) {
+
+    state = data->dealtStates[ i ];
+    for( j = 0; j < data->numActions[ i ]; ++j ) {
+
+      doAction( data->game, &data->actions[ data->firstAction[ i ] + j ],
+		&state );
+    }
+    data->sink += state.spent[ 0 ];
+    ops += data->numActions[ i ];
+  }
+
+  return ops;
+}
+
+/* walk down each hand the way a game tree traversal does, copying the
+   state before applying each action and querying the next player */
+static uint64_t benchCopyState( BenchData *data )
+{
+  int i, j;
+  uint64_t ops;
+  State state, child;
+
+  ops = 0;
+  for( i = 0; i < NUM_BENCH_STATES; ++i ) {
+
+    state = data->dealtStates[ i ];
+    for( j = 0; j < data->numActions[ i ]; ++j ) {
+
+      child = state;
+      doAction( data->game, &data->actions[ data->firstAction[ i ] + j ],
+		&child );
+      if( !stateFinished( &child ) ) {
+
+	data->sink += currentPlayer( data->game, &child );
+      }
+      state = child;
+    }
+    data->sink += state.spent[ 0 ];
+    ops += data->numActions[ i ];
+  }
+
+  return ops;
+}
+
+/* the same walk down each hand using undo records instead of copies,
+   taking every action back again afterwards */
+static uint64_t benchUndoAction( BenchData *data )
+{
+  int i, j;
+  uint64_t ops;
+  State state;
+  UndoRecord undo[ MAX_BENCH_ACTIONS ];
+
+  ops = 0;
+  for( i = 0; i < NUM_BENCH_STATES; ++i ) {
+
+    state = data->dealtStates[ i ];
+    for( j = 0; j < data->numActions[ i ]; ++j ) {
+
+      doActionUndoable( data->game,
+			&data->actions[ data->firstAction[ i ] + j ],
+			&state, &undo[ j ] );
+      if( !stateFinished( &state ) ) {
+
+	data->sink += currentPlayer( data->game, &state );
+      }
+    }
+    data->sink += state.spent[ 0 ];
+    for( j = data->numActions[ i ] - 1; j >= 0; --j ) {
+
+      undoAction( data->game, &undo[ j ], &state );
+    }
+    data->sink += state.spent[ 0 ];
+    ops += data->numActions[ i ];
+  }
+
+  return ops;
+}
+
+static const Benchmark benchmarks[] = {
+  { "rankCardset_sequential", "hand", benchRankSequential },
+  { "rankCardset_random", "hand", benchRankRandom },
+  { "rankCardsets_random", "hand", benchRankBatchRandom },
+  { "rankCardset_shared_board", "hand", benchRankSharedBoard },
+  { "rankHolesOnBoard_shared_board", "hand", benchRankHolesOnBoard },
+  { "rankHandPrefix_shared_board", "hand", benchRankHandPrefix },
+  { "valueOfState", "call", benchValueOfState },
+  { "readMatchState", "call", benchReadMatchState },
+  { "printState", "call", benchPrintState },
+  { "doAction", "call", benchDoAction },
+  { "copyState_doAction", "call", benchCopyState },
+  { "doActionUndoable_undoAction", "call", benchUndoAction }
+};
+
+#define NUM_BENCHMARKS ( sizeof( benchmarks ) / sizeof( benchmarks[ 0 ] ) )
+
+
+static int compareDoubles( const void *a, const void *b )
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* run a benchmark reps times (after one untimed warm up pass),
+   repeating short passes until each timed sample takes long enough */
+static void runBenchmark( const Benchmark *bench, BenchData *data,
+			  const int reps, BenchResult *result )
+{
+  int r;
+  uint64_t ops;
+  double start, elapsed, ns[ reps ];
+
+  bench->func( data );
+
+  ops = 0;
+  for( r = 0; r < reps; ++r ) {
+
+    ops = 0;
+    start = nowSeconds();
+    do {
+
+      ops += bench->func( data );
+      elapsed = nowSeconds() - start;
+    } while( elapsed < 0.05 );
+
+    ns[ r ] = elapsed * 1e9 / ops;
+  }
+  qsort( ns, reps, sizeof( ns[ 0 ] ), compareDoubles );
+
+  result->name = bench->name;
+  result->unit = bench->unit;
+  result->ops = ops;
+  result->minNs = ns[ 0 ];
+  result->medianNs = ns[ reps / 2 ];
+}
+
+static void printJSON( FILE *file, const char *gameFile, const uint32_t seed,
+		       const int reps, const int simd,
+		       const BenchResult *results, const int numResults )
+{
+  int i;
+
+  fprintf( file, "{\n" );
+  fprintf( file, "  \"cflags\": \"%s\",\n", BENCH_CFLAGS );
+#ifdef __VERSION__
+  fprintf( file, "  \"compiler\": \"%s\",\n", __VERSION__ );
+#endif
+  fprintf( file, "  \"game\": \"%s\",\n", gameFile );
+  fprintf( file, "  \"seed\": %"PRIu32",\n", seed );
+  fprintf( file, "  \"reps\": %d,\n", reps );
+  fprintf( file, "  \"simd\": %d,\n", simd );
+  fprintf( file, "  \"state_bytes\": %zu,\n", sizeof( State ) );
+  fprintf( file, "  \"results\": [\n" );
+  for( i = 0; i < numResults; ++i ) {
+
+    fprintf( file, "    { \"name\": \"%s\", \"unit\": \"%s\","
+	     " \"ops\": %"PRIu64", \"ns_per_op_min\": %.3f,"
+	     " \"ns_per_op_median\": %.3f, \"ops_per_sec\": %.0f }%s\n",
+	     results[ i ].name, results[ i ].unit, results[ i ].ops,
+	     results[ i ].minNs, results[ i ].medianNs,
+	     1e9 / results[ i ].medianNs, i + 1 < numResults ? "," : "" );
+  }
+  fprintf( file, "  ]\n}\n" );
+}
+
+static void printUsage( FILE *file, char *prog )
+{
+  fprintf( file, "usage: %s [options] [benchmark ...]\n", prog );
+  fprintf( file, "  -g game_def\tgame for the state benchmarks"
+	   " [default: %s]\n", DEFAULT_BENCH_GAME );
+  fprintf( file, "  -r reps\tnumber of timed samples per benchmark"
+	   " [default: %d]\n", DEFAULT_BENCH_REPS );
+  fprintf( file, "  -s seed\trandom number seed [default: 0]\n" );
+  fprintf( file, "  -o file\twrite JSON results to file\n" );
+  fprintf( file, "  -S\t\tdo not use the vectorised batch evaluator\n" );
+  fprintf( file, "  -l\t\tlist the benchmarks and exit\n" );
+}
+
+int main( int argc, char **argv )
+{
+  int i, b, reps, numResults, simd;
+  uint32_t seed;
+  char *gameFile, *jsonFile;
+  FILE *file;
+  Game *game;
+  BenchData data;
+  BenchResult results[ NUM_BENCHMARKS ];
+
+  gameFile = DEFAULT_BENCH_GAME;
+  jsonFile = NULL;
+  reps = DEFAULT_BENCH_REPS;
+  seed = 0;
+  simd = 1;
+  while( 1 ) {
+
+    i = getopt( argc, argv, "g:r:s:o:Sl" );
+    if( i < 0 ) {
+
+      break;
+    }
+
+    switch( i ) {
+    case 'g':
+
+      gameFile = optarg;
+      break;
+
+    case 'r':
+
+      if( sscanf( optarg, "%d", &reps ) < 1 || reps < 1 ) {
+
+	fprintf( stderr, "ERROR: could not get repetitions from %s\n",
+		 optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 's':
+
+      if( sscanf( optarg, "%"SCNu32, &seed ) < 1 ) {
+
+	fprintf( stderr, "ERROR: could not get random seed from %s\n",
+		 optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 'o':
+
+      jsonFile = optarg;
+      break;
+
+    case 'S':
+
+      simd = 0;
+      break;
+
+    case 'l':
+
+      for( b = 0; b < NUM_BENCHMARKS; ++b ) {
+
+	printf( "%s\n", benchmarks[ b ].name );
+      }
+      return EXIT_SUCCESS;
+
+    default:
+
+      printUsage( stderr, argv[ 0 ] );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  /* get the game definition */
+  file = fopen( gameFile, "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game definition %s\n",
+	     gameFile );
+    exit( EXIT_FAILURE );
+  }
+  game = readGame( file );
+  if( game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", gameFile );
+    exit( EXIT_FAILURE );
+  }
+  fclose( file );
+
+  simd = useSimdRanking( simd );
+  if( initBenchData( game, seed, &data ) < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+
+  /* run the benchmarks named on the command line, or all of them */
+  printf( "%-32s %12s %14s %12s\n", "benchmark", "ns/op", "ops/sec",
+	  "min ns/op" );
+  numResults = 0;
+  for( b = 0; b < NUM_BENCHMARKS; ++b ) {
+
+    for( i = optind; i < argc && strcmp( argv[ i ], benchmarks[ b ].name );
+	 ++i );
+    if( optind < argc && i == argc ) {
+      continue;
+    }
+
+    runBenchmark( &benchmarks[ b ], &data, reps, &results[ numResults ] );
+    printf( "%-32s %12.2f %14.0f %12.2f\n", results[ numResults ].name,
+	    results[ numResults ].medianNs,
+	    1e9 / results[ numResults ].medianNs,
+	    results[ numResults ].minNs );
+    fflush( stdout );
+    ++numResults;
+  }
+
+  if( jsonFile ) {
+
+    file = fopen( jsonFile, "w" );
+    if( file == NULL ) {
+
+      fprintf( stderr, "ERROR: could not open JSON file %s\n", jsonFile );
+      exit( EXIT_FAILURE );
+    }
+    printJSON( file, gameFile, seed, reps, simd, results, numResults );
+    fclose( file );
+  }
+
+  /* print the checksum so the work can't be optimised away */
+  fprintf( stderr, "checksum %"PRIu64"\n", data.sink );
+
+  freeBenchData( &data );
+  free( game );
+  return EXIT_SUCCESS;
+}
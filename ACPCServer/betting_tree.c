@@ -0,0 +1,292 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "betting_tree.h"
+
+
+/* state shared by the whole walk when counting or building a tree */
+typedef struct {
+  const Game *game;
+  const BetAbstraction *abstraction;
+  int limitToRound;
+
+  /* NULL when only counting */
+  BettingNode *nodes;
+
+  uint64_t numNodes;
+  uint64_t nodesPerRound[ MAX_ROUNDS ];
+} TreeWalk;
+
+
+void initBetAbstraction( BetAbstraction *abstraction )
+{
+  int r;
+
+  for( r = 0; r < MAX_ROUNDS; ++r ) {
+
+    abstraction->numFractions[ r ] = 1;
+    abstraction->potFraction[ r ][ 0 ] = 1.0;
+    abstraction->maxRaises[ r ] = UINT8_MAX;
+  }
+  abstraction->allIn = 1;
+}
+
+int bettingTreeActions( const Game *game, const BetAbstraction *abstraction,
+			const State *state, Action *actions )
+{
+  int i, n, p;
+  int32_t min, max, size, pot;
+
+  n = 0;
+
+  actions[ n ].type = a_fold;
+  actions[ n ].size = 0;
+  if( isValidAction( game, state, 0, &actions[ n ] ) ) {
+    ++n;
+  }
+
+  actions[ n ].type = a_call;
+  actions[ n ].size = 0;
+  ++n;
+
+  if( numRaises( state ) >= abstraction->maxRaises[ state->round ]
+      || !raiseIsValid( game, state, &min, &max ) ) {
+
+    return n;
+  }
+
+  if( game->bettingType != noLimitBetting ) {
+
+    actions[ n ].type = a_raise;
+    actions[ n ].size = 0;
+    return n + 1;
+  }
+
+  /* pot sizes are relative to the pot once the current bet is called */
+  p = currentPlayer( game, state );
+  pot = state->maxSpent - state->spent[ p ];
+  for( i = 0; i < game->numPlayers; ++i ) {
+    pot += state->spent[ i ];
+  }
+
+  for( i = 0; i < abstraction->numFractions[ state->round ]; ++i ) {
+
+    size = state->maxSpent
+      + (int32_t)( abstraction->potFraction[ state->round ][ i ] * pot );
+    if( size < min || size >= max ) {
+      continue;
+    }
+    if( actions[ n - 1 ].type == a_raise && actions[ n - 1 ].size >= size ) {
+      /* fractions should be increasing, and we don't want repeats */
+
+      continue;
+    }
+
+    actions[ n ].type = a_raise;
+    actions[ n ].size = size;
+    ++n;
+  }
+
+  if( abstraction->allIn || min == max ) {
+
+    actions[ n ].type = a_raise;
+    actions[ n ].size = max;
+    ++n;
+  }
+
+  return n;
+}
+
+/* fill in the node at index for state, reached by action */
+static void setNode( TreeWalk *walk, const uint64_t index,
+		     const State *state, const uint8_t type,
+		     const uint8_t round, const Action *action )
+{
+  int p;
+  BettingNode *node;
+
+  ++walk->nodesPerRound[ round ];
+  if( walk->nodes == NULL ) {
+    return;
+  }
+
+  node = &walk->nodes[ index ];
+  node->pot = 0;
+  for( p = 0; p < walk->game->numPlayers; ++p ) {
+    node->pot += state->spent[ p ];
+  }
+  node->maxSpent = state->maxSpent;
+  if( action ) {
+
+    node->actionType = action->type;
+    node->actionSize = action->size;
+  } else {
+
+    node->actionType = a_invalid;
+    node->actionSize = 0;
+  }
+  node->type = type;
+  node->player = type == bn_player ? currentPlayer( walk->game, state ) : 0;
+  node->round = round;
+  node->numChildren = 0;
+  node->firstChild = 0;
+}
+
+/* give node index numChildren children, returning the first one */
+static uint64_t addChildren( TreeWalk *walk, const uint64_t index,
+			     const int numChildren )
+{
+  uint64_t first;
+
+  first = walk->numNodes;
+  walk->numNodes += numChildren;
+  if( walk->nodes ) {
+
+    walk->nodes[ index ].numChildren = numChildren;
+    walk->nodes[ index ].firstChild = first;
+  }
+
+  return first;
+}
+
+/* add the children of player node index, which has state, recursively
+   state is returned unchanged */
+static void walkPlayerNode( TreeWalk *walk, const uint64_t index,
+			    State *state )
+{
+  int i, numActions;
+  uint64_t first, child;
+  Action actions[ MAX_BETTING_CHILDREN ];
+  UndoRecord undo;
+
+  numActions = bettingTreeActions( walk->game, walk->abstraction, state,
+				   actions );
+  first = addChildren( walk, index, numActions );
+
+  for( i = 0; i < numActions; ++i ) {
+
+    doActionUndoable( walk->game, &actions[ i ], state, &undo );
+
+    if( stateFinished( state ) ) {
+
+      setNode( walk, first + i, state,
+	       numFolded( walk->game, state ) + 1 >= walk->game->numPlayers
+	       ? bn_fold : bn_showdown,
+	       state->round, &actions[ i ] );
+    } else if( state->round != undo.round ) {
+      /* the round is over, so the board cards come next */
+
+      setNode( walk, first + i, state, bn_chance, undo.round,
+	       &actions[ i ] );
+      if( !walk->limitToRound ) {
+
+	child = addChildren( walk, first + i, 1 );
+	setNode( walk, child, state, bn_player, state->round, NULL );
+	walkPlayerNode( walk, child, state );
+      }
+    } else {
+
+      setNode( walk, first + i, state, bn_player, state->round,
+	       &actions[ i ] );
+      walkPlayerNode( walk, first + i, state );
+    }
+
+    undoAction( walk->game, &undo, state );
+  }
+}
+
+/* walk the whole tree under root, building it if walk->nodes is set */
+static void walkTree( TreeWalk *walk, const State *root )
+{
+  State state;
+
+  walk->numNodes = 1;
+  memset( walk->nodesPerRound, 0, sizeof( walk->nodesPerRound ) );
+
+  state = *root;
+  if( stateFinished( &state ) ) {
+
+    setNode( walk, 0, &state,
+	     numFolded( walk->game, &state ) + 1 >= walk->game->numPlayers
+	     ? bn_fold : bn_showdown, state.round, NULL );
+    return;
+  }
+
+  setNode( walk, 0, &state, bn_player, state.round, NULL );
+  walkPlayerNode( walk, 0, &state );
+}
+
+uint64_t countBettingTree( const Game *game,
+			   const BetAbstraction *abstraction,
+			   const State *root, const int limitToRound,
+			   uint64_t *nodesPerRound )
+{
+  TreeWalk walk;
+
+  walk.game = game;
+  walk.abstraction = abstraction;
+  walk.limitToRound = limitToRound;
+  walk.nodes = NULL;
+  walkTree( &walk, root );
+
+  if( nodesPerRound ) {
+
+    memcpy( nodesPerRound, walk.nodesPerRound,
+	    sizeof( walk.nodesPerRound ) );
+  }
+  return walk.numNodes;
+}
+
+int buildBettingTree( const Game *game, const BetAbstraction *abstraction,
+		      const State *root, const int limitToRound,
+		      BettingTree *tree )
+{
+  int r;
+  TreeWalk walk;
+
+  /* count first, so the tree goes into a single allocation */
+  walk.game = game;
+  walk.abstraction = abstraction;
+  walk.limitToRound = limitToRound;
+  walk.nodes = NULL;
+  walkTree( &walk, root );
+  if( walk.numNodes > UINT32_MAX ) {
+
+    fprintf( stderr, "ERROR: betting tree has too many nodes (%"PRIu64")\n",
+	     walk.numNodes );
+    return -1;
+  }
+
+  tree->numNodes = walk.numNodes;
+  tree->nodes = (BettingNode *)malloc( sizeof( BettingNode )
+				       * tree->numNodes );
+  if( tree->nodes == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate %"PRIu32" tree nodes\n",
+	     tree->numNodes );
+    return -1;
+  }
+
+  walk.nodes = tree->nodes;
+  walkTree( &walk, root );
+  assert( walk.numNodes == tree->numNodes );
+
+  for( r = 0; r < MAX_ROUNDS; ++r ) {
+
+    tree->roundNodes[ r ] = walk.nodesPerRound[ r ];
+  }
+
+  return 0;
+}
+
+void freeBettingTree( BettingTree *tree )
+{
+  free( tree->nodes );
+  tree->nodes = NULL;
+  tree->numNodes = 0;
+}
@@ -0,0 +1,100 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BETTING_TREE_H
+#define _BETTING_TREE_H
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "game.h"
+
+
+#define MAX_BET_FRACTIONS 8
+
+/* fold, call, each pot fraction, and all-in */
+#define MAX_BETTING_CHILDREN ( MAX_BET_FRACTIONS + 3 )
+
+
+enum BettingNodeType { bn_player = 0, bn_chance = 1, bn_fold = 2,
+		       bn_showdown = 3 };
+
+/* which no-limit bets the tree includes.  Limit games have at most one
+   raise size, so only maxRaises is used for them */
+typedef struct {
+  /* raise by potFraction[ r ][ i ] times the pot after calling, for
+     i < numFractions[ r ].  Sizes smaller than the minimum raise or at
+     least all-in are left out */
+  int numFractions[ MAX_ROUNDS ];
+  double potFraction[ MAX_ROUNDS ][ MAX_BET_FRACTIONS ];
+
+  /* most raises in round r, on top of the game's own limit */
+  uint8_t maxRaises[ MAX_ROUNDS ];
+
+  /* if non-zero, all-in is always one of the raises */
+  int allIn;
+} BetAbstraction;
+
+/* nodes are stored in one array, with the children of a node next to
+   each other at [ firstChild, firstChild + numChildren ).  The root is
+   node 0.  A chance node sits between the last action of a round and
+   the first player node of the next round, and has that node as its
+   only child.  Board cards are not part of the tree. */
+typedef struct {
+  /* total chips in the pot, and the largest amount put in by a player */
+  int32_t pot;
+  int32_t maxSpent;
+
+  /* action which led to this node, from the parent player node
+     type is a_invalid for the root and the children of chance nodes */
+  int32_t actionSize;
+  uint8_t actionType;
+
+  /* an enum BettingNodeType */
+  uint8_t type;
+
+  /* player to act in a player node, the round the node is in */
+  uint8_t player;
+  uint8_t round;
+
+  uint8_t numChildren;
+  uint32_t firstChild;
+} BettingNode;
+
+typedef struct {
+  BettingNode *nodes;
+  uint32_t numNodes;
+
+  /* number of nodes in each round */
+  uint32_t roundNodes[ MAX_ROUNDS ];
+} BettingTree;
+
+
+/* set abstraction to pot sized bets and all-in in every round, with
+   no extra limit on raises */
+void initBetAbstraction( BetAbstraction *abstraction );
+
+/* fill in actions with the actions the tree takes at a player node,
+   in the order fold, call, then raises in increasing size
+   returns the number of actions */
+int bettingTreeActions( const Game *game, const BetAbstraction *abstraction,
+			const State *state, Action *actions );
+
+/* count the nodes in the tree under root, without building it.  If
+   limitToRound is non-zero, chance nodes have no children.
+   nodesPerRound may be NULL
+   returns the total number of nodes */
+uint64_t countBettingTree( const Game *game,
+			   const BetAbstraction *abstraction,
+			   const State *root, const int limitToRound,
+			   uint64_t *nodesPerRound );
+
+/* build the tree under root
+   returns 0 on success, -1 on failure */
+int buildBettingTree( const Game *game, const BetAbstraction *abstraction,
+		      const State *root, const int limitToRound,
+		      BettingTree *tree );
+
+/* release memory allocated by buildBettingTree */
+void freeBettingTree( BettingTree *tree );
+
+#endif
@@ -0,0 +1,298 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include "game.h"
+#include "betting_tree.h"
+
+
+static void printUsage( FILE *file, char *prog )
+{
+  fprintf( file, "usage: %s game_def [options]\n", prog );
+  fprintf( file, "  builds the betting tree of a game and prints the number"
+	   " of nodes in each round\n" );
+  fprintf( file, "  -f fractions\tpot fractions to bet in each round, with"
+	   " rounds split by /\n"
+	   "\t\tand the last round repeated, eg 0.5,1/1 [default: 1]\n" );
+  fprintf( file, "  -m raises\tmost raises in each round, eg 4/3"
+	   " [default: game limit]\n" );
+  fprintf( file, "  -n\t\tdo not always include all-in\n" );
+  fprintf( file, "  -l\t\tonly build the first round\n" );
+  fprintf( file, "  -c\t\tonly count the nodes\n" );
+  fprintf( file, "  -o file\twrite the node array to file\n" );
+  fprintf( file, "  -d\t\tprint every node\n" );
+}
+
+/* read per round pot fractions from string
+   returns 0 on success, -1 on failure */
+static int readFractions( const char *string, BetAbstraction *abstraction )
+{
+  int r, i, c, consumed;
+
+  c = 0;
+  for( r = 0; r < MAX_ROUNDS; ++r ) {
+
+    i = 0;
+    while( 1 ) {
+
+      if( i >= MAX_BET_FRACTIONS ) {
+
+	fprintf( stderr, "ERROR: at most %d fractions per round\n",
+		 MAX_BET_FRACTIONS );
+	return -1;
+      }
+      if( sscanf( &string[ c ], "%lf%n", &abstraction->potFraction[ r ][ i ],
+		  &consumed ) < 1 ) {
+
+	fprintf( stderr, "ERROR: could not get pot fraction from %s\n",
+		 &string[ c ] );
+	return -1;
+      }
+      c += consumed;
+      ++i;
+
+      if( string[ c ] != ',' ) {
+	break;
+      }
+      ++c;
+    }
+    abstraction->numFractions[ r ] = i;
+
+    if( string[ c ] == 0 ) {
+      break;
+    }
+    if( string[ c ] != '/' ) {
+
+      fprintf( stderr, "ERROR: unexpected %s in pot fractions\n",
+	       &string[ c ] );
+      return -1;
+    }
+    ++c;
+  }
+
+  /* remaining rounds use the last fractions given */
+  for( ++r; r < MAX_ROUNDS; ++r ) {
+
+    abstraction->numFractions[ r ] = abstraction->numFractions[ r - 1 ];
+    memcpy( abstraction->potFraction[ r ], abstraction->potFraction[ r - 1 ],
+	    sizeof( abstraction->potFraction[ r ] ) );
+  }
+
+  return 0;
+}
+
+/* read per round raise limits from string
+   returns 0 on success, -1 on failure */
+static int readMaxRaises( const char *string, BetAbstraction *abstraction )
+{
+  int r, c, consumed;
+
+  c = 0;
+  for( r = 0; r < MAX_ROUNDS; ++r ) {
+
+    if( sscanf( &string[ c ], "%"SCNu8"%n", &abstraction->maxRaises[ r ],
+		&consumed ) < 1 ) {
+
+      fprintf( stderr, "ERROR: could not get number of raises from %s\n",
+	       &string[ c ] );
+      return -1;
+    }
+    c += consumed;
+
+    if( string[ c ] == 0 ) {
+      break;
+    }
+    if( string[ c ] != '/' ) {
+
+      fprintf( stderr, "ERROR: unexpected %s in number of raises\n",
+	       &string[ c ] );
+      return -1;
+    }
+    ++c;
+  }
+
+  for( ++r; r < MAX_ROUNDS; ++r ) {
+
+    abstraction->maxRaises[ r ] = abstraction->maxRaises[ r - 1 ];
+  }
+
+  return 0;
+}
+
+static double nowSeconds()
+{
+  struct timeval tv;
+
+  gettimeofday( &tv, NULL );
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+int main( int argc, char **argv )
+{
+  int i, r, countOnly, limitToRound, printNodes;
+  uint64_t numNodes, nodesPerRound[ MAX_ROUNDS ];
+  double start;
+  FILE *file;
+  Game *game;
+  State root;
+  BetAbstraction abstraction;
+  BettingTree tree;
+  BettingNode *node;
+  char *outFile;
+
+  initBetAbstraction( &abstraction );
+  countOnly = 0;
+  limitToRound = 0;
+  printNodes = 0;
+  outFile = NULL;
+
+  while( 1 ) {
+
+    i = getopt( argc, argv, "f:m:nlco:d" );
+    if( i < 0 ) {
+
+      break;
+    }
+
+    switch( i ) {
+    case 'f':
+
+      if( readFractions( optarg, &abstraction ) < 0 ) {
+
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 'm':
+
+      if( readMaxRaises( optarg, &abstraction ) < 0 ) {
+
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 'n':
+
+      abstraction.allIn = 0;
+      break;
+
+    case 'l':
+
+      limitToRound = 1;
+      break;
+
+    case 'c':
+
+      countOnly = 1;
+      break;
+
+    case 'o':
+
+      outFile = optarg;
+      break;
+
+    case 'd':
+
+      printNodes = 1;
+      break;
+
+    default:
+
+      printUsage( stderr, argv[ 0 ] );
+      exit( EXIT_FAILURE );
+    }
+  }
+  if( optind != argc - 1 ) {
+
+    printUsage( stderr, argv[ 0 ] );
+    exit( EXIT_FAILURE );
+  }
+
+  /* get the game definition */
+  file = fopen( argv[ optind ], "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game definition %s\n",
+	     argv[ optind ] );
+    exit( EXIT_FAILURE );
+  }
+  game = readGame( file );
+  if( game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", argv[ optind ] );
+    exit( EXIT_FAILURE );
+  }
+  fclose( file );
+
+  initState( game, 0, &root );
+
+  start = nowSeconds();
+  if( countOnly ) {
+
+    numNodes = countBettingTree( game, &abstraction, &root, limitToRound,
+				 nodesPerRound );
+  } else {
+
+    if( buildBettingTree( game, &abstraction, &root, limitToRound,
+			  &tree ) < 0 ) {
+
+      exit( EXIT_FAILURE );
+    }
+    numNodes = tree.numNodes;
+    for( r = 0; r < MAX_ROUNDS; ++r ) {
+      nodesPerRound[ r ] = tree.roundNodes[ r ];
+    }
+  }
+
+  for( r = 0; r < game->numRounds; ++r ) {
+
+    printf( "round %d: %"PRIu64" nodes\n", r, nodesPerRound[ r ] );
+  }
+  printf( "total: %"PRIu64" nodes, %"PRIu64" bytes, %.3f ms\n", numNodes,
+	  numNodes * (uint64_t)sizeof( BettingNode ),
+	  ( nowSeconds() - start ) * 1000.0 );
+
+  if( countOnly ) {
+
+    free( game );
+    return EXIT_SUCCESS;
+  }
+
+  if( printNodes ) {
+
+    for( i = 0; i < tree.numNodes; ++i ) {
+
+      node = &tree.nodes[ i ];
+      printf( "%d type %d round %d player %d pot %"PRId32" action %d %"PRId32
+	      " children %d at %"PRIu32"\n", i, node->type, node->round,
+	      node->player, node->pot, node->actionType, node->actionSize,
+	      node->numChildren, node->firstChild );
+    }
+  }
+
+  if( outFile ) {
+
+    file = fopen( outFile, "wb" );
+    if( file == NULL ) {
+
+      fprintf( stderr, "ERROR: could not open %s\n", outFile );
+      exit( EXIT_FAILURE );
+    }
+    if( fwrite( tree.nodes, sizeof( BettingNode ), tree.numNodes, file )
+	!= tree.numNodes ) {
+
+      fprintf( stderr, "ERROR: could not write tree to %s\n", outFile );
+      exit( EXIT_FAILURE );
+    }
+    fclose( file );
+  }
+
+  freeBettingTree( &tree );
+  free( game );
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,933 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "binary_log.h"
+#include "log_compress.h"
+
+
+/* bytes in a record before its contents: length and type */
+#define RECORD_START 3
+
+/* the end of a finished log: offset of the last index, and magic */
+#define END_LEN ( 8 + BINARY_LOG_MAGIC_LEN )
+
+static void putUint16( const uint16_t value, uint8_t *bytes )
+{
+  bytes[ 0 ] = value >> 8;
+  bytes[ 1 ] = value;
+}
+
+static void putUint32( const uint32_t value, uint8_t *bytes )
+{
+  putUint16( value >> 16, bytes );
+  putUint16( value, &bytes[ 2 ] );
+}
+
+static void putUint64( const uint64_t value, uint8_t *bytes )
+{
+  putUint32( value >> 32, bytes );
+  putUint32( value, &bytes[ 4 ] );
+}
+
+static uint16_t getUint16( const uint8_t *bytes )
+{
+  return ( bytes[ 0 ] << 8 ) | bytes[ 1 ];
+}
+
+static uint32_t getUint32( const uint8_t *bytes )
+{
+  return ( (uint32_t)getUint16( bytes ) << 16 ) | getUint16( &bytes[ 2 ] );
+}
+
+static uint64_t getUint64( const uint8_t *bytes )
+{
+  return ( (uint64_t)getUint32( bytes ) << 32 ) | getUint32( &bytes[ 4 ] );
+}
+
+uint32_t gameHash( const Game *game )
+{
+  char *text;
+  size_t len;
+  uint32_t hash;
+  FILE *file;
+
+  /* hash the game definition as it would be written out */
+  text = NULL;
+  len = 0;
+  file = open_memstream( &text, &len );
+  if( file == NULL ) {
+
+    return 0;
+  }
+  printGame( file, game );
+  fclose( file );
+
+  hash = matchStateChecksum( text, len );
+  free( text );
+
+  return hash;
+}
+
+int isBinaryLog( const void *bytes, const size_t len )
+{
+  return len >= BINARY_LOG_MAGIC_LEN
+    && memcmp( bytes, BINARY_LOG_MAGIC, BINARY_LOG_MAGIC_LEN ) == 0;
+}
+
+/* add an entry to the index of a log being opened
+   returns >= 0 on success, -1 on failure */
+static int addIndexEntry( BinaryLog *log, int *maxEntries,
+			  const uint32_t handId, const size_t offset )
+{
+  BinaryLogIndexEntry *entries;
+
+  if( log->numEntries == *maxEntries ) {
+
+    *maxEntries = *maxEntries ? *maxEntries * 2 : 256;
+    entries = (BinaryLogIndexEntry *)
+      realloc( log->entries, *maxEntries * sizeof( *entries ) );
+    if( entries == NULL ) {
+
+      return -1;
+    }
+    log->entries = entries;
+  }
+
+  if( log->numEntries
+      && handId < log->entries[ log->numEntries - 1 ].handId ) {
+
+    log->sorted = 0;
+  }
+  log->entries[ log->numEntries ].handId = handId;
+  log->entries[ log->numEntries ].offset = offset;
+  ++log->numEntries;
+
+  return 0;
+}
+
+/* build the index of a finished log from its index records, which are
+   chained from the last one back to the first
+   returns >= 0 on success, -1 if the index records can't be used */
+static int readIndexRecords( BinaryLog *log, int *maxEntries )
+{
+  size_t offset, numIndexes, i, j, n, first;
+  const uint8_t *record;
+
+  if( log->len < log->start + END_LEN
+      || memcmp( &log->data[ log->len - BINARY_LOG_MAGIC_LEN ],
+		 BINARY_LOG_END_MAGIC, BINARY_LOG_MAGIC_LEN ) != 0 ) {
+    /* not finished */
+
+    return -1;
+  }
+
+  /* count the index records, so the entries can be put in file order */
+  numIndexes = 0;
+  offset = getUint64( &log->data[ log->len - END_LEN ] );
+  while( offset ) {
+
+    if( offset < log->start || offset + RECORD_START + 10 > log->len
+	|| log->data[ offset + 2 ] != BINARY_LOG_INDEX ) {
+      return -1;
+    }
+    ++numIndexes;
+    offset = getUint64( &log->data[ offset + RECORD_START ] );
+  }
+
+  for( i = numIndexes; i > 0; --i ) {
+
+    /* find the i'th index record */
+    offset = getUint64( &log->data[ log->len - END_LEN ] );
+    for( j = numIndexes; j > i; --j ) {
+
+      offset = getUint64( &log->data[ offset + RECORD_START ] );
+    }
+
+    record = &log->data[ offset ];
+    n = getUint16( &record[ RECORD_START + 8 ] );
+    first = RECORD_START + 10;
+    if( first + n * 12 > getUint16( record ) ) {
+      return -1;
+    }
+    for( j = 0; j < n; ++j ) {
+
+      if( addIndexEntry( log, maxEntries,
+			 getUint32( &record[ first + j * 12 ] ),
+			 getUint64( &record[ first + j * 12 + 4 ] ) ) < 0 ) {
+	return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* build the index of a log by reading every record
+   returns >= 0 on success, -1 on failure */
+static int scanRecords( BinaryLog *log, int *maxEntries )
+{
+  int r;
+  size_t offset, recordOffset;
+  uint32_t numHands;
+  LogHand hand;
+  const char *text;
+  int textLen;
+
+  numHands = 0;
+  offset = log->start;
+  while( 1 ) {
+
+    recordOffset = offset;
+    r = readBinaryLogRecord( log, &offset, 0, &hand, &text, &textLen );
+    if( r <= 0 ) {
+      /* a log cut off part way through a record is read up to there */
+
+      return 0;
+    }
+    if( r != BINARY_LOG_HAND ) {
+      continue;
+    }
+
+    if( numHands % BINARY_LOG_INDEX_STRIDE == 0
+	&& addIndexEntry( log, maxEntries,
+			  hand.state.handId, recordOffset ) < 0 ) {
+      return -1;
+    }
+    ++numHands;
+  }
+}
+
+/* read all of a compressed log into memory
+   returns >= 0 on success, -1 on failure */
+static int readCompressedLog( const char *filename, uint8_t **data,
+			      size_t *len )
+{
+  size_t c, maxLen;
+  uint8_t *bytes;
+  FILE *file, *stream;
+
+  file = fopen( filename, "r" );
+  if( file == NULL ) {
+
+    return -1;
+  }
+  stream = openLogStream( file );
+  if( stream == NULL ) {
+
+    fclose( file );
+    return -1;
+  }
+
+  maxLen = 1 << 20;
+  *len = 0;
+  *data = NULL;
+  while( 1 ) {
+
+    bytes = (uint8_t *)realloc( *data, maxLen );
+    if( bytes == NULL ) {
+
+      break;
+    }
+    *data = bytes;
+
+    c = fread( &bytes[ *len ], 1, maxLen - *len, stream );
+    *len += c;
+    if( *len < maxLen ) {
+      break;
+    }
+    maxLen *= 2;
+  }
+
+  c = bytes == NULL || ferror( stream );
+  if( stream != file ) {
+    fclose( stream );
+  }
+  fclose( file );
+  if( c ) {
+
+    free( *data );
+    return -1;
+  }
+
+  return 0;
+}
+
+BinaryLog *openBinaryLog( const char *filename, const Game *game )
+{
+  int fd, s, maxEntries;
+  size_t c;
+  uint8_t *bytes;
+  struct stat st;
+  BinaryLog *log;
+
+  fd = open( filename, O_RDONLY );
+  if( fd < 0 ) {
+
+    fprintf( stderr, "ERROR: could not open binary log %s\n", filename );
+    return NULL;
+  }
+  if( fstat( fd, &st ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not get size of binary log %s\n",
+	     filename );
+    close( fd );
+    return NULL;
+  }
+
+  log = (BinaryLog *)calloc( 1, sizeof( BinaryLog ) );
+  if( log == NULL ) {
+
+    close( fd );
+    return NULL;
+  }
+  log->game = game;
+  log->len = st.st_size;
+  log->sorted = 1;
+  log->data = (const uint8_t *)mmap( NULL, log->len > 0 ? log->len : 1,
+				     PROT_READ, MAP_SHARED, fd, 0 );
+  close( fd );
+  if( log->data == MAP_FAILED ) {
+
+    fprintf( stderr, "ERROR: could not map binary log %s\n", filename );
+    free( log );
+    return NULL;
+  }
+  madvise( (void *)log->data, log->len, MADV_SEQUENTIAL );
+  log->mapped = 1;
+
+  /* a compressed log is decompressed into memory instead */
+  if( isCompressedLog( log->data, log->len ) ) {
+
+    munmap( (void *)log->data, log->len );
+    log->mapped = 0;
+    if( readCompressedLog( filename, &bytes, &log->len ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not decompress binary log %s\n",
+	       filename );
+      free( log );
+      return NULL;
+    }
+    log->data = bytes;
+  }
+
+  /* check the header */
+  c = BINARY_LOG_MAGIC_LEN + 6;
+  if( !isBinaryLog( log->data, log->len ) || log->len < c
+      || log->data[ BINARY_LOG_MAGIC_LEN ] != BINARY_LOG_VERSION ) {
+
+    fprintf( stderr, "ERROR: %s is not a binary log\n", filename );
+    closeBinaryLog( log );
+    return NULL;
+  }
+  if( getUint32( &log->data[ BINARY_LOG_MAGIC_LEN + 1 ] )
+      != gameHash( game ) ) {
+
+    fprintf( stderr, "ERROR: binary log %s is for a different game\n",
+	     filename );
+    closeBinaryLog( log );
+    return NULL;
+  }
+
+  /* get the seat names */
+  log->numSeats = log->data[ BINARY_LOG_MAGIC_LEN + 5 ];
+  if( log->numSeats != game->numPlayers ) {
+
+    fprintf( stderr, "ERROR: wrong number of seats in binary log %s\n",
+	     filename );
+    closeBinaryLog( log );
+    return NULL;
+  }
+  for( s = 0; s < log->numSeats; ++s ) {
+
+    if( c >= log->len || c + 1 + log->data[ c ] > log->len ) {
+
+      fprintf( stderr, "ERROR: bad header in binary log %s\n", filename );
+      closeBinaryLog( log );
+      return NULL;
+    }
+    log->seatName[ s ] = strndup( (const char *)&log->data[ c + 1 ],
+				  log->data[ c ] );
+    c += 1 + log->data[ c ];
+  }
+  log->start = c;
+
+  /* get the index, from the index records if the log was finished */
+  maxEntries = 0;
+  if( readIndexRecords( log, &maxEntries ) < 0 ) {
+
+    log->numEntries = 0;
+    log->sorted = 1;
+    if( scanRecords( log, &maxEntries ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not index binary log %s\n", filename );
+      closeBinaryLog( log );
+      return NULL;
+    }
+  }
+
+  return log;
+}
+
+void closeBinaryLog( BinaryLog *log )
+{
+  int s;
+
+  for( s = 0; s < log->numSeats; ++s ) {
+
+    free( log->seatName[ s ] );
+  }
+  free( log->entries );
+  if( log->mapped ) {
+
+    munmap( (void *)log->data, log->len > 0 ? log->len : 1 );
+  } else {
+
+    free( (void *)log->data );
+  }
+  free( log );
+}
+
+/* read the contents of a hand record from bytes, which end at end
+   returns >= 0 on success, -1 on failure */
+static int readHandRecord( const Game *game, const uint8_t *bytes,
+			   const int end, const int withState, LogHand *hand )
+{
+  int c, i, numActions, numCards, integerValues, valueLen;
+  uint8_t p;
+  uint64_t bits;
+  Action action;
+
+  if( end < 7 ) {
+    return -1;
+  }
+  initState( game, getUint32( bytes ), &hand->state );
+  integerValues = bytes[ 4 ] & BINARY_LOG_INTEGER_VALUES;
+  numActions = getUint16( &bytes[ 5 ] );
+  c = 7;
+
+  /* actions */
+  for( i = 0; i < numActions; ++i ) {
+
+    if( c >= end || bytes[ c ] >= NUM_ACTION_TYPES ) {
+      return -1;
+    }
+    action.type = (enum ActionType)bytes[ c ];
+    action.size = 0;
+    ++c;
+    if( action.type == a_raise && game->bettingType == noLimitBetting ) {
+
+      if( c + 4 > end ) {
+	return -1;
+      }
+      action.size = (int32_t)getUint32( &bytes[ c ] );
+      c += 4;
+    }
+
+    if( withState ) {
+
+      if( stateFinished( &hand->state )
+	  || !isValidAction( game, &hand->state, 0, &action ) ) {
+	return -1;
+      }
+      doAction( game, &action, &hand->state );
+    }
+  }
+
+  /* seats and hole cards */
+  if( c + game->numPlayers * ( 1 + game->numHoleCards ) + 1 > end ) {
+    return -1;
+  }
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( bytes[ c + p ] >= game->numPlayers ) {
+      return -1;
+    }
+  }
+  memcpy( hand->playerSeat, &bytes[ c ], game->numPlayers );
+  c += game->numPlayers;
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( withState ) {
+      memcpy( hand->state.holeCards[ p ], &bytes[ c ], game->numHoleCards );
+    }
+    c += game->numHoleCards;
+  }
+
+  /* board cards */
+  numCards = bytes[ c ];
+  ++c;
+  if( numCards > MAX_BOARD_CARDS || c + numCards > end ) {
+    return -1;
+  }
+  if( withState ) {
+    memcpy( hand->state.boardCards, &bytes[ c ], numCards );
+  }
+  c += numCards;
+
+  /* values */
+  valueLen = integerValues ? 4 : 8;
+  if( c + game->numPlayers * valueLen > end ) {
+    return -1;
+  }
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( integerValues ) {
+
+      hand->value[ p ] = (int32_t)getUint32( &bytes[ c ] );
+    } else {
+
+      bits = getUint64( &bytes[ c ] );
+      memcpy( &hand->value[ p ], &bits, sizeof( double ) );
+    }
+    c += valueLen;
+  }
+
+  return 0;
+}
+
+int readBinaryLogRecord( const BinaryLog *log, size_t *offset,
+			 const int withState, LogHand *hand,
+			 const char **text, int *textLen )
+{
+  const uint8_t *record;
+  int len;
+
+  while( 1 ) {
+
+    if( *offset + RECORD_START > log->len ) {
+      /* end of the log, or a record cut off part way */
+
+      return 0;
+    }
+    if( *offset + END_LEN == log->len
+	&& memcmp( &log->data[ log->len - BINARY_LOG_MAGIC_LEN ],
+		   BINARY_LOG_END_MAGIC, BINARY_LOG_MAGIC_LEN ) == 0 ) {
+      /* the end of a finished log */
+
+      return 0;
+    }
+    record = &log->data[ *offset ];
+    len = getUint16( record );
+    if( len < RECORD_START ) {
+      return -1;
+    }
+    if( *offset + len > log->len ) {
+      return 0;
+    }
+
+    switch( record[ 2 ] ) {
+    case BINARY_LOG_HAND:
+
+      if( readHandRecord( log->game, &record[ RECORD_START ],
+			  len - RECORD_START, withState, hand ) < 0 ) {
+	return -1;
+      }
+      *offset += len;
+      return BINARY_LOG_HAND;
+
+    case BINARY_LOG_TEXT:
+
+      *text = (const char *)&record[ RECORD_START ];
+      *textLen = len - RECORD_START;
+      *offset += len;
+      return BINARY_LOG_TEXT;
+
+    case BINARY_LOG_INDEX:
+      /* nothing for the reader */
+
+      *offset += len;
+      continue;
+
+    default:
+
+      return -1;
+    }
+  }
+}
+
+int findBinaryLogHand( const BinaryLog *log, const uint32_t handId,
+		       size_t *offset )
+{
+  int lo, hi, mid, r;
+  size_t start, end, recordOffset;
+  LogHand hand;
+  const char *text;
+  int textLen;
+
+  if( log->numEntries == 0 ) {
+    return -1;
+  }
+
+  /* search between the index entries on either side of handId, or the
+     whole log if the hands aren't in order */
+  start = log->start;
+  end = log->len;
+  if( log->sorted ) {
+
+    lo = 0;
+    hi = log->numEntries;
+    while( hi - lo > 1 ) {
+
+      mid = ( lo + hi ) / 2;
+      if( log->entries[ mid ].handId <= handId ) {
+	lo = mid;
+      } else {
+	hi = mid;
+      }
+    }
+    if( log->entries[ lo ].handId > handId ) {
+      return -1;
+    }
+    start = log->entries[ lo ].offset;
+    if( hi < log->numEntries ) {
+      end = log->entries[ hi ].offset;
+    }
+  }
+
+  while( start < end ) {
+
+    recordOffset = start;
+    r = readBinaryLogRecord( log, &start, 0, &hand, &text, &textLen );
+    if( r <= 0 ) {
+      break;
+    }
+    if( r == BINARY_LOG_HAND && hand.state.handId == handId ) {
+
+      *offset = recordOffset;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/* write a record with the length filled in
+   returns >= 0 on success, -1 on failure */
+static int writeRecord( BinaryLogWriter *writer, uint8_t *record,
+			const int len )
+{
+  putUint16( len, record );
+  if( fwrite( record, 1, len, writer->file ) != len ) {
+    return -1;
+  }
+  writer->offset += len;
+
+  return 0;
+}
+
+/* write the index entries since the last index
+   returns >= 0 on success, -1 on failure */
+static int writeIndexRecord( BinaryLogWriter *writer )
+{
+  int i, c;
+  uint64_t offset;
+  uint8_t record[ RECORD_START + 10
+		  + 12 * BINARY_LOG_INDEX_HANDS / BINARY_LOG_INDEX_STRIDE ];
+
+  offset = writer->offset;
+  record[ 2 ] = BINARY_LOG_INDEX;
+  putUint64( writer->lastIndex, &record[ RECORD_START ] );
+  putUint16( writer->numEntries, &record[ RECORD_START + 8 ] );
+  c = RECORD_START + 10;
+  for( i = 0; i < writer->numEntries; ++i ) {
+
+    putUint32( writer->entries[ i ].handId, &record[ c ] );
+    putUint64( writer->entries[ i ].offset, &record[ c + 4 ] );
+    c += 12;
+  }
+  if( writeRecord( writer, record, c ) < 0 ) {
+    return -1;
+  }
+
+  writer->lastIndex = offset;
+  writer->numEntries = 0;
+  writer->handsSinceIndex = 0;
+
+  return 0;
+}
+
+BinaryLogWriter *createBinaryLogWriter( FILE *file, const Game *game,
+					const int numSeats,
+					char * const seatName[ MAX_PLAYERS ] )
+{
+  BinaryLogWriter *writer;
+  int s, c, len;
+  uint8_t header[ BINARY_LOG_MAGIC_LEN + 6 + MAX_PLAYERS * 256 ];
+
+  if( numSeats > MAX_PLAYERS ) {
+    return NULL;
+  }
+
+  memcpy( header, BINARY_LOG_MAGIC, BINARY_LOG_MAGIC_LEN );
+  c = BINARY_LOG_MAGIC_LEN;
+  header[ c ] = BINARY_LOG_VERSION;
+  putUint32( gameHash( game ), &header[ c + 1 ] );
+  header[ c + 5 ] = numSeats;
+  c += 6;
+  for( s = 0; s < numSeats; ++s ) {
+
+    len = strlen( seatName[ s ] );
+    if( len > 255 ) {
+      return NULL;
+    }
+    header[ c ] = len;
+    memcpy( &header[ c + 1 ], seatName[ s ], len );
+    c += 1 + len;
+  }
+  if( fwrite( header, 1, c, file ) != c ) {
+    return NULL;
+  }
+
+  writer = (BinaryLogWriter *)malloc( sizeof( BinaryLogWriter ) );
+  if( writer == NULL ) {
+    return NULL;
+  }
+  writer->game = game;
+  writer->file = file;
+  writer->offset = c;
+  writer->lastIndex = 0;
+  writer->handsSinceIndex = 0;
+  writer->numEntries = 0;
+
+  return writer;
+}
+
+int writeBinaryLogHand( BinaryLogWriter *writer, const LogHand *hand )
+{
+  const Game *game = writer->game;
+  int c, i, pos, numCards, integerValues;
+  uint8_t p, player;
+  uint64_t bits;
+  Action action;
+  uint8_t record[ RECORD_START + 8 + MAX_NUM_ACTIONS * MAX_ROUNDS * 5
+		  + MAX_PLAYERS * ( 1 + MAX_HOLE_CARDS + 8 )
+		  + 1 + MAX_BOARD_CARDS ];
+
+  if( writer->handsSinceIndex % BINARY_LOG_INDEX_STRIDE == 0 ) {
+
+    writer->entries[ writer->numEntries ].handId = hand->state.handId;
+    writer->entries[ writer->numEntries ].offset = writer->offset;
+    ++writer->numEntries;
+  }
+
+  /* values are usually whole chips, which fit in 4 bytes */
+  integerValues = 1;
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( hand->value[ p ] != floor( hand->value[ p ] )
+	|| fabs( hand->value[ p ] ) > INT32_MAX
+	|| ( hand->value[ p ] == 0 && signbit( hand->value[ p ] ) ) ) {
+      /* -0 needs to stay -0 */
+
+
+      integerValues = 0;
+    }
+  }
+
+  record[ 2 ] = BINARY_LOG_HAND;
+  c = RECORD_START;
+  putUint32( hand->state.handId, &record[ c ] );
+  record[ c + 4 ] = integerValues ? BINARY_LOG_INTEGER_VALUES : 0;
+  putUint16( numActionsInHand( &hand->state ), &record[ c + 5 ] );
+  c += 7;
+
+  /* actions */
+  for( i = 0; i <= hand->state.round; ++i ) {
+
+    pos = 0;
+    while( nextActionInRound( &hand->state, i, &pos, &action, &player ) ) {
+
+      record[ c ] = action.type;
+      ++c;
+      if( action.type == a_raise && game->bettingType == noLimitBetting ) {
+
+	putUint32( action.size, &record[ c ] );
+	c += 4;
+      }
+    }
+  }
+
+  /* seats, hole cards and board cards */
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    record[ c ] = hand->playerSeat[ p ];
+    ++c;
+  }
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    memcpy( &record[ c ], hand->state.holeCards[ p ], game->numHoleCards );
+    c += game->numHoleCards;
+  }
+  numCards = sumBoardCards( game, hand->state.round );
+  record[ c ] = numCards;
+  memcpy( &record[ c + 1 ], hand->state.boardCards, numCards );
+  c += 1 + numCards;
+
+  /* values */
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( integerValues ) {
+
+      putUint32( (int32_t)hand->value[ p ], &record[ c ] );
+      c += 4;
+    } else {
+
+      memcpy( &bits, &hand->value[ p ], sizeof( double ) );
+      putUint64( bits, &record[ c ] );
+      c += 8;
+    }
+  }
+
+  if( writeRecord( writer, record, c ) < 0 ) {
+    return -1;
+  }
+
+  ++writer->handsSinceIndex;
+  if( writer->handsSinceIndex == BINARY_LOG_INDEX_HANDS ) {
+
+    return writeIndexRecord( writer );
+  }
+
+  return 0;
+}
+
+int writeBinaryLogText( BinaryLogWriter *writer,
+			const char *text, const int len )
+{
+  uint8_t record[ RECORD_START + MAX_LINE_LEN ];
+
+  if( len > MAX_LINE_LEN ) {
+    return -1;
+  }
+  record[ 2 ] = BINARY_LOG_TEXT;
+  memcpy( &record[ RECORD_START ], text, len );
+
+  return writeRecord( writer, record, RECORD_START + len );
+}
+
+int closeBinaryLogWriter( BinaryLogWriter *writer )
+{
+  int r;
+  uint8_t end[ END_LEN ];
+
+  r = writeIndexRecord( writer );
+  if( r >= 0 ) {
+
+    putUint64( writer->lastIndex, end );
+    memcpy( &end[ 8 ], BINARY_LOG_END_MAGIC, BINARY_LOG_MAGIC_LEN );
+    if( fwrite( end, 1, END_LEN, writer->file ) != END_LEN ) {
+      r = -1;
+    }
+  }
+  free( writer );
+
+  return r;
+}
+
+int readLogHand( const char *line, const Game *game, const int numSeats,
+		 char * const seatName[ MAX_PLAYERS ], LogHand *hand )
+{
+  int c, r, s, len;
+  uint8_t p;
+
+  /* STATE:handId:betting:cards */
+  c = readState( line, game, &hand->state );
+  if( c < 0 ) {
+    return -1;
+  }
+
+  /* :values */
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( line[ c ] != ( p ? '|' : ':' )
+	|| sscanf( &line[ c + 1 ], "%lf%n", &hand->value[ p ], &r ) < 1 ) {
+      return -1;
+    }
+    c += 1 + r;
+  }
+
+  /* :names, which give the seat of each player */
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( line[ c ] != ( p ? '|' : ':' ) ) {
+      return -1;
+    }
+    ++c;
+    len = strcspn( &line[ c ], "|\r\n" );
+    for( s = 0; s < numSeats; ++s ) {
+
+      if( strncmp( &line[ c ], seatName[ s ], len ) == 0
+	  && seatName[ s ][ len ] == 0 ) {
+	break;
+      }
+    }
+    if( s == numSeats ) {
+      return -1;
+    }
+    hand->playerSeat[ p ] = s;
+    c += len;
+  }
+
+  return c;
+}
+
+int printLogHand( const Game *game, const LogHand *hand,
+		  char * const seatName[ MAX_PLAYERS ],
+		  const int maxLen, char *string )
+{
+  int c, r;
+  uint8_t p;
+
+  c = printState( game, &hand->state, maxLen, string );
+  if( c < 0 ) {
+    return -1;
+  }
+
+  /* values, without trailing zeros, the way the dealer prints them.
+     Whole numbers come out the same when printed as integers, which is
+     much faster */
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( hand->value[ p ] == (int32_t)hand->value[ p ]
+	&& ( hand->value[ p ] != 0 || !signbit( hand->value[ p ] ) ) ) {
+
+      r = snprintf( &string[ c ], maxLen - c, p ? "|%"PRId32 : ":%"PRId32,
+		    (int32_t)hand->value[ p ] );
+      if( r < 0 || r >= maxLen - c ) {
+	return -1;
+      }
+      c += r;
+      continue;
+    }
+
+    r = snprintf( &string[ c ], maxLen - c,
+		  p ? "|%.6f" : ":%.6f", hand->value[ p ] );
+    if( r < 0 || r >= maxLen - c ) {
+      return -1;
+    }
+    c += r;
+
+    while( string[ c - 1 ] == '0' ) { --c; }
+    if( string[ c - 1 ] == '.' ) { --c; }
+    string[ c ] = 0;
+  }
+
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    r = snprintf( &string[ c ], maxLen - c,
+		  p ? "|%s" : ":%s", seatName[ hand->playerSeat[ p ] ] );
+    if( r < 0 || r >= maxLen - c ) {
+      return -1;
+    }
+    c += r;
+  }
+
+  return c;
+}
@@ -0,0 +1,172 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BINARY_LOG_H
+#define _BINARY_LOG_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "game.h"
+
+
+/* binary match logs hold the same hands as the dealer's text logs, in
+   about two thirds of the space (65-70% for two and three player hold'em
+   logs), and can be read without parsing.  Numbers are big-endian.  The
+   file starts with a header of
+
+     BINARY_LOG_MAGIC (8 bytes), BINARY_LOG_VERSION (1 byte),
+     hash of the game definition (4 bytes), number of seats (1 byte),
+     then for each seat, the length of its name (1 byte) and the name
+
+   followed by records.  Every record starts with its length in 2 bytes
+   (counting the length), then its type in 1 byte.  A hand record is
+
+     BINARY_LOG_HAND, handId (4 bytes), flags (1 byte),
+     number of actions (2 bytes), actions, the seat of each player,
+     hole cards of each player, number of board cards (1 byte), board
+     cards, the value of each player
+
+   where actions are as in binary protocol frames, and values are
+   4 byte signed integers if the BINARY_LOG_INTEGER_VALUES flag is set,
+   or 8 byte IEEE doubles otherwise.  A text record holds any other line
+   from the text log, like comments and the final score, without the
+   new-line.
+
+   After every BINARY_LOG_INDEX_HANDS hands there is an index record
+
+     BINARY_LOG_INDEX, offset of the previous index record (8 bytes, 0
+     if there isn't one), number of entries (2 bytes), then entries of
+     handId (4 bytes) and the offset of its record (8 bytes)
+
+   with an entry for every BINARY_LOG_INDEX_STRIDE hands.  A finished log
+   ends with a last index record, the offset of that record (8 bytes) and
+   BINARY_LOG_END_MAGIC (8 bytes).  A log which wasn't finished can still
+   be read, but is indexed by scanning it when opened. */
+#define BINARY_LOG_MAGIC "ACPCBLOG"
+#define BINARY_LOG_END_MAGIC "ACPCBEND"
+#define BINARY_LOG_MAGIC_LEN 8
+#define BINARY_LOG_VERSION 1
+
+#define BINARY_LOG_HAND 'H'
+#define BINARY_LOG_TEXT 'T'
+#define BINARY_LOG_INDEX 'I'
+
+#define BINARY_LOG_INTEGER_VALUES 1
+
+#define BINARY_LOG_INDEX_HANDS 4096
+#define BINARY_LOG_INDEX_STRIDE 64
+
+/* a hand from a log, with the players' values in player order, and the
+   seat each player was in */
+typedef struct {
+  State state;
+  double value[ MAX_PLAYERS ];
+  uint8_t playerSeat[ MAX_PLAYERS ];
+} LogHand;
+
+typedef struct {
+  uint32_t handId;
+  size_t offset;
+} BinaryLogIndexEntry;
+
+/* a binary log mapped into memory for reading, or decompressed into
+   memory if the log is compressed */
+typedef struct {
+  const Game *game;
+  int numSeats;
+  char *seatName[ MAX_PLAYERS ];
+
+  const uint8_t *data;
+  size_t len;
+  int mapped;
+
+  /* offset of the first record */
+  size_t start;
+
+  /* non-zero if the index entries are in increasing order of handId */
+  int sorted;
+  int numEntries;
+  BinaryLogIndexEntry *entries;
+} BinaryLog;
+
+/* writes a binary log to a stream, keeping track of the index */
+typedef struct {
+  const Game *game;
+  FILE *file;
+
+  /* bytes written so far */
+  uint64_t offset;
+
+  uint64_t lastIndex;
+  uint32_t handsSinceIndex;
+  int numEntries;
+  BinaryLogIndexEntry entries[ BINARY_LOG_INDEX_HANDS
+			       / BINARY_LOG_INDEX_STRIDE ];
+} BinaryLogWriter;
+
+
+/* returns a hash of the game definition, which is stored in binary logs
+   so they can only be read with the game they were written with */
+uint32_t gameHash( const Game *game );
+
+/* returns non-zero if the first bytes of a file are those of a binary
+   log */
+int isBinaryLog( const void *bytes, const size_t len );
+
+/* open a binary log of game, and map it into memory, or read it all if
+   it is compressed
+   returns NULL on failure */
+BinaryLog *openBinaryLog( const char *filename, const Game *game );
+
+void closeBinaryLog( BinaryLog *log );
+
+/* read the record at *offset, and move *offset past it.  If withState
+   is zero, the state of a hand is left with only its handId, which is
+   much faster when only the values are needed
+   returns BINARY_LOG_HAND after filling in hand, BINARY_LOG_TEXT after
+   pointing *text at the (unterminated) line and setting *textLen,
+   0 at the end of the log, or -1 on failure */
+int readBinaryLogRecord( const BinaryLog *log, size_t *offset,
+			 const int withState, LogHand *hand,
+			 const char **text, int *textLen );
+
+/* find the offset of the record for handId, which can then be read with
+   readBinaryLogRecord()
+   returns >= 0 if the hand was found, -1 if it wasn't */
+int findBinaryLogHand( const BinaryLog *log, const uint32_t handId,
+		       size_t *offset );
+
+/* start a binary log on file, with a header for the seats
+   returns NULL on failure */
+BinaryLogWriter *createBinaryLogWriter( FILE *file, const Game *game,
+					const int numSeats,
+					char * const seatName[ MAX_PLAYERS ] );
+
+/* returns >= 0 on success, -1 on failure */
+int writeBinaryLogHand( BinaryLogWriter *writer, const LogHand *hand );
+
+/* write a line of text, without the new-line
+   returns >= 0 on success, -1 on failure */
+int writeBinaryLogText( BinaryLogWriter *writer,
+			const char *text, const int len );
+
+/* write the last index and the end of the log, then free the writer.
+   The file is left open
+   returns >= 0 on success, -1 on failure */
+int closeBinaryLogWriter( BinaryLogWriter *writer );
+
+/* read a STATE:handId:betting:cards:values:names line from a text log,
+   finding each player's seat in seatName
+   returns >= 0 on success, -1 on failure */
+int readLogHand( const char *line, const Game *game, const int numSeats,
+		 char * const seatName[ MAX_PLAYERS ], LogHand *hand );
+
+/* print a hand the way the dealer puts it in a text log, without the
+   new-line
+   returns number of characters printed, or -1 on failure */
+int printLogHand( const Game *game, const LogHand *hand,
+		  char * const seatName[ MAX_PLAYERS ],
+		  const int maxLen, char *string );
+
+#endif
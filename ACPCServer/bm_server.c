@@ -22,6 +22,8 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #include <time.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
 #include "game.h"
 #include "net.h"
 #include "rng.h"
@@ -94,6 +96,7 @@ typedef struct {
   int status;
   UserSpec *user; /* NULL when status is STATUS_UNVALIDATED */
   ReadBuf *connBuf;
+  EventHandler *handler; /* NULL once the connection is closed */
 } Connection;
 
 typedef struct {
@@ -124,6 +127,7 @@ typedef struct {
 typedef struct {
   int listenSocket;
   LLPool *conns;
+  int numClosedConns; /* closed connections still in conns */
   LLPool *matches;
   LLPool *jobs;
 
@@ -132,6 +136,11 @@ typedef struct {
   char *hostname;
 
   int devnullfd;
+
+  /* the loop waiting on the listen socket and every connection, and the
+     configuration its callbacks need */
+  EventLoop *loop;
+  Config *conf;
 } ServerState;
 
 
@@ -627,9 +636,12 @@ void readConfig( const char *filename, Config *conf )
   fclose( file );
 }
 
+void handleConnectionEvent( void *context, int fd, void *data );
+
 void addConnection( ServerState *serv, const int sock )
 {
   Connection conn;
+  LLPoolEntry *connEntry;
 
   /* add the connection */
   conn.status = STATUS_UNVALIDATED;
@@ -640,7 +652,22 @@ void addConnection( ServerState *serv, const int sock )
     fprintf( stderr, "BM_ERROR: could not create read buffer for socket\n" );
     exit( EXIT_FAILURE );
   }
-  LLPoolAddItem( serv->conns, &conn );
+
+  /* reads only take what has arrived, so one client which sends part of
+     a line can't hold up the server.  The socket stays blocking, so the
+     replies written to it are never cut short */
+  setReadBufDontWait( conn.connBuf );
+  conn.handler = NULL;
+  connEntry = LLPoolAddItem( serv->conns, &conn );
+
+  /* wait for input on the connection */
+  ( (Connection *)LLPoolGetItem( connEntry ) )->handler
+    = addEventHandler( serv->loop, sock, handleConnectionEvent, connEntry );
+  if( ( (Connection *)LLPoolGetItem( connEntry ) )->handler == NULL ) {
+
+    fprintf( stderr, "BM_ERROR: could not add connection to event loop\n" );
+    exit( EXIT_FAILURE );
+  }
 }
 
 int matchUsesConnection( const Match *match, const LLPoolEntry *connEntry )
@@ -664,8 +691,11 @@ void closeConnection( ServerState *serv, LLPoolEntry *connEntry )
   Connection *conn = (Connection*)LLPoolGetItem( connEntry );
   LLPoolEntry *cur, *next;
 
+  removeEventHandler( serv->loop, conn->handler );
+  conn->handler = NULL;
   destroyReadBuf( conn->connBuf );
   conn->status = STATUS_CLOSED;
+  ++serv->numClosedConns;
 
   /* remove any pending matches which relied on the connection */
   for( cur = LLPoolFirstEntry( serv->matches ); cur != NULL; cur = next ) {
@@ -860,9 +890,9 @@ void handleConnection( Config *conf, ServerState *serv,
 {
   int r;
   Connection *conn = (Connection *)LLPoolGetItem( connEntry );
-  char line[ READBUF_LEN ];
+  const char *line;
 
-  while( ( r = getLine( conn->connBuf, READBUF_LEN, line, 0 ) ) >= 0 ) {
+  while( ( r = getLineView( conn->connBuf, READBUF_LEN, &line, 0 ) ) >= 0 ) {
 
     if( r == 0 ) {
 
@@ -889,7 +919,7 @@ void handleConnection( Config *conf, ServerState *serv,
       /* connection status is now okay */
       conn->user = user;
       conn->status = STATUS_OKAY;
-      return;
+      continue;
     }
 
     if( !strncasecmp( line, "HELP", 4 ) ) {
@@ -908,19 +938,37 @@ void handleConnection( Config *conf, ServerState *serv,
 
 	fprintf( stderr, "BM_ERROR: bad RUNMATCHES command: %s", line );
 	r = write( conn->connBuf->fd, "BAD RUNMATCHES COMMAND\n", 23 );
-	return;
+	continue;
       }
       match.user = ( (Connection *)LLPoolGetItem( connEntry ) )->user;
       match.isRunning = 0;
       gettimeofday( &match.queueTime, NULL );
       LLPoolAddItem( serv->matches, &match );
-      return;
     } else {
 
       r = write( conn->connBuf->fd, "UNKNOWN\n", 8 );
-      return;
     }
   }
+
+  /* anything but running out of input is a broken connection */
+  if( errno != EAGAIN && errno != EWOULDBLOCK ) {
+
+    closeConnection( serv, connEntry );
+  }
+}
+
+void handleConnectionEvent( void *context, int fd, void *data )
+{
+  ServerState *serv = (ServerState *)context;
+
+  handleConnection( serv->conf, serv, (LLPoolEntry *)data );
+}
+
+void handleListenEvent( void *context, int fd, void *data )
+{
+  ServerState *serv = (ServerState *)context;
+
+  handleListenSocket( serv->conf, serv );
 }
 
 int timeIsEarlier( struct timeval *a, struct timeval *b )
@@ -1098,16 +1146,13 @@ void startDealer( const Config *conf,
   /* parent has to talk to child to get ports */
   ssize_t r;
   int pos, t;
-  fd_set readfds;
-  struct timeval timeout;
+  struct pollfd pfd;
   char portString[ READBUF_LEN ];
 
   close( stdoutPipe[ 1 ] );
-  timeout.tv_sec = BM_DEALER_WAIT_SECS;
-  timeout.tv_usec = 0;
-  FD_ZERO( &readfds );
-  FD_SET( stdoutPipe[ 0 ], &readfds );
-  if( select( stdoutPipe[ 0 ] + 1, &readfds, NULL, NULL, &timeout ) < 1 ) {
+  pfd.fd = stdoutPipe[ 0 ];
+  pfd.events = POLLIN;
+  if( poll( &pfd, 1, BM_DEALER_WAIT_SECS * 1000 ) < 1 ) {
 
     fprintf( stderr,
 	     "BM_ERROR: timed out waiting for port string from dealer\n" );
@@ -1383,6 +1428,7 @@ void initServerState( const Config *conf, ServerState *serv )
   char ipstr[ INET6_ADDRSTRLEN ];
 
   serv->conns = newLLPool( sizeof( Connection ) );
+  serv->numClosedConns = 0;
   serv->matches = newLLPool( sizeof( Match ) );
   serv->jobs = newLLPool( sizeof( MatchJob ) );
 
@@ -1394,6 +1440,7 @@ void initServerState( const Config *conf, ServerState *serv )
     fprintf( stderr, "BM_ERROR: could not open socket for listening\n" );
     exit( EXIT_FAILURE );
   }
+  setNonBlocking( serv->listenSocket );
   printf( "starting server on port %"PRIu16"\n", conf->port );
 
   init_genrand( &serv->rng, time( NULL ) );
@@ -1446,6 +1493,16 @@ void initServerState( const Config *conf, ServerState *serv )
     fprintf( stderr, "BM_ERROR: could not open /dev/null\n" );
     exit( EXIT_FAILURE );
   }
+
+  /* wait for new connections */
+  serv->loop = createEventLoop( serv );
+  if( serv->loop == NULL
+      || addEventHandler( serv->loop, serv->listenSocket,
+			  handleListenEvent, NULL ) == NULL ) {
+
+    fprintf( stderr, "BM_ERROR: could not create event loop\n" );
+    exit( EXIT_FAILURE );
+  }
 }
 
 int checkIfJobFinished( MatchJob *job )
@@ -1510,10 +1567,7 @@ int main( int argc, char **argv )
 {
   Config conf;
   ServerState serv;
-  int maxfd;
-  fd_set readfds;
   LLPoolEntry *cur, *next;
-  struct timeval tv;
 
   if( argc < 2 ) {
 
@@ -1532,6 +1586,7 @@ int main( int argc, char **argv )
   readConfig( argv[ 1 ], &conf );
 
   /* initialise server state */
+  serv.conf = &conf;
   initServerState( &conf, &serv );
 
   /* main I/O loop */
@@ -1549,54 +1604,26 @@ int main( int argc, char **argv )
     }
 
     /* clean up any closed connections */
-    for( cur = LLPoolFirstEntry( serv.conns ); cur != NULL; cur = next ) {
+    for( cur = LLPoolFirstEntry( serv.conns );
+	 cur != NULL && serv.numClosedConns > 0; cur = next ) {
       next = LLPoolNextEntry( cur );
 
       if( ( (Connection *)LLPoolGetItem( cur ) )->status == STATUS_CLOSED ) {
 
 	LLPoolRemoveEntry( serv.conns, cur );
+	--serv.numClosedConns;
       }
     }
 
     /* start jobs, up to the maximum */
     while( startMatchJob( &conf, &serv ) );
 
-    /* wait for input */
-    FD_ZERO( &readfds );
-    FD_SET( serv.listenSocket, &readfds );
-    maxfd = serv.listenSocket;
-    tv.tv_sec = BM_MAX_IOWAIT_SECS;
-    tv.tv_usec = 0;
-    for( cur = LLPoolFirstEntry( serv.conns );
-	 cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-      Connection *conn = (Connection *)LLPoolGetItem( cur );
+    /* wait for input, and handle it */
+    if( runEventLoop( serv.loop, BM_MAX_IOWAIT_SECS * 1000000 ) < 0 ) {
 
-      FD_SET( conn->connBuf->fd, &readfds );
-      if( conn->connBuf->fd > maxfd ) {
-
-	maxfd = conn->connBuf->fd;
-      }
-    }
-    if( select( maxfd + 1, &readfds, NULL, NULL, &tv ) < 0 ) {
-
-      fprintf( stderr, "BM_ERROR: select failed\n" );
+      fprintf( stderr, "BM_ERROR: waiting for input failed\n" );
       exit( -1 );
     }
-
-    /* process anything that's happened */
-    if( FD_ISSET( serv.listenSocket, &readfds ) ) {
-
-      handleListenSocket( &conf, &serv );
-    }
-    for( cur = LLPoolFirstEntry( serv.conns );
-	 cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-      Connection *conn = (Connection *)LLPoolGetItem( cur );
-
-      if( FD_ISSET( conn->connBuf->fd, &readfds ) ) {
-
-	handleConnection( &conf, &serv, cur );
-      }
-    }
   }
 
   close( serv.listenSocket );
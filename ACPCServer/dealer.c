@@ -4,17 +4,21 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #define __STDC_LIMIT_MACROS
 #include <stdint.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/time.h>
-#include <sys/select.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <dlfcn.h>
 #include "game.h"
 #include "net.h"
+#include "player_plugin.h"
+#include "log_writer.h"
 
 
 /* the ports for players to connect to will be printed on standard out
@@ -42,6 +46,36 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #define DEFAULT_MAX_USED_HAND_MICROS 6000000000
 #define DEFAULT_MAX_USED_PER_HAND_MICROS 70000000
 
+/* players using the delta protocol get a checksum in at least one out of
+   this many delta messages, as well as at the end of every hand */
+#define DELTA_CHECKSUM_INTERVAL 16
+
+/* bytes of messages which can wait to be sent to a seat */
+#define SEAT_OUTPUT_LEN 16384
+
+/* duplicate matches play every permutation of the seats, so are limited
+   to games with at most MAX_DUPLICATE_PLAYERS players */
+#define MAX_DUPLICATE_PLAYERS 6
+#define MAX_PERMUTATIONS 720
+
+/* the transaction file gets a checkpoint of the match every this many
+   hands by default, so a resumed match only replays the hands after
+   the last one */
+#define DEFAULT_CHECKPOINT_HANDS 1000
+#define CHECKPOINT_PREFIX "CHECKPOINT"
+
+/* a checkpoint line has the random number generator's state, and values
+   which are printed as at most 24 characters each */
+#define MAX_CHECKPOINT_LEN ( 64 + RNG_N * 9 + MAX_PLAYERS * 64 \
+			     + MAX_PERMUTATIONS * MAX_DUPLICATE_PLAYERS * 32 )
+
+/* bytes read at a time when looking back from the end of a transaction
+   file for its last checkpoint */
+#define CHECKPOINT_SEARCH_LEN 65536
+
+/* bytes of transactions held back while reading a transaction file, in
+   case a checkpoint after them means they don't need replaying */
+#define REPLAY_BUFFER_LEN 1048576
 
 typedef struct {
   uint32_t maxInvalidActions;
@@ -54,21 +88,280 @@ typedef struct {
   uint64_t usedMatchMicros[ MAX_PLAYERS ];
 } ErrorInfo;
 
+/* protocol options a seat asked for in its version string */
+typedef struct {
+  /* non-zero if the seat is sent binary frames instead of text */
+  int binary;
+
+  /* non-zero if the seat is sent delta messages */
+  int delta;
+
+  /* delta messages sent since the last one with a checksum */
+  int sinceChecksum;
+
+  /* the last full state sent, which the next delta message is from
+     empty if there isn't one yet */
+  char lastState[ MAX_LINE_LEN ];
+} SeatProtocol;
+
+/* messages waiting to be sent to a seat.  A seat only needs its messages
+   when it has to respond, so everything up to then goes out in one
+   write instead of one write per message */
+typedef struct {
+  ReadBuf *conn;
+  int len;
+  char buf[ SEAT_OUTPUT_LEN ];
+} SeatOutput;
+
+/* how the seats are placed at the table and the cards dealt each hand */
+typedef struct {
+  /* non-zero if seat s is always player s, when not playing duplicate */
+  int fixedSeats;
+
+  /* number of seat permutations each deal is played with in a duplicate
+     match, or 1 if each deal is only played once */
+  int numPermutations;
+
+  /* the seat playing as each player in the current hand */
+  uint8_t playerSeat[ MAX_PLAYERS ];
+
+  /* the cards of the current deal, to be replayed with other
+     permutations of the seats */
+  State deal;
+
+  /* value for each seat, totalled over the hands played with each
+     permutation of the seats */
+  double permutationValue[ MAX_PERMUTATIONS ][ MAX_PLAYERS ];
+} Dealing;
+
+/* a player loaded from a shared object, which the dealer calls directly
+   instead of talking to it through a connection */
+typedef struct {
+  /* NULL if the seat is played over a connection */
+  void *player;
+
+  void *handle;
+  PlayerActFunc act;
+  PlayerObserveFunc observe;
+  PlayerFreeFunc free;
+} SeatPlugin;
+
+/* options which apply to every table the dealer runs */
+typedef struct {
+  int fixedSeats;
+  int duplicate;
+  int quiet;
+  int append;
+  int textOnly;
+  int useLogFile;
+  int useTransactionFile;
+
+  uint32_t maxInvalidActions;
+  uint64_t maxResponseMicros;
+  uint64_t maxUsedHandMicros;
+  uint64_t maxUsedPerHandMicros;
+  int64_t startTimeoutMicros;
+
+  /* NULL for TCP, otherwise the path prefix for unix sockets */
+  char *unixPrefix;
+  int useShm;
+
+  /* log and transaction files are flushed every logFlushHands hands, or
+     only at the end of the match if it is 0, and synced to disk when
+     flushed if logSync is non-zero, and compressed by the writer threads
+     if logCompress is non-zero */
+  uint32_t logFlushHands;
+  int logSync;
+  int logCompress;
+
+  /* the transaction file gets a checkpoint every checkpointHands hands,
+     or none if it is 0 */
+  uint32_t checkpointHands;
+
+  /* NULL if the seat is played over a connection, otherwise the shared
+     object with its player, and the arguments for the player */
+  char *pluginFile[ MAX_PLAYERS ];
+  char *pluginArgs[ MAX_PLAYERS ];
+} DealerOptions;
+
+/* a match being played at one table.  Tables share nothing but the
+   options, so several can be played at once */
+typedef struct {
+  const DealerOptions *options;
+
+  char *matchName;
+  char *gameName;
+  Game *game;
+  char *seatName[ MAX_PLAYERS ];
+  uint32_t numHands;
+  uint32_t seed;
+
+  rng_state_t rng;
+  ErrorInfo errorInfo;
+
+  SeatPlugin plugin[ MAX_PLAYERS ];
+  uint16_t listenPort[ MAX_PLAYERS ];
+  int listenSocket[ MAX_PLAYERS ];
+
+  FILE *logFile;
+  FILE *transactionFile;
+
+  /* what playTable() returned, when the table has its own thread */
+  int result;
+} Table;
+
+/* listen sockets waiting for players to connect */
+typedef struct {
+  EventLoop *loop;
+  int numConnected;
+  EventHandler *handler[ MAX_PLAYERS ];
+
+  /* -1 until the seat is connected */
+  int seatFD[ MAX_PLAYERS ];
+} SeatConnections;
+
 
 static void printUsage( FILE *file, int verbose )
 {
   fprintf( file, "usage: dealer matchName gameDefFile #Hands rngSeed p1name p2name ... [options]\n" );
   fprintf( file, "  -f use fixed dealer button at table\n" );
+  fprintf( file, "  --duplicate play each of the #Hands deals once for every permutation\n" );
+  fprintf( file, "    of the seats, and print the values for each permutation\n" );
   fprintf( file, "  -l/L disable/enable log file - enabled by default\n" );
   fprintf( file, "  -p player1_port,player2_port,... [default is random]\n" );
   fprintf( file, "  -q only print errors, warnings, and final value to stderr\n" );
   fprintf( file, "  -t/T disable/enable transaction file - disabled by default\n" );
   fprintf( file, "  -a append to log/transaction files - disabled by default\n" );
+  fprintf( file, "  --log_flush [hands] flush log/transaction files every this many\n" );
+  fprintf( file, "    hands, or only at the end of the match if 0 - default is 1\n" );
+  fprintf( file, "  --log_sync sync log/transaction files to disk whenever they are flushed\n" );
+  fprintf( file, "  --log_compress compress log/transaction files, which are named with\n" );
+  fprintf( file, "    an extra .zst or .gz, depending on how the dealer was built\n" );
+  fprintf( file, "  --checkpoint [hands] checkpoint the match in the transaction file every\n" );
+  fprintf( file, "    this many hands, or never if 0 - default is 1000\n" );
   fprintf( file, "  --t_response [milliseconds] maximum time per response\n" );
   fprintf( file, "  --t_hand [milliseconds] maximum player time per hand\n" );
   fprintf( file, "  --t_per_hand [milliseconds] maximum average player time for match\n" );
   fprintf( file, "  --start_timeout [milliseconds] maximum time to wait for players to connect\n" );
   fprintf( file, "    <0 [default] is no timeout\n" );
+  fprintf( file, "  --text_only ignore protocol options from players, so everyone gets\n" );
+  fprintf( file, "    the standard text protocol\n" );
+  fprintf( file, "  --unix [path prefix] listen on unix sockets named by the prefix\n" );
+  fprintf( file, "    followed by the port, for players connecting to unix:prefix\n" );
+  fprintf( file, "  --shm [path prefix] same as --unix, but then talk to players through\n" );
+  fprintf( file, "    shared memory, for players connecting to shm:prefix\n" );
+  fprintf( file, "  --plugin [seat:file[:args]] play the seat with the player in shared\n" );
+  fprintf( file, "    object file, called directly instead of over a connection\n" );
+  fprintf( file, "  --tables [file] play every match in the file at once, one per line\n" );
+  fprintf( file, "    as matchName gameDefFile #Hands rngSeed p1name p2name ... [ports]\n" );
+  fprintf( file, "    instead of the match on the command line\n" );
+}
+
+/* event loop callback for a player connecting to the listen socket of
+   a seat, where data points at the seat's entry in seatFD */
+static void acceptSeat( void *context, int fd, void *data )
+{
+  SeatConnections *connections = (SeatConnections *)context;
+  int *seatFD = (int *)data;
+  int seat;
+  struct sockaddr_storage addr;
+  socklen_t addrLen;
+
+  seat = seatFD - connections->seatFD;
+  addrLen = sizeof( addr );
+  *seatFD = accept( fd, (struct sockaddr *)&addr, &addrLen );
+  if( *seatFD < 0 ) {
+    /* keep waiting, rather than taking down every table */
+
+    fprintf( stderr, "WARNING: seat %d could not connect\n", seat + 1 );
+    *seatFD = -1;
+    return;
+  }
+
+  /* only one player per seat */
+  removeEventHandler( connections->loop, connections->handler[ seat ] );
+  close( fd );
+  ++connections->numConnected;
+}
+
+/* get the seat, file and arguments from a --plugin option of the form
+   seat:file[:args], where the seat starts from 1
+   returns >= 0 on success, -1 on error */
+static int scanPluginString( char *string, DealerOptions *options )
+{
+  int seat, r;
+  char *args;
+
+  r = 0;
+  if( sscanf( string, "%d:%n", &seat, &r ) < 1 || r == 0
+      || seat < 1 || seat > MAX_PLAYERS || string[ r ] == 0 ) {
+
+    return -1;
+  }
+
+  options->pluginFile[ seat - 1 ] = &string[ r ];
+  args = strchr( &string[ r ], ':' );
+  if( args != NULL ) {
+
+    *args = 0;
+    options->pluginArgs[ seat - 1 ] = args + 1;
+  } else {
+
+    options->pluginArgs[ seat - 1 ] = "";
+  }
+
+  return 0;
+}
+
+/* load a player from a shared object, and create a player for game
+   returns >= 0 on success, -1 on failure */
+static int loadSeatPlugin( const Game *game, const char *file,
+			   const char *args, SeatPlugin *plugin )
+{
+  PlayerInitFunc init;
+
+  /* without a path, dlopen() only looks in the library directories */
+  plugin->handle = dlopen( file, RTLD_NOW | RTLD_LOCAL );
+  if( plugin->handle == NULL ) {
+
+    fprintf( stderr, "ERROR: could not load plugin %s: %s\n",
+	     file, dlerror() );
+    return -1;
+  }
+
+  init = (PlayerInitFunc)dlsym( plugin->handle, PLAYER_PLUGIN_INIT );
+  plugin->act = (PlayerActFunc)dlsym( plugin->handle, PLAYER_PLUGIN_ACT );
+  plugin->observe
+    = (PlayerObserveFunc)dlsym( plugin->handle, PLAYER_PLUGIN_OBSERVE );
+  plugin->free = (PlayerFreeFunc)dlsym( plugin->handle, PLAYER_PLUGIN_FREE );
+  if( init == NULL || plugin->act == NULL
+      || plugin->observe == NULL || plugin->free == NULL ) {
+
+    fprintf( stderr, "ERROR: plugin %s is missing player functions\n", file );
+    dlclose( plugin->handle );
+    return -1;
+  }
+
+  plugin->player = init( game, args );
+  if( plugin->player == NULL ) {
+
+    fprintf( stderr, "ERROR: plugin %s could not create a player\n", file );
+    dlclose( plugin->handle );
+    return -1;
+  }
+
+  return 0;
+}
+
+static void freeSeatPlugin( SeatPlugin *plugin )
+{
+  if( plugin->player == NULL ) {
+    return;
+  }
+
+  plugin->free( plugin->player );
+  plugin->player = NULL;
+  dlclose( plugin->handle );
 }
 
 /* returns >= 0 on success, -1 on error */
@@ -198,25 +491,191 @@ static int checkErrorNewHand( const Game *game, ErrorInfo *info )
 }
 
 
-static uint8_t seatToPlayer( const Game *game, const uint8_t player0Seat,
+static uint8_t seatToPlayer( const Game *game,
+			     const uint8_t playerSeat[ MAX_PLAYERS ],
 			     const uint8_t seat )
 {
-  return ( seat + game->numPlayers - player0Seat ) % game->numPlayers;
+  uint8_t p;
+
+  for( p = 0; playerSeat[ p ] != seat; ++p );
+  return p;
 }
 
-static uint8_t playerToSeat( const Game *game, const uint8_t player0Seat,
+static uint8_t playerToSeat( const Game *game,
+			     const uint8_t playerSeat[ MAX_PLAYERS ],
 			     const uint8_t player )
 {
-  return ( player + player0Seat ) % game->numPlayers;
+  return playerSeat[ player ];
 }
 
-/* returns >= 0 if match should continue, -1 for failure */
+/* number of permutations of numPlayers seats */
+static int numSeatPermutations( const uint8_t numPlayers )
+{
+  int n, p;
+
+  n = 1;
+  for( p = 2; p <= numPlayers; ++p ) {
+    n *= p;
+  }
+
+  return n;
+}
+
+/* place the seats at the table for a hand.  Duplicate matches use each
+   permutation of the seats in turn, in lexicographic order, and
+   otherwise the seats rotate around the table each hand unless they are
+   fixed */
+static void seatPlayers( const Game *game, const uint32_t handId,
+			 Dealing *dealing )
+{
+  int k, f, i, p;
+  uint8_t unused[ MAX_PLAYERS ];
+
+  if( dealing->numPermutations > 1 ) {
+
+    for( i = 0; i < game->numPlayers; ++i ) {
+      unused[ i ] = i;
+    }
+
+    /* pick the seats using the digits of k in the factorial base */
+    k = handId % dealing->numPermutations;
+    f = dealing->numPermutations;
+    for( p = 0; p < game->numPlayers; ++p ) {
+
+      f /= game->numPlayers - p;
+      i = k / f;
+      k %= f;
+
+      dealing->playerSeat[ p ] = unused[ i ];
+      memmove( &unused[ i ], &unused[ i + 1 ],
+	       game->numPlayers - p - i - 1 );
+    }
+  } else {
+
+    i = dealing->fixedSeats ? 0 : handId % game->numPlayers;
+    for( p = 0; p < game->numPlayers; ++p ) {
+
+      dealing->playerSeat[ p ] = ( p + i ) % game->numPlayers;
+    }
+  }
+}
+
+/* deal the cards for a new hand in state.  In a duplicate match, the
+   first permutation of the seats gets new cards, and the rest replay
+   them */
+static void dealHand( const Game *game, rng_state_t *rng,
+		      Dealing *dealing, State *state )
+{
+  if( state->handId % dealing->numPermutations == 0 ) {
+
+    dealCards( game, rng, state );
+    memcpy( dealing->deal.boardCards, state->boardCards,
+	    sizeof( state->boardCards ) );
+    memcpy( dealing->deal.holeCards, state->holeCards,
+	    sizeof( state->holeCards ) );
+  } else {
+
+    memcpy( state->boardCards, dealing->deal.boardCards,
+	    sizeof( state->boardCards ) );
+    memcpy( state->holeCards, dealing->deal.holeCards,
+	    sizeof( state->holeCards ) );
+  }
+}
+
+/* add the value of a finished hand for each player to the totals for
+   the seats, and put the value for player p in value[ p ] */
+static void addHandValues( const Game *game, const State *state,
+			   Dealing *dealing, double value[ MAX_PLAYERS ],
+			   double totalValue[ MAX_PLAYERS ] )
+{
+  uint8_t p, seat;
+  double *permutationValue;
+
+  permutationValue
+    = dealing->permutationValue[ state->handId % dealing->numPermutations ];
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    value[ p ] = valueOfState( game, state, p );
+    seat = playerToSeat( game, dealing->playerSeat, p );
+    totalValue[ seat ] += value[ p ];
+    permutationValue[ seat ] += value[ p ];
+  }
+}
+
+/* send everything waiting for a seat
+   returns >= 0 if match should continue, -1 for failure */
+static int flushSeatOutput( const uint8_t seat, SeatOutput *output )
+{
+  if( output->len == 0 ) {
+    return 0;
+  }
+
+  if( writeToConnection( output->conn, output->buf, output->len )
+      != output->len ) {
+
+    fprintf( stderr, "ERROR: could not send state to seat %"PRIu8"\n",
+	     seat + 1 );
+    return -1;
+  }
+  output->len = 0;
+
+  return 0;
+}
+
+/* add a message to the ones waiting for a seat
+   returns >= 0 if match should continue, -1 for failure */
+static int queueSeatOutput( const uint8_t seat, SeatOutput *output,
+			    const void *message, const int len )
+{
+  if( output->len + len > SEAT_OUTPUT_LEN ) {
+    /* no room, so send what's waiting first */
+
+    if( flushSeatOutput( seat, output ) < 0 ) {
+      return -1;
+    }
+  }
+
+  memcpy( &output->buf[ output->len ], message, len );
+  output->len += len;
+
+  return 0;
+}
+
+/* queue a message with the state for a seat, which is sent by the next
+   flushSeatOutput()
+   returns >= 0 if match should continue, -1 for failure */
 static int sendPlayerMessage( const Game *game, const MatchState *state,
 			      const int quiet, const uint8_t seat,
-			      const int seatFD, struct timeval *sendTime )
+			      SeatOutput *output, SeatProtocol *protocol,
+			      struct timeval *sendTime )
 {
-  int c;
-  char line[ MAX_LINE_LEN ];
+  int c, d, checksum;
+  char line[ MAX_LINE_LEN ], delta[ MAX_LINE_LEN ];
+  uint8_t frame[ MAX_LINE_LEN ];
+
+  if( protocol->binary ) {
+    /* binary players get a frame, with no text to print */
+
+    c = printMatchStateBinary( game, state, MAX_LINE_LEN, frame );
+    if( c < 0 ) {
+
+      fprintf( stderr, "ERROR: state message too long\n" );
+      return -1;
+    }
+    if( queueSeatOutput( seat, output, frame, c ) < 0 ) {
+      return -1;
+    }
+    gettimeofday( sendTime, NULL );
+
+    /* log the text version of the message */
+    if( !quiet && printMatchState( game, state, MAX_LINE_LEN, line ) >= 0 ) {
+
+      fprintf( stderr, "TO %d at %zu.%.06zu %s\n", seat + 1,
+	       sendTime->tv_sec, sendTime->tv_usec, line );
+    }
+
+    return 0;
+  }
 
   /* prepare the message */
   c = printMatchState( game, state, MAX_LINE_LEN, line );
@@ -226,21 +685,37 @@ static int sendPlayerMessage( const Game *game, const MatchState *state,
     fprintf( stderr, "ERROR: state message too long\n" );
     return -1;
   }
+
+  if( protocol->delta ) {
+    /* send only what changed since the last message, if we can */
+
+    checksum = stateFinished( &state->state )
+      || protocol->sinceChecksum + 1 >= DELTA_CHECKSUM_INTERVAL;
+    d = printMatchStateDelta( protocol->lastState, line, checksum,
+			      MAX_LINE_LEN - 2, delta );
+    memcpy( protocol->lastState, line, c + 1 );
+    if( d >= 0 ) {
+
+      protocol->sinceChecksum = checksum ? 0 : protocol->sinceChecksum + 1;
+      memcpy( line, delta, d + 1 );
+      c = d;
+    } else {
+      /* a full state message doesn't need a checksum */
+
+      protocol->sinceChecksum = 0;
+    }
+  }
   line[ c ] = '\r';
   line[ c + 1 ] = '\n';
   line[ c + 2 ] = 0;
   c += 2;
 
-  /* send it to the player and flush */
-  if( write( seatFD, line, c ) != c ) {
-    /* couldn't send the line */
-
-    fprintf( stderr, "ERROR: could not send state to seat %"PRIu8"\n",
-	     seat + 1 );
+  /* queue it for the player */
+  if( queueSeatOutput( seat, output, line, c ) < 0 ) {
     return -1;
   }
 
-  /* note when we sent the message */
+  /* note when the message was queued */
   gettimeofday( sendTime, NULL );
 
   /* log the message */
@@ -258,23 +733,40 @@ static int readPlayerResponse( const Game *game,
 			       const MatchState *state,
 			       const int quiet,
 			       const uint8_t seat,
+			       const SeatProtocol *protocol,
 			       const struct timeval *sendTime,
 			       ErrorInfo *errorInfo,
 			       ReadBuf *readBuf,
 			       Action *action,
 			       struct timeval *recvTime )
 {
-  int c, r;
+  int c, r, len;
+  uint32_t handId;
+  uint16_t numActions;
   MatchState tempState;
-  char line[ MAX_LINE_LEN ];
+  const char *line;
+  char actionString[ MAX_LINE_LEN ];
+  uint8_t frame[ MAX_LINE_LEN ];
 
+  r = -1;
   while( 1 ) {
 
-    /* read a line of input from player */
+    /* read a line (or a frame) of input from player */
     struct timeval start;
     gettimeofday( &start, NULL );
-    if( getLine( readBuf, MAX_LINE_LEN, line,
-		 errorInfo->maxResponseMicros ) <= 0 ) {
+    if( protocol->binary ) {
+
+      len = getFrame( readBuf, MAX_LINE_LEN, frame,
+		      errorInfo->maxResponseMicros );
+
+      /* binary responses only have the action, and no comments */
+      r = readActionBinary( frame, len, game, &handId, &numActions, action );
+    } else {
+
+      len = getLineView( readBuf, MAX_LINE_LEN, &line,
+			 errorInfo->maxResponseMicros );
+    }
+    if( len <= 0 ) {
       /* couldn't get any input from player */
 
       struct timeval after;
@@ -296,15 +788,35 @@ static int readPlayerResponse( const Game *game,
     /* note when the message arrived */
     gettimeofday( recvTime, NULL );
 
-    /* log the response */
-    if( !quiet ) {
-      fprintf( stderr, "FROM %d at %zu.%06zu %s", seat + 1,
-	       recvTime->tv_sec, recvTime->tv_usec, line );
-    }
+    if( protocol->binary ) {
 
-    /* ignore comments */
-    if( line[ 0 ] == '#' || line[ 0 ] == ';' ) {
-      continue;
+      /* log a text version of the response */
+      if( !quiet ) {
+
+	if( r < 0 || printAction( game, action,
+				  MAX_LINE_LEN, actionString ) < 0 ) {
+
+	  fprintf( stderr, "FROM %d at %zu.%06zu bad frame\n", seat + 1,
+		   recvTime->tv_sec, recvTime->tv_usec );
+	} else {
+
+	  fprintf( stderr, "FROM %d at %zu.%06zu %"PRIu32":%"PRIu16":%s\n",
+		   seat + 1, recvTime->tv_sec, recvTime->tv_usec,
+		   handId, numActions, actionString );
+	}
+      }
+    } else {
+
+      /* log the response */
+      if( !quiet ) {
+	fprintf( stderr, "FROM %d at %zu.%06zu %s", seat + 1,
+		 recvTime->tv_sec, recvTime->tv_usec, line );
+      }
+
+      /* ignore comments */
+      if( line[ 0 ] == '#' || line[ 0 ] == ';' ) {
+	continue;
+      }
     }
 
     /* check for any timeout issues */
@@ -314,25 +826,51 @@ static int readPlayerResponse( const Game *game,
       return -1;
     }
 
-    /* parse out the state */
-    c = readMatchState( line, game, &tempState );
-    if( c < 0 ) {
-      /* couldn't get an intelligible state */
+    if( protocol->binary ) {
 
-      fprintf( stderr, "WARNING: bad state format in response\n" );
-      continue;
-    }
+      /* ignore responses that don't match the current state */
+      if( r >= 0 && ( handId != state->state.handId
+		      || numActions != numActionsInHand( &state->state ) ) ) {
 
-    /* ignore responses that don't match the current state */
-    if( !matchStatesEqual( game, state, &tempState ) ) {
+	fprintf( stderr, "WARNING: ignoring un-requested response\n" );
+	continue;
+      }
+    } else if( protocol->delta && line[ 0 ] == '+' ) {
+      /* delta players can give just the action, with the handId and
+	 number of actions of the state it is for */
 
-      fprintf( stderr, "WARNING: ignoring un-requested response\n" );
-      continue;
+      r = readActionDelta( line, game, &handId, &numActions, action );
+
+      /* ignore responses that don't match the current state */
+      if( r >= 0 && ( handId != state->state.handId
+		      || numActions != numActionsInHand( &state->state ) ) ) {
+
+	fprintf( stderr, "WARNING: ignoring un-requested response\n" );
+	continue;
+      }
+    } else {
+
+      /* parse out the state */
+      c = readMatchState( line, game, &tempState );
+      if( c < 0 ) {
+	/* couldn't get an intelligible state */
+
+	fprintf( stderr, "WARNING: bad state format in response\n" );
+	continue;
+      }
+
+      /* ignore responses that don't match the current state */
+      if( !matchStatesEqual( game, state, &tempState ) ) {
+
+	fprintf( stderr, "WARNING: ignoring un-requested response\n" );
+	continue;
+      }
+
+      /* get the action */
+      r = line[ c ] == ':' ? readAction( &line[ c + 1 ], game, action ) : -1;
     }
 
-    /* get the action */
-    if( line[ c++ ] != ':'
-	|| ( r = readAction( &line[ c ], game, action ) ) < 0 ) {
+    if( r < 0 ) {
 
       if( checkErrorInvalidAction( seat, errorInfo ) < 0 ) {
 
@@ -345,7 +883,6 @@ static int readPlayerResponse( const Game *game,
       action->size = 0;
       goto doneRead;
     }
-    c += r;
 
     /* make sure the action is valid */
     if( !isValidAction( game, &state->state, 1, action ) ) {
@@ -368,114 +905,502 @@ static int readPlayerResponse( const Game *game,
   return 0;
 }
 
-/* returns >= 0 if match should continue, -1 for failure */
-static int setUpNewHand( const Game *game, const uint8_t fixedSeats,
-			 uint32_t *handId, uint8_t *player0Seat,
-			 rng_state_t *rng, ErrorInfo *errorInfo, State *state )
+/* copy state into view with only the cards the viewing player would be
+   sent in a message, since a plugin could look at anything in state */
+static void getPluginView( const Game *game, const MatchState *state,
+			   MatchState *view )
 {
-  ++( *handId );
+  *view = *state;
+  hideMatchStateCards( game, view );
+}
+
+/* get an action from a seat played by a plugin, with the same checks as
+   readPlayerResponse()
+   returns >= 0 if action/size has been set to a valid action
+   returns -1 for failure (plugin gave up, timeout, too many bad actions) */
+static int getPluginAction( const Game *game,
+			    const MatchState *state,
+			    const int quiet,
+			    const uint8_t seat,
+			    const SeatPlugin *plugin,
+			    const struct timeval *sendTime,
+			    ErrorInfo *errorInfo,
+			    Action *action,
+			    struct timeval *recvTime )
+{
+  int r;
+  MatchState view;
+  char actionString[ MAX_LINE_LEN ];
 
-  /* rotate the players around the table */
-  if( !fixedSeats ) {
+  getPluginView( game, state, &view );
+  r = plugin->act( plugin->player, &view, action );
 
-    *player0Seat = ( *player0Seat + 1 ) % game->numPlayers;
-  }
+  /* note when the action came back */
+  gettimeofday( recvTime, NULL );
 
-  if( checkErrorNewHand( game, errorInfo ) < 0 ) {
+  if( r < 0 ) {
 
-    fprintf( stderr, "ERROR: unexpected game\n" );
+    fprintf( stderr, "ERROR: plugin for seat %"PRIu8" could not act\n",
+	     seat + 1 );
     return -1;
   }
-  initState( game, *handId, state );
-  dealCards( game, rng, state );
-
-  return 0;
-}
 
-/* returns >= 0 if match should continue, -1 for failure */
-static int processTransactionFile( const Game *game, const int fixedSeats,
-				   uint32_t *handId, uint8_t *player0Seat,
-				   rng_state_t *rng, ErrorInfo *errorInfo,
-				   double totalValue[ MAX_PLAYERS ],
-				   MatchState *state, FILE *file )
-{
-  int c, r;
-  uint32_t h;
-  uint8_t s;
-  Action action;
-  struct timeval sendTime, recvTime;
-  char line[ MAX_LINE_LEN ];
+  /* log the action */
+  if( !quiet && printAction( game, action,
+			     MAX_LINE_LEN, actionString ) >= 0 ) {
 
-  while( fgets( line, MAX_LINE_LEN, file ) ) {
+    fprintf( stderr, "FROM %d at %zu.%06zu %s\n", seat + 1,
+	     recvTime->tv_sec, recvTime->tv_usec, actionString );
+  }
 
-    /* get the log entry */
+  /* check for any timeout issues */
+  if( checkErrorTimes( seat, sendTime, recvTime, errorInfo ) < 0 ) {
 
-    /* ACTION */
-    c = readAction( line, game, &action );
-    if( c < 0 ) {
+    fprintf( stderr, "ERROR: seat %"PRIu8" ran out of time\n", seat + 1 );
+    return -1;
+  }
 
-      fprintf( stderr, "ERROR: could not parse transaction action %s", line );
-      return -1;
-    }
+  /* make sure the action is valid */
+  if( !isValidAction( game, &state->state, 1, action ) ) {
 
-    /* ACTION HANDID SEND RECV */
-    if( sscanf( &line[ c ], " %"SCNu32" %zu.%06zu %zu.%06zu%n", &h,
-		&sendTime.tv_sec, &sendTime.tv_usec,
-		&recvTime.tv_sec, &recvTime.tv_usec, &r ) < 4 ) {
+    if( checkErrorInvalidAction( seat, errorInfo ) < 0 ) {
 
-      fprintf( stderr, "ERROR: could not parse transaction stamp %s", line );
+      fprintf( stderr, "ERROR: invalid action\n" );
       return -1;
     }
-    c += r;
 
-    /* check that we're processing the expected handId */
-    if( h != *handId ) {
+    fprintf( stderr, "WARNING: invalid action, changed to call\n" );
+    action->type = a_call;
+    action->size = 0;
+  }
 
-      fprintf( stderr, "ERROR: handId mismatch in transaction log: %s", line );
-      return -1;
-    }
+  return 0;
+}
 
-    /* make sure the action is valid */
-    if( !isValidAction( game, &state->state, 0, &action ) ) {
+/* returns >= 0 if match should continue, -1 for failure */
+static int setUpNewHand( const Game *game, Dealing *dealing,
+			 uint32_t *handId, rng_state_t *rng,
+			 ErrorInfo *errorInfo, State *state )
+{
+  ++( *handId );
+
+  /* move the players around the table */
+  seatPlayers( game, *handId, dealing );
+
+  if( checkErrorNewHand( game, errorInfo ) < 0 ) {
+
+    fprintf( stderr, "ERROR: unexpected game\n" );
+    return -1;
+  }
+  initState( game, *handId, state );
+  dealHand( game, rng, dealing, state );
+
+  return 0;
+}
+
+/* print a checkpoint line to the transaction file, with everything
+   needed to carry on the match from hand nextHandId.  Duplicate matches
+   are only checkpointed before a new deal, so the deal isn't needed
+   returns >= 0 on success, -1 on failure */
+static int logCheckpoint( const Game *game, const Dealing *dealing,
+			  const uint32_t nextHandId, const rng_state_t *rng,
+			  const ErrorInfo *errorInfo,
+			  const double totalValue[ MAX_PLAYERS ],
+			  LogWriter *transactionFile )
+{
+  int c, i, k;
+  uint8_t seat;
+  char *line;
+
+  line = (char *)malloc( MAX_CHECKPOINT_LEN );
+  if( line == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate checkpoint\n" );
+    return -1;
+  }
+
+  /* CHECKPOINT HANDID PERMUTATIONS RNG_INDEX RNG_STATE... */
+  c = sprintf( line, "%s %"PRIu32" %d %d", CHECKPOINT_PREFIX, nextHandId,
+	       dealing->numPermutations, rng->mti );
+  for( i = 0; i < RNG_N; ++i ) {
+    c += sprintf( &line[ c ], " %"PRIx32, rng->mt[ i ] );
+  }
+
+  /* then VALUE INVALID_ACTIONS MATCH_MICROS for each seat, with the
+     values in hex so they are read back exactly */
+  for( seat = 0; seat < game->numPlayers; ++seat ) {
+    c += sprintf( &line[ c ], " %a %"PRIu32" %"PRIu64, totalValue[ seat ],
+		  errorInfo->numInvalidActions[ seat ],
+		  errorInfo->usedMatchMicros[ seat ] );
+  }
+
+  /* then the value for each seat with each permutation, if duplicate */
+  if( dealing->numPermutations > 1 ) {
+
+    for( k = 0; k < dealing->numPermutations; ++k ) {
+      for( seat = 0; seat < game->numPlayers; ++seat ) {
+	c += sprintf( &line[ c ], " %a", dealing->permutationValue[ k ][ seat ] );
+      }
+    }
+  }
+  line[ c ] = '\n';
+  ++c;
+
+  if( logWrite( transactionFile, line, c ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not write checkpoint\n" );
+    free( line );
+    return -1;
+  }
+  free( line );
+
+  return 0;
+}
+
+/* set up the next hand of the match from the checkpoint in line.  Nothing
+   is changed if the checkpoint can't be parsed
+   returns 1 if the checkpoint was restored, 0 if it was skipped because it
+   couldn't be parsed, -1 for failure */
+static int restoreCheckpoint( const Game *game, Dealing *dealing,
+			      uint32_t *handId,
+			      rng_state_t *rng, ErrorInfo *errorInfo,
+			      double totalValue[ MAX_PLAYERS ],
+			      MatchState *state, const char *line )
+{
+  int c, i, k, numPermutations;
+  uint32_t nextHandId;
+  uint8_t seat;
+  const char *cur;
+  char *end;
+  rng_state_t newRng;
+  ErrorInfo newErrorInfo;
+  double newTotalValue[ MAX_PLAYERS ];
+  double newPermutationValue[ MAX_PERMUTATIONS ][ MAX_PLAYERS ];
+
+  if( sscanf( &line[ sizeof( CHECKPOINT_PREFIX ) - 1 ], " %"SCNu32" %d %d%n",
+	      &nextHandId, &numPermutations, &newRng.mti, &c ) < 3
+      || nextHandId == 0 || newRng.mti < 0 || newRng.mti > RNG_N ) {
+
+    fprintf( stderr, "WARNING: skipping checkpoint which can't be parsed\n" );
+    return 0;
+  }
+  if( numPermutations != dealing->numPermutations ) {
+
+    fprintf( stderr, "ERROR: checkpoint is from a %s match\n",
+	     numPermutations > 1 ? "duplicate" : "non-duplicate" );
+    return -1;
+  }
+  cur = &line[ sizeof( CHECKPOINT_PREFIX ) - 1 + c ];
+
+  for( i = 0; i < RNG_N; ++i ) {
+
+    newRng.mt[ i ] = strtoul( cur, &end, 16 );
+    if( end == cur ) {
+      goto badCheckpoint;
+    }
+    cur = end;
+  }
+
+  newErrorInfo = *errorInfo;
+  memcpy( newTotalValue, totalValue, sizeof( newTotalValue ) );
+  for( seat = 0; seat < game->numPlayers; ++seat ) {
+
+    newTotalValue[ seat ] = strtod( cur, &end );
+    if( end == cur ) {
+      goto badCheckpoint;
+    }
+    cur = end;
+
+    newErrorInfo.numInvalidActions[ seat ] = strtoul( cur, &end, 10 );
+    if( end == cur ) {
+      goto badCheckpoint;
+    }
+    cur = end;
+
+    newErrorInfo.usedMatchMicros[ seat ] = strtoull( cur, &end, 10 );
+    if( end == cur ) {
+      goto badCheckpoint;
+    }
+    cur = end;
+  }
+
+  if( dealing->numPermutations > 1 ) {
+
+    memcpy( newPermutationValue, dealing->permutationValue,
+	    sizeof( newPermutationValue ) );
+    for( k = 0; k < dealing->numPermutations; ++k ) {
+      for( seat = 0; seat < game->numPlayers; ++seat ) {
 
-      fprintf( stderr, "ERROR: invalid action in transaction log: %s", line );
+	newPermutationValue[ k ][ seat ] = strtod( cur, &end );
+	if( end == cur ) {
+	  goto badCheckpoint;
+	}
+	cur = end;
+      }
+    }
+    memcpy( dealing->permutationValue, newPermutationValue,
+	    sizeof( newPermutationValue ) );
+  }
+  *rng = newRng;
+  *errorInfo = newErrorInfo;
+  memcpy( totalValue, newTotalValue, sizeof( newTotalValue ) );
+
+  /* deal the hand after the checkpoint */
+  *handId = nextHandId - 1;
+  if( setUpNewHand( game, dealing, handId, rng, errorInfo,
+		    &state->state ) < 0 ) {
+    return -1;
+  }
+  return 1;
+
+ badCheckpoint:
+  fprintf( stderr, "WARNING: skipping checkpoint for hand %"PRIu32
+	   " which can't be parsed\n", nextHandId );
+  return 0;
+}
+
+/* move a transaction file to the start of the last complete checkpoint
+   line which starts after start and before end, or to start if there
+   isn't one
+   returns the position moved to, -1 on failure */
+static off_t seekLastCheckpoint( FILE *file, const off_t start,
+				 const off_t end )
+{
+  int newLine;
+  size_t len, got, i;
+  off_t pos;
+  const char prefix[] = "\n" CHECKPOINT_PREFIX " ";
+  char buf[ CHECKPOINT_SEARCH_LEN + sizeof( prefix ) ];
+
+  /* go back a block at a time, looking for a newline followed by a
+     checkpoint which has a newline somewhere after it, so the dealer
+     didn't die while writing it */
+  newLine = 0;
+  pos = end;
+  while( pos > start ) {
+
+    len = pos - start < CHECKPOINT_SEARCH_LEN
+      ? pos - start : CHECKPOINT_SEARCH_LEN;
+    pos -= len;
+    if( fseeko( file, pos, SEEK_SET ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not seek in transaction file\n" );
       return -1;
     }
+    got = fread( buf, 1, len + sizeof( prefix ) - 1, file );
+    if( got < len ) {
 
-    /* check for any timeout issues */
-    s = playerToSeat( game, *player0Seat,
-		      currentPlayer( game, &state->state ) );
-    if( checkErrorTimes( s, &sendTime, &recvTime, errorInfo ) < 0 ) {
+      fprintf( stderr, "ERROR: could not read transaction file\n" );
+      return -1;
+    }
+
+    for( i = len; i > 0; --i ) {
+
+      if( buf[ i - 1 ] != '\n' ) {
+	continue;
+      }
+      if( newLine && i - 1 + sizeof( prefix ) - 1 <= got
+	  && memcmp( &buf[ i - 1 ], prefix, sizeof( prefix ) - 1 ) == 0 ) {
+
+	pos += i;
+	return fseeko( file, pos, SEEK_SET ) < 0 ? -1 : pos;
+      }
+      newLine = 1;
+    }
+  }
+
+  /* no checkpoint after the first line, which is read as usual */
+  if( fseeko( file, start, SEEK_SET ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not seek in transaction file\n" );
+    return -1;
+  }
+
+  return start;
+}
+
+/* replay an action from a line of the transaction file
+   returns >= 0 if match should continue, -1 for failure */
+static int replayTransaction( const Game *game, Dealing *dealing,
+			      uint32_t *handId,
+			      rng_state_t *rng, ErrorInfo *errorInfo,
+			      double totalValue[ MAX_PLAYERS ],
+			      MatchState *state, const char *line )
+{
+  int c, r;
+  uint32_t h;
+  uint8_t s;
+  Action action;
+  struct timeval sendTime, recvTime;
+  double value[ MAX_PLAYERS ];
+
+  /* get the log entry */
+
+  /* ACTION */
+  c = readAction( line, game, &action );
+  if( c < 0 ) {
+
+    fprintf( stderr, "ERROR: could not parse transaction action %s", line );
+    return -1;
+  }
+
+  /* ACTION HANDID SEND RECV */
+  if( sscanf( &line[ c ], " %"SCNu32" %zu.%06zu %zu.%06zu%n", &h,
+	      &sendTime.tv_sec, &sendTime.tv_usec,
+	      &recvTime.tv_sec, &recvTime.tv_usec, &r ) < 4 ) {
+
+    fprintf( stderr, "ERROR: could not parse transaction stamp %s", line );
+    return -1;
+  }
+  c += r;
+
+  /* check that we're processing the expected handId */
+  if( h != *handId ) {
+
+    fprintf( stderr, "ERROR: handId mismatch in transaction log: %s", line );
+    return -1;
+  }
+
+  /* make sure the action is valid */
+  if( !isValidAction( game, &state->state, 0, &action ) ) {
+
+    fprintf( stderr, "ERROR: invalid action in transaction log: %s", line );
+    return -1;
+  }
+
+  /* check for any timeout issues */
+  s = playerToSeat( game, dealing->playerSeat,
+		    currentPlayer( game, &state->state ) );
+  if( checkErrorTimes( s, &sendTime, &recvTime, errorInfo ) < 0 ) {
+
+    fprintf( stderr,
+	     "ERROR: seat %"PRIu8" ran out of time in transaction file\n",
+	     s + 1 );
+    return -1;
+  }
+
+  doAction( game, &action, &state->state );
+
+  if( stateFinished( &state->state ) ) {
+    /* hand is finished */
+
+    /* update the total value for each player */
+    addHandValues( game, &state->state, dealing, value, totalValue );
+
+    /* move on to next hand */
+    if( setUpNewHand( game, dealing, handId,
+		      rng, errorInfo, &state->state ) < 0 ) {
 
-      fprintf( stderr,
-	       "ERROR: seat %"PRIu8" ran out of time in transaction file\n",
-	       s + 1 );
       return -1;
     }
+  }
+
+  return 0;
+}
+
+/* process the transaction file from its current position.  Only the
+   transactions after the last checkpoint are replayed, so held back
+   transactions are dropped when a checkpoint is read.  Checkpoints which
+   can't be parsed are skipped, replaying from the one before instead
+   returns >= 0 if match should continue, -1 for failure */
+static int processTransactionFile( const Game *game, Dealing *dealing,
+				   uint32_t *handId,
+				   rng_state_t *rng, ErrorInfo *errorInfo,
+				   double totalValue[ MAX_PLAYERS ],
+				   MatchState *state, FILE *file )
+{
+  int r;
+  size_t len, pendingLen, c;
+  off_t start, end, pos;
+  char *line, *pending;
+
+  line = (char *)malloc( MAX_CHECKPOINT_LEN );
+  pending = (char *)malloc( REPLAY_BUFFER_LEN );
+  if( line == NULL || pending == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate transaction buffers\n" );
+    free( line );
+    free( pending );
+    return -1;
+  }
+
+  /* skip straight to the last checkpoint which can be restored, if the
+     file can seek.  Files which can't, like a stream decompressing a
+     transaction file, are read from the start */
+  r = 0;
+  start = ftello( file );
+  if( start >= 0 ) {
+
+    if( fseeko( file, 0, SEEK_END ) < 0 || ( end = ftello( file ) ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not seek in transaction file\n" );
+      r = -1;
+    }
+    while( r == 0 ) {
 
-    doAction( game, &action, &state->state );
+      pos = seekLastCheckpoint( file, start, end );
+      if( pos <= start ) {
 
-    if( stateFinished( &state->state ) ) {
-      /* hand is finished */
+	r = pos < 0 ? -1 : 0;
+	break;
+      }
+      if( !fgets( line, MAX_CHECKPOINT_LEN, file ) ) {
+
+	fprintf( stderr, "ERROR: could not read transaction file\n" );
+	r = -1;
+	break;
+      }
+      r = restoreCheckpoint( game, dealing, handId, rng, errorInfo,
+			     totalValue, state, line );
+      end = pos;
+    }
+  }
+
+  /* pending holds transactions since the last checkpoint, each followed
+     by a NUL, until it fills up and they have to be replayed */
+  pendingLen = 0;
+  while( r >= 0 && fgets( line, MAX_CHECKPOINT_LEN, file ) ) {
 
-      /* update the total value for each player */
-      for( s = 0; s < game->numPlayers; ++s ) {
+    len = strlen( line );
+    if( strncmp( line, CHECKPOINT_PREFIX " ",
+		 sizeof( CHECKPOINT_PREFIX ) ) == 0 ) {
 
-	totalValue[ s ]
-	  += valueOfState( game, &state->state,
-			   seatToPlayer( game, *player0Seat, s ) );
+      if( line[ len - 1 ] != '\n' ) {
+	/* the dealer died while writing the checkpoint */
+
+	break;
+      }
+      r = restoreCheckpoint( game, dealing, handId, rng, errorInfo,
+			     totalValue, state, line );
+      if( r > 0 ) {
+	/* transactions before the checkpoint don't need replaying */
+
+	pendingLen = 0;
       }
+      continue;
+    }
 
-      /* move on to next hand */
-      if( setUpNewHand( game, fixedSeats, handId, player0Seat,
-			rng, errorInfo, &state->state ) < 0 ) {
+    if( pendingLen + len + 1 > REPLAY_BUFFER_LEN ) {
 
-	return -1;
+      for( c = 0; r >= 0 && c < pendingLen;
+	   c += strlen( &pending[ c ] ) + 1 ) {
+	r = replayTransaction( game, dealing, handId, rng, errorInfo,
+			       totalValue, state, &pending[ c ] );
       }
+      pendingLen = 0;
     }
+    memcpy( &pending[ pendingLen ], line, len + 1 );
+    pendingLen += len + 1;
   }
 
-  return 0;
+  for( c = 0; r >= 0 && c < pendingLen; c += strlen( &pending[ c ] ) + 1 ) {
+    r = replayTransaction( game, dealing, handId, rng, errorInfo,
+			   totalValue, state, &pending[ c ] );
+  }
+
+  free( line );
+  free( pending );
+  return r;
 }
 
 /* returns >= 0 if match should continue, -1 on failure */
@@ -483,7 +1408,7 @@ static int logTransaction( const Game *game, const State *state,
 			   const Action *action,
 			   const struct timeval *sendTime,
 			   const struct timeval *recvTime,
-			   FILE *file )
+			   LogWriter *file )
 {
   int c, r;
   char line[ MAX_LINE_LEN ];
@@ -506,20 +1431,20 @@ static int logTransaction( const Game *game, const State *state,
   }
   c += r;
 
-  if( fwrite( line, 1, c, file ) != c ) {
+  if( logWrite( file, line, c ) != c ) {
 
     fprintf( stderr, "ERROR: could not write to transaction file\n" );
     return -1;
   }
-  fflush( file );
 
   return c;
 }
 
 /* returns >= 0 if match should continue, -1 on failure */
-static int checkVersion( const uint8_t seat,
-			 ReadBuf *readBuf )
+static int checkVersion( const uint8_t seat, const int textOnly,
+			 ReadBuf *readBuf, SeatProtocol *protocol )
 {
+  int c, r;
   uint32_t major, minor, rev;
   char line[ MAX_LINE_LEN ];
 
@@ -532,8 +1457,8 @@ static int checkVersion( const uint8_t seat,
     return -1;
   }
 
-  if( sscanf( line, "VERSION:%"SCNu32".%"SCNu32".%"SCNu32,
-	      &major, &minor, &rev ) < 3 ) {
+  if( sscanf( line, "VERSION:%"SCNu32".%"SCNu32".%"SCNu32"%n",
+	      &major, &minor, &rev, &c ) < 3 ) {
 
     fprintf( stderr,
 	     "ERROR: invalid version string %s", line );
@@ -545,14 +1470,43 @@ static int checkVersion( const uint8_t seat,
     fprintf( stderr, "ERROR: this server is currently using version %"SCNu32".%"SCNu32".%"SCNu32"\n", VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION );
   }
 
+  /* protocol extensions are listed after the version, each after a : */
+  protocol->binary = 0;
+  protocol->delta = 0;
+  protocol->sinceChecksum = 0;
+  protocol->lastState[ 0 ] = 0;
+  while( line[ c ] == ':' ) {
+
+    ++c;
+    r = strcspn( &line[ c ], ":\r\n" );
+    if( textOnly ) {
+
+      fprintf( stderr, "WARNING: ignoring protocol option %.*s from seat"
+	       " %"PRIu8", only using text\n", r, &line[ c ], seat + 1 );
+    } else if( r == strlen( DELTA_PROTOCOL_OPTION )
+	       && strncmp( &line[ c ], DELTA_PROTOCOL_OPTION, r ) == 0 ) {
+
+      protocol->delta = 1;
+    } else if( r == strlen( BINARY_PROTOCOL_OPTION )
+	       && strncmp( &line[ c ], BINARY_PROTOCOL_OPTION, r ) == 0 ) {
+
+      protocol->binary = 1;
+    } else {
+
+      fprintf( stderr, "WARNING: ignoring unknown protocol option %.*s"
+	       " from seat %"PRIu8"\n", r, &line[ c ], seat + 1 );
+    }
+    c += r;
+  }
+
   return 0;
 }
 
 /* returns >= 0 if match should continue, -1 on failure */
 static int addToLogFile( const Game *game, const State *state,
 			 const double value[ MAX_PLAYERS ],
-			 const uint8_t player0Seat,
-			 char *seatName[ MAX_PLAYERS ], FILE *logFile )
+			 const uint8_t playerSeat[ MAX_PLAYERS ],
+			 char *seatName[ MAX_PLAYERS ], LogWriter *logFile )
 {
   int c, r;
   uint8_t p;
@@ -590,7 +1544,7 @@ static int addToLogFile( const Game *game, const State *state,
 
     r = snprintf( &line[ c ], MAX_LINE_LEN - c,
 		  p ? "|%s" : ":%s",
-		  seatName[ playerToSeat( game, player0Seat, p ) ] );
+		  seatName[ playerToSeat( game, playerSeat, p ) ] );
     if( r < 0 ) {
 
       fprintf( stderr, "ERROR: log message too long\n" );
@@ -599,13 +1553,20 @@ static int addToLogFile( const Game *game, const State *state,
     c += r;
   }
 
-  /* print the line to log and flush */
-  if( fprintf( logFile, "%s\n", line ) < 0 ) {
+  /* add the line to the log, which is flushed at the end of the hand */
+  if( c >= MAX_LINE_LEN - 1 ) {
+
+    fprintf( stderr, "ERROR: log message too long\n" );
+    return -1;
+  }
+  line[ c ] = '\n';
+  ++c;
+  if( logWrite( logFile, line, c ) != c ) {
 
+    line[ c - 1 ] = 0;
     fprintf( stderr, "ERROR: logging failed for game %s\n", line );
     return -1;
   }
-  fflush( logFile );
 
   return 0;
 }
@@ -613,7 +1574,7 @@ static int addToLogFile( const Game *game, const State *state,
 /* returns >= 0 if match should continue, -1 on failure */
 static int printInitialMessage( const char *matchName, const char *gameName,
 				const uint32_t numHands, const uint32_t seed,
-				const ErrorInfo *info, FILE *logFile )
+				const ErrorInfo *info, LogWriter *logFile )
 {
   int c;
   char line[ MAX_LINE_LEN ];
@@ -633,7 +1594,11 @@ static int printInitialMessage( const char *matchName, const char *gameName,
   fprintf( stderr, "%s", line );
   if( logFile ) {
 
-    fprintf( logFile, "%s", line );
+    if( logWrite( logFile, line, c ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not write to log file\n" );
+      return -1;
+    }
   }
 
   return 0;
@@ -642,7 +1607,7 @@ static int printInitialMessage( const char *matchName, const char *gameName,
 /* returns >= 0 if match should continue, -1 on failure */
 static int printFinalMessage( const Game *game, char *seatName[ MAX_PLAYERS ],
 			      const double totalValue[ MAX_PLAYERS ],
-			      FILE *logFile )
+			      LogWriter *logFile, const char *scorePrefix )
 {
   int c, r;
   uint8_t s;
@@ -686,12 +1651,95 @@ static int printFinalMessage( const Game *game, char *seatName[ MAX_PLAYERS ],
     c += r;
   }
 
-  fprintf( stdout, "%s\n", line );
+  if( scorePrefix != NULL ) {
+
+    fprintf( stdout, "%s %s\n", scorePrefix, line );
+  } else {
+
+    fprintf( stdout, "%s\n", line );
+  }
   fprintf( stderr, "%s\n", line );
 
   if( logFile ) {
 
-    fprintf( logFile, "%s\n", line );
+    line[ c ] = '\n';
+    if( logWrite( logFile, line, c + 1 ) < 0 ) {
+
+      fprintf( stderr, "ERROR: logging failed for final values\n" );
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* print the values for the seats with each permutation of the seats in
+   a duplicate match, as PERMUTATION:players:values:names where players
+   gives the player each seat was
+   returns >= 0 if match should continue, -1 on failure */
+static int printPermutationValues( const Game *game,
+				   char *seatName[ MAX_PLAYERS ],
+				   Dealing *dealing, LogWriter *logFile )
+{
+  int c, r, k;
+  uint8_t s;
+  char line[ MAX_LINE_LEN ];
+
+  for( k = 0; k < dealing->numPermutations; ++k ) {
+
+    c = snprintf( line, MAX_LINE_LEN, "PERMUTATION" );
+    seatPlayers( game, k, dealing );
+    for( s = 0; s < game->numPlayers; ++s ) {
+
+      r = snprintf( &line[ c ], MAX_LINE_LEN - c, s ? "|%"PRIu8 : ":%"PRIu8,
+		    seatToPlayer( game, dealing->playerSeat, s ) );
+      if( r < 0 ) {
+
+	fprintf( stderr, "ERROR: permutation message too long\n" );
+	return -1;
+      }
+      c += r;
+    }
+
+    for( s = 0; s < game->numPlayers; ++s ) {
+
+      r = snprintf( &line[ c ], MAX_LINE_LEN - c, s ? "|%.6f" : ":%.6f",
+		    dealing->permutationValue[ k ][ s ] );
+      if( r < 0 ) {
+
+	fprintf( stderr, "ERROR: permutation message too long\n" );
+	return -1;
+      }
+      c += r;
+
+      /* remove trailing zeros after decimal-point */
+      while( line[ c - 1 ] == '0' ) { --c; }
+      if( line[ c - 1 ] == '.' ) { --c; }
+      line[ c ] = 0;
+    }
+
+    for( s = 0; s < game->numPlayers; ++s ) {
+
+      r = snprintf( &line[ c ], MAX_LINE_LEN - c,
+		    s ? "|%s" : ":%s", seatName[ s ] );
+      if( r < 0 ) {
+
+	fprintf( stderr, "ERROR: permutation message too long\n" );
+	return -1;
+      }
+      c += r;
+    }
+
+    fprintf( stderr, "%s\n", line );
+    if( logFile ) {
+
+      line[ c ] = '\n';
+      if( logWrite( logFile, line, c + 1 ) < 0 ) {
+
+	fprintf( stderr, "ERROR: logging failed for permutation values\n" );
+	return -1;
+      }
+    }
   }
 
   return 0;
@@ -702,7 +1750,7 @@ static int printFinalMessage( const Game *game, char *seatName[ MAX_PLAYERS ],
    cards are dealt using rng, error conditions like timeouts
    are controlled and stored in errorInfo
 
-   actions are read/sent to seat p on seatFD[ p ]
+   actions are read/sent to seat p on readBuf[ p ]
 
    if quiet is not zero, only print out errors, warnings, and final value
 
@@ -712,28 +1760,52 @@ static int printFinalMessage( const Game *game, char *seatName[ MAX_PLAYERS ],
 
    if transactionFile is not NULL, a transaction log of actions made
    is written to the file, and if there is any input left to read on
-   the stream when gameLoop is called, it will be processed to
-   initialise the state
+   its stream when gameLoop is called, it will be processed to
+   initialise the state.  If checkpointHands is not zero, a checkpoint
+   of the match is added to it about every checkpointHands hands, and
+   processing starts from the last one
+
+   if scorePrefix is not NULL, it is printed before the final values on
+   standard out, so the scores of several tables can be told apart
+
+   seats with a player in plugin are called directly, and have no
+   readBuf
 
    returns >=0 if the match finished correctly, -1 on error */
 static int gameLoop( const Game *game, char *seatName[ MAX_PLAYERS ],
 		     const uint32_t numHands, const int quiet,
-		     const int fixedSeats, rng_state_t *rng,
-		     ErrorInfo *errorInfo, const int seatFD[ MAX_PLAYERS ],
-		     ReadBuf *readBuf[ MAX_PLAYERS ],
-		     FILE *logFile, FILE *transactionFile )
+		     const int fixedSeats, const int duplicate,
+		     const int textOnly, rng_state_t *rng,
+		     ErrorInfo *errorInfo, ReadBuf *readBuf[ MAX_PLAYERS ],
+		     const SeatPlugin plugin[ MAX_PLAYERS ],
+		     LogWriter *logFile, LogWriter *transactionFile,
+		     const uint32_t checkpointHands, const char *scorePrefix )
 {
-  uint32_t handId;
-  uint8_t seat, p, player0Seat, currentP, currentSeat;
+  uint32_t handId, sinceCheckpoint;
+  uint8_t seat, currentP, currentSeat;
+  int k, r;
   struct timeval t, sendTime, recvTime;
   Action action;
-  MatchState state;
+  MatchState state, view;
   double value[ MAX_PLAYERS ], totalValue[ MAX_PLAYERS ];
+  FILE *replayFile;
+  SeatProtocol protocol[ MAX_PLAYERS ];
+  SeatOutput output[ MAX_PLAYERS ];
+  Dealing dealing;
 
   /* check version string for each player */
   for( seat = 0; seat < game->numPlayers; ++seat ) {
 
-    if( checkVersion( seat, readBuf[ seat ] ) < 0 ) {
+    output[ seat ].conn = readBuf[ seat ];
+    output[ seat ].len = 0;
+
+    if( plugin[ seat ].player != NULL ) {
+      /* plugins always get a MatchState */
+
+      continue;
+    }
+    if( checkVersion( seat, textOnly, readBuf[ seat ],
+		      &protocol[ seat ] ) < 0 ) {
       /* error messages already handled in function */
 
       return -1;
@@ -753,21 +1825,38 @@ static int gameLoop( const Game *game, char *seatName[ MAX_PLAYERS ],
     fprintf( stderr, "ERROR: unexpected game\n" );
     return -1;
   }
-  initState( game, handId, &state.state );
-  dealCards( game, rng, &state.state );
+  dealing.fixedSeats = fixedSeats;
+  dealing.numPermutations
+    = duplicate ? numSeatPermutations( game->numPlayers ) : 1;
   for( seat = 0; seat < game->numPlayers; ++seat ) {
+
     totalValue[ seat ] = 0.0;
+    for( k = 0; k < dealing.numPermutations; ++k ) {
+      dealing.permutationValue[ k ][ seat ] = 0.0;
+    }
   }
 
   /* seat 0 is player 0 in first game */
-  player0Seat = 0;
+  seatPlayers( game, handId, &dealing );
+  initState( game, handId, &state.state );
+  dealHand( game, rng, &dealing, &state.state );
 
-  /* process the transaction file */
+  /* process the transaction file, which may be compressed */
   if( transactionFile != NULL ) {
 
-    if( processTransactionFile( game, fixedSeats, &handId, &player0Seat,
+    replayFile = openLogStream( transactionFile->file );
+    if( replayFile == NULL ) {
+
+      fprintf( stderr, "ERROR: could not read transaction file\n" );
+      return -1;
+    }
+    r = processTransactionFile( game, &dealing, &handId,
 				rng, errorInfo, totalValue,
-				&state, transactionFile ) < 0 ) {
+				&state, replayFile );
+    if( replayFile != transactionFile->file ) {
+      fclose( replayFile );
+    }
+    if( r < 0 ) {
       /* error messages already handled in function */
 
       return -1;
@@ -777,6 +1866,7 @@ static int gameLoop( const Game *game, char *seatName[ MAX_PLAYERS ],
   if( handId >= numHands ) {
     goto finishedGameLoop;
   }
+  sinceCheckpoint = 0;
 
   /* play all the (remaining) hands */
   while( 1 ) {
@@ -786,31 +1876,53 @@ static int gameLoop( const Game *game, char *seatName[ MAX_PLAYERS ],
 
       /* find the current player */
       currentP = currentPlayer( game, &state.state );
+      currentSeat = playerToSeat( game, dealing.playerSeat, currentP );
 
       /* send state to each player */
       for( seat = 0; seat < game->numPlayers; ++seat ) {
 
-	state.viewingPlayer = seatToPlayer( game, player0Seat, seat );
-	if( sendPlayerMessage( game, &state, quiet, seat,
-			       seatFD[ seat ], &t ) < 0 ) {
+	state.viewingPlayer = seatToPlayer( game, dealing.playerSeat, seat );
+	if( plugin[ seat ].player != NULL ) {
+	  /* the current player sees the state when it is asked to act */
+
+	  if( seat != currentSeat ) {
+
+	    getPluginView( game, &state, &view );
+	    plugin[ seat ].observe( plugin[ seat ].player, &view );
+	  }
+	} else if( sendPlayerMessage( game, &state, quiet, seat,
+				      &output[ seat ], &protocol[ seat ],
+				      &t ) < 0 ) {
 	  /* error messages already handled in function */
 
 	  return -1;
 	}
+      }
 
-	/* remember the seat and send time if player is acting */
-	if( state.viewingPlayer == currentP ) {
+      /* only the current player needs its messages now, and its time
+	 starts once they are sent */
+      state.viewingPlayer = currentP;
+      if( flushSeatOutput( currentSeat, &output[ currentSeat ] ) < 0 ) {
+	/* error messages already handled in function */
 
-	  sendTime = t;
-	}
+	return -1;
       }
+      gettimeofday( &sendTime, NULL );
 
       /* get action from current player */
-      state.viewingPlayer = currentP;
-      currentSeat = playerToSeat( game, player0Seat, currentP );
-      if( readPlayerResponse( game, &state, quiet, currentSeat, &sendTime,
-			      errorInfo, readBuf[ currentSeat ],
-			      &action, &recvTime ) < 0 ) {
+      if( plugin[ currentSeat ].player != NULL ) {
+
+	if( getPluginAction( game, &state, quiet, currentSeat,
+			     &plugin[ currentSeat ], &sendTime,
+			     errorInfo, &action, &recvTime ) < 0 ) {
+	  /* error messages already handled in function */
+
+	  return -1;
+	}
+      } else if( readPlayerResponse( game, &state, quiet, currentSeat,
+				     &protocol[ currentSeat ], &sendTime,
+				     errorInfo, readBuf[ currentSeat ],
+				     &action, &recvTime ) < 0 ) {
 	/* error messages already handled in function */
 
 	return -1;
@@ -832,16 +1944,12 @@ static int gameLoop( const Game *game, char *seatName[ MAX_PLAYERS ],
     }
 
     /* get values */
-    for( p = 0; p < game->numPlayers; ++p ) {
-
-      value[ p ] = valueOfState( game, &state.state, p );
-      totalValue[ playerToSeat( game, player0Seat, p ) ] += value[ p ];
-    }
+    addHandValues( game, &state.state, &dealing, value, totalValue );
 
     /* add the game to the log */
     if( logFile != NULL ) {
 
-      if( addToLogFile( game, &state.state, value, player0Seat,
+      if( addToLogFile( game, &state.state, value, dealing.playerSeat,
 			seatName, logFile ) < 0 ) {
 	/* error messages already handled in function */
 
@@ -849,20 +1957,48 @@ static int gameLoop( const Game *game, char *seatName[ MAX_PLAYERS ],
       }
     }
 
-    /* send final state to each player */
-    for( seat = 0; seat < game->numPlayers; ++seat ) {
+    /* checkpoint the match every so often, between deals */
+    ++sinceCheckpoint;
+    if( transactionFile != NULL && checkpointHands > 0
+	&& sinceCheckpoint >= checkpointHands
+	&& ( handId + 1 ) % dealing.numPermutations == 0 ) {
 
-      state.viewingPlayer = seatToPlayer( game, player0Seat, seat );
-      if( sendPlayerMessage( game, &state, quiet, seat,
-			     seatFD[ seat ], &t ) < 0 ) {
+      if( logCheckpoint( game, &dealing, handId + 1, rng, errorInfo,
+			 totalValue, transactionFile ) < 0 ) {
 	/* error messages already handled in function */
 
 	return -1;
       }
+      sinceCheckpoint = 0;
     }
 
-    if ( !quiet ) {
-      if ( handId % 100 == 0) {
+    /* let the logs flush, if they flush after this many hands */
+    if( ( logFile != NULL && logEndHand( logFile ) < 0 )
+	|| ( transactionFile != NULL && logEndHand( transactionFile ) < 0 ) ) {
+
+      fprintf( stderr, "ERROR: could not write to log files\n" );
+      return -1;
+    }
+
+    /* send final state to each player */
+    for( seat = 0; seat < game->numPlayers; ++seat ) {
+
+      state.viewingPlayer = seatToPlayer( game, dealing.playerSeat, seat );
+      if( plugin[ seat ].player != NULL ) {
+
+	getPluginView( game, &state, &view );
+	plugin[ seat ].observe( plugin[ seat ].player, &view );
+      } else if( sendPlayerMessage( game, &state, quiet, seat,
+				    &output[ seat ], &protocol[ seat ],
+				    &t ) < 0 ) {
+	/* error messages already handled in function */
+
+	return -1;
+      }
+    }
+
+    if ( !quiet ) {
+      if ( handId % 100 == 0) {
 	for( seat = 0; seat < game->numPlayers; ++seat ) {
 	  fprintf(stderr, "Seconds cumulatively spent in match for seat %i: "
 		  "%i\n", seat,
@@ -872,7 +2008,7 @@ static int gameLoop( const Game *game, char *seatName[ MAX_PLAYERS ],
     }
 
     /* start a new hand */
-    if( setUpNewHand( game, fixedSeats, &handId, &player0Seat,
+    if( setUpNewHand( game, &dealing, &handId,
 		      rng, errorInfo, &state.state ) < 0 ) {
       /* error messages already handled in function */
 
@@ -884,13 +2020,30 @@ static int gameLoop( const Game *game, char *seatName[ MAX_PLAYERS ],
   }
 
  finishedGameLoop:
+  /* send anything still waiting */
+  for( seat = 0; seat < game->numPlayers; ++seat ) {
+
+    if( flushSeatOutput( seat, &output[ seat ] ) < 0 ) {
+      /* error messages already handled in function */
+
+      return -1;
+    }
+  }
+
   /* print out the final values */
   if( !quiet ) {
     gettimeofday( &t, NULL );
     fprintf( stderr, "FINISHED at %zu.%06zu\n",
 	     sendTime.tv_sec, sendTime.tv_usec );
   }
-  if( printFinalMessage( game, seatName, totalValue, logFile ) < 0 ) {
+  if( duplicate
+      && printPermutationValues( game, seatName, &dealing, logFile ) < 0 ) {
+    /* error messages already handled in function */
+
+    return -1;
+  }
+  if( printFinalMessage( game, seatName, totalValue, logFile,
+			 scorePrefix ) < 0 ) {
     /* error messages already handled in function */
 
     return -1;
@@ -899,44 +2052,593 @@ static int gameLoop( const Game *game, char *seatName[ MAX_PLAYERS ],
   return 0;
 }
 
-int main( int argc, char **argv )
+/* cut an uncompressed log which is being continued back to the end of its
+   last complete line, so a line the dealer died while writing isn't
+   joined onto the first line it appends
+   returns >= 0 on success, -1 on failure */
+static int finishTextLog( FILE *file )
 {
-  int i, listenSocket[ MAX_PLAYERS ], v, longOpt;
-  int fixedSeats, quiet, append;
-  int seatFD[ MAX_PLAYERS ];
-  FILE *file, *logFile, *transactionFile;
+  size_t len, i;
+  off_t pos;
+  char buf[ 4096 ];
+
+  if( fseeko( file, 0, SEEK_END ) < 0 || ( pos = ftello( file ) ) < 0 ) {
+    return -1;
+  }
+
+  while( pos > 0 ) {
+
+    len = pos < (off_t)sizeof( buf ) ? pos : sizeof( buf );
+    if( fseeko( file, pos - len, SEEK_SET ) < 0
+	|| fread( buf, 1, len, file ) < len ) {
+      return -1;
+    }
+
+    for( i = len; i > 0 && buf[ i - 1 ] != '\n'; --i );
+    if( i > 0 ) {
+
+      pos -= len - i;
+      break;
+    }
+    pos -= len;
+  }
+
+  if( ftruncate( fileno( file ), pos ) < 0 ) {
+    return -1;
+  }
+  rewind( file );
+
+  return 0;
+}
+
+/* set up a table from args, which are the match name, game definition
+   file, number of hands, random seed and the seat names, opening the
+   match's files and a listen socket for each seat.  listenPort gives
+   the ports to use, with 0 for a random port
+   returns >= 0 on success, -1 on failure */
+static int setUpTable( const DealerOptions *options,
+		       const int numArgs, char **args,
+		       const uint16_t listenPort[ MAX_PLAYERS ],
+		       Table *table )
+{
+  int i;
+  FILE *file;
+  char name[ MAX_LINE_LEN ];
+
+  table->options = options;
+  if( numArgs < 4 ) {
+
+    fprintf( stderr, "ERROR: not enough arguments for a match\n" );
+    return -1;
+  }
+  table->matchName = args[ 0 ];
+  table->gameName = args[ 1 ];
+
+  /* get the game definition */
+  file = fopen( table->gameName, "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game definition %s\n",
+	     table->gameName );
+    return -1;
+  }
+  table->game = readGame( file );
+  if( table->game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", table->gameName );
+    fclose( file );
+    return -1;
+  }
+  fclose( file );
+
+  /* save the seat names */
+  if( 4 + table->game->numPlayers > numArgs ) {
+
+    fprintf( stderr, "ERROR: not enough seat names for match %s\n",
+	     table->matchName );
+    return -1;
+  }
+  for( i = 0; i < table->game->numPlayers; ++i ) {
+
+    table->seatName[ i ] = args[ 4 + i ];
+  }
+
+  /* get number of hands */
+  if( sscanf( args[ 2 ], "%"SCNu32, &table->numHands ) < 1
+      || table->numHands == 0 ) {
+
+    fprintf( stderr, "ERROR: invalid number of hands %s\n", args[ 2 ] );
+    return -1;
+  }
+
+  /* duplicate matches play each of the hands once for every
+     permutation of the seats */
+  if( options->duplicate ) {
+
+    if( table->game->numPlayers > MAX_DUPLICATE_PLAYERS ) {
+
+      fprintf( stderr, "ERROR: duplicate matches can have at most %d players\n",
+	       MAX_DUPLICATE_PLAYERS );
+      return -1;
+    }
+    table->numHands *= numSeatPermutations( table->game->numPlayers );
+  }
+
+  /* get random number seed */
+  if( sscanf( args[ 3 ], "%"SCNu32, &table->seed ) < 1 ) {
+
+    fprintf( stderr, "ERROR: invalid random number seed %s\n", args[ 3 ] );
+    return -1;
+  }
+  init_genrand( &table->rng, table->seed );
+  srandom( table->seed ); /* used for random port selection */
+
+  if( options->useLogFile ) {
+    /* create/open the log */
+    if( snprintf( name, MAX_LINE_LEN, "%s.log%s", table->matchName,
+		  options->logCompress ? LOG_COMPRESS_SUFFIX : "" ) < 0 ) {
+
+      fprintf( stderr, "ERROR: match file name too long %s\n",
+	       table->matchName );
+      return -1;
+    }
+    if( options->append ) {
+      table->logFile = fopen( name, "a+" );
+    } else {
+      table->logFile = fopen( name, "w" );
+    }
+    if( table->logFile == NULL ) {
+
+      fprintf( stderr, "ERROR: could not open log file %s\n", name );
+      return -1;
+    }
+    if( options->append
+	&& ( options->logCompress ? finishCompressedLog( table->logFile )
+	     : finishTextLog( table->logFile ) ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not end log file %s\n", name );
+      return -1;
+    }
+  } else {
+    /* no log file */
+
+    table->logFile = NULL;
+  }
+
+  if( options->useTransactionFile ) {
+    /* create/open the transaction log */
+
+    if( snprintf( name, MAX_LINE_LEN, "%s.tlog%s", table->matchName,
+		  options->logCompress ? LOG_COMPRESS_SUFFIX : "" ) < 0 ) {
+
+      fprintf( stderr, "ERROR: match file name too long %s\n",
+	       table->matchName );
+      return -1;
+    }
+    if( options->append ) {
+      table->transactionFile = fopen( name, "a+" );
+    } else {
+      table->transactionFile = fopen( name, "w" );
+    }
+    if( table->transactionFile == NULL ) {
+
+      fprintf( stderr, "ERROR: could not open transaction file %s\n", name );
+      return -1;
+    }
+    if( options->append
+	&& ( options->logCompress
+	     ? finishCompressedLog( table->transactionFile )
+	     : finishTextLog( table->transactionFile ) ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not end transaction file %s\n", name );
+      return -1;
+    }
+  } else {
+    /* no transaction file */
+
+    table->transactionFile = NULL;
+  }
+
+  /* set up the error info */
+  initErrorInfo( options->maxInvalidActions, options->maxResponseMicros,
+		 options->maxUsedHandMicros,
+		 options->maxUsedPerHandMicros * table->numHands,
+		 &table->errorInfo );
+
+  /* load the plugin players */
+  for( i = 0; i < MAX_PLAYERS; ++i ) {
+
+    table->plugin[ i ].player = NULL;
+    if( options->pluginFile[ i ] == NULL ) {
+      continue;
+    }
+
+    if( i >= table->game->numPlayers ) {
+
+      fprintf( stderr, "ERROR: plugin for seat %d, but match %s only has %d seats\n",
+	       i + 1, table->matchName, table->game->numPlayers );
+      return -1;
+    }
+    if( loadSeatPlugin( table->game, options->pluginFile[ i ],
+			options->pluginArgs[ i ], &table->plugin[ i ] ) < 0 ) {
+      /* error messages already handled in function */
+
+      return -1;
+    }
+  }
+
+  /* open sockets for players to connect to, with port 0 for plugins */
+  for( i = 0; i < table->game->numPlayers; ++i ) {
+
+    table->listenPort[ i ] = listenPort[ i ];
+    if( table->plugin[ i ].player != NULL ) {
+
+      table->listenPort[ i ] = 0;
+      table->listenSocket[ i ] = -1;
+      continue;
+    }
+    if( options->unixPrefix != NULL ) {
+
+      table->listenSocket[ i ] = getUnixListenSocket( options->unixPrefix,
+						      &table->listenPort[ i ] );
+    } else {
+
+      table->listenSocket[ i ] = getListenSocket( &table->listenPort[ i ] );
+    }
+    if( table->listenSocket[ i ] < 0 ) {
+
+      fprintf( stderr, "ERROR: could not create listen socket for player %d\n",
+	       i + 1 );
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* wait for a player to connect to each seat of a table, and create the
+   read buffers used to talk to them
+   returns >= 0 on success, -1 on failure */
+static int connectPlayers( Table *table, ReadBuf *readBuf[ MAX_PLAYERS ] )
+{
+  const DealerOptions *options = table->options;
+  int i, v;
+  EventLoop *loop;
+  SeatConnections connections;
+  int64_t startDeadline, startTimeLeft;
+  ShmChannel *shm;
+  char name[ MAX_LINE_LEN ];
+
+  /* wait for the players to connect, in any order */
+  connections.numConnected = 0;
+  loop = createEventLoop( &connections );
+  if( loop == NULL ) {
+
+    fprintf( stderr, "ERROR: could not create event loop\n" );
+    return -1;
+  }
+  connections.loop = loop;
+  for( i = 0; i < table->game->numPlayers; ++i ) {
+
+    connections.seatFD[ i ] = -1;
+    if( table->plugin[ i ].player != NULL ) {
+      /* nothing to wait for */
+
+      ++connections.numConnected;
+      continue;
+    }
+    connections.handler[ i ] = addEventHandler( loop, table->listenSocket[ i ],
+						acceptSeat,
+						&connections.seatFD[ i ] );
+    if( connections.handler[ i ] == NULL ) {
+
+      fprintf( stderr, "ERROR: could not wait for seat %d\n", i + 1 );
+      destroyEventLoop( loop );
+      return -1;
+    }
+  }
+  startDeadline = -1;
+  if( options->startTimeoutMicros >= 0 ) {
+
+    startDeadline = monotonicMicros() + options->startTimeoutMicros;
+  }
+  while( connections.numConnected < table->game->numPlayers ) {
+
+    startTimeLeft = -1;
+    if( startDeadline >= 0 ) {
+
+      startTimeLeft = startDeadline - monotonicMicros();
+      if( startTimeLeft < 0 ) {
+
+	startTimeLeft = 0;
+      }
+    }
+
+    if( runEventLoop( loop, startTimeLeft ) < 1 ) {
+      /* no one connected within time, or an actual error */
+
+      for( i = 0; connections.seatFD[ i ] >= 0
+	     || table->plugin[ i ].player != NULL; ++i );
+      fprintf( stderr, "ERROR: timed out waiting for seat %d to connect\n",
+	       i + 1 );
+      destroyEventLoop( loop );
+      return -1;
+    }
+  }
+  destroyEventLoop( loop );
+
+  for( i = 0; i < table->game->numPlayers; ++i ) {
+
+    if( table->plugin[ i ].player != NULL ) {
+
+      readBuf[ i ] = NULL;
+      continue;
+    }
+    if( options->unixPrefix != NULL ) {
+      /* everyone is connected, so the socket names aren't needed */
+
+      snprintf( name, MAX_LINE_LEN, "%s%"PRIu16,
+		options->unixPrefix, table->listenPort[ i ] );
+      unlink( name );
+    } else {
+
+      v = 1;
+      setsockopt( connections.seatFD[ i ], IPPROTO_TCP, TCP_NODELAY,
+		  (char *)&v, sizeof(int) );
+    }
+
+    if( options->useShm ) {
+
+      shm = offerShmChannel( connections.seatFD[ i ] );
+      if( shm == NULL ) {
+
+	fprintf( stderr, "ERROR: could not set up shared memory for seat %d\n",
+		 i + 1 );
+	return -1;
+      }
+      readBuf[ i ] = createShmReadBuf( shm );
+    } else {
+
+      readBuf[ i ] = createReadBuf( connections.seatFD[ i ] );
+    }
+    if( readBuf[ i ] == NULL ) {
+
+      fprintf( stderr, "ERROR: could not create read buffer for seat %d\n",
+	       i + 1 );
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* play the match at a table which has been set up, and close it
+   if scorePrefix is not NULL, it is printed before the score on
+   standard out
+   returns >= 0 if the match finished correctly, -1 on error */
+static int playTable( Table *table, const char *scorePrefix )
+{
+  const DealerOptions *options = table->options;
+  int i, r;
   ReadBuf *readBuf[ MAX_PLAYERS ];
-  Game *game;
-  rng_state_t rng;
-  ErrorInfo errorInfo;
-  struct sockaddr_in addr;
-  socklen_t addrLen;
-  char *seatName[ MAX_PLAYERS ];
+  LogWriter *logWriter, *transactionWriter;
 
-  int useLogFile, useTransactionFile;
-  uint64_t maxResponseMicros, maxUsedHandMicros, maxUsedPerHandMicros;
-  int64_t startTimeoutMicros;
-  uint32_t numHands, seed, maxInvalidActions;
+  /* everything goes to the files through writer threads */
+  r = 0;
+  logWriter = NULL;
+  transactionWriter = NULL;
+  if( table->logFile != NULL ) {
+
+    logWriter = createLogWriter( table->logFile, options->logFlushHands,
+				 options->logSync, options->logCompress );
+    if( logWriter == NULL ) {
+
+      fprintf( stderr, "ERROR: could not start writing log file\n" );
+      r = -1;
+    }
+  }
+  if( r >= 0 && table->transactionFile != NULL ) {
+
+    transactionWriter = createLogWriter( table->transactionFile,
+					 options->logFlushHands,
+					 options->logSync,
+					 options->logCompress );
+    if( transactionWriter == NULL ) {
+
+      fprintf( stderr, "ERROR: could not start writing transaction file\n" );
+      r = -1;
+    }
+  }
+
+  /* print out usage information */
+  if( r >= 0 ) {
+
+    r = printInitialMessage( table->matchName, table->gameName,
+			     table->numHands, table->seed,
+			     &table->errorInfo, logWriter );
+  }
+
+  /* play the match */
+  if( r >= 0 ) {
+
+    r = connectPlayers( table, readBuf );
+  }
+  if( r >= 0 ) {
+
+    r = gameLoop( table->game, table->seatName, table->numHands,
+		  options->quiet, options->fixedSeats, options->duplicate,
+		  options->textOnly,
+		  &table->rng, &table->errorInfo, readBuf, table->plugin,
+		  logWriter, transactionWriter, options->checkpointHands,
+		  scorePrefix );
+    for( i = 0; i < table->game->numPlayers; ++i ) {
+
+      if( readBuf[ i ] != NULL ) {
+	destroyReadBuf( readBuf[ i ] );
+      }
+    }
+  }
+
+  for( i = 0; i < table->game->numPlayers; ++i ) {
+
+    freeSeatPlugin( &table->plugin[ i ] );
+  }
+
+  /* wait for everything to be written */
+  if( transactionWriter != NULL && closeLogWriter( transactionWriter ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not write to transaction file\n" );
+    r = -1;
+  }
+  if( logWriter != NULL && closeLogWriter( logWriter ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not write to log file\n" );
+    r = -1;
+  }
+
+  if( table->transactionFile != NULL ) {
+    fclose( table->transactionFile );
+  }
+  if( table->logFile != NULL ) {
+    fclose( table->logFile );
+  }
+  free( table->game );
+
+  return r;
+}
+
+static void *tableThread( void *arg )
+{
+  Table *table = (Table *)arg;
+
+  table->result = playTable( table, table->matchName );
+  if( table->result < 0 ) {
+
+    fprintf( stderr, "ERROR: match %s failed\n", table->matchName );
+  }
+
+  return NULL;
+}
+
+/* set up a table for each line of a tables file, which has the same
+   arguments as a single match (match name, game, hands, seed, names)
+   separated by white space, optionally followed by a port string.
+   Blank lines and lines starting with # are skipped
+   returns number of tables, or -1 on failure */
+static int readTableFile( const char *filename, const DealerOptions *options,
+			  Table **tables )
+{
+  int numTables, maxTables, numArgs, lineNum, i;
+  FILE *file;
+  char *token, *args[ MAX_PLAYERS + 5 ];
   uint16_t listenPort[ MAX_PLAYERS ];
+  char line[ MAX_LINE_LEN ];
+
+  file = fopen( filename, "r" );
+  if( file == NULL ) {
 
-  struct timeval startTime, tv;
+    fprintf( stderr, "ERROR: could not open tables file %s\n", filename );
+    return -1;
+  }
+
+  numTables = 0;
+  maxTables = 0;
+  *tables = NULL;
+  lineNum = 0;
+  while( fgets( line, MAX_LINE_LEN, file ) ) {
+    ++lineNum;
+
+    /* split the line into arguments, which are kept for the table */
+    numArgs = 0;
+    for( token = strtok( line, " \t\r\n" );
+	 token != NULL && numArgs < MAX_PLAYERS + 5;
+	 token = strtok( NULL, " \t\r\n" ) ) {
+
+      args[ numArgs ] = strdup( token );
+      ++numArgs;
+    }
+    if( numArgs == 0 || args[ 0 ][ 0 ] == '#' ) {
+      continue;
+    }
+
+    if( numTables == maxTables ) {
+
+      maxTables = maxTables ? maxTables * 2 : 16;
+      *tables = (Table *)realloc( *tables, maxTables * sizeof( Table ) );
+      if( *tables == NULL ) {
+
+	fprintf( stderr, "ERROR: could not allocate tables\n" );
+	fclose( file );
+	return -1;
+      }
+    }
+
+    for( i = 0; i < MAX_PLAYERS; ++i ) {
+
+      listenPort[ i ] = 0;
+    }
+    if( numArgs >= 5 && strchr( args[ numArgs - 1 ], ',' ) != NULL ) {
+      /* the ports are given */
+
+      if( scanPortString( args[ numArgs - 1 ], listenPort ) < 0 ) {
+
+	fprintf( stderr, "ERROR: bad port string %s on line %d of %s\n",
+		 args[ numArgs - 1 ], lineNum, filename );
+	fclose( file );
+	return -1;
+      }
+      --numArgs;
+    }
+
+    if( setUpTable( options, numArgs, args, listenPort,
+		    &( *tables )[ numTables ] ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not set up match on line %d of %s\n",
+	       lineNum, filename );
+      fclose( file );
+      return -1;
+    }
+    ++numTables;
+  }
+  fclose( file );
+
+  return numTables;
+}
+
+int main( int argc, char **argv )
+{
+  int i, t, numTables, longOpt;
+  DealerOptions options;
+  Table table, *tables;
+  char *tablesFile;
+  pthread_t *threads;
+  uint16_t listenPort[ MAX_PLAYERS ];
 
-  char name[ MAX_LINE_LEN ];
   static struct option longOptions[] = {
     { "t_response", 1, 0, 0 },
     { "t_hand", 1, 0, 0 },
     { "t_per_hand", 1, 0, 0 },
     { "start_timeout", 1, 0, 0 },
+    { "text_only", 0, 0, 0 },
+    { "unix", 1, 0, 0 },
+    { "shm", 1, 0, 0 },
+    { "tables", 1, 0, 0 },
+    { "duplicate", 0, 0, 0 },
+    { "plugin", 1, 0, 0 },
+    { "log_flush", 1, 0, 0 },
+    { "log_sync", 0, 0, 0 },
+    { "log_compress", 0, 0, 0 },
+    { "checkpoint", 1, 0, 0 },
     { 0, 0, 0, 0 }
   };
 
   /* set defaults */
 
   /* game error conditions */
-  maxInvalidActions = DEFAULT_MAX_INVALID_ACTIONS;
-  maxResponseMicros = DEFAULT_MAX_RESPONSE_MICROS;
-  maxUsedHandMicros = DEFAULT_MAX_USED_HAND_MICROS;
-  maxUsedPerHandMicros = DEFAULT_MAX_USED_PER_HAND_MICROS;
+  options.maxInvalidActions = DEFAULT_MAX_INVALID_ACTIONS;
+  options.maxResponseMicros = DEFAULT_MAX_RESPONSE_MICROS;
+  options.maxUsedHandMicros = DEFAULT_MAX_USED_HAND_MICROS;
+  options.maxUsedPerHandMicros = DEFAULT_MAX_USED_PER_HAND_MICROS;
 
   /* use random ports */
   for( i = 0; i < MAX_PLAYERS; ++i ) {
@@ -945,20 +2647,43 @@ int main( int argc, char **argv )
   }
 
   /* use log file, don't use transaction file */
-  useLogFile = 1;
-  useTransactionFile = 0;
+  options.useLogFile = 1;
+  options.useTransactionFile = 0;
+
+  /* flush the files after every hand, without syncing */
+  options.logFlushHands = 1;
+  options.logSync = 0;
+  options.logCompress = 0;
+
+  /* checkpoint the transaction file every so often */
+  options.checkpointHands = DEFAULT_CHECKPOINT_HANDS;
 
   /* print all messages */
-  quiet = 0;
+  options.quiet = 0;
 
   /* by default, overwrite preexisting log/transaction files */
-  append = 0;
+  options.append = 0;
 
   /* players rotate around the table */
-  fixedSeats = 0;
+  options.fixedSeats = 0;
+  options.duplicate = 0;
 
   /* no timeout on startup */
-  startTimeoutMicros = -1;
+  options.startTimeoutMicros = -1;
+
+  /* players can ask for protocol extensions */
+  options.textOnly = 0;
+
+  /* players connect over TCP */
+  options.unixPrefix = NULL;
+  options.useShm = 0;
+  for( i = 0; i < MAX_PLAYERS; ++i ) {
+
+    options.pluginFile[ i ] = NULL;
+  }
+
+  /* run a single match from the command line */
+  tablesFile = NULL;
 
   /* parse options */
   while( 1 ) {
@@ -977,7 +2702,7 @@ int main( int argc, char **argv )
       case 0:
 	/* t_response */
 
-	if( sscanf( optarg, "%"SCNu64, &maxResponseMicros ) < 1 ) {
+	if( sscanf( optarg, "%"SCNu64, &options.maxResponseMicros ) < 1 ) {
 
 	  fprintf( stderr, "ERROR: could not get response timeout from %s\n",
 		   optarg );
@@ -985,13 +2710,13 @@ int main( int argc, char **argv )
 	}
 
 	/* convert from milliseconds to microseconds */
-	maxResponseMicros *= 1000;
+	options.maxResponseMicros *= 1000;
 	break;
 
       case 1:
 	/* t_hand */
 
-	if( sscanf( optarg, "%"SCNu64, &maxUsedHandMicros ) < 1 ) {
+	if( sscanf( optarg, "%"SCNu64, &options.maxUsedHandMicros ) < 1 ) {
 
 	  fprintf( stderr,
 		   "ERROR: could not get player hand timeout from %s\n",
@@ -1000,35 +2725,114 @@ int main( int argc, char **argv )
 	}
 
 	/* convert from milliseconds to microseconds */
-	maxUsedHandMicros *= 1000;
+	options.maxUsedHandMicros *= 1000;
 	break;
 
       case 2:
 	/* t_per_hand */
 
-	if( sscanf( optarg, "%"SCNu64, &maxUsedPerHandMicros ) < 1 ) {
+	if( sscanf( optarg, "%"SCNu64, &options.maxUsedPerHandMicros ) < 1 ) {
 
 	  fprintf( stderr, "ERROR: could not get average player hand timeout from %s\n", optarg );
 	  exit( EXIT_FAILURE );
 	}
 
 	/* convert from milliseconds to microseconds */
-	maxUsedPerHandMicros *= 1000;
+	options.maxUsedPerHandMicros *= 1000;
 	break;
 
       case 3:
 	/* start_timeout */
 
-	if( sscanf( optarg, "%"SCNd64, &startTimeoutMicros ) < 1 ) {
+	if( sscanf( optarg, "%"SCNd64, &options.startTimeoutMicros ) < 1 ) {
 
 	  fprintf( stderr, "ERROR: could not get start timeout %s\n", optarg );
 	  exit( EXIT_FAILURE );
 	}
 
 	/* convert from milliseconds to microseconds */
-	if( startTimeoutMicros > 0 ) {
+	if( options.startTimeoutMicros > 0 ) {
+
+	  options.startTimeoutMicros *= 1000;
+	}
+	break;
+
+      case 4:
+	/* text_only */
+
+	options.textOnly = 1;
+	break;
+
+      case 5:
+	/* unix */
+
+	options.unixPrefix = optarg;
+	options.useShm = 0;
+	break;
+
+      case 6:
+	/* shm */
+
+	options.unixPrefix = optarg;
+	options.useShm = 1;
+	break;
+
+      case 7:
+	/* tables */
+
+	tablesFile = optarg;
+	break;
+
+      case 8:
+	/* duplicate */
+
+	options.duplicate = 1;
+	break;
 
-	  startTimeoutMicros *= 1000;
+      case 9:
+	/* plugin */
+
+	if( scanPluginString( optarg, &options ) < 0 ) {
+
+	  fprintf( stderr, "ERROR: bad plugin string %s\n", optarg );
+	  exit( EXIT_FAILURE );
+	}
+	break;
+
+      case 10:
+	/* log_flush */
+
+	if( sscanf( optarg, "%"SCNu32, &options.logFlushHands ) < 1 ) {
+
+	  fprintf( stderr, "ERROR: could not get hands between log flushes from %s\n", optarg );
+	  exit( EXIT_FAILURE );
+	}
+	break;
+
+      case 11:
+	/* log_sync */
+
+	options.logSync = 1;
+	break;
+
+      case 12:
+	/* log_compress */
+
+	if( !logCompressionAvailable() ) {
+
+	  fprintf( stderr, "ERROR: dealer was built without LOG_COMPRESSION\n" );
+	  exit( EXIT_FAILURE );
+	}
+	options.logCompress = 1;
+	break;
+
+      case 13:
+	/* checkpoint */
+
+	if( sscanf( optarg, "%"SCNu32, &options.checkpointHands ) < 1 ) {
+
+	  fprintf( stderr, "ERROR: could not get hands between checkpoints from %s\n", optarg );
+	  exit( EXIT_FAILURE );
 	}
 	break;
 
@@ -1038,19 +2842,19 @@ int main( int argc, char **argv )
     case 'f':
       /* fix the player seats */;
 
-      fixedSeats = 1;
+      options.fixedSeats = 1;
       break;
 
     case 'l':
       /* no transactionFile */;
 
-      useLogFile = 0;
+      options.useLogFile = 0;
       break;
 
     case 'L':
       /* use transactionFile */;
 
-      useLogFile = 1;
+      options.useLogFile = 1;
       break;
 
     case 'p':
@@ -1066,24 +2870,24 @@ int main( int argc, char **argv )
 
     case 'q':
 
-      quiet = 1;
+      options.quiet = 1;
       break;
 
     case 't':
       /* no transactionFile */
 
-      useTransactionFile = 0;
+      options.useTransactionFile = 0;
       break;
 
     case 'T':
       /* use transactionFile */
 
-      useTransactionFile = 1;
+      options.useTransactionFile = 1;
       break;
 
     case 'a':
 
-      append = 1;
+      options.append = 1;
       break;
 
     default:
@@ -1093,183 +2897,81 @@ int main( int argc, char **argv )
     }
   }
 
-  if( optind + 4 > argc ) {
-
-    printUsage( stdout, 0 );
-    exit( EXIT_FAILURE );
-  }
-
-  /* get the game definition */
-  file = fopen( argv[ optind + 1 ], "r" );
-  if( file == NULL ) {
-
-    fprintf( stderr, "ERROR: could not open game definition %s\n",
-	     argv[ optind + 1 ] );
-    exit( EXIT_FAILURE );
-  }
-  game = readGame( file );
-  if( game == NULL ) {
-
-    fprintf( stderr, "ERROR: could not read game %s\n", argv[ optind + 1 ] );
-    exit( EXIT_FAILURE );
-  }
-  fclose( file );
-
-  /* save the seat names */
-  if( optind + 4 + game->numPlayers > argc ) {
-
-    printUsage( stdout, 0 );
-    exit( EXIT_FAILURE );
-  }
-  for( i = 0; i < game->numPlayers; ++i ) {
-
-    seatName[ i ] = argv[ optind + 4 + i ];
-  }
-
-  /* get number of hands */
-  if( sscanf( argv[ optind + 2 ], "%"SCNu32, &numHands ) < 1
-      || numHands == 0 ) {
-
-    fprintf( stderr, "ERROR: invalid number of hands %s\n",
-	     argv[ optind + 2 ] );
-    exit( EXIT_FAILURE );
-  }
-
-  /* get random number seed */
-  if( sscanf( argv[ optind + 3 ], "%"SCNu32, &seed ) < 1 ) {
-
-    fprintf( stderr, "ERROR: invalid random number seed %s\n",
-	     argv[ optind + 3 ] );
-    exit( EXIT_FAILURE );
-  }
-  init_genrand( &rng, seed );
-  srandom( seed ); /* used for random port selection */
+  if( tablesFile != NULL ) {
+    /* run every match in the tables file at once */
 
-  if( useLogFile ) {
-    /* create/open the log */
-    if( snprintf( name, MAX_LINE_LEN, "%s.log", argv[ optind ] ) < 0 ) {
+    numTables = readTableFile( tablesFile, &options, &tables );
+    if( numTables <= 0 ) {
 
-      fprintf( stderr, "ERROR: match file name too long %s\n", argv[ optind ] );
+      fprintf( stderr, "ERROR: no matches to play in %s\n", tablesFile );
       exit( EXIT_FAILURE );
     }
-    if (append) {
-      logFile = fopen( name, "a+" );
-    } else {
-      logFile = fopen( name, "w" );
-    }
-    if( logFile == NULL ) {
 
-      fprintf( stderr, "ERROR: could not open log file %s\n", name );
-      exit( EXIT_FAILURE );
-    }
-  } else {
-    /* no log file */
+    /* print out the match names and port assignments */
+    for( t = 0; t < numTables; ++t ) {
 
-    logFile = NULL;
-  }
+      printf( "%s", tables[ t ].matchName );
+      for( i = 0; i < tables[ t ].game->numPlayers; ++i ) {
 
-  if( useTransactionFile ) {
-    /* create/open the transaction log */
+	printf( " %"PRIu16, tables[ t ].listenPort[ i ] );
+      }
+      printf( "\n" );
+    }
+    fflush( stdout );
 
-    if( snprintf( name, MAX_LINE_LEN, "%s.tlog", argv[ optind ] ) < 0 ) {
+    /* play the matches, each in its own thread */
+    threads = (pthread_t *)malloc( numTables * sizeof( pthread_t ) );
+    if( threads == NULL ) {
 
-      fprintf( stderr, "ERROR: match file name too long %s\n", argv[ optind ] );
+      fprintf( stderr, "ERROR: could not allocate threads\n" );
       exit( EXIT_FAILURE );
     }
-    if (append) {
-      transactionFile = fopen( name, "a+" );
-    } else {
-      transactionFile = fopen( name, "w" );
+    for( t = 0; t < numTables; ++t ) {
+
+      if( pthread_create( &threads[ t ], NULL,
+			  tableThread, &tables[ t ] ) != 0 ) {
+
+	fprintf( stderr, "ERROR: could not start match %s\n",
+		 tables[ t ].matchName );
+	exit( EXIT_FAILURE );
+      }
     }
-    if( transactionFile == NULL ) {
+    i = EXIT_SUCCESS;
+    for( t = 0; t < numTables; ++t ) {
 
-      fprintf( stderr, "ERROR: could not open transaction file %s\n", name );
-      exit( EXIT_FAILURE );
+      pthread_join( threads[ t ], NULL );
+      if( tables[ t ].result < 0 ) {
+
+	i = EXIT_FAILURE;
+      }
     }
-  } else {
-    /* no transaction file */
 
-    transactionFile = NULL;
+    fflush( stderr );
+    fflush( stdout );
+    return i;
   }
 
-  /* set up the error info */
-  initErrorInfo( maxInvalidActions, maxResponseMicros, maxUsedHandMicros,
-		 maxUsedPerHandMicros * numHands, &errorInfo );
-
-  /* open sockets for players to connect to */
-  for( i = 0; i < game->numPlayers; ++i ) {
+  if( optind + 4 > argc ) {
 
-    listenSocket[ i ] = getListenSocket( &listenPort[ i ] );
-    if( listenSocket[ i ] < 0 ) {
+    printUsage( stdout, 0 );
+    exit( EXIT_FAILURE );
+  }
+  if( setUpTable( &options, argc - optind, &argv[ optind ],
+		  listenPort, &table ) < 0 ) {
+    /* error messages already handled in function */
 
-      fprintf( stderr, "ERROR: could not create listen socket for player %d\n",
-	       i + 1 );
-      exit( EXIT_FAILURE );
-    }
+    exit( EXIT_FAILURE );
   }
 
   /* print out the final port assignments */
-  for( i = 0; i < game->numPlayers; ++i ) {
+  for( i = 0; i < table.game->numPlayers; ++i ) {
 
-    printf( i ? " %"PRIu16 : "%"PRIu16, listenPort[ i ] );
+    printf( i ? " %"PRIu16 : "%"PRIu16, table.listenPort[ i ] );
   }
   printf( "\n" );
   fflush( stdout );
 
-  /* print out usage information */
-  printInitialMessage( argv[ optind ], argv[ optind + 1 ],
-		       numHands, seed, &errorInfo, logFile );
-
-  /* wait for each player to connect */
-  gettimeofday( &startTime, NULL );
-  for( i = 0; i < game->numPlayers; ++i ) {
-
-    if( startTimeoutMicros >= 0 ) {
-      uint64_t startTimeLeft;
-      fd_set fds;
-
-      gettimeofday( &tv, NULL );
-      startTimeLeft = startTimeoutMicros
-	- (uint64_t)( tv.tv_sec - startTime.tv_sec ) * 1000000
-	- ( tv.tv_usec - startTime.tv_usec );
-      if( startTimeLeft < 0 ) {
-
-	startTimeLeft = 0;
-      }
-      tv.tv_sec = startTimeLeft / 1000000;
-      tv.tv_usec = startTimeLeft % 1000000;
-
-      FD_ZERO( &fds );
-      FD_SET( listenSocket[ i ], &fds );
-      if( select( listenSocket[ i ] + 1, &fds, NULL, NULL, &tv ) < 1 ) {
-	/* no input ready within time, or an actual error */
-
-	fprintf( stderr, "ERROR: timed out waiting for seat %d to connect\n",
-		 i + 1 );
-	exit( EXIT_FAILURE );
-      }
-    }
-
-    addrLen = sizeof( addr );
-    seatFD[ i ] = accept( listenSocket[ i ],
-			  (struct sockaddr *)&addr, &addrLen );
-    if( seatFD[ i ] < 0 ) {
-
-      fprintf( stderr, "ERROR: seat %d could not connect\n", i + 1 );
-      exit( EXIT_FAILURE );
-    }
-    close( listenSocket[ i ] );
-
-    v = 1;
-    setsockopt( seatFD[ i ], IPPROTO_TCP, TCP_NODELAY,
-		(char *)&v, sizeof(int) );
-
-    readBuf[ i ] = createReadBuf( seatFD[ i ] );
-  }
-
-  /* play the match */
-  if( gameLoop( game, seatName, numHands, quiet, fixedSeats, &rng, &errorInfo,
-		seatFD, readBuf, logFile, transactionFile ) < 0 ) {
+  if( playTable( &table, NULL ) < 0 ) {
     /* should have already printed an error message */
 
     exit( EXIT_FAILURE );
@@ -1277,13 +2979,6 @@ int main( int argc, char **argv )
 
   fflush( stderr );
   fflush( stdout );
-  if( transactionFile != NULL ) {
-    fclose( transactionFile );
-  }
-  if( logFile != NULL ) {
-    fclose( logFile );
-  }
-  free( game );
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,508 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "equity.h"
+#include "evaluator.h"
+#include "rng.h"
+
+
+/* largest number of suit permutations (4!) */
+#define MAX_SUIT_PERMS 24
+
+
+/* running totals for one thread */
+typedef struct {
+  double win[ MAX_PLAYERS ];
+  double tie[ MAX_PLAYERS ];
+  double share[ MAX_PLAYERS ];
+  double shareSq[ MAX_PLAYERS ];
+  uint64_t numRunouts;
+  uint64_t numEvaluated;
+} EquityTally;
+
+/* everything the worker threads share */
+typedef struct {
+  int numPlayers;
+  int numHoleCards;
+  uint8_t holeCards[ MAX_PLAYERS ][ MAX_HOLE_CARDS ];
+
+  /* known board cards */
+  HandPrefix board;
+
+  /* number of board cards still to come, and the cards they come from */
+  int numRunoutCards;
+  int deckSize;
+  uint8_t deck[ MAX_SUITS * MAX_RANKS ];
+
+  /* suit permutations which leave every hand and the board unchanged
+     perm[ 0 ] is always the identity */
+  int numPerms;
+  uint8_t perm[ MAX_SUIT_PERMS ][ MAX_SUITS ];
+
+  /* next first runout card to be enumerated, or samples to draw */
+  pthread_mutex_t lock;
+  int nextFirstCard;
+  uint64_t samplesLeft;
+  uint32_t nextSeed;
+
+  int sampling;
+} EquityWork;
+
+
+void initEquityOptions( EquityOptions *options )
+{
+  options->numThreads = 0;
+  options->maxEnumeration = DEFAULT_EQUITY_MAX_ENUMERATION;
+  options->numSamples = DEFAULT_EQUITY_SAMPLES;
+  options->seed = 0;
+  options->useIsomorphism = 1;
+}
+
+/* number of ways to choose k items from n, saturating at UINT64_MAX */
+static uint64_t choose( const int n, const int k )
+{
+  int i;
+  uint64_t r;
+
+  if( k < 0 || k > n ) {
+    return 0;
+  }
+
+  r = 1;
+  for( i = 1; i <= k; ++i ) {
+
+    if( r > UINT64_MAX / ( n - k + i ) ) {
+      return UINT64_MAX;
+    }
+    r = r * ( n - k + i ) / i;
+  }
+
+  return r;
+}
+
+static Cardset permuteCardset( const uint8_t perm[ MAX_SUITS ],
+			       const Cardset cards )
+{
+  int s;
+  Cardset c;
+
+  for( s = 0; s < MAX_SUITS; ++s ) {
+
+    c.bySuit[ perm[ s ] ] = cards.bySuit[ s ];
+  }
+
+  return c;
+}
+
+/* find all permutations of the suits which map each player's hand and
+   the board onto themselves, so any two runouts related by one of the
+   permutations give every player the same result */
+static void findSuitPerms( const Game *game, const Cardset *hands,
+			   const int numHands, EquityWork *work )
+{
+  int s, i, h, ok;
+  uint8_t perm[ MAX_SUITS ];
+
+  work->numPerms = 0;
+
+  /* walk through all permutations in lexicographic order, starting with
+     the identity */
+  for( s = 0; s < MAX_SUITS; ++s ) {
+    perm[ s ] = s;
+  }
+  while( 1 ) {
+
+    ok = 1;
+    for( s = 0; s < MAX_SUITS && ok; ++s ) {
+
+      /* suits not in the deck can't be swapped with suits that are */
+      if( ( s < MAX_SUITS - game->numSuits )
+	  != ( perm[ s ] < MAX_SUITS - game->numSuits ) ) {
+	ok = 0;
+      }
+    }
+    for( h = 0; h < numHands && ok; ++h ) {
+
+      if( permuteCardset( perm, hands[ h ] ).cards != hands[ h ].cards ) {
+	ok = 0;
+      }
+    }
+    if( ok ) {
+
+      memcpy( work->perm[ work->numPerms ], perm, MAX_SUITS );
+      ++work->numPerms;
+    }
+
+    /* move on to the next permutation */
+    for( i = MAX_SUITS - 2; i >= 0 && perm[ i ] > perm[ i + 1 ]; --i );
+    if( i < 0 ) {
+      break;
+    }
+    for( s = MAX_SUITS - 1; perm[ s ] < perm[ i ]; --s );
+    h = perm[ i ];
+    perm[ i ] = perm[ s ];
+    perm[ s ] = h;
+    for( ++i, s = MAX_SUITS - 1; i < s; ++i, --s ) {
+      h = perm[ i ];
+      perm[ i ] = perm[ s ];
+      perm[ s ] = h;
+    }
+  }
+}
+
+/* returns the number of runouts runout stands for, which is 0 if there
+   is an equivalent runout which is evaluated instead */
+static int runoutWeight( const EquityWork *work, const Cardset runout )
+{
+  int i, numFixed;
+  Cardset c;
+
+  numFixed = 1;
+  for( i = 1; i < work->numPerms; ++i ) {
+
+    c = permuteCardset( work->perm[ i ], runout );
+    if( c.cards < runout.cards ) {
+      /* only evaluate the smallest runout of the equivalent set */
+
+      return 0;
+    }
+    if( c.cards == runout.cards ) {
+      ++numFixed;
+    }
+  }
+
+  return work->numPerms / numFixed;
+}
+
+/* rank every player on a complete board and add the results */
+static void tallyRunout( const EquityWork *work, const HandPrefix *board,
+			 const int weight, EquityTally *tally )
+{
+  int p, best, numBest;
+  int rank[ MAX_PLAYERS ];
+  double share;
+
+  best = -1;
+  numBest = 0;
+  for( p = 0; p < work->numPlayers; ++p ) {
+
+    rank[ p ] = rankHandPrefix( board, work->numHoleCards,
+				work->holeCards[ p ] );
+    if( rank[ p ] > best ) {
+
+      best = rank[ p ];
+      numBest = 1;
+    } else if( rank[ p ] == best ) {
+
+      ++numBest;
+    }
+  }
+
+  share = 1.0 / numBest;
+  for( p = 0; p < work->numPlayers; ++p ) {
+
+    if( rank[ p ] == best ) {
+
+      if( numBest == 1 ) {
+	tally->win[ p ] += weight;
+      } else {
+	tally->tie[ p ] += weight;
+      }
+      tally->share[ p ] += share * weight;
+      tally->shareSq[ p ] += share * share * weight;
+    }
+  }
+
+  tally->numRunouts += weight;
+  ++tally->numEvaluated;
+}
+
+/* enumerate all runouts with cards after deck[ start ] */
+static void enumerateRunouts( const EquityWork *work, const HandPrefix *board,
+			      const Cardset runout, const int cardsLeft,
+			      const int start, EquityTally *tally )
+{
+  int i, weight;
+  HandPrefix next;
+  Cardset c;
+
+  if( cardsLeft == 0 ) {
+
+    weight = work->numPerms > 1 ? runoutWeight( work, runout ) : 1;
+    if( weight ) {
+      tallyRunout( work, board, weight, tally );
+    }
+    return;
+  }
+
+  for( i = start; i <= work->deckSize - cardsLeft; ++i ) {
+
+    extendHandPrefix( board, work->deck[ i ], &next );
+    c.cards = runout.cards | cardToCardset( work->deck[ i ] ).cards;
+    enumerateRunouts( work, &next, c, cardsLeft - 1, i + 1, tally );
+  }
+}
+
+/* draw numSamples random runouts */
+static void sampleRunouts( const EquityWork *work, const uint32_t seed,
+			   const uint64_t numSamples, EquityTally *tally )
+{
+  int i, j;
+  uint64_t n;
+  uint8_t deck[ MAX_SUITS * MAX_RANKS ], t;
+  rng_state_t rng;
+  HandPrefix board;
+
+  init_genrand( &rng, seed );
+  memcpy( deck, work->deck, work->deckSize );
+
+  for( n = 0; n < numSamples; ++n ) {
+
+    /* partial shuffle to get the runout cards */
+    board = work->board;
+    for( i = 0; i < work->numRunoutCards; ++i ) {
+
+      j = i + genrand_int32( &rng ) % ( work->deckSize - i );
+      t = deck[ i ];
+      deck[ i ] = deck[ j ];
+      deck[ j ] = t;
+      extendHandPrefix( &board, deck[ i ], &board );
+    }
+
+    tallyRunout( work, &board, 1, tally );
+  }
+}
+
+static void *equityThread( void *arg )
+{
+  EquityWork *work = (EquityWork *)arg;
+  EquityTally *tally;
+  HandPrefix board;
+  uint64_t n;
+  uint32_t seed;
+  int i;
+
+  tally = (EquityTally *)calloc( 1, sizeof( *tally ) );
+  if( tally == NULL ) {
+    return NULL;
+  }
+  n = 0;
+  seed = 0;
+
+  while( 1 ) {
+
+    /* get the next piece of work */
+    pthread_mutex_lock( &work->lock );
+    if( work->sampling ) {
+
+      n = work->samplesLeft < 10000 ? work->samplesLeft : 10000;
+      work->samplesLeft -= n;
+      seed = work->nextSeed;
+      ++work->nextSeed;
+      i = n ? 0 : -1;
+    } else {
+
+      i = work->nextFirstCard;
+      ++work->nextFirstCard;
+      if( i > work->deckSize - work->numRunoutCards
+	  || ( work->numRunoutCards == 0 && i > 0 ) ) {
+	i = -1;
+      }
+    }
+    pthread_mutex_unlock( &work->lock );
+    if( i < 0 ) {
+      break;
+    }
+
+    if( work->sampling ) {
+
+      sampleRunouts( work, seed, n, tally );
+    } else if( work->numRunoutCards == 0 ) {
+
+      tallyRunout( work, &work->board, 1, tally );
+    } else {
+
+      extendHandPrefix( &work->board, work->deck[ i ], &board );
+      enumerateRunouts( work, &board, cardToCardset( work->deck[ i ] ),
+			work->numRunoutCards - 1, i + 1, tally );
+    }
+  }
+
+  return tally;
+}
+
+int computeEquity( const Game *game, const int numPlayers,
+		   uint8_t holeCards[][ MAX_HOLE_CARDS ],
+		   const int numBoardCards, const uint8_t *boardCards,
+		   const EquityOptions *options, EquityResult *result )
+{
+  int p, i, r, s, numThreads;
+  Cardset used, c, hands[ MAX_PLAYERS + 1 ];
+  EquityWork work;
+  EquityTally total, *tally;
+  pthread_t thread[ 256 ];
+  double n, mean;
+
+  if( numPlayers < 2 || numPlayers > MAX_PLAYERS ) {
+
+    fprintf( stderr, "ERROR: invalid number of players %d\n", numPlayers );
+    return -1;
+  }
+  if( numBoardCards > sumBoardCards( game, game->numRounds - 1 ) ) {
+
+    fprintf( stderr, "ERROR: too many board cards\n" );
+    return -1;
+  }
+
+  /* collect the known cards, checking for duplicates */
+  used = emptyCardset();
+  work.numPlayers = numPlayers;
+  work.numHoleCards = game->numHoleCards;
+  for( p = 0; p <= numPlayers; ++p ) {
+
+    hands[ p ] = emptyCardset();
+    for( i = 0; i < ( p < numPlayers ? game->numHoleCards : numBoardCards );
+	 ++i ) {
+
+      r = p < numPlayers ? holeCards[ p ][ i ] : boardCards[ i ];
+      if( rankOfCard( r ) < MAX_RANKS - game->numRanks
+	  || suitOfCard( r ) < MAX_SUITS - game->numSuits
+	  || r >= MAX_SUITS * MAX_RANKS ) {
+
+	fprintf( stderr, "ERROR: card %d is not in the deck\n", r );
+	return -1;
+      }
+      c = cardToCardset( r );
+      if( c.cards & used.cards ) {
+
+	fprintf( stderr, "ERROR: card %d is used more than once\n", r );
+	return -1;
+      }
+      used.cards |= c.cards;
+      hands[ p ].cards |= c.cards;
+      if( p < numPlayers ) {
+	work.holeCards[ p ][ i ] = r;
+      }
+    }
+  }
+  initHandPrefix( &work.board, numBoardCards, boardCards,
+		  game->numHoleCards );
+
+  /* the remaining cards, in the same order dealCards uses */
+  work.deckSize = 0;
+  for( s = MAX_SUITS - game->numSuits; s < MAX_SUITS; ++s ) {
+
+    for( r = MAX_RANKS - game->numRanks; r < MAX_RANKS; ++r ) {
+
+      if( !( cardToCardset( makeCard( r, s ) ).cards & used.cards ) ) {
+
+	work.deck[ work.deckSize ] = makeCard( r, s );
+	++work.deckSize;
+      }
+    }
+  }
+  work.numRunoutCards = sumBoardCards( game, game->numRounds - 1 )
+    - numBoardCards;
+  if( work.numRunoutCards > work.deckSize ) {
+
+    fprintf( stderr, "ERROR: not enough cards left for the board\n" );
+    return -1;
+  }
+
+  /* decide whether we can enumerate everything */
+  work.sampling = choose( work.deckSize, work.numRunoutCards )
+    > options->maxEnumeration;
+  if( work.sampling || !options->useIsomorphism ) {
+
+    work.numPerms = 1;
+    for( s = 0; s < MAX_SUITS; ++s ) {
+      work.perm[ 0 ][ s ] = s;
+    }
+  } else {
+
+    findSuitPerms( game, hands, numPlayers + 1, &work );
+  }
+  work.nextFirstCard = 0;
+  work.samplesLeft = options->numSamples;
+  work.nextSeed = options->seed;
+  pthread_mutex_init( &work.lock, NULL );
+
+  /* do the work */
+  numThreads = options->numThreads;
+  if( numThreads <= 0 ) {
+
+    numThreads = sysconf( _SC_NPROCESSORS_ONLN );
+  }
+  if( numThreads < 1 ) {
+    numThreads = 1;
+  } else if( numThreads > 256 ) {
+    numThreads = 256;
+  }
+  for( i = 0; i < numThreads; ++i ) {
+
+    if( pthread_create( &thread[ i ], NULL, equityThread, &work ) ) {
+
+      fprintf( stderr, "ERROR: could not start equity thread\n" );
+      numThreads = i;
+      break;
+    }
+  }
+
+  memset( &total, 0, sizeof( total ) );
+  r = numThreads ? 0 : -1;
+  for( i = 0; i < numThreads; ++i ) {
+
+    pthread_join( thread[ i ], (void **)&tally );
+    if( tally == NULL ) {
+
+      fprintf( stderr, "ERROR: equity thread failed\n" );
+      r = -1;
+      continue;
+    }
+
+    for( p = 0; p < numPlayers; ++p ) {
+
+      total.win[ p ] += tally->win[ p ];
+      total.tie[ p ] += tally->tie[ p ];
+      total.share[ p ] += tally->share[ p ];
+      total.shareSq[ p ] += tally->shareSq[ p ];
+    }
+    total.numRunouts += tally->numRunouts;
+    total.numEvaluated += tally->numEvaluated;
+    free( tally );
+  }
+  pthread_mutex_destroy( &work.lock );
+  if( r < 0 || total.numRunouts == 0 ) {
+    return -1;
+  }
+
+  /* convert the totals to fractions */
+  n = (double)total.numRunouts;
+  for( p = 0; p < numPlayers; ++p ) {
+
+    result->win[ p ] = total.win[ p ] / n;
+    result->tie[ p ] = total.tie[ p ] / n;
+    result->loss[ p ] = 1.0 - result->win[ p ] - result->tie[ p ];
+    result->equity[ p ] = total.share[ p ] / n;
+
+    result->stdErr[ p ] = 0.0;
+    if( work.sampling && n > 1 ) {
+
+      mean = result->equity[ p ];
+      result->stdErr[ p ] = sqrt( ( total.shareSq[ p ] / n - mean * mean )
+				  / ( n - 1 ) );
+    }
+  }
+  result->numRunouts = total.numRunouts;
+  result->numEvaluated = total.numEvaluated;
+  result->exact = !work.sampling;
+
+  return 0;
+}
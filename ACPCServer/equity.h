@@ -0,0 +1,73 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _EQUITY_H
+#define _EQUITY_H
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "game.h"
+
+
+#define DEFAULT_EQUITY_MAX_ENUMERATION 20000000
+#define DEFAULT_EQUITY_SAMPLES 1000000
+
+
+typedef struct {
+  /* number of worker threads to use, or 0 for one per CPU */
+  int numThreads;
+
+  /* enumerate every runout if there are at most this many,
+     otherwise use Monte Carlo sampling */
+  uint64_t maxEnumeration;
+
+  /* number of runouts to sample for Monte Carlo */
+  uint64_t numSamples;
+
+  /* random number seed for Monte Carlo */
+  uint32_t seed;
+
+  /* if non-zero, only evaluate one runout out of each set of runouts
+     which are the same up to a permutation of the suits */
+  int useIsomorphism;
+} EquityOptions;
+
+typedef struct {
+  /* fraction of runouts where the player has the only best hand,
+     shares the best hand, or does not have the best hand */
+  double win[ MAX_PLAYERS ];
+  double tie[ MAX_PLAYERS ];
+  double loss[ MAX_PLAYERS ];
+
+  /* expected fraction of the pot won by the player, with ties split
+     evenly between the winners */
+  double equity[ MAX_PLAYERS ];
+
+  /* standard error of equity, 0 for exact results */
+  double stdErr[ MAX_PLAYERS ];
+
+  /* number of runouts the results are over, and the number actually
+     evaluated (less than numRunouts when using isomorphism) */
+  uint64_t numRunouts;
+  uint64_t numEvaluated;
+
+  /* non-zero if the results are from a full enumeration */
+  int exact;
+} EquityResult;
+
+
+/* set options to the default values */
+void initEquityOptions( EquityOptions *options );
+
+/* compute the showdown equity of numPlayers hands in game, where each
+   player has game->numHoleCards cards in holeCards[ p ] and the first
+   numBoardCards board cards are known.  The rest of the board is
+   enumerated or sampled, as controlled by options.  numPlayers may be
+   different from game->numPlayers.
+   returns 0 on success, -1 on failure (such as invalid cards) */
+int computeEquity( const Game *game, const int numPlayers,
+		   uint8_t holeCards[][ MAX_HOLE_CARDS ],
+		   const int numBoardCards, const uint8_t *boardCards,
+		   const EquityOptions *options, EquityResult *result );
+
+#endif
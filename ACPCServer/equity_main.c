@@ -0,0 +1,182 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include "game.h"
+#include "equity.h"
+
+
+static void printUsage( FILE *file, char *prog )
+{
+  fprintf( file, "usage: %s game_def hand1 hand2 [hand3 ...] [options]\n",
+	   prog );
+  fprintf( file, "  -b board\tknown board cards, eg AsKd7h\n" );
+  fprintf( file, "  -t threads\tnumber of threads [default: one per CPU]\n" );
+  fprintf( file, "  -m max\tenumerate if there are at most max runouts,\n"
+	   "\t\totherwise sample [default: %d]\n",
+	   DEFAULT_EQUITY_MAX_ENUMERATION );
+  fprintf( file, "  -n samples\tnumber of runouts to sample [default: %d]\n",
+	   DEFAULT_EQUITY_SAMPLES );
+  fprintf( file, "  -s seed\trandom number seed for sampling [default: 0]\n" );
+  fprintf( file, "  -i\t\tdo not use suit isomorphism\n" );
+}
+
+int main( int argc, char **argv )
+{
+  int i, p, numPlayers, numBoardCards, consumed;
+  FILE *file;
+  Game *game;
+  EquityOptions options;
+  EquityResult result;
+  uint8_t holeCards[ MAX_PLAYERS ][ MAX_HOLE_CARDS ];
+  uint8_t boardCards[ MAX_BOARD_CARDS ];
+  char *boardString;
+  char line[ 256 ];
+
+  initEquityOptions( &options );
+  boardString = NULL;
+
+  while( 1 ) {
+
+    i = getopt( argc, argv, "b:t:m:n:s:i" );
+    if( i < 0 ) {
+
+      break;
+    }
+
+    switch( i ) {
+    case 'b':
+
+      boardString = optarg;
+      break;
+
+    case 't':
+
+      if( sscanf( optarg, "%d", &options.numThreads ) < 1 ) {
+
+	fprintf( stderr, "ERROR: could not get number of threads from %s\n",
+		 optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 'm':
+
+      if( sscanf( optarg, "%"SCNu64, &options.maxEnumeration ) < 1 ) {
+
+	fprintf( stderr, "ERROR: could not get enumeration limit from %s\n",
+		 optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 'n':
+
+      if( sscanf( optarg, "%"SCNu64, &options.numSamples ) < 1 ) {
+
+	fprintf( stderr, "ERROR: could not get number of samples from %s\n",
+		 optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 's':
+
+      if( sscanf( optarg, "%"SCNu32, &options.seed ) < 1 ) {
+
+	fprintf( stderr, "ERROR: could not get random seed from %s\n",
+		 optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 'i':
+
+      options.useIsomorphism = 0;
+      break;
+
+    default:
+
+      printUsage( stderr, argv[ 0 ] );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  numPlayers = argc - optind - 1;
+  if( numPlayers < 2 || numPlayers > MAX_PLAYERS ) {
+
+    printUsage( stderr, argv[ 0 ] );
+    exit( EXIT_FAILURE );
+  }
+
+  /* get the game definition */
+  file = fopen( argv[ optind ], "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game definition %s\n",
+	     argv[ optind ] );
+    exit( EXIT_FAILURE );
+  }
+  game = readGame( file );
+  if( game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", argv[ optind ] );
+    exit( EXIT_FAILURE );
+  }
+  fclose( file );
+
+  /* get the hands */
+  for( p = 0; p < numPlayers; ++p ) {
+
+    if( readCards( argv[ optind + 1 + p ], game->numHoleCards,
+		   holeCards[ p ], &consumed ) != game->numHoleCards
+	|| argv[ optind + 1 + p ][ consumed ] != 0 ) {
+
+      fprintf( stderr, "ERROR: could not get %d hole cards from %s\n",
+	       game->numHoleCards, argv[ optind + 1 + p ] );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  /* get the board */
+  numBoardCards = 0;
+  if( boardString != NULL ) {
+
+    numBoardCards = readCards( boardString, MAX_BOARD_CARDS, boardCards,
+			       &consumed );
+    if( boardString[ consumed ] != 0 ) {
+
+      fprintf( stderr, "ERROR: could not get board cards from %s\n",
+	       boardString );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  if( computeEquity( game, numPlayers, holeCards, numBoardCards, boardCards,
+		     &options, &result ) < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+
+  printf( "%s %"PRIu64" runouts, %"PRIu64" evaluated\n",
+	  result.exact ? "enumerated" : "sampled",
+	  result.numRunouts, result.numEvaluated );
+  for( p = 0; p < numPlayers; ++p ) {
+
+    printCards( game->numHoleCards, holeCards[ p ], sizeof( line ), line );
+    printf( "%s: win %.6f tie %.6f loss %.6f equity %.6f",
+	    line, result.win[ p ], result.tie[ p ], result.loss[ p ],
+	    result.equity[ p ] );
+    if( !result.exact ) {
+      printf( " +/- %.6f", 1.96 * result.stdErr[ p ] );
+    }
+    printf( "\n" );
+  }
+
+  free( game );
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,629 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include "evaluator.h"
+
+/* the tables can be generated in other layouts by gen_eval_tables,
+   chosen by EVAL_TABLES in the Makefile.  The evaluator only uses the
+   8192 entry tables through these macros */
+#if defined( EVAL_TABLES_PACKED )
+#include "evalHandTables.packed"
+#define ONE_SUIT_VAL( set ) ( (int)oneSuitVal[ set ] )
+#define ANY_SUIT_VAL( set ) ( (int)( packedVal[ set ] & 0x3fff ) )
+#define PAIR_OTHER_VAL( set ) ( (int)( ( packedVal[ set ] >> 14 ) & 0x1ff ) )
+#define TRIPS_OTHER_VAL( set ) ( (int)( packedVal[ set ] >> 23 ) )
+#define TOP_BIT( set ) ( 31 - __builtin_clz( (set) | 1 ) )
+#elif defined( EVAL_TABLES_MERGED )
+#include "evalHandTables.merged"
+#define ONE_SUIT_VAL( set ) ( (int)( mergedVal[ set ] & 0x3fff ) )
+#define ANY_SUIT_VAL( set ) ( (int)( ( mergedVal[ set ] >> 14 ) & 0x3fff ) )
+#define TOP_BIT( set ) ( (int)( ( mergedVal[ set ] >> 28 ) & 0xf ) )
+#define PAIR_OTHER_VAL( set ) ( (int)( ( mergedVal[ set ] >> 32 ) & 0x1ff ) )
+#define TRIPS_OTHER_VAL( set ) ( (int)( mergedVal[ set ] >> 41 ) )
+#else
+#include "evalHandTables"
+#define ONE_SUIT_VAL( set ) ( (int)oneSuitVal[ set ] )
+#define ANY_SUIT_VAL( set ) ( (int)anySuitVal[ set ] )
+#define PAIR_OTHER_VAL( set ) ( (int)pairOtherVal[ set ] )
+#define TRIPS_OTHER_VAL( set ) ( (int)tripsOtherVal[ set ] )
+#define TOP_BIT( set ) ( (int)topBit[ set ] )
+#endif
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define EVAL_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+
+/* non-zero if the batch functions should use the vectorised ranking
+   -1 until the CPU has been checked.  Threads can rank at the same time,
+   so it is only read and written atomically, and only ever set to its
+   final value */
+static int useSimd = -1;
+
+
+/* finish ranking a hand, given the best flush (or 0 if there is no
+   flush) and sets, where sets.bySuit[ n ] has a bit for each rank
+   which appears in more than n suits */
+static inline int rankSets( int postponed, Cardset sets )
+{
+  int r;
+
+  if( postponed >= HANDCLASS_STRAIGHT_FLUSH ) {
+    /* straight flush */
+
+    return postponed;
+  }
+
+  if( sets.bySuit[ 3 ] ) {
+    /* quads */
+
+    r = TOP_BIT( sets.bySuit[ 3 ] );
+    return quadsVal[ r ] + TOP_BIT( sets.bySuit[ 0 ] ^ ( 1 << r ) );
+  }
+
+  if( sets.bySuit[ 2 ] ) {
+    /* trips or full house */
+
+    r = TOP_BIT( sets.bySuit[ 2 ] );
+    sets.bySuit[ 1 ] ^= ( 1 << r );
+    if( sets.bySuit[ 1 ] ) {
+      /* full house */
+
+      return tripsVal[ r ] + fullHouseOtherVal
+	+ TOP_BIT( sets.bySuit[ 1 ] );
+    }
+
+    if( postponed ) {
+      /* flush */
+
+      return postponed;
+    }
+
+    postponed = ANY_SUIT_VAL( sets.bySuit[ 0 ] );
+    if( postponed >= HANDCLASS_STRAIGHT ) {
+      /* straight */
+
+      return postponed;
+    }
+
+    /* trips */
+    sets.bySuit[ 0 ] ^= ( 1 << r );
+    return tripsVal[ r ] + TRIPS_OTHER_VAL( sets.bySuit[ 0 ] );
+  } else {
+
+    if( postponed ) {
+      /* flush */
+
+      return postponed;
+    }
+
+    postponed = ANY_SUIT_VAL( sets.bySuit[ 0 ] );
+    if( postponed >= HANDCLASS_STRAIGHT ) {
+      /* straight */
+
+      return postponed;
+    }
+  }
+
+  if( sets.bySuit[ 1 ] ) {
+    /* pair or two pair */
+
+    r = TOP_BIT( sets.bySuit[ 1 ] );
+    sets.bySuit[ 0 ] ^= ( 1 << r );
+    sets.bySuit[ 1 ] ^= ( 1 << r );
+    if( sets.bySuit[ 1 ] ) {
+      /* two pair */
+
+      sets.bySuit[ 0 ] ^= ( 1 << TOP_BIT( sets.bySuit[ 1 ] ) );
+      return pairsVal[ r ]
+	+ twoPairOtherVal[ TOP_BIT( sets.bySuit[ 1 ] ) ]
+	+ TOP_BIT( sets.bySuit[ 0 ] );
+    }
+
+    return pairsVal[ r ] + PAIR_OTHER_VAL( sets.bySuit[ 0 ] );
+  }
+
+  return postponed;
+}
+
+/* add a single card (with rank bit rankBit) to the rank count sets */
+static inline void addRankToSets( const uint16_t rankBit, Cardset *sets )
+{
+  sets->bySuit[ 3 ] |= sets->bySuit[ 2 ] & rankBit;
+  sets->bySuit[ 2 ] |= sets->bySuit[ 1 ] & rankBit;
+  sets->bySuit[ 1 ] |= sets->bySuit[ 0 ] & rankBit;
+  sets->bySuit[ 0 ] |= rankBit;
+}
+
+int rankCardset( const Cardset cards )
+{
+  int postponed;
+  Cardset sets;
+
+  postponed = ONE_SUIT_VAL( cards.bySuit[ 0 ] );
+  if( ONE_SUIT_VAL( cards.bySuit[ 1 ] ) > postponed ) {
+    postponed = ONE_SUIT_VAL( cards.bySuit[ 1 ] );
+  }
+  if( ONE_SUIT_VAL( cards.bySuit[ 2 ] ) > postponed ) {
+    postponed = ONE_SUIT_VAL( cards.bySuit[ 2 ] );
+  }
+  if( ONE_SUIT_VAL( cards.bySuit[ 3 ] ) > postponed ) {
+    postponed = ONE_SUIT_VAL( cards.bySuit[ 3 ] );
+  }
+
+  sets.bySuit[ 0 ] = cards.bySuit[ 0 ] | cards.bySuit[ 1 ];
+  sets.bySuit[ 1 ] = cards.bySuit[ 0 ] & cards.bySuit[ 1 ];
+  sets.bySuit[ 2 ] = sets.bySuit[ 1 ] & cards.bySuit[ 2 ];
+  sets.bySuit[ 1 ] |= sets.bySuit[ 0 ] & cards.bySuit[ 2 ];
+  sets.bySuit[ 0 ] |= cards.bySuit[ 2 ];
+  sets.bySuit[ 3 ] = sets.bySuit[ 2 ] & cards.bySuit[ 3 ];
+  sets.bySuit[ 2 ] |= sets.bySuit[ 1 ] & cards.bySuit[ 3 ];
+  sets.bySuit[ 1 ] |= sets.bySuit[ 0 ] & cards.bySuit[ 3 ];
+  sets.bySuit[ 0 ] |= cards.bySuit[ 3 ];
+
+  return rankSets( postponed, sets );
+}
+
+/* work out which suits could still make a flush */
+static void setPrefixFlushSuits( HandPrefix *prefix )
+{
+  int s, n;
+
+  prefix->flushSuits = 0;
+  for( s = 0; s < MAX_SUITS; ++s ) {
+
+    n = __builtin_popcount( prefix->cards.bySuit[ s ] );
+    if( n + prefix->numExtraCards >= 5 ) {
+
+      prefix->flushSuits |= 1 << s;
+    }
+  }
+}
+
+void initHandPrefix( HandPrefix *prefix, const int numCards,
+		     const uint8_t *cards, const int numExtraCards )
+{
+  int i;
+
+  prefix->cards = emptyCardset();
+  prefix->sets = emptyCardset();
+  prefix->numExtraCards = numExtraCards;
+  for( i = 0; i < numCards; ++i ) {
+
+    prefix->cards.cards |= cardToCardset( cards[ i ] ).cards;
+    addRankToSets( 1 << rankOfCard( cards[ i ] ), &prefix->sets );
+  }
+
+  setPrefixFlushSuits( prefix );
+}
+
+void extendHandPrefix( const HandPrefix *prefix, const uint8_t card,
+		       HandPrefix *extended )
+{
+  *extended = *prefix;
+  extended->cards.cards |= cardToCardset( card ).cards;
+  addRankToSets( 1 << rankOfCard( card ), &extended->sets );
+
+  /* adding cards can only make more suits flush candidates */
+  if( extended->flushSuits != ( 1 << MAX_SUITS ) - 1 ) {
+
+    setPrefixFlushSuits( extended );
+  }
+}
+
+int rankHandPrefix( const HandPrefix *prefix,
+		    const int numCards, const uint8_t *cards )
+{
+  int i, s, postponed, flushSuits;
+  Cardset all, sets;
+
+  assert( numCards <= prefix->numExtraCards );
+
+  all = prefix->cards;
+  sets = prefix->sets;
+  for( i = 0; i < numCards; ++i ) {
+
+    all.cards |= cardToCardset( cards[ i ] ).cards;
+    addRankToSets( 1 << rankOfCard( cards[ i ] ), &sets );
+  }
+
+  /* only look for a flush in suits where the prefix had enough cards */
+  postponed = 0;
+  for( flushSuits = prefix->flushSuits; flushSuits;
+       flushSuits &= flushSuits - 1 ) {
+
+    s = __builtin_ctz( flushSuits );
+    if( ONE_SUIT_VAL( all.bySuit[ s ] ) > postponed ) {
+      postponed = ONE_SUIT_VAL( all.bySuit[ s ] );
+    }
+  }
+
+  return rankSets( postponed, sets );
+}
+
+Cardset cardsToCardset( const int numCards, const uint8_t *cards )
+{
+  int i;
+  Cardset c = emptyCardset();
+
+  for( i = 0; i < numCards; ++i ) {
+
+    c.cards |= cardToCardset( cards[ i ] ).cards;
+  }
+
+  return c;
+}
+
+#ifdef EVAL_HAVE_AVX2
+/* look up 16 bit table entries for each 32 bit lane of idx
+   gathers work on 32 bit words, so fetch the aligned word holding the
+   entry and shift it down, which never reads outside the table */
+#define GATHER16( table, idx )						\
+  _mm256_and_si256(							\
+    _mm256_srlv_epi32(							\
+      _mm256_i32gather_epi32( (const int *)( table ),			\
+			      _mm256_srli_epi32( idx, 1 ), 4 ),		\
+      _mm256_slli_epi32( _mm256_and_si256( idx, one ), 4 ) ),		\
+    _mm256_set1_epi32( 0xffff ) )
+
+/* look up 8 bit table entries, as in GATHER16 */
+#define GATHER8( table, idx )						\
+  _mm256_and_si256(							\
+    _mm256_srlv_epi32(							\
+      _mm256_i32gather_epi32( (const int *)( table ),			\
+			      _mm256_srli_epi32( idx, 2 ), 4 ),		\
+      _mm256_slli_epi32( _mm256_and_si256( idx,				\
+					   _mm256_set1_epi32( 3 ) ), 3 ) ), \
+    _mm256_set1_epi32( 0xff ) )
+
+/* gather the 8192 entry tables for each lane of idx, for the table
+   layout chosen above.  Like GATHER16, these need "one" in scope */
+#if defined( EVAL_TABLES_PACKED )
+#define GATHER_PACKED( idx )						\
+  _mm256_i32gather_epi32( (const int *)packedVal, idx, 4 )
+#define GATHER_ONE_SUIT_VAL( idx ) GATHER16( oneSuitVal, idx )
+#define GATHER_ANY_SUIT_VAL( idx )					\
+  _mm256_and_si256( GATHER_PACKED( idx ), _mm256_set1_epi32( 0x3fff ) )
+#define GATHER_PAIR_OTHER_VAL( idx )					\
+  _mm256_and_si256( _mm256_srli_epi32( GATHER_PACKED( idx ), 14 ),	\
+		    _mm256_set1_epi32( 0x1ff ) )
+#define GATHER_TRIPS_OTHER_VAL( idx )					\
+  _mm256_srli_epi32( GATHER_PACKED( idx ), 23 )
+/* the exponent of the (exact) float conversion is the top bit */
+#define GATHER_TOP_BIT( idx )						\
+  _mm256_sub_epi32(							\
+    _mm256_srli_epi32(							\
+      _mm256_castps_si256(						\
+	_mm256_cvtepi32_ps( _mm256_or_si256( idx, one ) ) ), 23 ),	\
+    _mm256_set1_epi32( 127 ) )
+#elif defined( EVAL_TABLES_MERGED )
+/* entries are 64 bits, so gather the low or high 32 bit word */
+#define GATHER_MERGED( idx, word )					\
+  _mm256_i32gather_epi32( (const int *)mergedVal,			\
+			  _mm256_add_epi32( _mm256_slli_epi32( idx, 1 ), \
+					    _mm256_set1_epi32( word ) ), 4 )
+#define GATHER_ONE_SUIT_VAL( idx )					\
+  _mm256_and_si256( GATHER_MERGED( idx, 0 ), _mm256_set1_epi32( 0x3fff ) )
+#define GATHER_ANY_SUIT_VAL( idx )					\
+  _mm256_and_si256( _mm256_srli_epi32( GATHER_MERGED( idx, 0 ), 14 ),	\
+		    _mm256_set1_epi32( 0x3fff ) )
+#define GATHER_TOP_BIT( idx )						\
+  _mm256_srli_epi32( GATHER_MERGED( idx, 0 ), 28 )
+#define GATHER_PAIR_OTHER_VAL( idx )					\
+  _mm256_and_si256( GATHER_MERGED( idx, 1 ), _mm256_set1_epi32( 0x1ff ) )
+#define GATHER_TRIPS_OTHER_VAL( idx )					\
+  _mm256_srli_epi32( GATHER_MERGED( idx, 1 ), 9 )
+#else
+#define GATHER_ONE_SUIT_VAL( idx ) GATHER16( oneSuitVal, idx )
+#define GATHER_ANY_SUIT_VAL( idx ) GATHER16( anySuitVal, idx )
+#define GATHER_PAIR_OTHER_VAL( idx ) GATHER16( pairOtherVal, idx )
+#define GATHER_TRIPS_OTHER_VAL( idx ) GATHER8( tripsOtherVal, idx )
+#define GATHER_TOP_BIT( idx ) GATHER8( topBit, idx )
+#endif
+
+/* load one of the 13 entry per-rank tables into a pair of registers */
+__attribute__(( target( "avx2" ) ))
+static void loadRankTable( const uint16_t table[ 13 ],
+			   __m256i *low, __m256i *high )
+{
+  *low = _mm256_setr_epi32( table[ 0 ], table[ 1 ], table[ 2 ], table[ 3 ],
+			    table[ 4 ], table[ 5 ], table[ 6 ], table[ 7 ] );
+  *high = _mm256_setr_epi32( table[ 8 ], table[ 9 ], table[ 10 ],
+			     table[ 11 ], table[ 12 ], 0, 0, 0 );
+}
+
+/* look up a per-rank table loaded by loadRankTable */
+__attribute__(( target( "avx2" ) ))
+static inline __m256i rankTableLookup( const __m256i low, const __m256i high,
+				       const __m256i rank )
+{
+  return _mm256_blendv_epi8( _mm256_permutevar8x32_epi32( low, rank ),
+			     _mm256_permutevar8x32_epi32( high, rank ),
+			     _mm256_cmpgt_epi32( rank,
+						 _mm256_set1_epi32( 7 ) ) );
+}
+
+/* rank cardsets eight at a time
+   this follows rankCardset exactly, but every case is computed and the
+   result for each lane is selected in order of increasing precedence
+   instead of branching.  Cases which no lane needs are skipped.
+   returns the number of cardsets which were ranked */
+__attribute__(( target( "avx2" ) ))
+static int rankCardsetsAVX2( const Cardset *cardsets, const int numCardsets,
+			     int *ranks )
+{
+  int i;
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32( 1 );
+  const __m256i low16 = _mm256_set1_epi32( 0xffff );
+  const __m256i evenFirst = _mm256_setr_epi32( 0, 2, 4, 6, 1, 3, 5, 7 );
+  const __m256i straightClass = _mm256_set1_epi32( HANDCLASS_STRAIGHT - 1 );
+  const __m256i straightFlushClass
+    = _mm256_set1_epi32( HANDCLASS_STRAIGHT_FLUSH - 1 );
+  const __m256i fullHouseClass = _mm256_set1_epi32( fullHouseOtherVal );
+  __m256i quadsLow, quadsHigh, tripsLow, tripsHigh;
+  __m256i pairsLow, pairsHigh, twoPairLow, twoPairHigh;
+  __m256i a, b, c0, c1, c2, c3, s0, s1, s2, s3, flush, res;
+  __m256i r, t, u, bit, noStraight;
+
+  loadRankTable( quadsVal, &quadsLow, &quadsHigh );
+  loadRankTable( tripsVal, &tripsLow, &tripsHigh );
+  loadRankTable( pairsVal, &pairsLow, &pairsHigh );
+  loadRankTable( twoPairOtherVal, &twoPairLow, &twoPairHigh );
+
+  for( i = 0; i + 8 <= numCardsets; i += 8 ) {
+
+    /* split the cards into one register per suit, with the cardsets
+       in order across the lanes */
+    a = _mm256_loadu_si256( (const __m256i *)&cardsets[ i ] );
+    b = _mm256_loadu_si256( (const __m256i *)&cardsets[ i + 4 ] );
+    c0 = _mm256_permutevar8x32_epi32( _mm256_and_si256( a, low16 ),
+				      evenFirst );
+    c1 = _mm256_permutevar8x32_epi32( _mm256_srli_epi32( a, 16 ),
+				      evenFirst );
+    a = _mm256_permutevar8x32_epi32( _mm256_and_si256( b, low16 ),
+				     evenFirst );
+    b = _mm256_permutevar8x32_epi32( _mm256_srli_epi32( b, 16 ),
+				     evenFirst );
+    c2 = _mm256_permute2x128_si256( c0, a, 0x31 );
+    c0 = _mm256_permute2x128_si256( c0, a, 0x20 );
+    c3 = _mm256_permute2x128_si256( c1, b, 0x31 );
+    c1 = _mm256_permute2x128_si256( c1, b, 0x20 );
+
+    /* best flush, if any */
+    flush = _mm256_max_epi32( _mm256_max_epi32( GATHER_ONE_SUIT_VAL( c0 ),
+						GATHER_ONE_SUIT_VAL( c1 ) ),
+			      _mm256_max_epi32( GATHER_ONE_SUIT_VAL( c2 ),
+						GATHER_ONE_SUIT_VAL( c3 ) ) );
+
+    /* s0..s3 are the ranks held at least once..four times */
+    s0 = _mm256_or_si256( c0, c1 );
+    s1 = _mm256_and_si256( c0, c1 );
+    s2 = _mm256_and_si256( s1, c2 );
+    s1 = _mm256_or_si256( s1, _mm256_and_si256( s0, c2 ) );
+    s0 = _mm256_or_si256( s0, c2 );
+    s3 = _mm256_and_si256( s2, c3 );
+    s2 = _mm256_or_si256( s2, _mm256_and_si256( s1, c3 ) );
+    s1 = _mm256_or_si256( s1, _mm256_and_si256( s0, c3 ) );
+    s0 = _mm256_or_si256( s0, c3 );
+
+    /* high card or straight */
+    res = GATHER_ANY_SUIT_VAL( s0 );
+    noStraight = _mm256_cmpgt_epi32( straightClass, res );
+
+    /* pair or two pair */
+    if( !_mm256_testz_si256( s1, s1 ) ) {
+
+      r = GATHER_TOP_BIT( s1 );
+      bit = _mm256_sllv_epi32( one, r );
+      t = _mm256_xor_si256( s0, bit );
+      u = _mm256_xor_si256( s1, bit );
+      r = rankTableLookup( pairsLow, pairsHigh, r );
+      a = _mm256_add_epi32( r, GATHER_PAIR_OTHER_VAL( t ) );
+      if( !_mm256_testz_si256( u, u ) ) {
+
+	/* second pair, and the kicker is the best remaining card */
+	b = GATHER_TOP_BIT( u );
+	t = _mm256_xor_si256( t, _mm256_sllv_epi32( one, b ) );
+	b = _mm256_add_epi32( rankTableLookup( twoPairLow, twoPairHigh, b ),
+			      GATHER_TOP_BIT( t ) );
+	a = _mm256_blendv_epi8( _mm256_add_epi32( r, b ), a,
+				_mm256_cmpeq_epi32( u, zero ) );
+      }
+      res = _mm256_blendv_epi8( res, a,
+				_mm256_andnot_si256( _mm256_cmpeq_epi32( s1,
+									 zero ),
+						     noStraight ) );
+    }
+
+    /* trips, or full house if there is another pair */
+    if( !_mm256_testz_si256( s2, s2 ) ) {
+
+      r = GATHER_TOP_BIT( s2 );
+      bit = _mm256_sllv_epi32( one, r );
+      t = rankTableLookup( tripsLow, tripsHigh, r );
+      a = _mm256_add_epi32( t, GATHER_TRIPS_OTHER_VAL( _mm256_xor_si256( s0,
+									 bit ) ) );
+      u = _mm256_xor_si256( s1, bit );
+      b = _mm256_add_epi32( _mm256_add_epi32( t, fullHouseClass ),
+			    GATHER_TOP_BIT( u ) );
+      t = _mm256_cmpeq_epi32( s2, zero );
+      res = _mm256_blendv_epi8( res, a, _mm256_andnot_si256( t, noStraight ) );
+
+      /* flush beats trips, but not a full house */
+      res = _mm256_blendv_epi8( flush, res, _mm256_cmpeq_epi32( flush, zero ) );
+      res = _mm256_blendv_epi8( b, res,
+				_mm256_or_si256( t,
+						 _mm256_cmpeq_epi32( u, zero ) ) );
+    } else {
+
+      res = _mm256_blendv_epi8( flush, res, _mm256_cmpeq_epi32( flush, zero ) );
+    }
+
+    /* quads */
+    if( !_mm256_testz_si256( s3, s3 ) ) {
+
+      r = GATHER_TOP_BIT( s3 );
+      t = _mm256_xor_si256( s0, _mm256_sllv_epi32( one, r ) );
+      a = _mm256_add_epi32( rankTableLookup( quadsLow, quadsHigh, r ),
+			    GATHER_TOP_BIT( t ) );
+      res = _mm256_blendv_epi8( a, res, _mm256_cmpeq_epi32( s3, zero ) );
+    }
+
+    /* straight flush beats everything */
+    res = _mm256_blendv_epi8( res, flush,
+			      _mm256_cmpgt_epi32( flush, straightFlushClass ) );
+
+    _mm256_storeu_si256( (__m256i *)&ranks[ i ], res );
+  }
+
+  return i;
+}
+#endif
+
+int useSimdRanking( const int enable )
+{
+  int simd;
+
+  simd = 0;
+#ifdef EVAL_HAVE_AVX2
+  if( enable ) {
+
+    __builtin_cpu_init();
+    simd = __builtin_cpu_supports( "avx2" ) ? 1 : 0;
+  }
+#endif
+  __atomic_store_n( &useSimd, simd, __ATOMIC_RELAXED );
+
+  return simd;
+}
+
+void rankCardsets( const Cardset *cardsets, const int numCardsets,
+		   int *ranks )
+{
+  int i, simd;
+
+  simd = __atomic_load_n( &useSimd, __ATOMIC_RELAXED );
+  if( simd < 0 ) {
+    /* first call, so pick the implementation.  Threads which get here
+       together all find the same answer */
+
+    simd = useSimdRanking( 1 );
+  }
+
+  i = 0;
+#ifdef EVAL_HAVE_AVX2
+  if( simd ) {
+
+    i = rankCardsetsAVX2( cardsets, numCardsets, ranks );
+  }
+#endif
+
+  /* anything left over is done one at a time */
+  for( ; i < numCardsets; ++i ) {
+
+    ranks[ i ] = rankCardset( cardsets[ i ] );
+  }
+}
+
+void rankHolesOnBoard( const Cardset board,
+		       const Cardset *holes, const int numHoles,
+		       int *ranks )
+{
+  int i, j, n;
+  int idx[ RANK_BATCH_SIZE ], batchRanks[ RANK_BATCH_SIZE ];
+  Cardset batch[ RANK_BATCH_SIZE ];
+
+  for( i = 0; i < numHoles; i += n ) {
+
+    /* build a batch of possible hands, marking impossible ones */
+    n = 0;
+    for( j = i; j < numHoles && j < i + RANK_BATCH_SIZE; ++j ) {
+
+      if( holes[ j ].cards & board.cards ) {
+	/* hole cards are already on the board */
+
+	ranks[ j ] = -1;
+	continue;
+      }
+
+      batch[ n ].cards = board.cards | holes[ j ].cards;
+      idx[ n ] = j;
+      ++n;
+    }
+
+    rankCardsets( batch, n, batchRanks );
+    while( n ) {
+      --n;
+      ranks[ idx[ n ] ] = batchRanks[ n ];
+    }
+    n = j - i;
+  }
+}
+
+void rankAllHolePairs( const Cardset board, int ranks[ NUM_HOLE_PAIRS ] )
+{
+  int high, low, idx, n;
+  int valid[ NUM_HOLE_PAIRS ], validRanks[ NUM_HOLE_PAIRS ];
+  Cardset withHigh, c, hands[ NUM_HOLE_PAIRS ];
+
+  /* build all the possible hands */
+  idx = 0;
+  n = 0;
+  for( high = 1; high < MAX_SUITS * MAX_RANKS; ++high ) {
+
+    withHigh = cardToCardset( high );
+    if( withHigh.cards & board.cards ) {
+      /* high card is on the board, so every hand with it is impossible */
+
+      for( low = 0; low < high; ++low ) {
+
+	ranks[ idx ] = -1;
+	++idx;
+      }
+      continue;
+    }
+    withHigh.cards |= board.cards;
+
+    for( low = 0; low < high; ++low ) {
+
+      c = cardToCardset( low );
+      if( c.cards & board.cards ) {
+
+	ranks[ idx ] = -1;
+      } else {
+
+	hands[ n ].cards = c.cards | withHigh.cards;
+	valid[ n ] = idx;
+	++n;
+      }
+      ++idx;
+    }
+  }
+
+  /* rank them all at once */
+  rankCardsets( hands, n, validRanks );
+  while( n ) {
+    --n;
+    ranks[ valid[ n ] ] = validRanks[ n ];
+  }
+}
+
+void holePairCards( const int index, uint8_t *low, uint8_t *high )
+{
+  int h;
+
+  /* find largest h with h * ( h - 1 ) / 2 <= index */
+  h = 1;
+  while( ( h + 1 ) * h / 2 <= index ) {
+    ++h;
+  }
+
+  *high = h;
+  *low = index - h * ( h - 1 ) / 2;
+}
@@ -0,0 +1,135 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _EVALUATOR_H
+#define _EVALUATOR_H
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "game.h"
+
+
+/* number of distinct two card hands in a MAX_SUITS x MAX_RANKS deck */
+#define NUM_HOLE_PAIRS ( MAX_SUITS * MAX_RANKS \
+			 * ( MAX_SUITS * MAX_RANKS - 1 ) / 2 )
+
+
+/* number of hands rankHolesOnBoard builds up before ranking them */
+#define RANK_BATCH_SIZE 64
+
+/* a set of cards, with one bit per rank for each suit */
+typedef union {
+  uint16_t bySuit[ 4 ];
+  uint64_t cards;
+} Cardset;
+
+/* an incremental evaluator for hands which share a set of cards (for
+   example, every player's hand on a board.)  The shared cards are added
+   once, after which ranking a hand only costs adding up to numExtraCards
+   more cards and the final table lookups.  It is small and meant to be
+   copied, so extendHandPrefix can step through boards one card at a time
+   without any undo */
+typedef struct {
+  /* all cards in the prefix */
+  Cardset cards;
+
+  /* sets.bySuit[ n ] has a bit for each rank held in more than n suits */
+  Cardset sets;
+
+  /* most cards which will be added on top of the prefix when ranking */
+  uint8_t numExtraCards;
+
+  /* bit s is set if suit s has enough cards to possibly make a flush */
+  uint8_t flushSuits;
+} HandPrefix;
+
+
+/* returns a cardset with no cards in it */
+static inline Cardset emptyCardset()
+{
+  Cardset c;
+
+  c.cards = 0;
+
+  return c;
+}
+
+static inline void addCardToCardset( Cardset *c, int suit, int rank )
+{
+  c->cards |= (uint64_t)1 << ( ( suit << 4 ) + rank );
+}
+
+/* returns a cardset containing only card (as made by makeCard()) */
+static inline Cardset cardToCardset( const uint8_t card )
+{
+  Cardset c;
+
+  c.cards = (uint64_t)1 << ( ( suitOfCard( card ) << 4 )
+			     + rankOfCard( card ) );
+
+  return c;
+}
+
+/* returns a cardset containing the first numCards entries of cards */
+Cardset cardsToCardset( const int numCards, const uint8_t *cards );
+
+/* returns the rank of the best hand which can be made from cards
+   larger ranks are better hands, and equal ranks are tied hands */
+int rankCardset( const Cardset cards );
+
+/* choose whether the batch ranking functions below use the vectorised
+   (AVX2) evaluator, which ranks eight cardsets at a time and gives
+   exactly the same ranks as rankCardset.  By default it is used if the
+   CPU supports it.
+   returns non-zero if the vectorised evaluator will be used */
+int useSimdRanking( const int enable );
+
+/* rank numCardsets independent cardsets
+   ranks[ i ] is set to the rank of cardsets[ i ] */
+void rankCardsets( const Cardset *cardsets, const int numCardsets,
+		   int *ranks );
+
+/* rank numHoles hands which all share the same board
+   ranks[ i ] is set to the rank of board combined with holes[ i ],
+   or -1 if holes[ i ] shares a card with board */
+void rankHolesOnBoard( const Cardset board,
+		       const Cardset *holes, const int numHoles,
+		       int *ranks );
+
+/* rank every two card hand in the deck on a board
+   ranks[ holePairIndex( a, b ) ] is set to the rank of board plus cards
+   a and b, or -1 if either card is on the board */
+void rankAllHolePairs( const Cardset board, int ranks[ NUM_HOLE_PAIRS ] );
+
+/* initialise prefix to hold numCards cards, for ranking hands with
+   at most numExtraCards more cards */
+void initHandPrefix( HandPrefix *prefix, const int numCards,
+		     const uint8_t *cards, const int numExtraCards );
+
+/* set extended to prefix plus one more shared card
+   prefix and extended may be the same */
+void extendHandPrefix( const HandPrefix *prefix, const uint8_t card,
+		       HandPrefix *extended );
+
+/* returns the rank of the cards in prefix plus numCards cards, which
+   must not already be in prefix.  The result is the same as rankCardset
+   on all of the cards */
+int rankHandPrefix( const HandPrefix *prefix,
+		    const int numCards, const uint8_t *cards );
+
+/* get the index of a two card hand, in [0,NUM_HOLE_PAIRS)
+   cards are ordered by the larger card then the smaller card, which
+   is the same order the Lua code uses for range vectors */
+static inline int holePairIndex( const uint8_t a, const uint8_t b )
+{
+  if( a > b ) {
+    return a * ( a - 1 ) / 2 + b;
+  }
+  return b * ( b - 1 ) / 2 + a;
+}
+
+/* get the cards in the two card hand with the given index
+   on return, *low < *high */
+void holePairCards( const int index, uint8_t *low, uint8_t *high );
+
+#endif
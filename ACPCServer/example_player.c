@@ -19,7 +19,7 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 
 int main( int argc, char **argv )
 {
-  int sock, len, r, a;
+  int len, r, a, delta, binary, haveState;
   int32_t min, max;
   uint16_t port;
   double p;
@@ -32,13 +32,34 @@ int main( int argc, char **argv )
   double actionProbs[ NUM_ACTION_TYPES ];
   rng_state_t rng;
   char line[ MAX_LINE_LEN ];
+  uint8_t frame[ MAX_LINE_LEN ];
 
   /* we make some assumptions about the actions - check them here */
   assert( NUM_ACTION_TYPES == 3 );
 
+  /* -d asks the dealer for delta protocol messages, -b for binary frames */
+  delta = 0;
+  binary = 0;
+  while( ( r = getopt( argc, argv, "db" ) ) >= 0 ) {
+
+    if( r == 'd' ) {
+
+      delta = 1;
+    } else if( r == 'b' ) {
+
+      binary = 1;
+    } else {
+
+      fprintf( stderr, "usage: player [-d|-b] game server port\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
   if( argc < 4 ) {
 
-    fprintf( stderr, "usage: player game server port\n" );
+    fprintf( stderr, "usage: player [-d|-b] game server port\n" );
     exit( EXIT_FAILURE );
   }
 
@@ -72,41 +93,82 @@ int main( int argc, char **argv )
     fprintf( stderr, "ERROR: invalid port %s\n", argv[ 3 ] );
     exit( EXIT_FAILURE );
   }
-  sock = connectTo( argv[ 2 ], port );
-  if( sock < 0 ) {
-
-    exit( EXIT_FAILURE );
-  }
-  toServer = fdopen( sock, "w" );
-  fromServer = fdopen( sock, "r" );
-  if( toServer == NULL || fromServer == NULL ) {
+  if( openDealerStreams( argv[ 2 ], port, &toServer, &fromServer ) < 0 ) {
 
-    fprintf( stderr, "ERROR: could not get socket streams\n" );
     exit( EXIT_FAILURE );
   }
 
   /* send version string to dealer */
-  if( fprintf( toServer, "VERSION:%"PRIu32".%"PRIu32".%"PRIu32"\n",
-	       VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION ) != 14 ) {
+  if( fprintf( toServer, "VERSION:%"PRIu32".%"PRIu32".%"PRIu32"%s\n",
+	       VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION,
+	       binary ? ":"BINARY_PROTOCOL_OPTION
+	       : delta ? ":"DELTA_PROTOCOL_OPTION : "" ) < 14 ) {
 
     fprintf( stderr, "ERROR: could not get send version to server\n" );
     exit( EXIT_FAILURE );
   }
   fflush( toServer );
 
+  /* a dealer which doesn't know about (or won't use) binary frames sends
+     text, which can't be the start of a frame because frames are never
+     that long */
+  if( binary ) {
+
+    r = getc( fromServer );
+    if( r == 'M' || r == '#' || r == ';' ) {
+
+      fprintf( stderr, "WARNING: dealer is not using binary frames\n" );
+      binary = 0;
+    }
+    ungetc( r, fromServer );
+  }
+
   /* play the game! */
-  while( fgets( line, MAX_LINE_LEN, fromServer ) ) {
+  haveState = 0;
+  while( 1 ) {
+
+    if( binary ) {
+      /* get the length of the frame, then the rest of it */
+
+      if( fread( frame, 1, FRAME_LEN_BYTES, fromServer ) != FRAME_LEN_BYTES ) {
+	break;
+      }
+      len = ( frame[ 0 ] << 8 ) | frame[ 1 ];
+      if( len > MAX_LINE_LEN - FRAME_LEN_BYTES
+	  || fread( &frame[ FRAME_LEN_BYTES ], 1, len, fromServer ) != len
+	  || readMatchStateBinary( frame, len + FRAME_LEN_BYTES,
+				   game, &state ) < 0 ) {
+
+	fprintf( stderr, "ERROR: could not read binary state\n" );
+	exit( EXIT_FAILURE );
+      }
+    } else if( !fgets( line, MAX_LINE_LEN, fromServer ) ) {
+
+      break;
+    } else if( line[ 0 ] == '#' || line[ 0 ] == ';' ) {
+      /* ignore comments */
 
-    /* ignore comments */
-    if( line[ 0 ] == '#' || line[ 0 ] == ';' ) {
       continue;
-    }
+    } else if( line[ 0 ] == '+' && haveState ) {
+      /* a delta message, which updates the last state we were sent */
 
-    len = readMatchState( line, game, &state );
-    if( len < 0 ) {
+      if( readMatchStateDelta( line, game, &state ) < 0 ) {
 
-      fprintf( stderr, "ERROR: could not read state %s", line );
-      exit( EXIT_FAILURE );
+	fprintf( stderr, "ERROR: could not apply delta %s", line );
+	exit( EXIT_FAILURE );
+      }
+
+      /* respond with just the action */
+      len = 0;
+    } else {
+
+      len = readMatchState( line, game, &state );
+      if( len < 0 ) {
+
+	fprintf( stderr, "ERROR: could not read state %s", line );
+	exit( EXIT_FAILURE );
+      }
+      haveState = 1;
     }
 
     if( stateFinished( &state.state ) ) {
@@ -121,10 +183,6 @@ int main( int argc, char **argv )
       continue;
     }
 
-    /* add a colon (guaranteed to fit because we read a new-line in fgets) */
-    line[ len ] = ':';
-    ++len;
-
     /* build the set of valid actions */
     p = 0;
     for( a = 0; a < NUM_ACTION_TYPES; ++a ) {
@@ -179,8 +237,31 @@ int main( int argc, char **argv )
 
     /* do the action! */
     assert( isValidAction( game, &state.state, 0, &action ) );
-    r = printAction( game, &action, MAX_LINE_LEN - len - 2,
-		     &line[ len ] );
+    if( binary ) {
+
+      len = printActionBinary( &state, &action, MAX_LINE_LEN, frame );
+      if( len < 0 || fwrite( frame, 1, len, toServer ) != len ) {
+
+	fprintf( stderr, "ERROR: could not get send response to server\n" );
+	exit( EXIT_FAILURE );
+      }
+      fflush( toServer );
+      continue;
+    }
+
+    if( len ) {
+      /* add a colon (guaranteed to fit because we read a new-line in
+	 fgets) and the action */
+
+      line[ len ] = ':';
+      ++len;
+      r = printAction( game, &action, MAX_LINE_LEN - len - 2,
+		       &line[ len ] );
+    } else {
+      /* a delta response replaces the whole line */
+
+      r = printActionDelta( game, &state, &action, MAX_LINE_LEN - 2, line );
+    }
     if( r < 0 ) {
 
       fprintf( stderr, "ERROR: line too long after printing action\n" );
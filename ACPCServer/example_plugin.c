@@ -0,0 +1,122 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+/* the player from example_player.c as a dealer plugin, to be loaded with
+   dealer --plugin seat:example_plugin.so[:seed] */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include "game.h"
+#include "rng.h"
+#include "player_plugin.h"
+
+typedef struct {
+  const Game *game;
+  double probs[ NUM_ACTION_TYPES ];
+  rng_state_t rng;
+} ExamplePlayer;
+
+void *playerInit( const Game *game, const char *args )
+{
+  ExamplePlayer *player;
+  struct timeval tv;
+  uint32_t seed;
+
+  /* we make some assumptions about the actions - check them here */
+  if( NUM_ACTION_TYPES != 3 ) {
+
+    fprintf( stderr, "ERROR: example plugin needs fold, call and raise\n" );
+    return NULL;
+  }
+
+  player = (ExamplePlayer *)malloc( sizeof( *player ) );
+  if( player == NULL ) {
+
+    return NULL;
+  }
+  player->game = game;
+
+  /* Define the probabilities of actions for the player */
+  player->probs[ a_fold ] = 0.06;
+  player->probs[ a_call ] = ( 1.0 - player->probs[ a_fold ] ) * 0.5;
+  player->probs[ a_raise ] = ( 1.0 - player->probs[ a_fold ] ) * 0.5;
+
+  /* Initialize the player's random number state using the seed in args,
+     or the time if there isn't one */
+  if( sscanf( args, "%"SCNu32, &seed ) < 1 ) {
+
+    gettimeofday( &tv, NULL );
+    seed = tv.tv_usec;
+  }
+  init_genrand( &player->rng, seed );
+
+  return player;
+}
+
+int playerAct( void *p, const MatchState *state, Action *action )
+{
+  ExamplePlayer *player = (ExamplePlayer *)p;
+  const Game *game = player->game;
+  int a;
+  int32_t min, max;
+  double r, total;
+  double actionProbs[ NUM_ACTION_TYPES ];
+
+  /* build the set of valid actions */
+  total = 0;
+  for( a = 0; a < NUM_ACTION_TYPES; ++a ) {
+
+    actionProbs[ a ] = 0.0;
+  }
+
+  /* consider fold */
+  action->type = a_fold;
+  action->size = 0;
+  if( isValidAction( game, &state->state, 0, action ) ) {
+
+    actionProbs[ a_fold ] = player->probs[ a_fold ];
+    total += player->probs[ a_fold ];
+  }
+
+  /* consider call */
+  actionProbs[ a_call ] = player->probs[ a_call ];
+  total += player->probs[ a_call ];
+
+  /* consider raise */
+  if( raiseIsValid( game, &state->state, &min, &max ) ) {
+
+    actionProbs[ a_raise ] = player->probs[ a_raise ];
+    total += player->probs[ a_raise ];
+  }
+
+  /* choose one of the valid actions at random */
+  r = genrand_real2( &player->rng ) * total;
+  for( a = 0; a < NUM_ACTION_TYPES - 1; ++a ) {
+
+    if( r <= actionProbs[ a ] ) {
+
+      break;
+    }
+    r -= actionProbs[ a ];
+  }
+  action->type = (enum ActionType)a;
+  action->size = 0;
+  if( a == a_raise ) {
+
+    action->size = min + genrand_int32( &player->rng ) % ( max - min + 1 );
+  }
+
+  return 0;
+}
+
+void playerObserve( void *player, const MatchState *state )
+{
+  /* the example player doesn't keep track of anything */
+}
+
+void playerFree( void *player )
+{
+  free( player );
+}
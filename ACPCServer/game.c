@@ -11,8 +11,7 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #include <stdint.h>
 #include "game.h"
 #include "rng.h"
-
-#include "evalHandTables"
+#include "evaluator.h"
 
 
 static enum ActionType charToAction[ 256 ] = {
@@ -103,6 +102,70 @@ static char actionChars[ a_invalid + 1 ] = "fcr";
 static char suitChars[ MAX_SUITS + 1 ] = "cdhs";
 static char rankChars[ MAX_RANKS + 1 ] = "23456789TJQKA";
 
+/* one more than the rank or suit of a card character, 0 if invalid */
+static const uint8_t charToRank[ 256 ] = {
+  [ '2' ] = 1, [ '3' ] = 2, [ '4' ] = 3, [ '5' ] = 4, [ '6' ] = 5,
+  [ '7' ] = 6, [ '8' ] = 7, [ '9' ] = 8, [ 'T' ] = 9, [ 't' ] = 9,
+  [ 'J' ] = 10, [ 'j' ] = 10, [ 'Q' ] = 11, [ 'q' ] = 11,
+  [ 'K' ] = 12, [ 'k' ] = 12, [ 'A' ] = 13, [ 'a' ] = 13
+};
+static const uint8_t charToSuit[ 256 ] = {
+  [ 'c' ] = 1, [ 'C' ] = 1, [ 'd' ] = 2, [ 'D' ] = 2,
+  [ 'h' ] = 3, [ 'H' ] = 3, [ 's' ] = 4, [ 'S' ] = 4
+};
+
+
+/* read an unsigned decimal number of at most 9 digits from string,
+   without going through sscanf.  Anything else (spaces, signs, or
+   numbers which might overflow) fails, and callers fall back to sscanf
+   so unusual input is treated exactly as it always has been
+   returns number of characters consumed, or -1 on failure */
+static int readDigits( const char *string, int32_t *value )
+{
+  int c;
+  int32_t v;
+
+  v = 0;
+  for( c = 0; string[ c ] >= '0' && string[ c ] <= '9'; ++c ) {
+
+    if( c == 9 ) {
+      return -1;
+    }
+    v = v * 10 + ( string[ c ] - '0' );
+  }
+  if( c == 0 ) {
+    return -1;
+  }
+
+  *value = v;
+  return c;
+}
+
+/* print value in decimal without going through snprintf
+   does not add a 0 terminator
+   returns number of characters printed, or -1 if there's not room */
+static int printNumber( uint32_t value, const int maxLen, char *string )
+{
+  int c, i;
+  char digits[ 10 ];
+
+  c = 0;
+  do {
+    digits[ c ] = '0' + value % 10;
+    ++c;
+    value /= 10;
+  } while( value );
+
+  if( c > maxLen ) {
+    return -1;
+  }
+  for( i = 0; i < c; ++i ) {
+    string[ i ] = digits[ c - 1 - i ];
+  }
+
+  return c;
+}
+
 
 static int consumeSpaces( const char *string, int consumeEqual )
 {
@@ -480,8 +543,7 @@ uint8_t currentPlayer( const Game *game, const State *state )
 {
   /* if action has already been made, compute next player from last player */
   if( state->numActions[ state->round ] ) {
-    return nextPlayer( game, state, state->actingPlayer[ state->round ]
-		       [ state->numActions[ state->round ] - 1 ] );
+    return nextPlayer( game, state, state->lastActingPlayer );
   }
 
   /* first player in a round is determined by the game and round
@@ -492,98 +554,164 @@ uint8_t currentPlayer( const Game *game, const State *state )
 
 uint8_t numRaises( const State *state )
 {
-  int i;
-  uint8_t ret;
+  return state->numRoundRaises;
+}
 
-  ret = 0;
-  for( i = 0; i < state->numActions[ state->round ]; ++i ) {
-    if( state->action[ state->round ][ i ].type == a_raise ) {
-      ++ret;
-    }
+uint16_t numActionsInHand( const State *state )
+{
+  int r;
+  uint16_t num;
+
+  num = 0;
+  for( r = 0; r <= state->round; ++r ) {
+    num += state->numActions[ r ];
   }
 
-  return ret;
+  return num;
 }
 
 uint8_t numFolded( const Game *game, const State *state )
 {
-  int p;
-  uint8_t ret;
+  return state->numFoldedPlayers;
+}
 
-  ret = 0;
-  for( p = 0; p < game->numPlayers; ++p ) {
-    if( state->playerFolded[ p ] ) {
-      ++ret;
-    }
-  }
+uint8_t numCalled( const Game *game, const State *state )
+{
+  return state->numCalledPlayers;
+}
 
-  return ret;
+uint8_t numAllIn( const Game *game, const State *state )
+{
+  return state->numAllInPlayers;
 }
 
-uint8_t numCalled( const Game *game, const State *state )
+uint8_t numActingPlayers( const Game *game, const State *state )
 {
-  int i;
-  uint8_t ret, p;
+  /* a player who is all-in can't fold, so no one is counted twice */
+  return game->numPlayers - state->numFoldedPlayers
+    - state->numAllInPlayers;
+}
+
+#ifdef COMPACT_STATE
+/* decode the action starting at state->history[ pos ]
+   returns the position of the following action */
+static int decodeAction( const State *state, int pos,
+			 Action *action, uint8_t *player )
+{
+  int shift;
+  uint32_t size;
+
+  *player = state->history[ pos ] >> 2;
+  action->type = (enum ActionType)( state->history[ pos ] & 3 );
+  ++pos;
 
-  ret = 0;
-  for( i = state->numActions[ state->round ]; i > 0; --i ) {
+  size = 0;
+  if( action->type == a_raise ) {
+
+    shift = 0;
+    do {
+      size |= (uint32_t)( state->history[ pos ] & 127 ) << shift;
+      shift += 7;
+    } while( state->history[ pos++ ] & 128 );
+  }
+  action->size = size;
 
-    p = state->actingPlayer[ state->round ][ i - 1 ];
+  return pos;
+}
 
-    if( state->action[ state->round ][ i - 1 ].type == a_raise ) {
-      /* player initiated the bet, so they've called it */
+/* append action by player to the packed history */
+static void encodeAction( State *state, const Action *action,
+			  const uint8_t player )
+{
+  uint32_t size;
 
-      if( state->spent[ p ] < game->stack[ p ] ) {
-	/* player is not all-in, so they're still acting */
+  assert( state->historyLen + MAX_ACTION_BYTES <= MAX_HISTORY_BYTES );
 
-	++ret;
-      }
+  state->history[ state->historyLen ] = ( player << 2 ) | action->type;
+  ++state->historyLen;
 
-      /* this is the start of the current bet, so we're finished */
-      return ret;
-    } else if( state->action[ state->round ][ i - 1 ].type == a_call ) {
+  if( action->type == a_raise ) {
 
-      if( state->spent[ p ] < game->stack[ p ] ) {
-	/* player is not all-in, so they're still acting */
+    size = action->size;
+    while( size >= 128 ) {
 
-	++ret;
-      }
+      state->history[ state->historyLen ] = ( size & 127 ) | 128;
+      ++state->historyLen;
+      size >>= 7;
     }
+    state->history[ state->historyLen ] = size;
+    ++state->historyLen;
   }
+}
 
-  return ret;
+int nextActionInRound( const State *state, const uint8_t round, int *pos,
+		       Action *action, uint8_t *player )
+{
+  int end;
+
+  if( round > state->round ) {
+    return 0;
+  }
+  end = round < state->round
+    ? state->historyStart[ round + 1 ] : state->historyLen;
+  if( state->historyStart[ round ] + *pos >= end ) {
+    return 0;
+  }
+
+  *pos = decodeAction( state, state->historyStart[ round ] + *pos,
+		       action, player ) - state->historyStart[ round ];
+  return 1;
 }
 
-uint8_t numAllIn( const Game *game, const State *state )
+Action getAction( const State *state, const uint8_t round,
+		  const uint8_t index )
 {
-  int p;
-  uint8_t ret;
+  int i, pos;
+  Action action;
+  uint8_t player;
 
-  ret = 0;
-  for( p = 0; p < game->numPlayers; ++p ) {
-    if( state->spent[ p ] >= game->stack[ p ] ) {
-      ++ret;
-    }
+  action.type = a_invalid;
+  action.size = 0;
+  player = 0;
+  pos = 0;
+  for( i = 0; i <= index; ++i ) {
+    nextActionInRound( state, round, &pos, &action, &player );
   }
 
-  return ret;
+  return action;
 }
 
-uint8_t numActingPlayers( const Game *game, const State *state )
+uint8_t getActingPlayer( const State *state, const uint8_t round,
+			 const uint8_t index )
 {
-  int p;
-  uint8_t ret;
+  int i, pos;
+  Action action;
+  uint8_t player;
 
-  ret = 0;
-  for( p = 0; p < game->numPlayers; ++p ) {
-    if( state->playerFolded[ p ] == 0
-	&& state->spent[ p ] < game->stack[ p ] ) {
-      ++ret;
-    }
+  action.type = a_invalid;
+  action.size = 0;
+  player = 0;
+  pos = 0;
+  for( i = 0; i <= index; ++i ) {
+    nextActionInRound( state, round, &pos, &action, &player );
   }
 
-  return ret;
+  return player;
+}
+#else
+int nextActionInRound( const State *state, const uint8_t round, int *pos,
+		       Action *action, uint8_t *player )
+{
+  if( round > state->round || *pos >= state->numActions[ round ] ) {
+    return 0;
+  }
+
+  *action = state->action[ round ][ *pos ];
+  *player = state->actingPlayer[ round ][ *pos ];
+  ++( *pos );
+  return 1;
 }
+#endif
 
 void initState( const Game *game, const uint32_t handId, State *state )
 {
@@ -635,6 +763,26 @@ void initState( const Game *game, const uint32_t handId, State *state )
 
     state->numActions[ r ] = 0;
   }
+#ifdef COMPACT_STATE
+  state->historyLen = 0;
+  for( r = 0; r < MAX_ROUNDS; ++r ) {
+
+    state->historyStart[ r ] = 0;
+  }
+#endif
+
+  /* blinds may put players all-in before anyone acts */
+  state->numFoldedPlayers = 0;
+  state->numAllInPlayers = 0;
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( state->spent[ p ] >= game->stack[ p ] ) {
+      ++state->numAllInPlayers;
+    }
+  }
+  state->numCalledPlayers = 0;
+  state->numRoundRaises = 0;
+  state->lastActingPlayer = 0;
 
   state->round = 0;
 
@@ -694,7 +842,9 @@ void dealCards( const Game *game, rng_state_t *rng, State *state )
 static int statesEqualCommon( const Game *game, const State *a,
 			      const State *b )
 {
-  int r, i, t;
+  int r, i, t, posA, posB;
+  Action actionA, actionB;
+  uint8_t player;
 
   /* is it the same hand? */
   if( a->handId != b->handId ) {
@@ -712,12 +862,17 @@ static int statesEqualCommon( const Game *game, const State *a,
       return 0;
     }
 
-    for( i = 0; i < a->numActions[ r ]; ++i ) {
+    posA = 0;
+    posB = 0;
+    while( nextActionInRound( a, r, &posA, &actionA, &player ) ) {
 
-      if( a->action[ r ][ i ].type != b->action[ r ][ i ].type ) {
+      if( !nextActionInRound( b, r, &posB, &actionB, &player ) ) {
 	return 0;
       }
-      if( a->action[ r ][ i ].size != b->action[ r ][ i ].size ) {
+      if( actionA.type != actionB.type ) {
+	return 0;
+      }
+      if( actionA.size != actionB.size ) {
 	return 0;
       }
     }
@@ -804,6 +959,16 @@ int raiseIsValid( const Game *game, const State *curState,
     return 0;
   }
 
+#ifdef COMPACT_STATE
+  if( curState->historyLen + MAX_ACTION_BYTES * game->numPlayers
+      > MAX_HISTORY_BYTES ) {
+    /* 1 raise + NUM PLAYERS-1 calls might not fit in the history */
+
+    fprintf( stderr, "WARNING: betting history is too close to MAX_HISTORY_BYTES, forcing call/fold\n" );
+    return 0;
+  }
+#endif
+
   if( numActingPlayers( game, curState ) <= 1 ) {
     /* last remaining player can't bet if there's no one left to call
        (this check is needed if the 2nd last player goes all in, and
@@ -843,17 +1008,17 @@ int raiseIsValid( const Game *game, const State *curState,
   return 1;
 }
 
-int isValidAction( const Game *game, const State *curState,
-		   const int tryFixing, Action *action )
+/* isValidAction() for an action by p, who must be the current player */
+static int isValidActionByPlayer( const Game *game, const State *curState,
+				  const int p, const int tryFixing,
+				  Action *action )
 {
-  int min, max, p;
+  int min, max;
 
   if( stateFinished( curState ) || action->type == a_invalid ) {
     return 0;
   }
 
-  p = currentPlayer( game, curState );
-
   if( action->type == a_raise ) {
 
     if( !raiseIsValid( game, curState, &min, &max ) ) {
@@ -916,20 +1081,41 @@ int isValidAction( const Game *game, const State *curState,
   return 1;
 }
 
-void doAction( const Game *game, const Action *action, State *state )
+int isValidAction( const Game *game, const State *curState,
+		   const int tryFixing, Action *action )
 {
-  int p = currentPlayer( game, state );
+  if( stateFinished( curState ) ) {
+    return 0;
+  }
+
+  return isValidActionByPlayer( game, curState,
+				currentPlayer( game, curState ),
+				tryFixing, action );
+}
+
+/* doAction() for an action by p, who must be the current player */
+static void doActionByPlayer( const Game *game, const Action *action,
+			      State *state, const int p )
+{
+  int i;
+  uint8_t prevRound;
 
   assert( state->numActions[ state->round ] < MAX_NUM_ACTIONS );
 
+#ifdef COMPACT_STATE
+  encodeAction( state, action, p );
+#else
   state->action[ state->round ][ state->numActions[ state->round ] ] = *action;
   state->actingPlayer[ state->round ][ state->numActions[ state->round ] ] = p;
+#endif
   ++state->numActions[ state->round ];
+  state->lastActingPlayer = p;
 
   switch( action->type ) {
   case a_fold:
 
     state->playerFolded[ p ] = 1;
+    ++state->numFoldedPlayers;
     break;
 
   case a_call:
@@ -943,6 +1129,15 @@ void doAction( const Game *game, const Action *action, State *state )
 
       state->spent[ p ] = state->maxSpent;
     }
+
+    if( state->spent[ p ] >= game->stack[ p ] ) {
+
+      ++state->numAllInPlayers;
+    } else {
+      /* player has called the current bet, and can still act */
+
+      ++state->numCalledPlayers;
+    }
     break;
 
   case a_raise:
@@ -977,6 +1172,17 @@ void doAction( const Game *game, const Action *action, State *state )
     }
 
     state->spent[ p ] = state->maxSpent;
+    ++state->numRoundRaises;
+
+    /* a raise starts a new bet, which only the raiser has called */
+    if( state->spent[ p ] >= game->stack[ p ] ) {
+
+      ++state->numAllInPlayers;
+      state->numCalledPlayers = 0;
+    } else {
+
+      state->numCalledPlayers = 1;
+    }
     break;
 
   default:
@@ -985,6 +1191,7 @@ void doAction( const Game *game, const Action *action, State *state )
   }
 
   /* see if the round or game has ended */
+  prevRound = state->round;
   if( numFolded( game, state ) + 1 >= game->numPlayers ) {
     /* only one player left - game is immediately over, no showdown */
 
@@ -1002,11 +1209,11 @@ void doAction( const Game *game, const Action *action, State *state )
 
 	/* minimum raise-by is reset to minimum of big blind or 1 chip */
 	state->minNoLimitRaiseTo = 1;
-	for( p = 0; p < game->numPlayers; ++p ) {
+	for( i = 0; i < game->numPlayers; ++i ) {
 
-	  if( game->blind[ p ] > state->minNoLimitRaiseTo ) {
+	  if( game->blind[ i ] > state->minNoLimitRaiseTo ) {
 
-	    state->minNoLimitRaiseTo = game->blind[ p ];
+	    state->minNoLimitRaiseTo = game->blind[ i ];
 	  }
 	}
 
@@ -1024,36 +1231,89 @@ void doAction( const Game *game, const Action *action, State *state )
       state->round = game->numRounds - 1;
     }
   }
-}
 
-static int rankHand( const Game *game, const State *state,
-		     const uint8_t player )
-{
-  int i;
-  Cardset c = emptyCardset();
+  if( state->round != prevRound ) {
+    /* nothing has happened yet in the new round */
 
-  for( i = 0; i < game->numHoleCards; ++i ) {
+    state->numCalledPlayers = 0;
+    state->numRoundRaises = 0;
+#ifdef COMPACT_STATE
+    /* any skipped rounds (everyone all-in) have no actions */
+    while( prevRound < state->round ) {
 
-    addCardToCardset( &c, suitOfCard( state->holeCards[ player ][ i ] ),
-		      rankOfCard( state->holeCards[ player ][ i ] ) );
+      ++prevRound;
+      state->historyStart[ prevRound ] = state->historyLen;
+    }
+#endif
   }
+}
 
-  for( i = 0; i < sumBoardCards( game, state->round ); ++i ) {
+void doActionUndoable( const Game *game, const Action *action, State *state,
+		       UndoRecord *undo )
+{
+  undo->player = currentPlayer( game, state );
+  undo->maxSpent = state->maxSpent;
+  undo->minNoLimitRaiseTo = state->minNoLimitRaiseTo;
+  undo->spent = state->spent[ undo->player ];
+#ifdef COMPACT_STATE
+  undo->historyLen = state->historyLen;
+#endif
+  undo->round = state->round;
+  undo->finished = state->finished;
+  undo->numFoldedPlayers = state->numFoldedPlayers;
+  undo->numAllInPlayers = state->numAllInPlayers;
+  undo->numCalledPlayers = state->numCalledPlayers;
+  undo->numRoundRaises = state->numRoundRaises;
+  undo->lastActingPlayer = state->lastActingPlayer;
+
+  doAction( game, action, state );
+}
 
-    addCardToCardset( &c, suitOfCard( state->boardCards[ i ] ),
-		      rankOfCard( state->boardCards[ i ] ) );
-  }
+void undoAction( const Game *game, const UndoRecord *undo, State *state )
+{
+  /* the action was appended to the round it was made in, which is the
+     round recorded before any change of round */
+  state->round = undo->round;
+  assert( state->numActions[ state->round ] > 0 );
+  --state->numActions[ state->round ];
+#ifdef COMPACT_STATE
+  state->historyLen = undo->historyLen;
+#endif
+
+  /* only the acting player's spent or folded flag can have changed, and
+     a player who had folded could not have acted */
+  state->spent[ undo->player ] = undo->spent;
+  state->playerFolded[ undo->player ] = 0;
+
+  state->maxSpent = undo->maxSpent;
+  state->minNoLimitRaiseTo = undo->minNoLimitRaiseTo;
+  state->finished = undo->finished;
+  state->numFoldedPlayers = undo->numFoldedPlayers;
+  state->numAllInPlayers = undo->numAllInPlayers;
+  state->numCalledPlayers = undo->numCalledPlayers;
+  state->numRoundRaises = undo->numRoundRaises;
+  state->lastActingPlayer = undo->lastActingPlayer;
+}
+
+void doAction( const Game *game, const Action *action, State *state )
+{
+  doActionByPlayer( game, action, state, currentPlayer( game, state ) );
+}
 
-  return rankCardset( c );
+/* rank a player's hand, given all the visible board cards */
+static int rankHand( const Game *game, const State *state,
+		     const HandPrefix *board, const uint8_t player )
+{
+  return rankHandPrefix( board, game->numHoleCards,
+			 state->holeCards[ player ] );
 }
 
 double valueOfState( const Game *game, const State *state,
 		     const uint8_t player )
 {
   double value;
-  int p, numPlayers, playerIdx, numWinners, newNumPlayers;
-  int32_t size, spent[ MAX_PLAYERS ];
-  int rank[ MAX_PLAYERS ], winRank;
+  int p, rank[ MAX_PLAYERS ];
+  HandPrefix board;
 
   if( state->playerFolded[ player ] ) {
     /* folding player loses all spent money */
@@ -1076,6 +1336,36 @@ double valueOfState( const Game *game, const State *state,
 
   /* there's a showdown, and player is particpating.  Exciting! */
 
+  /* the board is shared by every player, so only build it once */
+  initHandPrefix( &board, sumBoardCards( game, state->round ),
+		  state->boardCards, game->numHoleCards );
+
+  /* rank the hands of everyone in the showdown */
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( state->spent[ p ] != 0 && !state->playerFolded[ p ] ) {
+      rank[ p ] = rankHand( game, state, &board, p );
+    }
+  }
+
+  return valueOfShowdown( game, state, rank, player );
+}
+
+double valueOfShowdown( const Game *game, const State *state,
+			const int handRank[ MAX_PLAYERS ],
+			const uint8_t player )
+{
+  double value;
+  int p, numPlayers, playerIdx, numWinners, newNumPlayers;
+  int32_t size, spent[ MAX_PLAYERS ];
+  int rank[ MAX_PLAYERS ], winRank;
+
+  if( state->playerFolded[ player ] ) {
+    /* folding player loses all spent money */
+
+    return (double)-state->spent[ player ];
+  }
+
   /* make up a list of players */
   numPlayers = 0;
   playerIdx = -1; /* useless, but gets rid of a warning */
@@ -1096,7 +1386,7 @@ double valueOfState( const Game *game, const State *state,
       if( p == player ) {
 	playerIdx = numPlayers;
       }
-      rank[ numPlayers ] = rankHand( game, state, p );
+      rank[ numPlayers ] = handRank[ p ];
     }
 
     spent[ numPlayers ] = state->spent[ p ];
@@ -1184,7 +1474,7 @@ double valueOfState( const Game *game, const State *state,
    state will be modified, even on failure */
 static int readBetting( const char *string, const Game *game, State *state )
 {
-  int c, r;
+  int c, r, p;
   Action action;
 
   c = 0;
@@ -1206,15 +1496,17 @@ static int readBetting( const char *string, const Game *game, State *state )
     }
 
     r = readAction( &string[ c ], game, &action );
-    if( r < 0 ) {
+    if( r < 0 || stateFinished( state ) ) {
       return -1;
     }
 
-    if( !isValidAction( game, state, 0, &action ) ) {
+    /* only find the acting player once for checking and doing the action */
+    p = currentPlayer( game, state );
+    if( !isValidActionByPlayer( game, state, p, 0, &action ) ) {
       return -1;
     }
 
-    doAction( game, &action, state );
+    doActionByPlayer( game, &action, state, p );
     c += r;
   }
 
@@ -1227,7 +1519,9 @@ static int readBetting( const char *string, const Game *game, State *state )
 static int printBetting( const Game *game, const State *state,
 			 const int maxLen, char *string )
 {
-  int i, a, c, r;
+  int i, pos, c, r;
+  Action action;
+  uint8_t player;
 
   c = 0;
   for( i = 0; i <= state->round; ++i ) {
@@ -1243,10 +1537,10 @@ static int printBetting( const Game *game, const State *state,
     }
 
     /* print betting for round */
-    for( a = 0; a < state->numActions[ i ]; ++a ) {
+    pos = 0;
+    while( nextActionInRound( state, i, &pos, &action, &player ) ) {
 
-      r = printAction( game, &state->action[ i ][ a ],
-		       maxLen - c, &string[ c ] );
+      r = printAction( game, &action, maxLen - c, &string[ c ] );
       if( r < 0 ) {
 	return -1;
       }
@@ -1329,6 +1623,20 @@ static int printAllHoleCards( const Game *game, const State *state,
   return c;
 }
 
+/* returns non-zero if player can see the hole cards of player p */
+static int holeCardsVisible( const Game *game, const State *state,
+			     const uint8_t player, const uint8_t p )
+{
+  if( p == player ) {
+    return 1;
+  }
+
+  /* don't show other player's cards unless there was a showdown
+     and they didn't fold */
+  return stateFinished( state ) && !state->playerFolded[ p ]
+    && numFolded( game, state ) + 1 != game->numPlayers;
+}
+
 static int printPlayerHoleCards( const Game *game, const State *state,
 				 const uint8_t player,
 				 const int maxLen, char *string )
@@ -1348,21 +1656,8 @@ static int printPlayerHoleCards( const Game *game, const State *state,
       ++c;
     }
 
-    if( p != player ) {
-      /* don't print other player's cards unless there was a showdown
-          and they didn't fold */
-
-      if( !stateFinished( state ) ) {
-	continue;
-      }
-
-      if( state->playerFolded[ p ] ) {
-	continue;
-      }
-
-      if( numFolded( game, state ) + 1 == game->numPlayers ) {
-	continue;
-      }
+    if( !holeCardsVisible( game, state, player, p ) ) {
+      continue;
     }
 
     r = printCards( game->numHoleCards, state->holeCards[ p ],
@@ -1449,13 +1744,23 @@ static int readStateCommon( const char *string, const Game *game,
 			    State *state )
 {
   uint32_t handId;
+  int32_t digits;
   int c, r;
 
   /* HEADER */
   c = 0;
 
   /* HEADER:handId */
-  if( sscanf( string, ":%"SCNu32"%n", &handId, &r ) < 1 ) {
+  if( string[ c ] != ':' ) {
+    return -1;
+  }
+  ++c;
+  r = readDigits( &string[ c ], &digits );
+  if( r >= 0 ) {
+
+    handId = digits;
+  } else if( sscanf( &string[ c ], "%"SCNu32"%n", &handId, &r ) < 1 ) {
+
     return -1;
   }
   c += r;
@@ -1516,13 +1821,27 @@ int readMatchState( const char *string, const Game *game,
 		    MatchState *state )
 {
   int c, r;
+  int32_t digits;
 
   /* HEADER = MATCHSTATE:player */
-  if( sscanf( string, "MATCHSTATE:%"SCNu8"%n",
-	      &state->viewingPlayer, &c ) < 1
-      || state->viewingPlayer >= game->numPlayers )  {
+  if( strncmp( string, "MATCHSTATE:", 11 ) != 0 ) {
+    return -1;
+  }
+  c = 11;
+  r = readDigits( &string[ c ], &digits );
+  if( r >= 0 ) {
+
+    if( digits >= game->numPlayers ) {
+      return -1;
+    }
+    state->viewingPlayer = digits;
+  } else if( sscanf( &string[ c ], "%"SCNu8"%n",
+		     &state->viewingPlayer, &r ) < 1
+	     || state->viewingPlayer >= game->numPlayers ) {
+
     return -1;
   }
+  c += r;
 
   /* read rest of state */
   r = readStateCommon( &string[ c ], game, &state->state );
@@ -1543,11 +1862,21 @@ static int printStateCommon( const Game *game, const State *state,
   c = 0;
 
   /* HEADER:handId: */
-  r = snprintf( &string[ c ], maxLen - c, ":%"PRIu32":", state->handId );
+  if( c >= maxLen ) {
+    return -1;
+  }
+  string[ c ] = ':';
+  ++c;
+  r = printNumber( state->handId, maxLen - c, &string[ c ] );
   if( r < 0 ) {
     return -1;
   }
   c += r;
+  if( c >= maxLen ) {
+    return -1;
+  }
+  string[ c ] = ':';
+  ++c;
 
   /* HEADER:handId:betting */
   r = printBetting( game, state, maxLen - c, &string[ c ] );
@@ -1574,11 +1903,11 @@ int printState( const Game *game, const State *state,
   c = 0;
 
   /* STATE */
-  r = snprintf( &string[ c ], maxLen - c, "STATE" );
-  if( r < 0 ) {
+  if( maxLen < 5 ) {
     return -1;
   }
-  c += r;
+  memcpy( string, "STATE", 5 );
+  c += 5;
 
   /* STATE:handId:betting: */
   r = printStateCommon( game, state, maxLen - c, &string[ c ] );
@@ -1617,8 +1946,12 @@ int printMatchState( const Game *game, const MatchState *state,
   c = 0;
 
   /* MATCHSTATE:player */
-  r = snprintf( &string[ c ], maxLen - c, "MATCHSTATE:%"PRIu8,
-		state->viewingPlayer );
+  if( maxLen < 11 ) {
+    return -1;
+  }
+  memcpy( string, "MATCHSTATE:", 11 );
+  c += 11;
+  r = printNumber( state->viewingPlayer, maxLen - c, &string[ c ] );
   if( r < 0 ) {
     return -1;
   }
@@ -1654,6 +1987,433 @@ int printMatchState( const Game *game, const MatchState *state,
   return c;
 }
 
+uint32_t matchStateChecksum( const char *string, const int len )
+{
+  int i;
+  uint32_t hash;
+
+  /* 32 bit FNV-1a */
+  hash = 2166136261U;
+  for( i = 0; i < len; ++i ) {
+
+    hash ^= (uint8_t)string[ i ];
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+/* find the end of the MATCHSTATE:player:handId: header in string
+   returns the length of the header, or -1 on failure */
+static int matchStateHeaderLen( const char *string )
+{
+  int i, c;
+
+  c = 0;
+  for( i = 0; i < 3; ++i ) {
+
+    while( string[ c ] != ':' ) {
+
+      if( string[ c ] == 0 ) {
+	return -1;
+      }
+      ++c;
+    }
+    ++c;
+  }
+
+  return c;
+}
+
+int printMatchStateDelta( const char *prevString, const char *curString,
+			  const int withChecksum,
+			  const int maxLen, char *string )
+{
+  int c, r, header, prevBetting, curBetting, prevCards, curCards;
+
+  /* must be the same player in the same hand */
+  header = matchStateHeaderLen( curString );
+  if( header < 0 || matchStateHeaderLen( prevString ) != header
+      || strncmp( prevString, curString, header ) != 0 ) {
+    return -1;
+  }
+
+  /* the betting can only have grown */
+  prevBetting = strcspn( &prevString[ header ], ":" );
+  curBetting = strcspn( &curString[ header ], ":" );
+  if( prevBetting > curBetting
+      || strncmp( &prevString[ header ], &curString[ header ],
+		  prevBetting ) != 0
+      || curString[ header + curBetting ] != ':' ) {
+    return -1;
+  }
+
+  prevCards = strlen( &prevString[ header + prevBetting ] );
+  curCards = strlen( &curString[ header + curBetting ] );
+  if( prevCards == curCards
+      && memcmp( &prevString[ header + prevBetting ],
+		 &curString[ header + curBetting ], curCards ) == 0 ) {
+    /* cards haven't changed, so just send the : */
+
+    curCards = 1;
+  }
+
+  /* +betting:cards */
+  if( curBetting - prevBetting + curCards + 2 > maxLen ) {
+    return -1;
+  }
+  c = 0;
+  string[ c ] = '+';
+  ++c;
+  memcpy( &string[ c ], &curString[ header + prevBetting ],
+	  curBetting - prevBetting + curCards );
+  c += curBetting - prevBetting + curCards;
+
+  /* +betting:cards:checksum */
+  if( withChecksum ) {
+
+    r = snprintf( &string[ c ], maxLen - c, ":%08"PRIx32,
+		  matchStateChecksum( curString,
+				      header + curBetting
+				      + strlen( &curString[ header
+							    + curBetting ] ) ) );
+    if( r < 0 || r >= maxLen - c ) {
+      return -1;
+    }
+    c += r;
+  }
+
+  string[ c ] = 0;
+  return c;
+}
+
+int readMatchStateDelta( const char *string, const Game *game,
+			 MatchState *state )
+{
+  int c, r, len;
+  uint32_t checksum;
+  char line[ MAX_LINE_LEN ];
+
+  /* + */
+  if( string[ 0 ] != '+' ) {
+    return -1;
+  }
+  c = 1;
+
+  /* +betting: */
+  r = readBetting( &string[ c ], game, &state->state );
+  if( r < 0 || string[ c + r - 1 ] != ':' ) {
+    return -1;
+  }
+  c += r;
+
+  /* +betting:cards */
+  if( string[ c ] != ':' && string[ c ] != '\r' && string[ c ] != '\n'
+      && string[ c ] != 0 ) {
+
+    r = readHoleCards( &string[ c ], game, &state->state );
+    if( r < 0 ) {
+      return -1;
+    }
+    c += r;
+
+    r = readBoardCards( &string[ c ], game, &state->state );
+    if( r < 0 ) {
+      return -1;
+    }
+    c += r;
+  }
+
+  /* +betting:cards:checksum */
+  if( string[ c ] == ':' ) {
+
+    ++c;
+    if( sscanf( &string[ c ], "%8"SCNx32"%n", &checksum, &r ) < 1 ) {
+      return -1;
+    }
+    c += r;
+
+    len = printMatchState( game, state, MAX_LINE_LEN, line );
+    if( len < 0 || matchStateChecksum( line, len ) != checksum ) {
+      return -1;
+    }
+  }
+
+  return c;
+}
+
+int printActionDelta( const Game *game, const MatchState *state,
+		      const Action *action, const int maxLen, char *string )
+{
+  int c, r;
+
+  c = snprintf( string, maxLen, "+%"PRIu32":%"PRIu16":",
+		state->state.handId, numActionsInHand( &state->state ) );
+  if( c < 0 || c >= maxLen ) {
+    return -1;
+  }
+
+  r = printAction( game, action, maxLen - c, &string[ c ] );
+  if( r < 0 ) {
+    return -1;
+  }
+
+  return c + r;
+}
+
+int readActionDelta( const char *string, const Game *game,
+		     uint32_t *handId, uint16_t *numActions, Action *action )
+{
+  int c, r;
+
+  c = -1;
+  if( sscanf( string, "+%"SCNu32":%"SCNu16":%n", handId, numActions,
+	      &c ) < 2 || c < 0 ) {
+    return -1;
+  }
+
+  r = readAction( &string[ c ], game, action );
+  if( r < 0 ) {
+    return -1;
+  }
+
+  return c + r;
+}
+
+static void putUint16( const uint16_t value, uint8_t *bytes )
+{
+  bytes[ 0 ] = value >> 8;
+  bytes[ 1 ] = value;
+}
+
+static void putUint32( const uint32_t value, uint8_t *bytes )
+{
+  bytes[ 0 ] = value >> 24;
+  bytes[ 1 ] = value >> 16;
+  bytes[ 2 ] = value >> 8;
+  bytes[ 3 ] = value;
+}
+
+static uint16_t getUint16( const uint8_t *bytes )
+{
+  return ( (uint16_t)bytes[ 0 ] << 8 ) | bytes[ 1 ];
+}
+
+static uint32_t getUint32( const uint8_t *bytes )
+{
+  return ( (uint32_t)bytes[ 0 ] << 24 ) | ( (uint32_t)bytes[ 1 ] << 16 )
+    | ( (uint32_t)bytes[ 2 ] << 8 ) | bytes[ 3 ];
+}
+
+void hideMatchStateCards( const Game *game, MatchState *state )
+{
+  int p, numCards;
+
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( !holeCardsVisible( game, &state->state, state->viewingPlayer, p ) ) {
+      memset( state->state.holeCards[ p ], BINARY_UNKNOWN_CARD,
+	      sizeof( state->state.holeCards[ p ] ) );
+    }
+  }
+
+  numCards = sumBoardCards( game, state->state.round );
+  memset( &state->state.boardCards[ numCards ], BINARY_UNKNOWN_CARD,
+	  MAX_BOARD_CARDS - numCards );
+}
+
+int printMatchStateBinary( const Game *game, const MatchState *state,
+			   const int maxLen, uint8_t *frame )
+{
+  int c, i, pos, numCards;
+  uint8_t p, player;
+  Action action;
+
+  /* length, type, player, handId, number of actions */
+  c = FRAME_LEN_BYTES + 8;
+  if( c > maxLen ) {
+    return -1;
+  }
+  frame[ FRAME_LEN_BYTES ] = BINARY_MATCHSTATE;
+  frame[ FRAME_LEN_BYTES + 1 ] = state->viewingPlayer;
+  putUint32( state->state.handId, &frame[ FRAME_LEN_BYTES + 2 ] );
+  putUint16( numActionsInHand( &state->state ),
+	     &frame[ FRAME_LEN_BYTES + 6 ] );
+
+  /* actions */
+  for( i = 0; i <= state->state.round; ++i ) {
+
+    pos = 0;
+    while( nextActionInRound( &state->state, i, &pos, &action, &player ) ) {
+
+      if( c + 5 > maxLen ) {
+	return -1;
+      }
+      frame[ c ] = action.type;
+      ++c;
+      if( action.type == a_raise && game->bettingType == noLimitBetting ) {
+
+	putUint32( action.size, &frame[ c ] );
+	c += 4;
+      }
+    }
+  }
+
+  /* hole cards, then board cards */
+  numCards = sumBoardCards( game, state->state.round );
+  if( c + game->numPlayers * game->numHoleCards + numCards > maxLen ) {
+    return -1;
+  }
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( holeCardsVisible( game, &state->state, state->viewingPlayer, p ) ) {
+
+      memcpy( &frame[ c ], state->state.holeCards[ p ], game->numHoleCards );
+    } else {
+
+      memset( &frame[ c ], BINARY_UNKNOWN_CARD, game->numHoleCards );
+    }
+    c += game->numHoleCards;
+  }
+  memcpy( &frame[ c ], state->state.boardCards, numCards );
+  c += numCards;
+
+  if( c - FRAME_LEN_BYTES > UINT16_MAX ) {
+    return -1;
+  }
+  putUint16( c - FRAME_LEN_BYTES, frame );
+  return c;
+}
+
+int readMatchStateBinary( const uint8_t *frame, const int len,
+			  const Game *game, MatchState *state )
+{
+  int c, i, j, end, numActions, numCards;
+  uint8_t p;
+  Action action;
+
+  if( len < FRAME_LEN_BYTES + 8
+      || getUint16( frame ) + FRAME_LEN_BYTES > len
+      || frame[ FRAME_LEN_BYTES ] != BINARY_MATCHSTATE
+      || frame[ FRAME_LEN_BYTES + 1 ] >= game->numPlayers ) {
+    return -1;
+  }
+  end = getUint16( frame ) + FRAME_LEN_BYTES;
+  state->viewingPlayer = frame[ FRAME_LEN_BYTES + 1 ];
+  initState( game, getUint32( &frame[ FRAME_LEN_BYTES + 2 ] ),
+	     &state->state );
+  numActions = getUint16( &frame[ FRAME_LEN_BYTES + 6 ] );
+  c = FRAME_LEN_BYTES + 8;
+
+  /* actions */
+  for( i = 0; i < numActions; ++i ) {
+
+    if( c >= end || frame[ c ] >= NUM_ACTION_TYPES
+	|| stateFinished( &state->state ) ) {
+      return -1;
+    }
+    action.type = (enum ActionType)frame[ c ];
+    action.size = 0;
+    ++c;
+    if( action.type == a_raise && game->bettingType == noLimitBetting ) {
+
+      if( c + 4 > end ) {
+	return -1;
+      }
+      action.size = (int32_t)getUint32( &frame[ c ] );
+      c += 4;
+    }
+
+    p = currentPlayer( game, &state->state );
+    if( !isValidActionByPlayer( game, &state->state, p, 0, &action ) ) {
+      return -1;
+    }
+    doActionByPlayer( game, &action, &state->state, p );
+  }
+
+  /* hole cards, which are either all known or all unknown for a player */
+  numCards = sumBoardCards( game, state->state.round );
+  if( c + game->numPlayers * game->numHoleCards + numCards > end ) {
+    return -1;
+  }
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( frame[ c ] != BINARY_UNKNOWN_CARD ) {
+
+      for( j = 0; j < game->numHoleCards; ++j ) {
+
+	if( frame[ c + j ] >= MAX_RANKS * MAX_SUITS ) {
+	  return -1;
+	}
+      }
+      memcpy( state->state.holeCards[ p ], &frame[ c ],
+	      game->numHoleCards );
+    }
+    c += game->numHoleCards;
+  }
+
+  /* board cards */
+  for( j = 0; j < numCards; ++j ) {
+
+    if( frame[ c + j ] >= MAX_RANKS * MAX_SUITS ) {
+      return -1;
+    }
+  }
+  memcpy( state->state.boardCards, &frame[ c ], numCards );
+  c += numCards;
+
+  /* there shouldn't be anything left over */
+  if( c != end ) {
+    return -1;
+  }
+
+  return c;
+}
+
+int printActionBinary( const MatchState *state, const Action *action,
+		       const int maxLen, uint8_t *frame )
+{
+  if( maxLen < FRAME_LEN_BYTES + 12 ) {
+    return -1;
+  }
+
+  putUint16( 12, frame );
+  frame[ FRAME_LEN_BYTES ] = BINARY_ACTION;
+  putUint32( state->state.handId, &frame[ FRAME_LEN_BYTES + 1 ] );
+  putUint16( numActionsInHand( &state->state ),
+	     &frame[ FRAME_LEN_BYTES + 5 ] );
+  frame[ FRAME_LEN_BYTES + 7 ] = action->type;
+  putUint32( action->size, &frame[ FRAME_LEN_BYTES + 8 ] );
+
+  return FRAME_LEN_BYTES + 12;
+}
+
+int readActionBinary( const uint8_t *frame, const int len,
+		      const Game *game, uint32_t *handId,
+		      uint16_t *numActions, Action *action )
+{
+  if( len < FRAME_LEN_BYTES + 12 || getUint16( frame ) != 12
+      || frame[ FRAME_LEN_BYTES ] != BINARY_ACTION
+      || frame[ FRAME_LEN_BYTES + 7 ] >= NUM_ACTION_TYPES ) {
+    return -1;
+  }
+
+  *handId = getUint32( &frame[ FRAME_LEN_BYTES + 1 ] );
+  *numActions = getUint16( &frame[ FRAME_LEN_BYTES + 5 ] );
+  action->type = (enum ActionType)frame[ FRAME_LEN_BYTES + 7 ];
+
+  /* size is zero for anything but a no-limit raise */
+  if( action->type == a_raise && game->bettingType == noLimitBetting ) {
+
+    action->size = (int32_t)getUint32( &frame[ FRAME_LEN_BYTES + 8 ] );
+  } else {
+
+    action->size = 0;
+  }
+
+  return FRAME_LEN_BYTES + 12;
+}
+
 int readAction( const char *string, const Game *game, Action *action )
 {
   int c, r;
@@ -1667,7 +2427,9 @@ int readAction( const char *string, const Game *game, Action *action )
   if( action->type == a_raise && game->bettingType == noLimitBetting ) {
     /* no-limit bet/raise needs to read a size */
 
-    if( sscanf( &string[ c ], "%"SCNd32"%n", &action->size, &r ) < 1 ) {
+    r = readDigits( &string[ c ], &action->size );
+    if( r < 0
+	&& sscanf( &string[ c ], "%"SCNd32"%n", &action->size, &r ) < 1 ) {
       return -1;
     }
     c += r;
@@ -1697,7 +2459,17 @@ int printAction( const Game *game, const Action *action,
   if( game->bettingType == noLimitBetting && action->type == a_raise ) {
     /* 2010 AAAI no-limit format has a size for bet/raise */
 
-    r = snprintf( &string[ c ], maxLen - c, "%"PRId32, action->size );
+    if( action->size < 0 ) {
+      /* never valid, but print it as it is */
+
+      if( c >= maxLen ) {
+	return -1;
+      }
+      string[ c ] = '-';
+      ++c;
+    }
+    r = printNumber( action->size < 0 ? -(int64_t)action->size
+		     : action->size, maxLen - c, &string[ c ] );
     if( r < 0 ) {
       return -1;
     }
@@ -1714,27 +2486,19 @@ int printAction( const Game *game, const Action *action,
 
 int readCard( const char *string, uint8_t *card )
 {
-  char *spos;
-  uint8_t c;
-
-  if( string[ 0 ] == 0 ) {
-    return -1;
-  }
-  spos = strchr( rankChars, toupper( string[ 0 ] ) );
-  if( spos == 0 ) {
-    return -1;
-  }
-  c = spos - rankChars;
+  uint8_t rank, suit;
 
-  if( string[ 1 ] == 0 ) {
+  /* a 0 terminator maps to 0, so we never look past the end */
+  rank = charToRank[ (uint8_t)string[ 0 ] ];
+  if( rank == 0 ) {
     return -1;
   }
-  spos = strchr( suitChars, tolower( string[ 1 ] ) );
-  if( spos == 0 ) {
+  suit = charToSuit[ (uint8_t)string[ 1 ] ];
+  if( suit == 0 ) {
     return -1;
   }
 
-  *card = makeCard( c, spos - suitChars );
+  *card = makeCard( rank - 1, suit - 1 );
 
   return 2;
 }
@@ -26,6 +26,25 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 
 #define NUM_ACTION_TYPES 3
 
+#ifdef COMPACT_STATE
+/* space for the packed betting history of a compact State, and the
+   most space one action can take up (type byte plus a 32 bit size).
+
+   This limits the whole hand, rather than each round as MAX_NUM_ACTIONS
+   does, so a compact build accepts fewer states than a normal one.  A
+   call or fold takes one byte and a raise two to six, depending on its
+   size, so a no-limit hand with more than about 60 to 80 raises is
+   refused, although limit games never get near it.  Making it big
+   enough for every state a normal build accepts, MAX_ROUNDS *
+   MAX_NUM_ACTIONS * MAX_ACTION_BYTES, would make a compact State over
+   four times larger.  Players built with COMPACT_STATE can fail to read
+   messages from a dealer built without it in such hands, so build the
+   dealer with COMPACT_STATE too, or only use compact builds for games
+   with few enough actions */
+#define MAX_HISTORY_BYTES 256
+#define MAX_ACTION_BYTES 6
+#endif
+
 
 enum BettingType { limitBetting, noLimitBetting };
 enum ActionType { a_fold = 0, a_call = 1, a_raise = 2,
@@ -87,14 +106,6 @@ typedef struct {
   /* spent[ p ] gives the total amount put into the pot by player p */
   int32_t spent[ MAX_PLAYERS ];
 
-  /* action[ r ][ i ] gives the i'th action in round r */
-  Action action[ MAX_ROUNDS ][ MAX_NUM_ACTIONS ];
-
-  /* actingPlayer[ r ][ i ] gives the player who made action i in round r
-     we can always figure this out from the actions taken, but it's
-     easier to just remember this in multiplayer (because of folds) */
-  uint8_t actingPlayer[ MAX_ROUNDS ][ MAX_NUM_ACTIONS ];
-
   /* numActions[ r ] gives the number of actions made in round r */
   uint8_t numActions[ MAX_ROUNDS ];
 
@@ -108,11 +119,45 @@ typedef struct {
   /* playerFolded[ p ] is non-zero if and only player p has folded */
   uint8_t playerFolded[ MAX_PLAYERS ];
 
+  /* counts kept up to date by initState and doAction, so that
+     numFolded(), numAllIn(), numCalled(), numRaises() and
+     currentPlayer() don't need to look through the players or actions */
+  uint8_t numFoldedPlayers;
+  uint8_t numAllInPlayers;
+  uint8_t numCalledPlayers;
+  uint8_t numRoundRaises;
+
+  /* player who made the last action in the current round
+     only meaningful if numActions[ round ] is non-zero */
+  uint8_t lastActingPlayer;
+
   /* public cards (including cards which may not yet be visible to players) */
   uint8_t boardCards[ MAX_BOARD_CARDS ];
 
   /* private cards */
   uint8_t holeCards[ MAX_PLAYERS ][ MAX_HOLE_CARDS ];
+
+#ifdef COMPACT_STATE
+  /* the betting, packed one action after another.  Each action is a
+     byte holding ( actingPlayer << 2 ) | type, which is followed for
+     raises by the size, 7 bits per byte with the low bits first and
+     the top bit of each byte set if more bytes follow.
+     historyStart[ r ] is the offset of the first action in round r */
+  uint16_t historyLen;
+  uint16_t historyStart[ MAX_ROUNDS ];
+  uint8_t history[ MAX_HISTORY_BYTES ];
+#else
+  /* action[ r ][ i ] gives the i'th action in round r
+     use getAction() rather than accessing this directly, so code also
+     works with COMPACT_STATE */
+  Action action[ MAX_ROUNDS ][ MAX_NUM_ACTIONS ];
+
+  /* actingPlayer[ r ][ i ] gives the player who made action i in round r
+     we can always figure this out from the actions taken, but it's
+     easier to just remember this in multiplayer (because of folds)
+     use getActingPlayer() rather than accessing this directly */
+  uint8_t actingPlayer[ MAX_ROUNDS ][ MAX_NUM_ACTIONS ];
+#endif
 } State;
 
 typedef struct {
@@ -120,6 +165,25 @@ typedef struct {
   uint8_t viewingPlayer;
 } MatchState;
 
+/* everything doAction() changes in a State other than the appended
+   action, so that undoAction() can put the state back exactly */
+typedef struct {
+  int32_t maxSpent;
+  int32_t minNoLimitRaiseTo;
+  int32_t spent;
+#ifdef COMPACT_STATE
+  uint16_t historyLen;
+#endif
+  uint8_t player;
+  uint8_t round;
+  uint8_t finished;
+  uint8_t numFoldedPlayers;
+  uint8_t numAllInPlayers;
+  uint8_t numCalledPlayers;
+  uint8_t numRoundRaises;
+  uint8_t lastActingPlayer;
+} UndoRecord;
+
 
 /* returns a game structure, or NULL on failure */
 Game *readGame( FILE *file );
@@ -158,6 +222,39 @@ int isValidAction( const Game *game, const State *curState,
     does not check that action is valid */
 void doAction( const Game *game, const Action *action, State *state );
 
+/* same as doAction, but also fills in undo so the action can later be
+   taken back with undoAction().  Walking a betting tree this way doesn't
+   need a copy of the state for every node */
+void doActionUndoable( const Game *game, const Action *action, State *state,
+		       UndoRecord *undo );
+
+/* take back the last action done to state, which must have been done by
+   doActionUndoable() with the given undo record.  Records must be undone
+   in the reverse order they were made */
+void undoAction( const Game *game, const UndoRecord *undo, State *state );
+
+/* get the i'th action in round r, and the player who made it
+   with COMPACT_STATE these have to decode the packed history from the
+   start of the round, so loop over a round with nextActionInRound() */
+#ifdef COMPACT_STATE
+Action getAction( const State *state, const uint8_t round,
+		  const uint8_t index );
+uint8_t getActingPlayer( const State *state, const uint8_t round,
+			 const uint8_t index );
+#else
+#define getAction( constStatePtr, round, index )		\
+  ((constStatePtr)->action[ (round) ][ (index) ])
+#define getActingPlayer( constStatePtr, round, index )	\
+  ((constStatePtr)->actingPlayer[ (round) ][ (index) ])
+#endif
+
+/* step through the actions of a round in order: *pos should start at 0,
+   and is advanced past each action
+   returns non-zero and sets *action and *player if there was another
+   action in round, zero at the end of the round */
+int nextActionInRound( const State *state, const uint8_t round, int *pos,
+		       Action *action, uint8_t *player );
+
 /* returns non-zero if hand is finished, zero otherwise */
 #define stateFinished( constStatePtr ) ((constStatePtr)->finished)
 
@@ -167,6 +264,9 @@ uint8_t currentPlayer( const Game *game, const State *state );
 /* number of raises in the current round */
 uint8_t numRaises( const State *state );
 
+/* number of actions in all rounds of the hand so far */
+uint16_t numActionsInHand( const State *state );
+
 /* number of players who have folded */
 uint8_t numFolded( const Game *game, const State *state );
 
@@ -194,6 +294,15 @@ uint8_t sumBoardCards( const Game *game, const uint8_t round );
 double valueOfState( const Game *game, const State *state,
 		      const uint8_t player );
 
+/* return the value of a finished hand with a showdown for a player,
+   given the rank of each player's hand in rank[] (as from rankCardset,
+   or any numbers which compare the same way.)  Ranks of players who
+   folded or spent nothing are ignored.  valueOfState( game, state, p )
+   is valueOfShowdown() with the ranks of the hands on state's board */
+double valueOfShowdown( const Game *game, const State *state,
+			const int rank[ MAX_PLAYERS ],
+			const uint8_t player );
+
 /* returns number of characters consumed on success, -1 on failure
    state will be modified even on a failure to read */
 int readState( const char *string, const Game *game, State *state );
@@ -214,6 +323,116 @@ int printState( const Game *game, const State *state,
 int printMatchState( const Game *game, const MatchState *state,
 		     const int maxLen, char *string );
 
+/* delta protocol extension: a player which sends a version string
+   ending in ":DELTA" (eg VERSION:2.0.0:DELTA) may be sent delta messages
+   in place of most MATCHSTATE messages.  A delta message is
+
+     +betting:cards[:checksum]
+
+   where betting is what has been added to the betting since the previous
+   message, cards is the whole card string if it has changed and empty
+   otherwise, and checksum is matchStateChecksum() of the full MATCHSTATE
+   message in hexadecimal.  The first message of each hand is always a
+   full MATCHSTATE message.  A player can respond to any message with
+
+     +handId:numActions:action
+
+   instead of the full MATCHSTATE:...:action response, where handId and
+   numActions (as given by numActionsInHand()) are those of the state it
+   is responding to, so the dealer can ignore responses to old states */
+#define DELTA_PROTOCOL_OPTION "DELTA"
+
+/* checksum of the first len characters of a MATCHSTATE message */
+uint32_t matchStateChecksum( const char *string, const int len );
+
+/* print the delta message which takes a player from the MATCHSTATE
+   message prevString to the MATCHSTATE message curString, both as made
+   by printMatchState().  Includes the checksum if withChecksum is
+   non-zero
+   returns number of characters printed, or -1 if curString does not
+   follow on from prevString (such as a new hand) or on failure */
+int printMatchStateDelta( const char *prevString, const char *curString,
+			  const int withChecksum,
+			  const int maxLen, char *string );
+
+/* apply a delta message to state, which must be the state of the
+   message before it
+   returns number of characters consumed, or -1 on failure (including
+   a checksum which doesn't match)
+   state will be modified, even on failure */
+int readMatchStateDelta( const char *string, const Game *game,
+			 MatchState *state );
+
+/* print the delta response to state with action
+   returns number of characters printed, or -1 on failure
+   DOES NOT COUNT FINAL 0 TERMINATOR IN THIS COUNT!!! */
+int printActionDelta( const Game *game, const MatchState *state,
+		      const Action *action, const int maxLen, char *string );
+
+/* read a delta response.  handId and numActions are set to those of the
+   state being responded to, which the caller should check
+   returns number of characters consumed, or -1 on failure */
+int readActionDelta( const char *string, const Game *game,
+		     uint32_t *handId, uint16_t *numActions, Action *action );
+
+/* binary protocol extension: a player which sends a version string
+   ending in ":BINARY" (eg VERSION:2.0.0:BINARY) is sent binary frames
+   in place of MATCHSTATE lines, and must respond with binary frames.
+   Every frame starts with a FRAME_LEN_BYTES big-endian count of the
+   bytes which follow it, and then a frame type byte.  Numbers are
+   big-endian.  A state frame is
+
+     BINARY_MATCHSTATE, viewingPlayer, handId (4 bytes),
+     number of actions (2 bytes), actions, hole cards, board cards
+
+   where each action is its type in one byte, followed by its size in
+   4 bytes if it is a no-limit raise.  Rounds are not marked, and follow
+   from the actions.  There are numHoleCards bytes for each player,
+   holding BINARY_UNKNOWN_CARD if the viewing player can't see them,
+   then one byte for each board card dealt so far.  A response is
+
+     BINARY_ACTION, handId (4 bytes), number of actions (2 bytes),
+     action type (1 byte), action size (4 bytes)
+
+   where the handId and number of actions are those of the state the
+   player is responding to.  A dealer which doesn't take the option
+   sends text messages, which a player can spot because no frame is long
+   enough to start with a text character */
+#define BINARY_PROTOCOL_OPTION "BINARY"
+#define BINARY_MATCHSTATE 'S'
+#define BINARY_ACTION 'A'
+#define BINARY_UNKNOWN_CARD 0xff
+
+/* print the binary frame for state, including the length
+   returns number of bytes in the frame, or -1 on failure */
+int printMatchStateBinary( const Game *game, const MatchState *state,
+			   const int maxLen, uint8_t *frame );
+
+/* read a binary state frame of len bytes, including the length
+   returns number of bytes consumed, or -1 on failure
+   state will be modified, even on failure */
+int readMatchStateBinary( const uint8_t *frame, const int len,
+			  const Game *game, MatchState *state );
+
+/* print the binary frame responding to state with action
+   returns number of bytes in the frame, or -1 on failure */
+int printActionBinary( const MatchState *state, const Action *action,
+		       const int maxLen, uint8_t *frame );
+
+/* set every card in state which the viewing player can't see, the same
+   cards printMatchState() leaves out, to BINARY_UNKNOWN_CARD.  These are
+   the other players' hole cards unless they were shown at a showdown,
+   and board cards for later rounds */
+void hideMatchStateCards( const Game *game, MatchState *state );
+
+/* read a binary response frame of len bytes, including the length
+   handId and numActions are set to those of the state being responded
+   to, which the caller should check
+   returns number of bytes consumed, or -1 on failure */
+int readActionBinary( const uint8_t *frame, const int len,
+		      const Game *game, uint32_t *handId,
+		      uint16_t *numActions, Action *action );
+
 /* read an action, returning the action in the passed pointer
    action and size will be modified even on a failure to read
    returns number of characters consumed on succes, -1 on failure */
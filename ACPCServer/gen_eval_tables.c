@@ -0,0 +1,360 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <getopt.h>
+
+/* the checked in tables, for -v */
+#include "evalHandTables"
+
+
+#define NUM_RANK_SETS 8192
+#define NUM_RANKS 13
+
+/* the tables, in the layout of evalHandTables */
+typedef struct {
+  uint16_t oneSuitVal[ NUM_RANK_SETS ];
+  uint16_t pairOtherVal[ NUM_RANK_SETS ];
+  uint16_t anySuitVal[ NUM_RANK_SETS ];
+  uint8_t topBit[ NUM_RANK_SETS ];
+  uint8_t tripsOtherVal[ NUM_RANK_SETS ];
+  uint16_t quadsVal[ NUM_RANKS ];
+  uint16_t tripsVal[ NUM_RANKS ];
+  uint16_t pairsVal[ NUM_RANKS ];
+  uint16_t twoPairOtherVal[ NUM_RANKS ];
+} EvalTables;
+
+
+static int choose( const int n, const int k )
+{
+  int i, r;
+
+  if( k < 0 || k > n ) {
+    return 0;
+  }
+
+  r = 1;
+  for( i = 1; i <= k; ++i ) {
+
+    r = r * ( n - k + i ) / i;
+  }
+
+  return r;
+}
+
+/* colex index of the numRanks highest ranks in set, out of all sets of
+   that many ranks.  Sets with fewer ranks are indexed as they are */
+static int topRanksIndex( const int set, const int numRanks )
+{
+  int r, n, index;
+
+  index = 0;
+  n = __builtin_popcount( set );
+  if( n > numRanks ) {
+    n = numRanks;
+  }
+  for( r = NUM_RANKS - 1; r >= 0 && n > 0; --r ) {
+
+    if( set & ( 1 << r ) ) {
+
+      index += choose( r, n );
+      --n;
+    }
+  }
+
+  return index;
+}
+
+/* returns the rank of the highest card in a straight made from set
+   (3 for a five high straight), or -1 if there is no straight */
+static int straightTop( const int set )
+{
+  int r;
+
+  for( r = NUM_RANKS - 1; r >= 4; --r ) {
+
+    if( ( ( set >> ( r - 4 ) ) & 0x1f ) == 0x1f ) {
+      return r;
+    }
+  }
+  if( ( set & 0x100f ) == 0x100f ) {
+    /* ace to five */
+
+    return 3;
+  }
+
+  return -1;
+}
+
+static void makeTables( EvalTables *t )
+{
+  int set, r, top;
+
+  for( set = 0; set < NUM_RANK_SETS; ++set ) {
+
+    top = straightTop( set );
+    if( __builtin_popcount( set ) < 5 ) {
+      t->oneSuitVal[ set ] = 0;
+    } else if( top >= 0 ) {
+      t->oneSuitVal[ set ] = HANDCLASS_STRAIGHT_FLUSH + top;
+    } else {
+      t->oneSuitVal[ set ] = HANDCLASS_FLUSH + topRanksIndex( set, 5 );
+    }
+
+    if( top >= 0 ) {
+      t->anySuitVal[ set ] = HANDCLASS_STRAIGHT + top;
+    } else {
+      t->anySuitVal[ set ] = HANDCLASS_SINGLE_CARD
+	+ topRanksIndex( set, 5 );
+    }
+
+    t->pairOtherVal[ set ] = topRanksIndex( set, 3 );
+    t->tripsOtherVal[ set ] = topRanksIndex( set, 2 );
+    t->topBit[ set ] = set ? 31 - __builtin_clz( set ) : 0;
+  }
+
+  for( r = 0; r < NUM_RANKS; ++r ) {
+
+    t->quadsVal[ r ] = HANDCLASS_QUADS + r * NUM_RANKS;
+    t->tripsVal[ r ] = HANDCLASS_TRIPS + r * choose( NUM_RANKS, 2 );
+    t->pairsVal[ r ] = HANDCLASS_PAIR + r * choose( NUM_RANKS, 3 );
+    t->twoPairOtherVal[ r ] = HANDCLASS_TWO_PAIR - HANDCLASS_PAIR
+      + r * NUM_RANKS;
+  }
+}
+
+static int compareTable( const char *name, const int size,
+			 const void *made, const void *current,
+			 const int entrySize )
+{
+  int i, numDiffs;
+  uint64_t a, b;
+
+  numDiffs = 0;
+  for( i = 0; i < size; ++i ) {
+
+    a = b = 0;
+    memcpy( &a, (const char *)made + i * entrySize, entrySize );
+    memcpy( &b, (const char *)current + i * entrySize, entrySize );
+    if( a != b ) {
+
+      if( numDiffs < 10 ) {
+	fprintf( stderr, "%s[ %d ]: generated %"PRIu64", evalHandTables has"
+		 " %"PRIu64"\n", name, i, a, b );
+      }
+      ++numDiffs;
+    }
+  }
+
+  return numDiffs;
+}
+
+/* check the generated tables against evalHandTables
+   returns the number of entries which are different */
+static int verifyTables( const EvalTables *t )
+{
+  int numDiffs;
+
+#define COMPARE( table ) \
+  compareTable( #table, sizeof( table ) / sizeof( table[ 0 ] ), t->table, \
+		table, sizeof( table[ 0 ] ) )
+
+  numDiffs = COMPARE( oneSuitVal );
+  numDiffs += COMPARE( pairOtherVal );
+  numDiffs += COMPARE( anySuitVal );
+  numDiffs += COMPARE( topBit );
+  numDiffs += COMPARE( tripsOtherVal );
+  numDiffs += COMPARE( quadsVal );
+  numDiffs += COMPARE( tripsVal );
+  numDiffs += COMPARE( pairsVal );
+  numDiffs += COMPARE( twoPairOtherVal );
+
+#undef COMPARE
+
+  return numDiffs;
+}
+
+static void printTable( FILE *file, const char *type, const char *name,
+			const int size, const uint64_t *values,
+			const int perLine )
+{
+  int i;
+
+  fprintf( file, "static const %s %s[ %d ]\n"
+	   "__attribute__(( aligned( 64 ) )) = {", type, name, size );
+  for( i = 0; i < size; ++i ) {
+
+    if( i % perLine == 0 ) {
+      fprintf( file, "\n  " );
+    }
+    fprintf( file, "%"PRIu64"%s", values[ i ],
+	     i + 1 < size ? ", " : " };\n\n" );
+  }
+}
+
+static void printRankTable( FILE *file, const char *name,
+			    const uint16_t *table )
+{
+  int r;
+  uint64_t values[ NUM_RANKS ];
+
+  for( r = 0; r < NUM_RANKS; ++r ) {
+
+    values[ r ] = table[ r ];
+  }
+  printTable( file, "uint16_t", name, NUM_RANKS, values, 7 );
+}
+
+static int printTables( FILE *file, const EvalTables *t, const char *layout )
+{
+  int set;
+  uint64_t values[ NUM_RANK_SETS ];
+
+  fprintf( file, "/*\nCopyright (C) 2011 by the Computer Poker Research Group,"
+	   " University of Alberta\n*/\n\n"
+	   "/* generated by gen_eval_tables -l %s, do not edit */\n\n",
+	   layout );
+  fprintf( file, "/* high card\t1287\t0\n"
+	   "   pair\t\t3718\t1287\n"
+	   "   two pair\t3601\t5005\n"
+	   "   trips\t1014\t8606\n"
+	   "   straight\t13\t9620\n"
+	   "   flush\t1287\t9633\n"
+	   "   f_house\t1014\t10920\n"
+	   "   quads\t169\t11934\n"
+	   "   s_flush\t13\t12103 */\n" );
+  fprintf( file, "#define HANDCLASS_SINGLE_CARD %d\n", HANDCLASS_SINGLE_CARD );
+  fprintf( file, "#define HANDCLASS_PAIR %d\n", HANDCLASS_PAIR );
+  fprintf( file, "#define HANDCLASS_TWO_PAIR %d\n", HANDCLASS_TWO_PAIR );
+  fprintf( file, "#define HANDCLASS_TRIPS %d\n", HANDCLASS_TRIPS );
+  fprintf( file, "#define HANDCLASS_STRAIGHT %d\n", HANDCLASS_STRAIGHT );
+  fprintf( file, "#define HANDCLASS_FLUSH %d\n", HANDCLASS_FLUSH );
+  fprintf( file, "#define HANDCLASS_FULL_HOUSE %d\n", HANDCLASS_FULL_HOUSE );
+  fprintf( file, "#define HANDCLASS_QUADS %d\n", HANDCLASS_QUADS );
+  fprintf( file, "#define HANDCLASS_STRAIGHT_FLUSH %d\n\n",
+	   HANDCLASS_STRAIGHT_FLUSH );
+
+  if( !strcmp( layout, "default" ) ) {
+
+#define PRINT_SET_TABLE( type, table )					\
+    for( set = 0; set < NUM_RANK_SETS; ++set ) {			\
+      values[ set ] = t->table[ set ];					\
+    }									\
+    printTable( file, type, #table, NUM_RANK_SETS, values, 16 );
+
+    PRINT_SET_TABLE( "uint16_t", oneSuitVal );
+    PRINT_SET_TABLE( "uint16_t", pairOtherVal );
+    PRINT_SET_TABLE( "uint16_t", anySuitVal );
+    PRINT_SET_TABLE( "uint8_t", topBit );
+    PRINT_SET_TABLE( "uint8_t", tripsOtherVal );
+
+#undef PRINT_SET_TABLE
+  } else if( !strcmp( layout, "packed" ) ) {
+
+    for( set = 0; set < NUM_RANK_SETS; ++set ) {
+      values[ set ] = t->oneSuitVal[ set ];
+    }
+    printTable( file, "uint16_t", "oneSuitVal", NUM_RANK_SETS, values, 16 );
+
+    fprintf( file, "/* bits 0-13 anySuitVal, 14-22 pairOtherVal,"
+	     " 23-29 tripsOtherVal */\n" );
+    for( set = 0; set < NUM_RANK_SETS; ++set ) {
+
+      values[ set ] = t->anySuitVal[ set ]
+	| ( (uint64_t)t->pairOtherVal[ set ] << 14 )
+	| ( (uint64_t)t->tripsOtherVal[ set ] << 23 );
+    }
+    printTable( file, "uint32_t", "packedVal", NUM_RANK_SETS, values, 8 );
+  } else if( !strcmp( layout, "merged" ) ) {
+
+    fprintf( file, "/* bits 0-13 oneSuitVal, 14-27 anySuitVal, 28-31 topBit,"
+	     " 32-40 pairOtherVal,\n   41-47 tripsOtherVal */\n" );
+    for( set = 0; set < NUM_RANK_SETS; ++set ) {
+
+      values[ set ] = t->oneSuitVal[ set ]
+	| ( (uint64_t)t->anySuitVal[ set ] << 14 )
+	| ( (uint64_t)t->topBit[ set ] << 28 )
+	| ( (uint64_t)t->pairOtherVal[ set ] << 32 )
+	| ( (uint64_t)t->tripsOtherVal[ set ] << 41 );
+    }
+    printTable( file, "uint64_t", "mergedVal", NUM_RANK_SETS, values, 4 );
+  } else {
+
+    fprintf( stderr, "ERROR: unknown table layout %s\n", layout );
+    return -1;
+  }
+
+  printRankTable( file, "quadsVal", t->quadsVal );
+  printRankTable( file, "tripsVal", t->tripsVal );
+  fprintf( file, "static const uint16_t fullHouseOtherVal\n"
+	   "= HANDCLASS_FULL_HOUSE - HANDCLASS_TRIPS;\n\n" );
+  printRankTable( file, "pairsVal", t->pairsVal );
+  printRankTable( file, "twoPairOtherVal", t->twoPairOtherVal );
+
+  return 0;
+}
+
+int main( int argc, char **argv )
+{
+  int i, verify, numDiffs;
+  char *layout;
+  EvalTables tables;
+
+  verify = 0;
+  layout = "default";
+  while( 1 ) {
+
+    i = getopt( argc, argv, "l:v" );
+    if( i < 0 ) {
+
+      break;
+    }
+
+    switch( i ) {
+    case 'l':
+
+      layout = optarg;
+      break;
+
+    case 'v':
+
+      verify = 1;
+      break;
+
+    default:
+
+      fprintf( stderr, "usage: %s [-l default|packed|merged] [-v]\n"
+	       "  -l layout\tprint the tables in the given layout\n"
+	       "  -v\t\tcheck the generated tables against evalHandTables\n",
+	       argv[ 0 ] );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  makeTables( &tables );
+
+  if( verify ) {
+
+    numDiffs = verifyTables( &tables );
+    if( numDiffs ) {
+
+      fprintf( stderr, "ERROR: %d generated table entries differ from"
+	       " evalHandTables\n", numDiffs );
+      exit( EXIT_FAILURE );
+    }
+    printf( "generated tables match evalHandTables\n" );
+    return EXIT_SUCCESS;
+  }
+
+  if( printTables( stdout, &tables, layout ) < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+
+  return EXIT_SUCCESS;
+}
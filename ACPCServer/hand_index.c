@@ -0,0 +1,859 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "hand_index.h"
+
+
+/* bits used to hold the number of cards a suit has in one group */
+#define GROUP_SHAPE_BITS 3
+
+/* bits used to hold the shape of one suit (cards in each group) */
+#define SUIT_SHAPE_BITS ( GROUP_SHAPE_BITS * MAX_HAND_INDEX_GROUPS )
+
+
+/* number of ways to choose k items from n */
+static uint64_t choose( const uint64_t n, const int k )
+{
+  int i;
+  unsigned __int128 r;
+
+  if( k < 0 || (uint64_t)k > n ) {
+    return 0;
+  }
+
+  r = 1;
+  for( i = 1; i <= k; ++i ) {
+
+    r = r * ( n - k + i ) / i;
+  }
+
+  return (uint64_t)r;
+}
+
+/* number of multisets of m items drawn from n */
+static uint64_t multisetCount( const uint64_t n, const int m )
+{
+  return choose( n + m - 1, m );
+}
+
+static int shapeCards( const uint64_t shape, const int group )
+{
+  return ( shape >> ( GROUP_SHAPE_BITS
+		      * ( MAX_HAND_INDEX_GROUPS - 1 - group ) ) )
+    & ( ( 1 << GROUP_SHAPE_BITS ) - 1 );
+}
+
+/* number of different ways one suit can hold the cards in shape */
+static uint64_t shapeCount( const HandIndexer *indexer, const int numGroups,
+			    const uint64_t shape )
+{
+  int g, used, k;
+  uint64_t count;
+
+  count = 1;
+  used = 0;
+  for( g = 0; g < numGroups; ++g ) {
+
+    k = shapeCards( shape, g );
+    count *= choose( indexer->numRanks - used, k );
+    used += k;
+  }
+
+  return count;
+}
+
+static uint64_t configShape( const uint64_t key, const int suit )
+{
+  return ( key >> ( SUIT_SHAPE_BITS * ( MAX_SUITS - 1 - suit ) ) )
+    & ( ( (uint64_t)1 << SUIT_SHAPE_BITS ) - 1 );
+}
+
+/* number of indices used by the hands in a configuration */
+static uint64_t configCount( const HandIndexer *indexer, const int numGroups,
+			     const uint64_t key )
+{
+  int i, j;
+  uint64_t count;
+
+  count = 1;
+  for( i = 0; i < indexer->numSuits; i = j ) {
+
+    for( j = i + 1; j < indexer->numSuits
+	   && configShape( key, j ) == configShape( key, i ); ++j );
+    count *= multisetCount( shapeCount( indexer, numGroups,
+					configShape( key, i ) ),
+			    j - i );
+  }
+
+  return count;
+}
+
+/* find all configurations of the groups in a round, by giving each suit
+   in turn a shape no larger than the previous suit's
+   returns the number of configurations, and fills in keys if not NULL */
+static int findConfigs( const HandIndexer *indexer,
+			const int numShapes, const uint64_t *shapes,
+			const int suit, const int firstShape,
+			int *cardsLeft, const uint64_t key, uint64_t *keys )
+{
+  int i, g, ok, num, numGroups;
+
+  numGroups = MAX_HAND_INDEX_GROUPS;
+  if( suit == indexer->numSuits ) {
+
+    for( g = 0; g < numGroups; ++g ) {
+
+      if( cardsLeft[ g ] ) {
+	return 0;
+      }
+    }
+    if( keys ) {
+      keys[ 0 ] = key;
+    }
+    return 1;
+  }
+
+  num = 0;
+  for( i = firstShape; i < numShapes; ++i ) {
+
+    ok = 1;
+    for( g = 0; g < numGroups; ++g ) {
+
+      if( shapeCards( shapes[ i ], g ) > cardsLeft[ g ] ) {
+	ok = 0;
+      }
+    }
+    if( !ok ) {
+      continue;
+    }
+
+    for( g = 0; g < numGroups; ++g ) {
+      cardsLeft[ g ] -= shapeCards( shapes[ i ], g );
+    }
+    num += findConfigs( indexer, numShapes, shapes, suit + 1, i, cardsLeft,
+			key | ( shapes[ i ] << ( SUIT_SHAPE_BITS
+						 * ( MAX_SUITS - 1 - suit ) ) ),
+			keys ? &keys[ num ] : NULL );
+    for( g = 0; g < numGroups; ++g ) {
+      cardsLeft[ g ] += shapeCards( shapes[ i ], g );
+    }
+  }
+
+  return num;
+}
+
+static int compareKeys( const void *a, const void *b )
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+int initHandIndexer( HandIndexer *indexer, const Game *game )
+{
+  int r, g, i, numGroups, numShapes, total;
+  int cardsLeft[ MAX_HAND_INDEX_GROUPS ];
+  uint64_t *shapes;
+  uint64_t shape;
+
+  memset( indexer, 0, sizeof( *indexer ) );
+  indexer->numSuits = game->numSuits;
+  indexer->numRanks = game->numRanks;
+  indexer->numRounds = game->numRounds;
+  indexer->groupSize[ 0 ] = game->numHoleCards;
+  for( r = 0; r < game->numRounds; ++r ) {
+
+    indexer->groupSize[ r + 1 ] = game->numBoardCards[ r ];
+  }
+  for( g = 0; g < MAX_HAND_INDEX_GROUPS; ++g ) {
+
+    if( indexer->groupSize[ g ] >= ( 1 << GROUP_SHAPE_BITS ) ) {
+
+      fprintf( stderr, "ERROR: too many cards in one round to index\n" );
+      return -1;
+    }
+  }
+
+  /* too big for the stack, with a slot for every possible shape */
+  shapes = (uint64_t *)malloc( sizeof( uint64_t ) << SUIT_SHAPE_BITS );
+  if( shapes == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate hand indexer\n" );
+    return -1;
+  }
+
+  for( r = 0; r < game->numRounds; ++r ) {
+    numGroups = r + 2;
+
+    /* list every shape one suit could have, largest first */
+    numShapes = 0;
+    for( shape = ( 1 << SUIT_SHAPE_BITS ) - 1; ; --shape ) {
+
+      total = 0;
+      for( g = 0; g < MAX_HAND_INDEX_GROUPS; ++g ) {
+
+	if( shapeCards( shape, g ) > ( g < numGroups
+				       ? indexer->groupSize[ g ] : 0 ) ) {
+	  break;
+	}
+	total += shapeCards( shape, g );
+      }
+      if( g == MAX_HAND_INDEX_GROUPS && total <= indexer->numRanks ) {
+
+	shapes[ numShapes ] = shape;
+	++numShapes;
+      }
+      if( shape == 0 ) {
+	break;
+      }
+    }
+
+    /* find the configurations */
+    for( g = 0; g < MAX_HAND_INDEX_GROUPS; ++g ) {
+
+      cardsLeft[ g ] = g < numGroups ? indexer->groupSize[ g ] : 0;
+    }
+    indexer->numConfigs[ r ]
+      = findConfigs( indexer, numShapes, shapes, 0, 0, cardsLeft, 0, NULL );
+    indexer->configKey[ r ] = (uint64_t *)malloc( sizeof( uint64_t )
+						  * indexer->numConfigs[ r ] );
+    indexer->configOffset[ r ]
+      = (uint64_t *)malloc( sizeof( uint64_t )
+			    * ( indexer->numConfigs[ r ] + 1 ) );
+    if( indexer->configKey[ r ] == NULL
+	|| indexer->configOffset[ r ] == NULL ) {
+
+      fprintf( stderr, "ERROR: could not allocate hand indexer\n" );
+      freeHandIndexer( indexer );
+      free( shapes );
+      return -1;
+    }
+    findConfigs( indexer, numShapes, shapes, 0, 0, cardsLeft, 0,
+		 indexer->configKey[ r ] );
+    qsort( indexer->configKey[ r ], indexer->numConfigs[ r ],
+	   sizeof( uint64_t ), compareKeys );
+
+    indexer->configOffset[ r ][ 0 ] = 0;
+    for( i = 0; i < indexer->numConfigs[ r ]; ++i ) {
+
+      indexer->configOffset[ r ][ i + 1 ] = indexer->configOffset[ r ][ i ]
+	+ configCount( indexer, numGroups, indexer->configKey[ r ][ i ] );
+    }
+    indexer->size[ r ] = indexer->configOffset[ r ][ indexer->numConfigs[ r ] ];
+  }
+  free( shapes );
+
+  return 0;
+}
+
+void freeHandIndexer( HandIndexer *indexer )
+{
+  int r;
+
+  for( r = 0; r < MAX_ROUNDS; ++r ) {
+
+    free( indexer->configKey[ r ] );
+    free( indexer->configOffset[ r ] );
+    indexer->configKey[ r ] = NULL;
+    indexer->configOffset[ r ] = NULL;
+  }
+}
+
+/* split a hand into the ranks each suit holds in each group */
+static void handSets( const HandIndexer *indexer, const int numGroups,
+		      const uint8_t *holeCards, const uint8_t *boardCards,
+		      uint16_t sets[ MAX_SUITS ][ MAX_HAND_INDEX_GROUPS ] )
+{
+  int g, i, n;
+  uint8_t card;
+
+  memset( sets, 0, sizeof( sets[ 0 ] ) * MAX_SUITS );
+  n = 0;
+  for( g = 0; g < numGroups; ++g ) {
+
+    for( i = 0; i < indexer->groupSize[ g ]; ++i ) {
+
+      if( g == 0 ) {
+	card = holeCards[ i ];
+      } else {
+	card = boardCards[ n ];
+	++n;
+      }
+      sets[ suitOfCard( card ) - ( MAX_SUITS - indexer->numSuits ) ][ g ]
+	|= 1 << ( rankOfCard( card ) - ( MAX_RANKS - indexer->numRanks ) );
+    }
+  }
+}
+
+/* index the ranks one suit holds in each group, out of shapeCount()
+   possibilities.  Each group is a colex index of its ranks, skipping
+   the ranks used by earlier groups */
+static uint64_t suitIndex( const HandIndexer *indexer, const int numGroups,
+			   const uint16_t *sets, uint64_t *shape )
+{
+  int g, k, pos;
+  uint16_t used, bits;
+  uint64_t index, mult, part;
+
+  index = 0;
+  mult = 1;
+  used = 0;
+  *shape = 0;
+  for( g = 0; g < numGroups; ++g ) {
+
+    part = 0;
+    k = 0;
+    for( bits = sets[ g ]; bits; bits &= bits - 1 ) {
+
+      pos = __builtin_ctz( bits );
+      pos -= __builtin_popcount( used & ( ( 1 << pos ) - 1 ) );
+      ++k;
+      part += choose( pos, k );
+    }
+
+    index += mult * part;
+    mult *= choose( indexer->numRanks - __builtin_popcount( used ), k );
+    used |= sets[ g ];
+    *shape |= (uint64_t)k << ( GROUP_SHAPE_BITS
+			       * ( MAX_HAND_INDEX_GROUPS - 1 - g ) );
+  }
+
+  return index;
+}
+
+/* inverse of suitIndex() */
+static void suitUnindex( const HandIndexer *indexer, const int numGroups,
+			 const uint64_t shape, uint64_t index,
+			 uint16_t *sets )
+{
+  int g, j, k, n, pos, r;
+  uint16_t used;
+  uint64_t c, part;
+
+  used = 0;
+  for( g = 0; g < numGroups; ++g ) {
+
+    k = shapeCards( shape, g );
+    n = indexer->numRanks - __builtin_popcount( used );
+    c = choose( n, k );
+    part = index % c;
+    index /= c;
+
+    sets[ g ] = 0;
+    for( j = k; j > 0; --j ) {
+
+      /* largest position with choose( pos, j ) <= part */
+      for( pos = j - 1; choose( pos + 1, j ) <= part; ++pos );
+      part -= choose( pos, j );
+
+      /* position pos among the unused ranks */
+      for( r = 0; ; ++r ) {
+
+	if( !( used & ( 1 << r ) ) ) {
+
+	  if( pos == 0 ) {
+	    break;
+	  }
+	  --pos;
+	}
+      }
+      sets[ g ] |= 1 << r;
+    }
+    used |= sets[ g ];
+  }
+}
+
+/* colex index of a multiset of m values, given in increasing order */
+static uint64_t multisetIndex( const int m, const uint64_t *values )
+{
+  int j;
+  uint64_t index;
+
+  index = 0;
+  for( j = 0; j < m; ++j ) {
+
+    index += choose( values[ j ] + j, j + 1 );
+  }
+
+  return index;
+}
+
+/* inverse of multisetIndex(), for values drawn from n */
+static void multisetUnindex( const int m, const uint64_t n, uint64_t index,
+			     uint64_t *values )
+{
+  int j;
+  uint64_t lo, hi, mid;
+
+  for( j = m; j > 0; --j ) {
+
+    /* largest w in [ j - 1, n + j - 2 ] with choose( w, j ) <= index */
+    lo = j - 1;
+    hi = n + j - 2;
+    while( lo < hi ) {
+
+      mid = lo + ( hi - lo + 1 ) / 2;
+      if( choose( mid, j ) <= index ) {
+	lo = mid;
+      } else {
+	hi = mid - 1;
+      }
+    }
+    index -= choose( lo, j );
+    values[ j - 1 ] = lo - ( j - 1 );
+  }
+}
+
+uint64_t indexHand( const HandIndexer *indexer, const uint8_t round,
+		    const uint8_t *holeCards, const uint8_t *boardCards )
+{
+  int numGroups, i, j, s, lo, hi, mid;
+  int order[ MAX_SUITS ];
+  uint16_t sets[ MAX_SUITS ][ MAX_HAND_INDEX_GROUPS ];
+  uint64_t shape[ MAX_SUITS ], suit[ MAX_SUITS ], values[ MAX_SUITS ];
+  uint64_t key, index;
+
+  numGroups = round + 2;
+  handSets( indexer, numGroups, holeCards, boardCards, sets );
+
+  /* sort the suits by shape, largest first, then by index */
+  for( s = 0; s < indexer->numSuits; ++s ) {
+
+    suit[ s ] = suitIndex( indexer, numGroups, sets[ s ], &shape[ s ] );
+    for( i = s; i > 0
+	   && ( shape[ order[ i - 1 ] ] < shape[ s ]
+		|| ( shape[ order[ i - 1 ] ] == shape[ s ]
+		     && suit[ order[ i - 1 ] ] > suit[ s ] ) ); --i ) {
+
+      order[ i ] = order[ i - 1 ];
+    }
+    order[ i ] = s;
+  }
+
+  /* find the configuration */
+  key = 0;
+  for( i = 0; i < indexer->numSuits; ++i ) {
+
+    key |= shape[ order[ i ] ] << ( SUIT_SHAPE_BITS * ( MAX_SUITS - 1 - i ) );
+  }
+  lo = 0;
+  hi = indexer->numConfigs[ round ] - 1;
+  while( lo < hi ) {
+
+    mid = ( lo + hi ) / 2;
+    if( indexer->configKey[ round ][ mid ] < key ) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  /* suits with the same shape are interchangeable, so each run of them
+     is indexed as a multiset */
+  index = 0;
+  for( i = 0; i < indexer->numSuits; i = j ) {
+
+    for( j = i; j < indexer->numSuits
+	   && shape[ order[ j ] ] == shape[ order[ i ] ]; ++j ) {
+
+      values[ j - i ] = suit[ order[ j ] ];
+    }
+    index = index * multisetCount( shapeCount( indexer, numGroups,
+					       shape[ order[ i ] ] ), j - i )
+      + multisetIndex( j - i, values );
+  }
+
+  return indexer->configOffset[ round ][ lo ] + index;
+}
+
+int unindexHand( const HandIndexer *indexer, const uint8_t round,
+		 const uint64_t index,
+		 uint8_t *holeCards, uint8_t *boardCards )
+{
+  int numGroups, lo, hi, mid, i, j, s, g, n, start, c;
+  int numCards[ MAX_HAND_INDEX_GROUPS ];
+  uint8_t *cards[ MAX_HAND_INDEX_GROUPS ], card;
+  uint16_t sets[ MAX_HAND_INDEX_GROUPS ], bits;
+  uint64_t key, rest, count, shape, values[ MAX_SUITS ];
+
+  if( round >= indexer->numRounds || index >= indexer->size[ round ] ) {
+    return -1;
+  }
+  numGroups = round + 2;
+
+  /* find the configuration */
+  lo = 0;
+  hi = indexer->numConfigs[ round ] - 1;
+  while( lo < hi ) {
+
+    mid = ( lo + hi + 1 ) / 2;
+    if( indexer->configOffset[ round ][ mid ] <= index ) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  key = indexer->configKey[ round ][ lo ];
+  rest = index - indexer->configOffset[ round ][ lo ];
+
+  /* where each group's cards go */
+  n = 0;
+  for( g = 0; g < numGroups; ++g ) {
+
+    numCards[ g ] = 0;
+    if( g == 0 ) {
+      cards[ g ] = holeCards;
+    } else {
+      cards[ g ] = &boardCards[ n ];
+      n += indexer->groupSize[ g ];
+    }
+  }
+
+  /* runs of suits with the same shape were indexed first to last, so
+     take them off last to first.  Suit s of the canonical hand gets the
+     s'th entry of the configuration */
+  for( j = indexer->numSuits; j > 0; j = i ) {
+
+    shape = configShape( key, j - 1 );
+    for( i = j - 1; i > 0 && configShape( key, i - 1 ) == shape; --i );
+    count = multisetCount( shapeCount( indexer, numGroups, shape ), j - i );
+    multisetUnindex( j - i, shapeCount( indexer, numGroups, shape ),
+		     rest % count, values );
+    rest /= count;
+
+    for( s = i; s < j; ++s ) {
+
+      suitUnindex( indexer, numGroups, shape, values[ s - i ], sets );
+      for( g = 0; g < numGroups; ++g ) {
+
+	for( bits = sets[ g ]; bits; bits &= bits - 1 ) {
+
+	  cards[ g ][ numCards[ g ] ]
+	    = makeCard( __builtin_ctz( bits )
+			+ MAX_RANKS - indexer->numRanks,
+			s + MAX_SUITS - indexer->numSuits );
+	  ++numCards[ g ];
+	}
+      }
+    }
+  }
+
+  /* put each group in increasing order */
+  for( g = 0; g < numGroups; ++g ) {
+
+    for( start = 1; start < numCards[ g ]; ++start ) {
+
+      card = cards[ g ][ start ];
+      for( c = start; c > 0 && cards[ g ][ c - 1 ] > card; --c ) {
+
+	cards[ g ][ c ] = cards[ g ][ c - 1 ];
+      }
+      cards[ g ][ c ] = card;
+    }
+  }
+
+  return 0;
+}
+
+
+/* the Lua bucketing IDs work on cards numbered from 1 */
+#define LUA_CARD( card ) ( (card) + 1 )
+#define LUA_RANK( card ) ( ( (card) - 1 ) / 4 )
+#define LUA_SUIT( card ) ( ( (card) - 1 ) % 4 )
+
+static void sortLuaCards( const int numCards, int *cards )
+{
+  int i, j, c;
+
+  for( i = 1; i < numCards; ++i ) {
+
+    c = cards[ i ];
+    for( j = i; j > 0 && cards[ j - 1 ] > c; --j ) {
+
+      cards[ j ] = cards[ j - 1 ];
+    }
+    cards[ j ] = c;
+  }
+}
+
+/* sort the board, rename suits in order of first appearance (hole cards
+   then board), then sort the board again */
+static void canonicaliseLuaCards( const int numBoardCards,
+				  const uint8_t *holeCards,
+				  const uint8_t *boardCards, int *cards,
+				  int *suits )
+{
+  int i, j, numSuits, oldSuits[ 7 ];
+
+  cards[ 0 ] = LUA_CARD( holeCards[ 0 ] );
+  cards[ 1 ] = LUA_CARD( holeCards[ 1 ] );
+  for( i = 0; i < numBoardCards; ++i ) {
+
+    cards[ i + 2 ] = LUA_CARD( boardCards[ i ] );
+  }
+  sortLuaCards( numBoardCards, &cards[ 2 ] );
+
+  numSuits = 0;
+  for( i = 0; i < numBoardCards + 2; ++i ) {
+
+    oldSuits[ i ] = LUA_SUIT( cards[ i ] );
+    for( j = 0; j < i; ++j ) {
+
+      if( oldSuits[ j ] == oldSuits[ i ] ) {
+	break;
+      }
+    }
+    if( j < i ) {
+      suits[ i ] = suits[ j ];
+    } else {
+      suits[ i ] = numSuits;
+      ++numSuits;
+    }
+    cards[ i ] += suits[ i ] - oldSuits[ i ];
+  }
+  sortLuaCards( numBoardCards, &cards[ 2 ] );
+
+  for( i = 0; i < numBoardCards + 2; ++i ) {
+
+    suits[ i ] = LUA_SUIT( cards[ i ] );
+  }
+}
+
+static int suitCatFlop( const int *s )
+{
+  if( s[ 0 ] != 0 ) {
+    return -1;
+  }
+
+  if( s[ 1 ] == 0 ) {
+
+    if( s[ 2 ] == 0 ) {
+      return s[ 3 ] * 2 + s[ 4 ];
+    } else if( s[ 2 ] == 1 ) {
+      return 5 + s[ 3 ] * 3 + s[ 4 ];
+    }
+  } else if( s[ 1 ] == 1 ) {
+
+    if( s[ 2 ] == 0 ) {
+      return 15 + s[ 3 ] * 3 + s[ 4 ];
+    } else if( s[ 2 ] == 1 ) {
+      return 25 + s[ 3 ] * 3 + s[ 4 ];
+    } else if( s[ 2 ] == 2 ) {
+      return 35 + s[ 3 ] * 4 + s[ 4 ];
+    }
+  }
+
+  return -1;
+}
+
+int64_t flopID( const uint8_t *holeCards, const uint8_t *boardCards )
+{
+  int i, cat, cards[ 5 ], suits[ 5 ];
+  int64_t id;
+
+  canonicaliseLuaCards( 3, holeCards, boardCards, cards, suits );
+
+  cat = suitCatFlop( suits );
+  if( cat < 0 ) {
+    return -1;
+  }
+
+  id = cat;
+  for( i = 0; i < 5; ++i ) {
+
+    id = id * 13 + LUA_RANK( cards[ i ] );
+  }
+
+  return id;
+}
+
+static int suitCatTurn( const int *s )
+{
+  if( s[ 0 ] != 0 ) {
+    return -1;
+  }
+
+  if( s[ 1 ] == 0 ) {
+
+    if( s[ 2 ] == 0 ) {
+
+      if( s[ 3 ] == 0 ) {
+	return s[ 4 ] * 2 + s[ 5 ];
+      } else if( s[ 3 ] == 1 ) {
+	return 5 + s[ 4 ] * 3 + s[ 5 ];
+      }
+    } else if( s[ 2 ] == 1 ) {
+
+      if( s[ 3 ] == 0 ) {
+	return 15 + s[ 4 ] * 3 + s[ 5 ];
+      } else if( s[ 3 ] == 1 ) {
+	return 25 + s[ 4 ] * 3 + s[ 5 ];
+      } else if( s[ 3 ] == 2 ) {
+	return 35 + s[ 4 ] * 4 + s[ 5 ];
+      }
+    }
+  } else if( s[ 1 ] == 1 ) {
+
+    if( s[ 2 ] == 0 ) {
+
+      if( s[ 3 ] == 0 ) {
+	return 51 + s[ 4 ] * 3 + s[ 5 ];
+      } else if( s[ 3 ] == 1 ) {
+	return 61 + s[ 4 ] * 3 + s[ 5 ];
+      } else if( s[ 3 ] == 2 ) {
+	return 71 + s[ 4 ] * 4 + s[ 5 ];
+      }
+    } else if( s[ 2 ] == 1 ) {
+
+      if( s[ 3 ] == 0 ) {
+	return 87 + s[ 4 ] * 3 + s[ 5 ];
+      } else if( s[ 3 ] == 1 ) {
+	return 97 + s[ 4 ] * 3 + s[ 5 ];
+      } else if( s[ 3 ] == 2 ) {
+	return 107 + s[ 4 ] * 4 + s[ 5 ];
+      }
+    } else if( s[ 2 ] == 2 ) {
+      return 123 + s[ 3 ] * 16 + s[ 4 ] * 4 + s[ 5 ];
+    }
+  }
+
+  return -1;
+}
+
+int64_t turnID( const uint8_t *holeCards, const uint8_t *boardCards )
+{
+  int i, cat, cards[ 6 ], suits[ 6 ];
+  int64_t id;
+
+  canonicaliseLuaCards( 4, holeCards, boardCards, cards, suits );
+
+  cat = suitCatTurn( suits );
+  if( cat < 0 ) {
+    return -1;
+  }
+
+  id = cat;
+  for( i = 0; i < 6; ++i ) {
+
+    id = id * 13 + LUA_RANK( cards[ i ] );
+  }
+
+  return id;
+}
+
+/* s[ 0 ] and s[ 1 ] are the hole card suits, s[ 2 ] to s[ 6 ] the board */
+static int suitCatRiver( const int *s )
+{
+  int i, theSuit, mask, add, count[ 4 ];
+
+  memset( count, 0, sizeof( count ) );
+  for( i = 2; i < 7; ++i ) {
+
+    ++count[ s[ i ] ];
+  }
+
+  /* only suits with at least three board cards matter */
+  theSuit = -1;
+  for( i = 0; i < 4; ++i ) {
+
+    if( count[ i ] >= 3 ) {
+      theSuit = i;
+    }
+  }
+  if( theSuit < 0 ) {
+    return 0;
+  }
+
+  if( s[ 0 ] == theSuit && s[ 1 ] == theSuit ) {
+    add = 0;
+  } else if( s[ 0 ] == theSuit ) {
+    add = 1;
+  } else if( s[ 1 ] == theSuit ) {
+    add = 2;
+  } else {
+    add = 3;
+  }
+
+  if( count[ theSuit ] == 3 ) {
+
+    mask = 0;
+    for( i = 2; i < 7; ++i ) {
+
+      if( s[ i ] == theSuit ) {
+	mask |= 1 << ( i - 2 );
+      }
+    }
+
+    /* the Lua code counts "both hole cards suited" as 1, and "neither"
+       as 0, unlike the four and five card cases */
+    add = add == 0 ? 1 : add == 3 ? 0 : add + 1;
+    switch( mask ) {
+    case 7:
+      return 1 + add;
+    case 11:
+      return 5 + add;
+    case 19:
+      return 9 + add;
+    case 13:
+      return 13 + add;
+    case 21:
+      return 17 + add;
+    case 25:
+      return 21 + add;
+    case 14:
+      return 25 + add;
+    case 22:
+      return 29 + add;
+    case 26:
+      return 33 + add;
+    case 28:
+      return 37 + add;
+    }
+    return -1;
+  }
+
+  if( count[ theSuit ] == 4 ) {
+
+    /* position of the board card in another suit */
+    for( i = 2; i < 7 && s[ i ] == theSuit; ++i );
+    return 42 + ( i - 2 ) * 4 + add;
+  }
+
+  return 62 + add;
+}
+
+int64_t riverID( const uint8_t *holeCards, const uint8_t *boardCards )
+{
+  int i, cat, cards[ 7 ], suits[ 7 ];
+  int64_t id;
+
+  /* unlike flopID and turnID, the suits are not renamed */
+  cards[ 0 ] = LUA_CARD( holeCards[ 0 ] );
+  cards[ 1 ] = LUA_CARD( holeCards[ 1 ] );
+  for( i = 0; i < 5; ++i ) {
+
+    cards[ i + 2 ] = LUA_CARD( boardCards[ i ] );
+  }
+  sortLuaCards( 5, &cards[ 2 ] );
+  for( i = 0; i < 7; ++i ) {
+
+    suits[ i ] = cards[ i ] % 4;
+  }
+
+  cat = suitCatRiver( suits );
+  if( cat < 0 ) {
+    return -1;
+  }
+
+  id = 0;
+  for( i = 0; i < 7; ++i ) {
+
+    id = id * 13 + LUA_RANK( cards[ i ] );
+  }
+
+  return (int64_t)cat * 815730722 + id;
+}
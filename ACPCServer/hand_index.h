@@ -0,0 +1,70 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _HAND_INDEX_H
+#define _HAND_INDEX_H
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "game.h"
+
+
+/* cards are split into groups which can't be swapped with each other:
+   group 0 is the hole cards, group r+1 the board cards dealt in round r */
+#define MAX_HAND_INDEX_GROUPS ( MAX_ROUNDS + 1 )
+
+
+/* maps a player's hole cards and the board up to some round onto a
+   dense index, where two hands get the same index if and only if one
+   can be turned into the other by renaming the suits.  Cards dealt in
+   the same group are unordered. */
+typedef struct {
+  int numSuits;
+  int numRanks;
+  int numRounds;
+  uint8_t groupSize[ MAX_HAND_INDEX_GROUPS ];
+
+  /* number of distinct indices in each round */
+  uint64_t size[ MAX_ROUNDS ];
+
+  /* each configuration is a sorted list of how many cards of each group
+     a suit has, one per suit.  configKey[ r ] is sorted, and the indices
+     for configuration c are [ configOffset[ r ][ c ],
+     configOffset[ r ][ c + 1 ] ) */
+  int numConfigs[ MAX_ROUNDS ];
+  uint64_t *configKey[ MAX_ROUNDS ];
+  uint64_t *configOffset[ MAX_ROUNDS ];
+} HandIndexer;
+
+
+/* set up indexer for the deck and rounds of game
+   returns 0 on success, -1 on failure */
+int initHandIndexer( HandIndexer *indexer, const Game *game );
+
+/* release memory allocated by initHandIndexer */
+void freeHandIndexer( HandIndexer *indexer );
+
+/* returns the index of holeCards plus the board cards up to round,
+   in [0,indexer->size[ round ]) */
+uint64_t indexHand( const HandIndexer *indexer, const uint8_t round,
+		    const uint8_t *holeCards, const uint8_t *boardCards );
+
+/* set holeCards and boardCards to a canonical hand with the given index
+   cards within each group are in increasing order
+   returns 0 on success, -1 if index is out of range */
+int unindexHand( const HandIndexer *indexer, const uint8_t round,
+		 const uint64_t index,
+		 uint8_t *holeCards, uint8_t *boardCards );
+
+/* the suit categorised IDs used by the Lua bucketing code to look up
+   flop_means.dat, turn_means.dat and rcats.dat, for two hole cards and
+   three, four or five board cards.  Cards are as made by makeCard(),
+   and the hole cards should be in the order the Lua code passes them
+   (increasing.)  Results are identical to flopID, turnID and riverID
+   in Source/Nn/Bucketing
+   returns -1 on failure */
+int64_t flopID( const uint8_t *holeCards, const uint8_t *boardCards );
+int64_t turnID( const uint8_t *holeCards, const uint8_t *boardCards );
+int64_t riverID( const uint8_t *holeCards, const uint8_t *boardCards );
+
+#endif
@@ -0,0 +1,205 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include "game.h"
+#include "evaluator.h"
+#include "hand_index.h"
+
+
+/* default largest round checkIndexer will go through completely */
+#define DEFAULT_CHECK_LIMIT 2000000
+
+
+static void printUsage( FILE *file, char *prog )
+{
+  fprintf( file, "usage: %s game_def [options] < hands\n", prog );
+  fprintf( file, "  reads lines of the form holeCards|boardCards, such as"
+	   " AsKd|2h3d9s, and\n"
+	   "  prints the round, hand index, and the Lua bucketing ID"
+	   " (or -1)\n" );
+  fprintf( file, "  -c\t\tprint the number of indices in each round, and"
+	   " check that\n"
+	   "\t\tevery index in rounds with at most limit indices\n"
+	   "\t\tunindexes to a hand with the same index\n" );
+  fprintf( file, "  -l limit\tlimit for -c [default: %d]\n",
+	   DEFAULT_CHECK_LIMIT );
+}
+
+static int checkIndexer( const Game *game, const HandIndexer *indexer,
+			 const uint64_t limit )
+{
+  int r;
+  uint64_t index, check;
+  uint8_t holeCards[ MAX_HOLE_CARDS ], boardCards[ MAX_BOARD_CARDS ];
+
+  for( r = 0; r < game->numRounds; ++r ) {
+
+    printf( "round %d: %"PRIu64" indices, %d configurations\n",
+	    r, indexer->size[ r ], indexer->numConfigs[ r ] );
+    if( indexer->size[ r ] > limit ) {
+      continue;
+    }
+
+    for( index = 0; index < indexer->size[ r ]; ++index ) {
+
+      if( unindexHand( indexer, r, index, holeCards, boardCards ) < 0 ) {
+
+	fprintf( stderr, "ERROR: could not unindex %"PRIu64" in round %d\n",
+		 index, r );
+	return -1;
+      }
+      check = indexHand( indexer, r, holeCards, boardCards );
+      if( check != index ) {
+
+	fprintf( stderr, "ERROR: index %"PRIu64" in round %d unindexes to"
+		 " a hand with index %"PRIu64"\n", index, r, check );
+	return -1;
+      }
+    }
+    printf( "round %d: all indices checked\n", r );
+  }
+
+  return 0;
+}
+
+int main( int argc, char **argv )
+{
+  int i, r, check, numHoleCards, numBoardCards, consumed;
+  uint64_t limit;
+  int64_t id;
+  FILE *file;
+  Game *game;
+  HandIndexer indexer;
+  Cardset used;
+  uint8_t holeCards[ MAX_HOLE_CARDS ], boardCards[ MAX_BOARD_CARDS ];
+  char line[ 256 ];
+
+  check = 0;
+  limit = DEFAULT_CHECK_LIMIT;
+  while( 1 ) {
+
+    i = getopt( argc, argv, "cl:" );
+    if( i < 0 ) {
+
+      break;
+    }
+
+    switch( i ) {
+    case 'c':
+
+      check = 1;
+      break;
+
+    case 'l':
+
+      if( sscanf( optarg, "%"SCNu64, &limit ) < 1 ) {
+
+	fprintf( stderr, "ERROR: could not get check limit from %s\n",
+		 optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    default:
+
+      printUsage( stderr, argv[ 0 ] );
+      exit( EXIT_FAILURE );
+    }
+  }
+  if( optind != argc - 1 ) {
+
+    printUsage( stderr, argv[ 0 ] );
+    exit( EXIT_FAILURE );
+  }
+
+  /* get the game definition */
+  file = fopen( argv[ optind ], "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game definition %s\n",
+	     argv[ optind ] );
+    exit( EXIT_FAILURE );
+  }
+  game = readGame( file );
+  if( game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", argv[ optind ] );
+    exit( EXIT_FAILURE );
+  }
+  fclose( file );
+
+  if( initHandIndexer( &indexer, game ) < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+
+  if( check ) {
+
+    if( checkIndexer( game, &indexer, limit ) < 0 ) {
+
+      exit( EXIT_FAILURE );
+    }
+    freeHandIndexer( &indexer );
+    free( game );
+    return EXIT_SUCCESS;
+  }
+
+  while( fgets( line, sizeof( line ), stdin ) ) {
+
+    /* get the hole cards and board */
+    numHoleCards = readCards( line, game->numHoleCards, holeCards,
+			      &consumed );
+    i = consumed;
+    numBoardCards = 0;
+    if( line[ i ] == '|' ) {
+
+      ++i;
+      numBoardCards = readCards( &line[ i ], MAX_BOARD_CARDS, boardCards,
+				 &consumed );
+      i += consumed;
+    }
+    for( r = 0; r < game->numRounds
+	   && sumBoardCards( game, r ) != numBoardCards; ++r );
+    if( numHoleCards != game->numHoleCards || r == game->numRounds
+	|| ( line[ i ] != '\n' && line[ i ] != 0 ) ) {
+
+      fprintf( stderr, "ERROR: could not get hand from %s", line );
+      exit( EXIT_FAILURE );
+    }
+
+    used = cardsToCardset( numHoleCards, holeCards );
+    if( __builtin_popcountll( used.cards
+			      | cardsToCardset( numBoardCards,
+						boardCards ).cards )
+	!= numHoleCards + numBoardCards ) {
+
+      fprintf( stderr, "ERROR: repeated card in %s", line );
+      exit( EXIT_FAILURE );
+    }
+
+    id = -1;
+    if( game->numHoleCards == 2 && game->numSuits == 4
+	&& game->numRanks == 13 ) {
+
+      if( numBoardCards == 3 ) {
+	id = flopID( holeCards, boardCards );
+      } else if( numBoardCards == 4 ) {
+	id = turnID( holeCards, boardCards );
+      } else if( numBoardCards == 5 ) {
+	id = riverID( holeCards, boardCards );
+      }
+    }
+
+    printf( "%d %"PRIu64" %"PRId64"\n", r,
+	    indexHand( &indexer, r, holeCards, boardCards ), id );
+  }
+
+  freeHandIndexer( &indexer );
+  free( game );
+  return EXIT_SUCCESS;
+}
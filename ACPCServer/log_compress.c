@@ -0,0 +1,740 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+/* for fopencookie and memrchr */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#if defined( LOG_COMPRESS_ZSTD )
+#include <zstd.h>
+#elif defined( LOG_COMPRESS_ZLIB )
+#include <zlib.h>
+#endif
+#include "log_compress.h"
+
+
+/* size of the buffers for compressed data */
+#define COMPRESS_CHUNK_LEN ( 1 << 16 )
+
+/* zstd level 3 and gzip level 6 are each library's default */
+#define ZSTD_LEVEL 3
+#define ZLIB_LEVEL 6
+
+static const uint8_t zstdMagic[ LOG_COMPRESS_MAGIC_LEN ]
+= { 0x28, 0xb5, 0x2f, 0xfd };
+static const uint8_t gzipMagic[ 2 ] = { 0x1f, 0x8b };
+
+struct LogCompressorStruct {
+  int fd;
+#if defined( LOG_COMPRESS_ZSTD )
+  ZSTD_CCtx *ctx;
+#elif defined( LOG_COMPRESS_ZLIB )
+  z_stream z;
+#endif
+  uint8_t out[ COMPRESS_CHUNK_LEN ];
+};
+
+/* a compressed log being read through a stream */
+typedef struct {
+  FILE *file;
+#if defined( LOG_COMPRESS_ZSTD )
+  ZSTD_DCtx *ctx;
+  ZSTD_inBuffer in;
+#elif defined( LOG_COMPRESS_ZLIB )
+  z_stream z;
+#endif
+  uint8_t data[ COMPRESS_CHUNK_LEN ];
+
+  /* decompressed text, of which the bytes from textPos to safeLen can be
+     read.  Text after the last new-line is held back until its frame
+     ends, so an unfinished frame never gives part of a line */
+  size_t textPos;
+  size_t textLen;
+  size_t safeLen;
+  char text[ COMPRESS_CHUNK_LEN ];
+
+  /* non-zero if the last read found the end of the file */
+  int atEnd;
+} LogStream;
+
+
+int logCompressionAvailable()
+{
+#if defined( LOG_COMPRESS_ZSTD ) || defined( LOG_COMPRESS_ZLIB )
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+int isCompressedLog( const void *bytes, const size_t len )
+{
+  return ( len >= LOG_COMPRESS_MAGIC_LEN
+	   && !memcmp( bytes, zstdMagic, LOG_COMPRESS_MAGIC_LEN ) )
+    || ( len >= sizeof( gzipMagic )
+	 && !memcmp( bytes, gzipMagic, sizeof( gzipMagic ) ) );
+}
+
+#if defined( LOG_COMPRESS_ZSTD ) || defined( LOG_COMPRESS_ZLIB )
+/* returns >= 0 on success, -1 on failure */
+static int writeAll( int fd, const uint8_t *data, size_t len )
+{
+  ssize_t r;
+
+  while( len > 0 ) {
+
+    r = write( fd, data, len );
+    if( r < 0 ) {
+
+      if( errno == EINTR ) {
+	continue;
+      }
+      return -1;
+    }
+    data += r;
+    len -= r;
+  }
+
+  return 0;
+}
+#endif
+
+LogCompressor *createLogCompressor( int fd )
+{
+#if defined( LOG_COMPRESS_ZSTD ) || defined( LOG_COMPRESS_ZLIB )
+  LogCompressor *compressor;
+
+  compressor = (LogCompressor *)malloc( sizeof( LogCompressor ) );
+  if( compressor == NULL ) {
+
+    return NULL;
+  }
+  compressor->fd = fd;
+
+#if defined( LOG_COMPRESS_ZSTD )
+  /* frames never hold their size, so finishCompressedLog() can end
+     them early */
+  compressor->ctx = ZSTD_createCCtx();
+  if( compressor->ctx == NULL
+      || ZSTD_isError( ZSTD_CCtx_setParameter( compressor->ctx,
+					       ZSTD_c_compressionLevel,
+					       ZSTD_LEVEL ) )
+      || ZSTD_isError( ZSTD_CCtx_setParameter( compressor->ctx,
+					       ZSTD_c_contentSizeFlag,
+					       0 ) ) ) {
+
+    ZSTD_freeCCtx( compressor->ctx );
+    free( compressor );
+    return NULL;
+  }
+#else
+  /* window bits over 15 give a gzip header */
+  memset( &compressor->z, 0, sizeof( compressor->z ) );
+  if( deflateInit2( &compressor->z, ZLIB_LEVEL, Z_DEFLATED, 15 + 16, 8,
+		    Z_DEFAULT_STRATEGY ) != Z_OK ) {
+
+    free( compressor );
+    return NULL;
+  }
+#endif
+
+  return compressor;
+#else
+  return NULL;
+#endif
+}
+
+int compressLog( LogCompressor *compressor, const void *data,
+		 const size_t len, const int mode )
+{
+#if defined( LOG_COMPRESS_ZSTD )
+  static const ZSTD_EndDirective directive[ 3 ]
+    = { ZSTD_e_continue, ZSTD_e_flush, ZSTD_e_end };
+  ZSTD_inBuffer in = { data, len, 0 };
+  ZSTD_outBuffer out;
+  size_t left;
+
+  /* keep going until all input is used, and for a flush or end, until
+     the library has nothing left to give */
+  do {
+
+    out.dst = compressor->out;
+    out.size = COMPRESS_CHUNK_LEN;
+    out.pos = 0;
+    left = ZSTD_compressStream2( compressor->ctx, &out, &in,
+				 directive[ mode ] );
+    if( ZSTD_isError( left ) ) {
+
+      return -1;
+    }
+    if( writeAll( compressor->fd, compressor->out, out.pos ) < 0 ) {
+
+      return -1;
+    }
+  } while( in.pos < in.size
+	   || ( mode != LOG_COMPRESS_CONTINUE && left > 0 ) );
+
+  return 0;
+#elif defined( LOG_COMPRESS_ZLIB )
+  static const int flush[ 3 ] = { Z_NO_FLUSH, Z_SYNC_FLUSH, Z_FINISH };
+  int r;
+
+  compressor->z.next_in = (Bytef *)data;
+  compressor->z.avail_in = len;
+
+  /* zlib is done when it has space left over after using all the input */
+  do {
+
+    compressor->z.next_out = compressor->out;
+    compressor->z.avail_out = COMPRESS_CHUNK_LEN;
+    r = deflate( &compressor->z, flush[ mode ] );
+    if( r == Z_STREAM_ERROR ) {
+
+      return -1;
+    }
+    if( writeAll( compressor->fd, compressor->out,
+		  COMPRESS_CHUNK_LEN - compressor->z.avail_out ) < 0 ) {
+
+      return -1;
+    }
+  } while( compressor->z.avail_out == 0
+	   || ( mode == LOG_COMPRESS_END && r != Z_STREAM_END ) );
+
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+void freeLogCompressor( LogCompressor *compressor )
+{
+#if defined( LOG_COMPRESS_ZSTD )
+  ZSTD_freeCCtx( compressor->ctx );
+#elif defined( LOG_COMPRESS_ZLIB )
+  deflateEnd( &compressor->z );
+#endif
+  free( compressor );
+}
+
+#if defined( LOG_COMPRESS_ZSTD ) || defined( LOG_COMPRESS_ZLIB )
+/* decompress as much of the input as fits after the text
+   returns 0 at the end of a frame, 1 otherwise, or -1 on failure */
+static int decompressText( LogStream *stream )
+{
+#if defined( LOG_COMPRESS_ZSTD )
+  ZSTD_outBuffer out = { &stream->text[ stream->textLen ],
+			 COMPRESS_CHUNK_LEN - stream->textLen, 0 };
+  size_t r;
+
+  /* zstd moves on to the next frame by itself */
+  r = ZSTD_decompressStream( stream->ctx, &out, &stream->in );
+  stream->textLen += out.pos;
+  if( ZSTD_isError( r ) ) {
+
+    return -1;
+  }
+  return r == 0 ? 0 : 1;
+#else
+  int r;
+
+  stream->z.next_out = (Bytef *)&stream->text[ stream->textLen ];
+  stream->z.avail_out = COMPRESS_CHUNK_LEN - stream->textLen;
+  r = inflate( &stream->z, Z_NO_FLUSH );
+  stream->textLen = COMPRESS_CHUNK_LEN - stream->z.avail_out;
+  if( r == Z_STREAM_END ) {
+    /* another member may follow */
+
+    inflateReset( &stream->z );
+    return 0;
+  }
+  return r == Z_OK || r == Z_BUF_ERROR ? 1 : -1;
+#endif
+}
+
+/* decompress more text
+   returns > 0 on success, 0 at the end of the log, -1 on failure */
+static int fillText( LogStream *stream )
+{
+  size_t c;
+  const char *newLine;
+  int r;
+
+  /* make room */
+  memmove( stream->text, &stream->text[ stream->textPos ],
+	   stream->textLen - stream->textPos );
+  stream->textLen -= stream->textPos;
+  stream->safeLen -= stream->textPos;
+  stream->textPos = 0;
+
+#if defined( LOG_COMPRESS_ZSTD )
+  c = stream->in.pos < stream->in.size;
+#else
+  c = stream->z.avail_in > 0;
+#endif
+  if( !c ) {
+
+    c = fread( stream->data, 1, COMPRESS_CHUNK_LEN, stream->file );
+    if( c == 0 ) {
+
+      if( ferror( stream->file ) ) {
+	return -1;
+      }
+
+      /* the held back text stays, in case the log is still being
+	 written and the rest of the frame turns up later */
+      clearerr( stream->file );
+      stream->atEnd = 1;
+      return 0;
+    }
+    stream->atEnd = 0;
+#if defined( LOG_COMPRESS_ZSTD )
+    stream->in.src = stream->data;
+    stream->in.size = c;
+    stream->in.pos = 0;
+#else
+    stream->z.next_in = stream->data;
+    stream->z.avail_in = c;
+#endif
+  }
+
+  r = decompressText( stream );
+  if( r < 0 ) {
+
+    return -1;
+  }
+  if( r == 0 ) {
+
+    stream->safeLen = stream->textLen;
+    return 1;
+  }
+
+  newLine = memrchr( &stream->text[ stream->safeLen ], '\n',
+		     stream->textLen - stream->safeLen );
+  if( newLine != NULL ) {
+
+    stream->safeLen = newLine - stream->text + 1;
+  } else if( stream->textLen == COMPRESS_CHUNK_LEN ) {
+    /* a line too long to be from a log */
+
+    stream->safeLen = stream->textLen;
+  }
+
+  return 1;
+}
+
+/* read decompressed bytes.  A log which ends part way through a frame
+   is read up to the last full line that can be decompressed */
+static ssize_t logStreamRead( void *cookie, char *buf, size_t size )
+{
+  LogStream *stream = (LogStream *)cookie;
+  size_t len;
+  int r;
+
+  while( stream->textPos == stream->safeLen ) {
+
+    r = fillText( stream );
+    if( r <= 0 ) {
+
+      if( r < 0 ) {
+	errno = EIO;
+      }
+      return r;
+    }
+  }
+
+  len = stream->safeLen - stream->textPos;
+  if( len > size ) {
+    len = size;
+  }
+  memcpy( buf, &stream->text[ stream->textPos ], len );
+  stream->textPos += len;
+
+  return len;
+}
+
+static int logStreamClose( void *cookie )
+{
+  LogStream *stream = (LogStream *)cookie;
+
+  if( stream->atEnd && stream->textLen > stream->safeLen ) {
+
+    fprintf( stderr, "WARNING: dropped a partial line from the unfinished end of a compressed log\n" );
+  }
+#if defined( LOG_COMPRESS_ZSTD )
+  ZSTD_freeDCtx( stream->ctx );
+#else
+  inflateEnd( &stream->z );
+#endif
+  free( stream );
+
+  return 0;
+}
+#endif
+
+FILE *openLogStream( FILE *file )
+{
+  size_t c;
+  uint8_t magic[ LOG_COMPRESS_MAGIC_LEN ];
+#if defined( LOG_COMPRESS_ZSTD ) || defined( LOG_COMPRESS_ZLIB )
+  LogStream *stream;
+  FILE *r;
+  cookie_io_functions_t funcs = { logStreamRead, NULL, NULL,
+				  logStreamClose };
+#endif
+
+  /* look at the start of the log, then go back to it */
+  c = fread( magic, 1, LOG_COMPRESS_MAGIC_LEN, file );
+  if( fseek( file, -(long)c, SEEK_CUR ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not seek in log\n" );
+    return NULL;
+  }
+  if( !isCompressedLog( magic, c ) ) {
+
+    return file;
+  }
+
+#if defined( LOG_COMPRESS_ZSTD ) || defined( LOG_COMPRESS_ZLIB )
+#if defined( LOG_COMPRESS_ZSTD )
+  if( memcmp( magic, zstdMagic, LOG_COMPRESS_MAGIC_LEN ) ) {
+
+    fprintf( stderr, "ERROR: log is gzip compressed, but this was built with LOG_COMPRESSION=zstd\n" );
+    return NULL;
+  }
+#else
+  if( memcmp( magic, gzipMagic, sizeof( gzipMagic ) ) ) {
+
+    fprintf( stderr, "ERROR: log is zstd compressed, but this was built with LOG_COMPRESSION=zlib\n" );
+    return NULL;
+  }
+#endif
+
+  stream = (LogStream *)malloc( sizeof( LogStream ) );
+  if( stream == NULL ) {
+
+    return NULL;
+  }
+  stream->file = file;
+  stream->textPos = 0;
+  stream->textLen = 0;
+  stream->safeLen = 0;
+  stream->atEnd = 0;
+#if defined( LOG_COMPRESS_ZSTD )
+  stream->ctx = ZSTD_createDCtx();
+  if( stream->ctx == NULL ) {
+
+    free( stream );
+    return NULL;
+  }
+  stream->in.src = stream->data;
+  stream->in.size = 0;
+  stream->in.pos = 0;
+#else
+  /* window bits over 31 take a gzip or zlib header */
+  memset( &stream->z, 0, sizeof( stream->z ) );
+  if( inflateInit2( &stream->z, 15 + 32 ) != Z_OK ) {
+
+    free( stream );
+    return NULL;
+  }
+#endif
+
+  r = fopencookie( stream, "r", funcs );
+  if( r == NULL ) {
+
+    logStreamClose( stream );
+  }
+  return r;
+#else
+  fprintf( stderr, "ERROR: log is compressed, but this was built without LOG_COMPRESSION\n" );
+  return NULL;
+#endif
+}
+
+#if defined( LOG_COMPRESS_ZSTD )
+/* returns the bytes in a zstd frame header before the first block, or 0
+   if there aren't enough bytes, or the frame holds its size or a
+   checksum, which the dealer never writes */
+static size_t zstdHeaderLen( const uint8_t *bytes, const size_t len )
+{
+  static const size_t dictIdLen[ 4 ] = { 0, 1, 2, 4 };
+  uint8_t descriptor;
+  size_t c;
+
+  if( len < LOG_COMPRESS_MAGIC_LEN + 1
+      || memcmp( bytes, zstdMagic, LOG_COMPRESS_MAGIC_LEN ) ) {
+    return 0;
+  }
+  descriptor = bytes[ LOG_COMPRESS_MAGIC_LEN ];
+  if( ( descriptor >> 6 ) || ( descriptor & 0x20 ) || ( descriptor & 4 ) ) {
+    /* content size, single segment, or checksum */
+
+    return 0;
+  }
+
+  /* magic, descriptor, window size, and dictionary id */
+  c = LOG_COMPRESS_MAGIC_LEN + 2 + dictIdLen[ descriptor & 3 ];
+  return c <= len ? c : 0;
+}
+
+/* find where to cut the unfinished frame at the start of bytes, which
+   is the end of the last whole block after which the text ends in a
+   new-line, or the start of the frame if there isn't one.  text is room
+   for COMPRESS_CHUNK_LEN bytes of decompressed text
+   returns >= 0 on success, -1 on failure */
+static int findZstdCut( ZSTD_DCtx *ctx, char *text,
+			const uint8_t *bytes, const size_t len,
+			size_t *cut )
+{
+  size_t c, blockLen, r;
+  uint32_t header;
+  char last;
+  ZSTD_inBuffer in;
+  ZSTD_outBuffer out;
+
+  *cut = 0;
+  c = zstdHeaderLen( bytes, len );
+  if( c == 0 ) {
+    /* cutting the whole frame is all that can be done */
+
+    return 0;
+  }
+
+  ZSTD_DCtx_reset( ctx, ZSTD_reset_session_only );
+  in.src = bytes;
+  in.pos = 0;
+  last = '\n';
+  while( c + 3 <= len ) {
+
+    /* block headers are 3 little-endian bytes of last block flag, type,
+       and size, where RLE blocks only hold 1 byte */
+    header = bytes[ c ] | ( bytes[ c + 1 ] << 8 ) | ( bytes[ c + 2 ] << 16 );
+    blockLen = ( ( header >> 1 ) & 3 ) == 1 ? 1 : header >> 3;
+    if( header & 1 || c + 3 + blockLen > len ) {
+      /* the last block is never whole in an unfinished frame */
+
+      break;
+    }
+    c += 3 + blockLen;
+
+    /* decompress up to the end of the block */
+    in.size = c;
+    do {
+
+      out.dst = text;
+      out.size = COMPRESS_CHUNK_LEN;
+      out.pos = 0;
+      r = ZSTD_decompressStream( ctx, &out, &in );
+      if( ZSTD_isError( r ) ) {
+
+	return -1;
+      }
+      if( out.pos > 0 ) {
+	last = text[ out.pos - 1 ];
+      }
+    } while( in.pos < in.size || out.pos == out.size );
+
+    if( last == '\n' ) {
+      *cut = c;
+    }
+  }
+
+  return 0;
+}
+#endif
+
+int finishCompressedLog( FILE *file )
+{
+  size_t len;
+  uint8_t magic[ LOG_COMPRESS_MAGIC_LEN ];
+#if defined( LOG_COMPRESS_ZSTD )
+  static const uint8_t lastBlock[ 3 ] = { 1, 0, 0 };
+  size_t frameStart, frameLen, cut, maxLen;
+  uint8_t *bytes, *more;
+  char *text;
+  ZSTD_DCtx *ctx;
+#elif defined( LOG_COMPRESS_ZLIB )
+  size_t memberStart, offset, cut, used;
+  uLong crc, size;
+  int r, i;
+  char last;
+  z_stream z;
+  uint8_t end[ 10 ];
+  uint8_t data[ COMPRESS_CHUNK_LEN ];
+  char text[ COMPRESS_CHUNK_LEN ];
+#endif
+
+  /* empty or uncompressed logs are left alone */
+  rewind( file );
+  len = fread( magic, 1, LOG_COMPRESS_MAGIC_LEN, file );
+  rewind( file );
+  if( !isCompressedLog( magic, len ) ) {
+
+    return 0;
+  }
+
+#if defined( LOG_COMPRESS_ZSTD )
+  /* zstd frames can be walked without decompressing them, so read the
+     log into memory and find the first frame that isn't whole */
+  maxLen = 1 << 20;
+  len = 0;
+  bytes = NULL;
+  while( 1 ) {
+
+    more = (uint8_t *)realloc( bytes, maxLen );
+    if( more == NULL ) {
+
+      free( bytes );
+      return -1;
+    }
+    bytes = more;
+    len += fread( &bytes[ len ], 1, maxLen - len, file );
+    if( len < maxLen ) {
+      break;
+    }
+    maxLen *= 2;
+  }
+  if( ferror( file ) ) {
+
+    free( bytes );
+    return -1;
+  }
+
+  frameStart = 0;
+  while( frameStart < len ) {
+
+    frameLen = ZSTD_findFrameCompressedSize( &bytes[ frameStart ],
+					     len - frameStart );
+    if( ZSTD_isError( frameLen ) ) {
+      break;
+    }
+    frameStart += frameLen;
+  }
+  if( frameStart == len ) {
+    /* every frame is whole */
+
+    free( bytes );
+    rewind( file );
+    return 0;
+  }
+
+  ctx = ZSTD_createDCtx();
+  text = (char *)malloc( COMPRESS_CHUNK_LEN );
+  if( ctx == NULL || text == NULL
+      || findZstdCut( ctx, text, &bytes[ frameStart ], len - frameStart,
+		      &cut ) < 0 ) {
+
+    ZSTD_freeDCtx( ctx );
+    free( text );
+    free( bytes );
+    return -1;
+  }
+  ZSTD_freeDCtx( ctx );
+  free( text );
+  free( bytes );
+
+  /* cut the frame back, and end it with an empty last block */
+  if( ftruncate( fileno( file ), frameStart + cut ) < 0 ) {
+
+    return -1;
+  }
+  if( cut > 0
+      && writeAll( fileno( file ), lastBlock, sizeof( lastBlock ) ) < 0 ) {
+
+    return -1;
+  }
+#elif defined( LOG_COMPRESS_ZLIB )
+  /* decompress the log a block at a time, remembering the last point
+     where the member could be ended, which is a block boundary on a byte
+     boundary after a full line, as left by each flush */
+  memset( &z, 0, sizeof( z ) );
+  if( inflateInit2( &z, 15 + 16 ) != Z_OK ) {
+
+    return -1;
+  }
+  memberStart = 0;
+  offset = 0;
+  cut = 0;
+  crc = 0;
+  size = 0;
+  last = '\n';
+  r = Z_OK;
+  while( ( len = fread( data, 1, COMPRESS_CHUNK_LEN, file ) ) > 0 ) {
+
+    z.next_in = data;
+    z.avail_in = len;
+    while( z.avail_in > 0 ) {
+
+      z.next_out = (Bytef *)text;
+      z.avail_out = COMPRESS_CHUNK_LEN;
+      r = inflate( &z, Z_BLOCK );
+      if( r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR ) {
+
+	inflateEnd( &z );
+	return -1;
+      }
+      if( z.avail_out < COMPRESS_CHUNK_LEN ) {
+	last = text[ COMPRESS_CHUNK_LEN - 1 - z.avail_out ];
+      }
+      used = offset + ( z.next_in - data );
+
+      if( r == Z_STREAM_END ) {
+
+	inflateReset( &z );
+	memberStart = used;
+	cut = used;
+	last = '\n';
+      } else if( ( z.data_type & 128 ) && !( z.data_type & 64 )
+		 && ( z.data_type & 7 ) == 0 && last == '\n' ) {
+
+	cut = used;
+	crc = z.adler;
+	size = z.total_out;
+      }
+    }
+    offset += len;
+  }
+  inflateEnd( &z );
+  if( ferror( file ) ) {
+
+    return -1;
+  }
+  if( offset == memberStart ) {
+    /* every member is whole */
+
+    rewind( file );
+    return 0;
+  }
+
+  /* cut the member back, and end it with an empty last block, then the
+     CRC and size of the text, both little-endian */
+  if( ftruncate( fileno( file ), cut ) < 0 ) {
+
+    return -1;
+  }
+  if( cut > memberStart ) {
+
+    end[ 0 ] = 3;
+    end[ 1 ] = 0;
+    for( i = 0; i < 4; ++i ) {
+
+      end[ 2 + i ] = ( crc >> ( i * 8 ) ) & 0xff;
+      end[ 6 + i ] = ( size >> ( i * 8 ) ) & 0xff;
+    }
+    if( writeAll( fileno( file ), end, sizeof( end ) ) < 0 ) {
+
+      return -1;
+    }
+  }
+#else
+  fprintf( stderr, "ERROR: log is compressed, but this was built without LOG_COMPRESSION\n" );
+  return -1;
+#endif
+
+  fprintf( stderr, "WARNING: ended the unfinished last frame of a compressed log\n" );
+  rewind( file );
+  return 0;
+}
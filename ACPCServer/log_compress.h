@@ -0,0 +1,77 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _LOG_COMPRESS_H
+#define _LOG_COMPRESS_H
+
+#include <stdlib.h>
+#include <stdio.h>
+
+
+/* streaming compression of log files.  Which compressor is used is picked
+   when building, with LOG_COMPRESS_ZSTD for zstd, LOG_COMPRESS_ZLIB for
+   gzip, or neither for no compression, in which case compressed logs
+   can't be written or read.
+
+   A compressed log is a series of zstd frames or gzip members, so logs
+   can be appended to by starting a new one.  Compressed data is flushed
+   at the writer's flush points, so everything before the last flush
+   point can be read back from a log which was never finished, and
+   finishCompressedLog() can cut an unfinished frame back to the last
+   flush point and end it there, before anything is appended. */
+#if defined( LOG_COMPRESS_ZSTD )
+#define LOG_COMPRESS_SUFFIX ".zst"
+#elif defined( LOG_COMPRESS_ZLIB )
+#define LOG_COMPRESS_SUFFIX ".gz"
+#else
+#define LOG_COMPRESS_SUFFIX ""
+#endif
+
+/* bytes needed by isCompressedLog() */
+#define LOG_COMPRESS_MAGIC_LEN 4
+
+/* what compressLog() does after compressing its data */
+#define LOG_COMPRESS_CONTINUE 0 /* nothing, output may be held back */
+#define LOG_COMPRESS_FLUSH 1 /* write out everything */
+#define LOG_COMPRESS_END 2 /* write out everything and end the frame */
+
+typedef struct LogCompressorStruct LogCompressor;
+
+
+/* returns non-zero if this build can compress logs */
+int logCompressionAvailable();
+
+/* returns non-zero if the first bytes of a file are those of a
+   compressed log, whether or not this build can read it */
+int isCompressedLog( const void *bytes, const size_t len );
+
+/* start a new compressed frame, written to fd
+   returns NULL on failure */
+LogCompressor *createLogCompressor( int fd );
+
+/* compress len bytes of data, writing whatever output is ready
+   returns >= 0 on success, -1 on failure */
+int compressLog( LogCompressor *compressor, const void *data,
+		 const size_t len, const int mode );
+
+/* free the compressor, without ending its frame */
+void freeLogCompressor( LogCompressor *compressor );
+
+/* if the last frame of a compressed log was never finished, because the
+   program writing it died, cut the frame back to the last full line it
+   can end at and end it, so frames can be appended after it.  Logs
+   which aren't compressed are left alone.  file must have been opened
+   for appending, and is rewound
+   returns >= 0 on success, -1 on failure */
+int finishCompressedLog( FILE *file );
+
+/* get a stream for reading a log from the current position of file.  If
+   the log is compressed, the stream decompresses it, stopping at the
+   last full line of an unfinished frame, and closing the stream leaves
+   file open.  Otherwise, the stream is file itself.  file must be
+   seekable
+   returns NULL on failure */
+FILE *openLogStream( FILE *file );
+
+#endif
@@ -0,0 +1,296 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include "game.h"
+#include "binary_log.h"
+#include "log_compress.h"
+
+
+/* lines of a text log before the first hand, which have to wait until
+   the seat names for the binary log header are known */
+#define MAX_LEADING_LINES 64
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: log_convert [-h handId] gameDefFile inFile [outFile]\n" );
+  fprintf( file, "  converts a text log to a binary log, or a binary log to a text log,\n" );
+  fprintf( file, "  writing to standard out if there is no outFile.  inFile can be compressed\n" );
+  fprintf( file, "  -h print only the hand with handId from a binary log\n" );
+}
+
+/* returns >= 0 on success, -1 on failure */
+static int textToBinary( const Game *game, FILE *in, FILE *out )
+{
+  int numLeading, len, i;
+  uint8_t p;
+  BinaryLogWriter *writer;
+  LogHand hand;
+  char *seatName[ MAX_PLAYERS ];
+  char *leading[ MAX_LEADING_LINES ];
+  char line[ MAX_LINE_LEN ], names[ MAX_LINE_LEN ];
+
+  writer = NULL;
+  numLeading = 0;
+  while( fgets( line, MAX_LINE_LEN, in ) ) {
+
+    len = strcspn( line, "\r\n" );
+    line[ len ] = 0;
+
+    if( writer == NULL ) {
+      /* the seats are the players of the first hand */
+
+      if( strncmp( line, "STATE", 5 ) != 0 ) {
+
+	if( numLeading == MAX_LEADING_LINES ) {
+
+	  fprintf( stderr, "ERROR: too many lines before the first hand\n" );
+	  return -1;
+	}
+	leading[ numLeading ] = strdup( line );
+	++numLeading;
+	continue;
+      }
+
+      /* the names are the last fields of the line */
+      memcpy( names, line, len + 1 );
+      for( p = game->numPlayers, i = len; p > 0 && i > 0; --i ) {
+
+	if( names[ i - 1 ] == '|' || names[ i - 1 ] == ':' ) {
+
+	  --p;
+	  seatName[ p ] = strdup( &names[ i ] );
+	  names[ i - 1 ] = 0;
+	}
+      }
+      if( p > 0 ) {
+
+	fprintf( stderr, "ERROR: could not find player names in %s\n", line );
+	return -1;
+      }
+
+      writer = createBinaryLogWriter( out, game, game->numPlayers, seatName );
+      if( writer == NULL ) {
+
+	fprintf( stderr, "ERROR: could not write binary log header\n" );
+	return -1;
+      }
+      for( i = 0; i < numLeading; ++i ) {
+
+	if( writeBinaryLogText( writer, leading[ i ],
+				strlen( leading[ i ] ) ) < 0 ) {
+
+	  fprintf( stderr, "ERROR: could not write binary log\n" );
+	  return -1;
+	}
+	free( leading[ i ] );
+      }
+    }
+
+    if( strncmp( line, "STATE", 5 ) == 0 ) {
+
+      if( readLogHand( line, game, game->numPlayers, seatName, &hand ) < 0 ) {
+
+	fprintf( stderr, "ERROR: could not read hand %s\n", line );
+	return -1;
+      }
+      if( writeBinaryLogHand( writer, &hand ) < 0 ) {
+
+	fprintf( stderr, "ERROR: could not write binary log\n" );
+	return -1;
+      }
+    } else if( writeBinaryLogText( writer, line, strlen( line ) ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not write binary log\n" );
+      return -1;
+    }
+  }
+
+  if( writer == NULL ) {
+
+    fprintf( stderr, "ERROR: no hands in text log\n" );
+    return -1;
+  }
+  if( closeBinaryLogWriter( writer ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not write binary log\n" );
+    return -1;
+  }
+
+  return 0;
+}
+
+/* print records from a binary log, starting at offset, and stopping
+   after the first hand if onlyOne is non-zero
+   returns >= 0 on success, -1 on failure */
+static int binaryToText( const BinaryLog *log, size_t offset,
+			 const int onlyOne, FILE *out )
+{
+  int r, len;
+  LogHand hand;
+  const char *text;
+  char line[ MAX_LINE_LEN ];
+
+  while( ( r = readBinaryLogRecord( log, &offset, 1, &hand,
+				    &text, &len ) ) > 0 ) {
+
+    if( r == BINARY_LOG_TEXT ) {
+
+      if( !onlyOne ) {
+	fprintf( out, "%.*s\n", len, text );
+      }
+      continue;
+    }
+
+    if( printLogHand( log->game, &hand, log->seatName,
+		      MAX_LINE_LEN, line ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not print hand %"PRIu32"\n",
+	       hand.state.handId );
+      return -1;
+    }
+    fprintf( out, "%s\n", line );
+    if( onlyOne ) {
+      return 0;
+    }
+  }
+  if( r < 0 ) {
+
+    fprintf( stderr, "ERROR: bad record in binary log\n" );
+    return -1;
+  }
+
+  return 0;
+}
+
+int main( int argc, char **argv )
+{
+  int i, r, findHand;
+  uint32_t handId;
+  size_t offset;
+  FILE *file, *logFile, *out;
+  Game *game;
+  BinaryLog *log;
+  char magic[ BINARY_LOG_MAGIC_LEN ];
+
+  findHand = 0;
+  while( ( i = getopt( argc, argv, "h:" ) ) >= 0 ) {
+
+    if( i == 'h' && sscanf( optarg, "%"SCNu32, &handId ) == 1 ) {
+
+      findHand = 1;
+    } else {
+
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+  }
+  if( optind + 2 > argc ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  /* get the game definition */
+  file = fopen( argv[ optind ], "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game definition %s\n",
+	     argv[ optind ] );
+    exit( EXIT_FAILURE );
+  }
+  game = readGame( file );
+  if( game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", argv[ optind ] );
+    exit( EXIT_FAILURE );
+  }
+  fclose( file );
+
+  /* open the output */
+  out = stdout;
+  if( optind + 2 < argc ) {
+
+    out = fopen( argv[ optind + 2 ], "w" );
+    if( out == NULL ) {
+
+      fprintf( stderr, "ERROR: could not open %s\n", argv[ optind + 2 ] );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  /* see which way to convert */
+  logFile = fopen( argv[ optind + 1 ], "r" );
+  if( logFile == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open log %s\n", argv[ optind + 1 ] );
+    exit( EXIT_FAILURE );
+  }
+  file = openLogStream( logFile );
+  if( file == NULL ) {
+    /* error messages already handled in function */
+
+    exit( EXIT_FAILURE );
+  }
+  r = fread( magic, 1, BINARY_LOG_MAGIC_LEN, file );
+  if( file != logFile ) {
+    fclose( file );
+  }
+
+  if( !isBinaryLog( magic, r ) ) {
+
+    if( findHand ) {
+
+      fprintf( stderr, "ERROR: -h needs a binary log\n" );
+      exit( EXIT_FAILURE );
+    }
+    rewind( logFile );
+    file = openLogStream( logFile );
+    if( file == NULL ) {
+
+      exit( EXIT_FAILURE );
+    }
+    r = textToBinary( game, file, out );
+    if( file != logFile ) {
+      fclose( file );
+    }
+    fclose( logFile );
+  } else {
+
+    fclose( logFile );
+    log = openBinaryLog( argv[ optind + 1 ], game );
+    if( log == NULL ) {
+      /* error messages already handled in function */
+
+      exit( EXIT_FAILURE );
+    }
+
+    if( findHand ) {
+
+      r = findBinaryLogHand( log, handId, &offset );
+      if( r < 0 ) {
+
+	fprintf( stderr, "ERROR: no hand %"PRIu32" in log\n", handId );
+      } else {
+
+	r = binaryToText( log, offset, 1, out );
+      }
+    } else {
+
+      r = binaryToText( log, log->start, 0, out );
+    }
+    closeBinaryLog( log );
+  }
+
+  if( fclose( out ) != 0 ) {
+
+    r = -1;
+  }
+  free( game );
+
+  return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
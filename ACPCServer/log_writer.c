@@ -0,0 +1,288 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "log_writer.h"
+
+
+static void futexWait( uint32_t *word, uint32_t value )
+{
+  syscall( SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0 );
+}
+
+static void futexWake( uint32_t *word )
+{
+  syscall( SYS_futex, word, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0 );
+}
+
+/* wait until *word is no longer value, with the waiting flag set for
+   the other thread to check after it changes *word */
+static void waitForChange( uint32_t *word, uint32_t value,
+			   uint32_t *waiting )
+{
+  __atomic_store_n( waiting, 1, __ATOMIC_SEQ_CST );
+  if( __atomic_load_n( word, __ATOMIC_SEQ_CST ) == value ) {
+
+    futexWait( word, value );
+  }
+  __atomic_store_n( waiting, 0, __ATOMIC_SEQ_CST );
+}
+
+/* let the writer thread know it has something to do */
+static void wakeWriter( LogWriter *log )
+{
+  __atomic_add_fetch( &log->events, 1, __ATOMIC_SEQ_CST );
+  if( __atomic_load_n( &log->writerWaiting, __ATOMIC_SEQ_CST ) ) {
+    futexWake( &log->events );
+  }
+}
+
+/* write the bytes from tail to head in the ring to the file, or to the
+   compressor, which may hold some of them back until the next flush
+   returns >= 0 on success, -1 on failure */
+static int writeRing( LogWriter *log, uint32_t tail, uint32_t head )
+{
+  uint32_t start, len;
+  ssize_t r;
+
+  while( tail != head ) {
+
+    /* write up to the end of the ring, then from the start */
+    start = tail % LOG_RING_LEN;
+    len = head - tail;
+    if( len > LOG_RING_LEN - start ) {
+      len = LOG_RING_LEN - start;
+    }
+
+    if( log->compressor != NULL ) {
+
+      if( compressLog( log->compressor, &log->data[ start ], len,
+		       LOG_COMPRESS_CONTINUE ) < 0 ) {
+	return -1;
+      }
+      tail += len;
+      continue;
+    }
+
+    r = write( log->fd, &log->data[ start ], len );
+    if( r < 0 ) {
+
+      if( errno == EINTR ) {
+	continue;
+      }
+      return -1;
+    }
+    tail += r;
+  }
+
+  return 0;
+}
+
+static void *logWriterThread( void *arg )
+{
+  LogWriter *log = (LogWriter *)arg;
+  uint32_t events, head, tail, flushHead, flushed, closed;
+
+  tail = 0;
+  flushed = 0;
+  while( 1 ) {
+
+    /* closed is set after the last write, so head is final if it's set */
+    events = __atomic_load_n( &log->events, __ATOMIC_ACQUIRE );
+    closed = __atomic_load_n( &log->closed, __ATOMIC_ACQUIRE );
+    head = __atomic_load_n( &log->head, __ATOMIC_ACQUIRE );
+    flushHead = __atomic_load_n( &log->flushHead, __ATOMIC_ACQUIRE );
+
+    if( !closed && flushHead == flushed
+	&& head - tail < LOG_HIGH_WATER ) {
+      /* nothing to do yet */
+
+      waitForChange( &log->events, events, &log->writerWaiting );
+      continue;
+    }
+
+    /* after a failure, keep emptying the ring so the producer never
+       waits forever */
+    if( !log->failed && writeRing( log, tail, head ) < 0 ) {
+
+      __atomic_store_n( &log->failed, 1, __ATOMIC_SEQ_CST );
+    }
+    tail = head;
+    __atomic_store_n( &log->tail, tail, __ATOMIC_SEQ_CST );
+    if( __atomic_load_n( &log->producerWaiting, __ATOMIC_SEQ_CST ) ) {
+      futexWake( &log->tail );
+    }
+
+    if( flushHead != flushed || closed ) {
+
+      /* end the compressed frame when closing, so the file is complete */
+      if( log->compressor != NULL && !log->failed
+	  && compressLog( log->compressor, NULL, 0,
+			  closed ? LOG_COMPRESS_END
+			  : LOG_COMPRESS_FLUSH ) < 0 ) {
+
+	__atomic_store_n( &log->failed, 1, __ATOMIC_SEQ_CST );
+      }
+      if( log->sync && !log->failed && fdatasync( log->fd ) < 0
+	  && errno != EINVAL ) {
+	/* EINVAL is a file which can't be synced, like a pipe */
+
+	__atomic_store_n( &log->failed, 1, __ATOMIC_SEQ_CST );
+      }
+      flushed = flushHead;
+    }
+
+    if( closed ) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+LogWriter *createLogWriter( FILE *file, uint32_t flushHands, int sync,
+			    int compress )
+{
+  LogWriter *log;
+
+  /* anything already in the stream has to come first */
+  if( fflush( file ) != 0 ) {
+
+    return NULL;
+  }
+
+  log = (LogWriter *)malloc( sizeof( LogWriter ) );
+  if( log == NULL ) {
+
+    return NULL;
+  }
+  log->data = (char *)malloc( LOG_RING_LEN );
+  if( log->data == NULL ) {
+
+    free( log );
+    return NULL;
+  }
+
+  log->file = file;
+  log->fd = fileno( file );
+  log->compressor = NULL;
+  if( compress ) {
+
+    log->compressor = createLogCompressor( log->fd );
+    if( log->compressor == NULL ) {
+
+      free( log->data );
+      free( log );
+      return NULL;
+    }
+  }
+  log->flushHands = flushHands;
+  log->sync = sync;
+  log->head = 0;
+  log->flushHead = 0;
+  log->handsSinceFlush = 0;
+  log->closed = 0;
+  log->tail = 0;
+  log->failed = 0;
+  log->events = 0;
+  log->writerWaiting = 0;
+  log->producerWaiting = 0;
+
+  if( pthread_create( &log->thread, NULL, logWriterThread, log ) != 0 ) {
+
+    if( log->compressor != NULL ) {
+      freeLogCompressor( log->compressor );
+    }
+    free( log->data );
+    free( log );
+    return NULL;
+  }
+
+  return log;
+}
+
+ssize_t logWrite( LogWriter *log, const void *data, size_t len )
+{
+  const char *bytes = (const char *)data;
+  uint32_t head, tail, n, start, first;
+  size_t done;
+
+  if( __atomic_load_n( &log->failed, __ATOMIC_ACQUIRE ) ) {
+    return -1;
+  }
+
+  /* only the producer changes head */
+  head = log->head;
+  done = 0;
+  while( done < len ) {
+
+    tail = __atomic_load_n( &log->tail, __ATOMIC_ACQUIRE );
+    n = LOG_RING_LEN - ( head - tail );
+    if( n == 0 ) {
+      /* ring is full, which the writer has already been told about */
+
+      waitForChange( &log->tail, tail, &log->producerWaiting );
+      continue;
+    }
+    if( n > len - done ) {
+      n = len - done;
+    }
+
+    start = head % LOG_RING_LEN;
+    first = LOG_RING_LEN - start;
+    if( first > n ) {
+      first = n;
+    }
+    memcpy( &log->data[ start ], &bytes[ done ], first );
+    memcpy( log->data, &bytes[ done + first ], n - first );
+    head += n;
+    done += n;
+
+    __atomic_store_n( &log->head, head, __ATOMIC_RELEASE );
+    if( head - tail >= LOG_HIGH_WATER ) {
+      wakeWriter( log );
+    }
+  }
+
+  return len;
+}
+
+int logEndHand( LogWriter *log )
+{
+  if( __atomic_load_n( &log->failed, __ATOMIC_ACQUIRE ) ) {
+    return -1;
+  }
+
+  if( log->flushHands == 0 || ++log->handsSinceFlush < log->flushHands ) {
+    return 0;
+  }
+
+  log->handsSinceFlush = 0;
+  __atomic_store_n( &log->flushHead, log->head, __ATOMIC_RELEASE );
+  wakeWriter( log );
+
+  return 0;
+}
+
+int closeLogWriter( LogWriter *log )
+{
+  int r;
+
+  __atomic_store_n( &log->closed, 1, __ATOMIC_RELEASE );
+  wakeWriter( log );
+  pthread_join( log->thread, NULL );
+
+  r = log->failed ? -1 : 0;
+  if( log->compressor != NULL ) {
+    freeLogCompressor( log->compressor );
+  }
+  free( log->data );
+  free( log );
+
+  return r;
+}
@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _LOG_WRITER_H
+#define _LOG_WRITER_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <pthread.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "log_compress.h"
+
+
+/* bytes of log which can be waiting for the writer thread.  Each table
+   of a dealer has two rings, so this is kept small, but it must stay a
+   power of two */
+#define LOG_RING_LEN ( 1 << 16 )
+/* the writer thread starts writing once this much is waiting, even if
+   nothing asked for it */
+#define LOG_HIGH_WATER ( LOG_RING_LEN / 2 )
+
+/* a log file written by its own thread, so disk latency stays out of the
+   thread adding to the log.  Lines are copied into a ring buffer with one
+   producer (the thread calling logWrite) and one consumer (the writer
+   thread), which only wait on each other when there is nothing to write
+   or no room to add more.
+
+   The writer writes everything waiting at flush points, which are the
+   end of every flushHands hands, and when the writer is closed.  If sync
+   is non-zero, the file is also synced to disk at every flush point, so
+   a crash can only lose what came after the last one.
+
+   A compressed log is compressed by the writer thread as well, so
+   compression never slows down the producer unless the ring fills up. */
+typedef struct {
+  /* the file being written, which can still be read through the stream.
+     Writes go straight to its descriptor */
+  FILE *file;
+  int fd;
+
+  /* NULL if the log isn't compressed */
+  LogCompressor *compressor;
+
+  /* 0 to only flush when closed */
+  uint32_t flushHands;
+  int sync;
+
+  /* only changed by the producer */
+  uint32_t head;
+  uint32_t flushHead; /* head at the last flush point */
+  uint32_t handsSinceFlush;
+  uint32_t closed;
+
+  /* only changed by the writer thread */
+  uint32_t tail;
+  uint32_t failed;
+
+  /* changed by the producer whenever the writer has something to do */
+  uint32_t events;
+
+  /* non-zero while the thread may be in a futex wait */
+  uint32_t writerWaiting;
+  uint32_t producerWaiting;
+
+  pthread_t thread;
+  char *data;
+} LogWriter;
+
+/* start a writer thread for file, after writing anything buffered in the
+   stream.  If compress is non-zero, everything written is compressed as
+   a new frame.  Nothing else should write to file until the writer is
+   closed
+   returns NULL on failure */
+LogWriter *createLogWriter( FILE *file, uint32_t flushHands, int sync,
+			    int compress );
+
+/* add len bytes to the log, waiting for room if the writer is behind
+   returns len on success, -1 if an earlier write to the file failed */
+ssize_t logWrite( LogWriter *log, const void *data, size_t len );
+
+/* note the end of a hand, which may be a flush point
+   returns >= 0 on success, -1 if an earlier write to the file failed */
+int logEndHand( LogWriter *log );
+
+/* write and sync everything, ending any compressed frame, and stop the
+   writer thread.  The file is left open
+   returns >= 0 on success, -1 if any write to the file failed */
+int closeLogWriter( LogWriter *log );
+
+#endif
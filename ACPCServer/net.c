@@ -2,11 +2,22 @@
 Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 */
 
+/* for memfd_create, fopencookie and POLLRDHUP */
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <netdb.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/futex.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include "net.h"
@@ -20,19 +31,588 @@ ReadBuf *createReadBuf( int fd )
     return readBuf;
   }
 
+  /* one extra byte so getLineView() can always terminate a line */
+  readBuf->buf = (char *)malloc( READBUF_LEN + 1 );
+  if( readBuf->buf == 0 ) {
+
+    free( readBuf );
+    return 0;
+  }
+  readBuf->bufSize = READBUF_LEN;
+
   readBuf->fd = fd;
   readBuf->bufStart = 0;
   readBuf->bufEnd = 0;
+  readBuf->savedChar = -1;
+  readBuf->shm = NULL;
+  readBuf->nonBlocking = ( fcntl( fd, F_GETFL, 0 ) & O_NONBLOCK ) != 0;
+  readBuf->recvFlags = 0;
 
   return readBuf;
 }
 
+ReadBuf *createShmReadBuf( ShmChannel *shm )
+{
+  ReadBuf *readBuf = createReadBuf( shm->sock );
+  if( readBuf == 0 ) {
+
+    return readBuf;
+  }
+
+  readBuf->shm = shm;
+  return readBuf;
+}
+
+void setReadBufDontWait( ReadBuf *readBuf )
+{
+  readBuf->nonBlocking = 1;
+  readBuf->recvFlags = MSG_DONTWAIT;
+}
+
 void destroyReadBuf( ReadBuf *readBuf )
 {
-  close( readBuf->fd );
+  if( readBuf->shm ) {
+
+    destroyShmChannel( readBuf->shm );
+  } else {
+
+    close( readBuf->fd );
+  }
+  free( readBuf->buf );
   free( readBuf );
 }
 
+int64_t monotonicMicros()
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int setNonBlocking( int fd )
+{
+  int flags;
+
+  flags = fcntl( fd, F_GETFL, 0 );
+  if( flags < 0 || fcntl( fd, F_SETFL, flags | O_NONBLOCK ) < 0 ) {
+
+    return -1;
+  }
+
+  return 0;
+}
+
+/* turn a timeout into a monotonic time deadline, -1 for no timeout
+   a timeout of 0 gives a deadline of 0, which has always passed, without
+   looking at the clock */
+static int64_t timeoutDeadline( int64_t timeoutMicros )
+{
+  if( timeoutMicros < 0 ) {
+    return -1;
+  }
+  if( timeoutMicros == 0 ) {
+    return 0;
+  }
+
+  return monotonicMicros() + timeoutMicros;
+}
+
+/* wait until fd has input, or until the monotonic time deadline
+   (in microseconds) if it is non-negative
+   returns 1 if there is input, 0 on timeout, -1 on error */
+static int waitForInput( int fd, int64_t deadline )
+{
+  int64_t timeLeft;
+  struct pollfd pfd;
+  int r;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while( 1 ) {
+
+    if( deadline < 0 ) {
+
+      r = poll( &pfd, 1, -1 );
+    } else {
+
+      /* round up, so we don't spin just before the deadline */
+      timeLeft = deadline - monotonicMicros();
+      if( timeLeft < 0 ) {
+
+	timeLeft = 0;
+      }
+      r = poll( &pfd, 1, ( timeLeft + 999 ) / 1000 );
+    }
+
+    if( r < 0 && errno == EINTR ) {
+      continue;
+    }
+    return r;
+  }
+}
+
+static long futexWait( uint32_t *word, uint32_t value, int64_t micros )
+{
+  struct timespec ts;
+
+  ts.tv_sec = micros / 1000000;
+  ts.tv_nsec = ( micros % 1000000 ) * 1000;
+  return syscall( SYS_futex, word, FUTEX_WAIT, value, &ts, NULL, 0 );
+}
+
+static void futexWake( uint32_t *word )
+{
+  syscall( SYS_futex, word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0 );
+}
+
+/* returns non-zero if the other end of a unix socket has closed it */
+static int peerClosed( int sock )
+{
+  struct pollfd pfd;
+
+  pfd.fd = sock;
+  pfd.events = POLLRDHUP;
+  return poll( &pfd, 1, 0 ) > 0
+    && ( pfd.revents & ( POLLRDHUP | POLLHUP | POLLERR ) );
+}
+
+/* wait until *word in ring is no longer value, or until the monotonic
+   time deadline (in microseconds) if it is non-negative.  The futex wait
+   is done in short slices, so a peer which died without closing the
+   channel is noticed through the channel's socket
+   returns 0 when *word might have changed, -1 on timeout or if the
+   other end has gone away */
+static int shmWait( ShmChannel *shm, ShmRing *ring,
+		    uint32_t *word, uint32_t value, int64_t deadline )
+{
+  int64_t micros;
+  long r;
+
+  micros = SHM_CHECK_MICROS;
+  if( deadline >= 0 ) {
+
+    micros = deadline - monotonicMicros();
+    if( micros <= 0 ) {
+
+      errno = EAGAIN;
+      return -1;
+    }
+    if( micros > SHM_CHECK_MICROS ) {
+      micros = SHM_CHECK_MICROS;
+    }
+  }
+
+  /* the other side checks waiting after changing *word, so either we
+     see the change here, or it sees waiting and wakes us */
+  __atomic_store_n( &ring->waiting, 1, __ATOMIC_SEQ_CST );
+  r = 0;
+  if( __atomic_load_n( word, __ATOMIC_SEQ_CST ) == value
+      && !__atomic_load_n( &ring->closed, __ATOMIC_SEQ_CST ) ) {
+
+    r = futexWait( word, value, micros );
+  }
+  __atomic_store_n( &ring->waiting, 0, __ATOMIC_SEQ_CST );
+
+  if( r < 0 && errno == ETIMEDOUT && peerClosed( shm->sock ) ) {
+
+    return -1;
+  }
+  return 0;
+}
+
+/* read up to maxLen bytes from a shared memory channel, waiting no later
+   than the monotonic time deadline (in microseconds) if it is
+   non-negative
+   returns number of bytes read, 0 on end of file, or -1 on error or
+   timeout */
+static ssize_t shmRead( ShmChannel *shm, char *bytes, size_t maxLen,
+			int64_t deadline )
+{
+  ShmRing *ring = shm->in;
+  uint32_t head, tail, len, start, first;
+
+  /* only the reader changes tail */
+  tail = ring->tail;
+  while( 1 ) {
+
+    head = __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE );
+    if( head != tail ) {
+      break;
+    }
+
+    if( __atomic_load_n( &ring->closed, __ATOMIC_ACQUIRE ) ) {
+      /* data written just before closing still has to be read */
+
+      if( __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE ) == tail ) {
+	return 0;
+      }
+      continue;
+    }
+
+    if( shmWait( shm, ring, &ring->head, tail, deadline ) < 0 ) {
+      return -1;
+    }
+  }
+
+  len = head - tail;
+  if( len > maxLen ) {
+    len = maxLen;
+  }
+  start = tail % SHM_RING_LEN;
+  first = SHM_RING_LEN - start;
+  if( first > len ) {
+    first = len;
+  }
+  memcpy( bytes, &ring->data[ start ], first );
+  memcpy( &bytes[ first ], ring->data, len - first );
+
+  /* let a writer waiting for space know there is some */
+  __atomic_store_n( &ring->tail, tail + len, __ATOMIC_SEQ_CST );
+  if( __atomic_load_n( &ring->waiting, __ATOMIC_SEQ_CST ) ) {
+    futexWake( &ring->tail );
+  }
+
+  return len;
+}
+
+ssize_t shmWrite( ShmChannel *shm, const void *data, size_t len )
+{
+  ShmRing *ring = shm->out;
+  const char *bytes = (const char *)data;
+  uint32_t head, tail, n, start, first;
+  size_t done;
+
+  /* only the writer changes head */
+  head = ring->head;
+  done = 0;
+  while( done < len ) {
+
+    if( __atomic_load_n( &ring->closed, __ATOMIC_ACQUIRE ) ) {
+      return -1;
+    }
+
+    tail = __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE );
+    n = SHM_RING_LEN - ( head - tail );
+    if( n == 0 ) {
+      /* ring is full */
+
+      if( shmWait( shm, ring, &ring->tail, tail, -1 ) < 0 ) {
+	return -1;
+      }
+      continue;
+    }
+    if( n > len - done ) {
+      n = len - done;
+    }
+
+    start = head % SHM_RING_LEN;
+    first = SHM_RING_LEN - start;
+    if( first > n ) {
+      first = n;
+    }
+    memcpy( &ring->data[ start ], &bytes[ done ], first );
+    memcpy( ring->data, &bytes[ done + first ], n - first );
+    head += n;
+    done += n;
+
+    /* let a waiting reader know there is data */
+    __atomic_store_n( &ring->head, head, __ATOMIC_SEQ_CST );
+    if( __atomic_load_n( &ring->waiting, __ATOMIC_SEQ_CST ) ) {
+      futexWake( &ring->head );
+    }
+  }
+
+  return len;
+}
+
+/* map the rings of a channel from fd, where dealer is non-zero on the
+   dealer's side of the channel
+   returns NULL on failure */
+static ShmChannel *mapShmChannel( int sock, int fd, int dealer )
+{
+  ShmChannel *shm;
+  ShmRing *rings;
+
+  rings = (ShmRing *)mmap( NULL, 2 * sizeof( ShmRing ),
+			   PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  if( rings == MAP_FAILED ) {
+    return NULL;
+  }
+
+  shm = (ShmChannel *)malloc( sizeof( ShmChannel ) );
+  if( shm == NULL ) {
+
+    munmap( rings, 2 * sizeof( ShmRing ) );
+    return NULL;
+  }
+  shm->sock = sock;
+  shm->out = &rings[ dealer ? 0 : 1 ];
+  shm->in = &rings[ dealer ? 1 : 0 ];
+
+  return shm;
+}
+
+ShmChannel *offerShmChannel( int sock )
+{
+  int fd;
+  char byte;
+  ShmChannel *shm;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char control[ CMSG_SPACE( sizeof( int ) ) ];
+
+  /* anonymous shared memory, zeroed by ftruncate */
+  fd = memfd_create( "acpc_channel", MFD_CLOEXEC );
+  if( fd < 0 ) {
+    return NULL;
+  }
+  if( ftruncate( fd, 2 * sizeof( ShmRing ) ) < 0 ) {
+
+    close( fd );
+    return NULL;
+  }
+  shm = mapShmChannel( sock, fd, 1 );
+  if( shm == NULL ) {
+
+    close( fd );
+    return NULL;
+  }
+
+  /* pass the descriptor to the player, along with a byte of data */
+  byte = 0;
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  memset( &msg, 0, sizeof( msg ) );
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof( control );
+  cmsg = CMSG_FIRSTHDR( &msg );
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN( sizeof( int ) );
+  memcpy( CMSG_DATA( cmsg ), &fd, sizeof( int ) );
+  if( sendmsg( sock, &msg, 0 ) != 1 ) {
+
+    close( fd );
+    shm->sock = -1;
+    destroyShmChannel( shm );
+    return NULL;
+  }
+
+  close( fd );
+  return shm;
+}
+
+ShmChannel *acceptShmChannel( int sock )
+{
+  int fd;
+  char byte;
+  ShmChannel *shm;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char control[ CMSG_SPACE( sizeof( int ) ) ];
+
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  memset( &msg, 0, sizeof( msg ) );
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof( control );
+  if( recvmsg( sock, &msg, MSG_CMSG_CLOEXEC ) != 1 ) {
+    return NULL;
+  }
+  cmsg = CMSG_FIRSTHDR( &msg );
+  if( cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET
+      || cmsg->cmsg_type != SCM_RIGHTS ) {
+    return NULL;
+  }
+  memcpy( &fd, CMSG_DATA( cmsg ), sizeof( int ) );
+
+  shm = mapShmChannel( sock, fd, 0 );
+  close( fd );
+  return shm;
+}
+
+void destroyShmChannel( ShmChannel *shm )
+{
+  ShmRing *rings;
+
+  /* wake anything the other end is waiting for, so it sees the close */
+  __atomic_store_n( &shm->out->closed, 1, __ATOMIC_SEQ_CST );
+  __atomic_store_n( &shm->in->closed, 1, __ATOMIC_SEQ_CST );
+  futexWake( &shm->out->head );
+  futexWake( &shm->out->tail );
+  futexWake( &shm->in->head );
+  futexWake( &shm->in->tail );
+
+  rings = shm->out < shm->in ? shm->out : shm->in;
+  munmap( rings, 2 * sizeof( ShmRing ) );
+  if( shm->sock >= 0 ) {
+    close( shm->sock );
+  }
+  free( shm );
+}
+
+/* undo the string terminator written by the last getLineView() */
+static void restoreSavedChar( ReadBuf *readBuf )
+{
+  if( readBuf->savedChar >= 0 ) {
+
+    readBuf->buf[ readBuf->bufStart ] = readBuf->savedChar;
+    readBuf->savedChar = -1;
+  }
+}
+
+/* add more data after the unread data in the buffer, waiting no later
+   than the monotonic time deadline (in microseconds) if it is
+   non-negative.  Unread data is moved to the start of the buffer first,
+   and the buffer grows if it is full, or if the last read filled it
+   returns number of bytes read, 0 on end of file, or -1 on error or
+   timeout */
+static ssize_t fillReadBuf( ReadBuf *readBuf, int64_t deadline )
+{
+  ssize_t r;
+  int newSize;
+  char *newBuf;
+
+  /* make room after the unread data */
+  if( readBuf->bufStart > 0 ) {
+
+    memmove( readBuf->buf, &readBuf->buf[ readBuf->bufStart ],
+	     readBuf->bufEnd - readBuf->bufStart );
+    readBuf->bufEnd -= readBuf->bufStart;
+    readBuf->bufStart = 0;
+  }
+  if( readBuf->bufEnd == readBuf->bufSize ) {
+
+    newSize = readBuf->bufSize * 2;
+    newBuf = (char *)realloc( readBuf->buf, newSize + 1 );
+    if( newBuf == NULL ) {
+      return -1;
+    }
+    readBuf->buf = newBuf;
+    readBuf->bufSize = newSize;
+  }
+
+  if( readBuf->shm ) {
+
+    r = shmRead( readBuf->shm, &readBuf->buf[ readBuf->bufEnd ],
+		 readBuf->bufSize - readBuf->bufEnd, deadline );
+    if( r <= 0 ) {
+      return r;
+    }
+    goto haveData;
+  }
+
+  /* blocking reads need to know there's input before reading, but
+     non-blocking reads can just try */
+  if( deadline >= 0 && !readBuf->nonBlocking ) {
+
+    if( waitForInput( readBuf->fd, deadline ) < 1 ) {
+      /* no input ready within time, or an actual error */
+
+      return -1;
+    }
+  }
+
+  /* try reading as much as will fit */
+  while( 1 ) {
+
+    if( readBuf->recvFlags ) {
+
+      r = recv( readBuf->fd, &readBuf->buf[ readBuf->bufEnd ],
+		readBuf->bufSize - readBuf->bufEnd, readBuf->recvFlags );
+    } else {
+
+      r = read( readBuf->fd, &readBuf->buf[ readBuf->bufEnd ],
+		readBuf->bufSize - readBuf->bufEnd );
+    }
+    if( r >= 0 ) {
+      break;
+    }
+
+    if( errno == EINTR ) {
+      continue;
+    }
+    if( errno != EAGAIN && errno != EWOULDBLOCK ) {
+      /* error condition */
+
+      return -1;
+    }
+
+    /* nothing to read from a non-blocking descriptor yet */
+    if( deadline == 0 || waitForInput( readBuf->fd, deadline ) < 1 ) {
+      return -1;
+    }
+  }
+
+haveData:
+  /* data is arriving faster than we take it, so read more at a time */
+  if( readBuf->bufEnd + r == readBuf->bufSize
+      && readBuf->bufSize < READBUF_MAX_LEN ) {
+
+    newBuf = (char *)realloc( readBuf->buf, readBuf->bufSize * 2 + 1 );
+    if( newBuf != NULL ) {
+
+      readBuf->buf = newBuf;
+      readBuf->bufSize *= 2;
+    }
+  }
+
+  readBuf->bufEnd += r;
+  return r;
+}
+
+/* find the length of the next line in the buffer, including the newline
+   but no more than maxLen characters, reading more input as needed.
+   Lines are always left in one piece starting at bufStart
+   returns 0 on end of file, or -1 on error or timeout, with any partial
+   line left in the buffer */
+static ssize_t scanLine( ReadBuf *readBuf, ssize_t maxLen, int64_t deadline )
+{
+  ssize_t scanned, avail, r;
+  char *newline;
+
+  restoreSavedChar( readBuf );
+
+  scanned = 0;
+  while( 1 ) {
+
+    /* only look at the new data for a newline */
+    avail = readBuf->bufEnd - readBuf->bufStart;
+    if( avail > maxLen ) {
+      avail = maxLen;
+    }
+    newline = (char *)memchr( &readBuf->buf[ readBuf->bufStart + scanned ],
+			      '\n', avail - scanned );
+    if( newline != NULL ) {
+
+      return newline - &readBuf->buf[ readBuf->bufStart ] + 1;
+    }
+    if( avail == maxLen ) {
+      /* no room for any more of the line */
+
+      return maxLen;
+    }
+    scanned = avail;
+
+    r = fillReadBuf( readBuf, deadline );
+    if( r == 0 ) {
+      /* end of input, so whatever is left is the last line */
+
+      return readBuf->bufEnd - readBuf->bufStart;
+    } else if( r < 0 ) {
+
+      return -1;
+    }
+  }
+}
+
 /* get a newline terminated line and place it as a string in 'line'
    terminates the string with a 0 character
    if timeoutMicros is non-negative, do not spend more than
@@ -44,86 +624,104 @@ ssize_t getLine( ReadBuf *readBuf,
 		 char *line,
 		 int64_t timeoutMicros )
 {
-  int haveStartTime, c;
   ssize_t len;
-  fd_set fds;
-  struct timeval start, tv;
 
   /* reserve space for string terminator */
-  --maxLen;
-  if( maxLen < 0 ) {
+  if( maxLen < 1 ) {
     return -1;
   }
 
-  /* read the line */
-  haveStartTime = 0;
-  len = 0;
-  while( len < maxLen ) {
+  len = scanLine( readBuf, maxLen - 1, timeoutDeadline( timeoutMicros ) );
+  if( len < 0 ) {
+    return -1;
+  }
 
-    if( readBuf->bufStart >= readBuf->bufEnd ) {
-      /* buffer is empty */
+  memcpy( line, &readBuf->buf[ readBuf->bufStart ], len );
+  readBuf->bufStart += len;
+  line[ len ] = 0;
+  return len;
+}
 
-      if( timeoutMicros >= 0 ) {
-	/* figure out how much time is left for reading */
-	uint64_t timeLeft;
+ssize_t getLineView( ReadBuf *readBuf,
+		     size_t maxLen,
+		     const char **line,
+		     int64_t timeoutMicros )
+{
+  ssize_t len;
 
-	timeLeft = timeoutMicros;
-	if( haveStartTime ) {
+  if( maxLen < 1 ) {
+    return -1;
+  }
 
-	  gettimeofday( &tv, NULL );
-	  timeLeft -= (uint64_t)( tv.tv_sec - start.tv_sec ) * 1000000
-	    + ( tv.tv_usec - start.tv_usec );
-	  if( timeLeft < 0 ) {
+  len = scanLine( readBuf, maxLen - 1, timeoutDeadline( timeoutMicros ) );
+  if( len < 0 ) {
+    return -1;
+  }
 
-	    timeLeft = 0;
-	  }
-	} else {
+  /* terminate the line in place, remembering what was overwritten */
+  *line = &readBuf->buf[ readBuf->bufStart ];
+  readBuf->bufStart += len;
+  readBuf->savedChar = (unsigned char)readBuf->buf[ readBuf->bufStart ];
+  readBuf->buf[ readBuf->bufStart ] = 0;
+  return len;
+}
 
-	  haveStartTime = 1;
-	  gettimeofday( &start, NULL );
-	}
-	tv.tv_sec = timeLeft / 1000000;
-	tv.tv_usec = timeLeft % 1000000;
-
-	/* wait for file descriptor to be ready */
-	FD_ZERO( &fds );
-	FD_SET( readBuf->fd, &fds );
-	if( select( readBuf->fd + 1, &fds, NULL, NULL, &tv ) < 1 ) {
-	  /* no input ready within time, or an actual error */
-	
-	  return -1;
-	}
-      }
+ssize_t getFrame( ReadBuf *readBuf,
+		  size_t maxLen,
+		  uint8_t *frame,
+		  int64_t timeoutMicros )
+{
+  int haveLength, i;
+  ssize_t avail, want, r;
+  int64_t deadline;
+  const uint8_t *bytes;
 
-      /* try reading a buffer full of data */
-      readBuf->bufStart = 0;
-      readBuf->bufEnd = read( readBuf->fd, readBuf->buf, READBUF_LEN );
-      if( readBuf->bufEnd == 0 ) {
-	/* end of input */
+  restoreSavedChar( readBuf );
 
-	break;
-      } else if( readBuf->bufEnd < 0 ) {
-	/* error condition */
+  if( maxLen < FRAME_LEN_BYTES ) {
+    return -1;
+  }
+
+  deadline = timeoutDeadline( timeoutMicros );
+
+  /* wait for the length, then the rest of the frame */
+  haveLength = 0;
+  want = FRAME_LEN_BYTES;
+  while( 1 ) {
 
-	readBuf->bufEnd = 0;
+    avail = readBuf->bufEnd - readBuf->bufStart;
+    if( !haveLength && avail >= FRAME_LEN_BYTES ) {
+      /* now we know how long the frame is */
+
+      haveLength = 1;
+      bytes = (const uint8_t *)&readBuf->buf[ readBuf->bufStart ];
+      want = 0;
+      for( i = 0; i < FRAME_LEN_BYTES; ++i ) {
+	want = ( want << 8 ) | bytes[ i ];
+      }
+      want += FRAME_LEN_BYTES;
+      if( want > maxLen ) {
 	return -1;
       }
     }
+    if( haveLength && avail >= want ) {
+      break;
+    }
 
-    /* keep adding to the string until we see a newline */
-    c = readBuf->buf[ readBuf->bufStart ];
-    ++readBuf->bufStart;
-    line[ len ] = c;
-    ++len;
-    if( c == '\n' ) {
+    r = fillReadBuf( readBuf, deadline );
+    if( r == 0 ) {
+      /* end of input, which is only clean between frames */
 
-      break;
+      return avail ? -1 : 0;
+    } else if( r < 0 ) {
+
+      return -1;
     }
   }
 
-  /* terminate the string */
-  line[ len ] = 0;
-  return len;
+  memcpy( frame, &readBuf->buf[ readBuf->bufStart ], want );
+  readBuf->bufStart += want;
+  return want;
 }
 
 
@@ -216,3 +814,322 @@ int getListenSocket( uint16_t *desiredPort )
 
   return sock;
 }
+
+/* fill in addr with the unix socket path prefix followed by port
+   returns 0 on success, -1 if the path is too long */
+static int unixSocketAddress( const char *prefix, uint16_t port,
+			      struct sockaddr_un *addr )
+{
+  int c;
+
+  memset( addr, 0, sizeof( *addr ) );
+  addr->sun_family = AF_UNIX;
+  c = snprintf( addr->sun_path, sizeof( addr->sun_path ),
+		"%s%"PRIu16, prefix, port );
+  if( c < 0 || c >= sizeof( addr->sun_path ) ) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int connectToUnix( const char *prefix, uint16_t port )
+{
+  int sock;
+  struct sockaddr_un addr;
+
+  if( unixSocketAddress( prefix, port, &addr ) < 0 ) {
+
+    fprintf( stderr, "ERROR: unix socket path %s%"PRIu16" is too long\n",
+	     prefix, port );
+    return -1;
+  }
+
+  if( ( sock = socket( AF_UNIX, SOCK_STREAM, 0 ) ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not open socket\n" );
+    return -1;
+  }
+
+  if( connect( sock, (struct sockaddr *)&addr, sizeof( addr ) ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not connect to %s\n", addr.sun_path );
+    close( sock );
+    return -1;
+  }
+
+  return sock;
+}
+
+int getUnixListenSocket( const char *prefix, uint16_t *desiredPort )
+{
+  int sock, t;
+  struct sockaddr_un addr;
+
+  if( ( sock = socket( AF_UNIX, SOCK_STREAM, 0 ) ) < 0 ) {
+
+    return -1;
+  }
+
+  /* bind the socket to the path for the port, picking a random port
+     which isn't in use if the desired port is 0 */
+  t = 0;
+  while( 1 ) {
+
+    if( *desiredPort == 0 || t ) {
+
+      *desiredPort = ( random() % 64512 ) + 1024;
+    }
+    if( unixSocketAddress( prefix, *desiredPort, &addr ) < 0 ) {
+
+      close( sock );
+      return -1;
+    }
+    if( bind( sock, (struct sockaddr *)&addr, sizeof( addr ) ) < 0 ) {
+
+      if( errno == EADDRINUSE && t < NUM_PORT_CREATION_ATTEMPTS ) {
+
+	++t;
+	continue;
+      }
+
+      close( sock );
+      return -1;
+    }
+
+    break;
+  }
+
+  /* listen on the socket */
+  if( listen( sock, 8 ) < 0 ) {
+
+    close( sock );
+    return -1;
+  }
+
+  return sock;
+}
+
+ssize_t writeToConnection( ReadBuf *readBuf, const void *data, size_t len )
+{
+  const char *bytes = (const char *)data;
+  size_t done;
+  ssize_t r;
+
+  if( readBuf->shm ) {
+
+    return shmWrite( readBuf->shm, data, len );
+  }
+
+  for( done = 0; done < len; done += r ) {
+
+    r = write( readBuf->fd, &bytes[ done ], len - done );
+    if( r < 0 ) {
+
+      if( errno == EINTR ) {
+
+	r = 0;
+	continue;
+      }
+      return -1;
+    }
+  }
+
+  return len;
+}
+
+
+/* stdio cookie functions for the streams of a shared memory channel */
+static ssize_t shmStreamRead( void *cookie, char *buf, size_t size )
+{
+  ssize_t r;
+
+  r = shmRead( (ShmChannel *)cookie, buf, size, -1 );
+  return r < 0 ? -1 : r;
+}
+
+static ssize_t shmStreamWrite( void *cookie, const char *buf, size_t size )
+{
+  return shmWrite( (ShmChannel *)cookie, buf, size ) < 0 ? 0 : size;
+}
+
+static int shmStreamClose( void *cookie )
+{
+  destroyShmChannel( (ShmChannel *)cookie );
+  return 0;
+}
+
+int openDealerStreams( char *hostname, uint16_t port,
+		       FILE **toServer, FILE **fromServer )
+{
+  int sock;
+  ShmChannel *shm;
+  cookie_io_functions_t readFuncs = { shmStreamRead, NULL, NULL,
+				      shmStreamClose };
+  cookie_io_functions_t writeFuncs = { NULL, shmStreamWrite, NULL, NULL };
+
+  if( !strncmp( hostname, UNIX_ADDRESS_PREFIX,
+		strlen( UNIX_ADDRESS_PREFIX ) ) ) {
+
+    sock = connectToUnix( &hostname[ strlen( UNIX_ADDRESS_PREFIX ) ], port );
+  } else if( !strncmp( hostname, SHM_ADDRESS_PREFIX,
+		       strlen( SHM_ADDRESS_PREFIX ) ) ) {
+
+    sock = connectToUnix( &hostname[ strlen( SHM_ADDRESS_PREFIX ) ], port );
+    if( sock < 0 ) {
+      return -1;
+    }
+
+    shm = acceptShmChannel( sock );
+    if( shm == NULL ) {
+
+      fprintf( stderr, "ERROR: could not get shared memory from dealer\n" );
+      close( sock );
+      return -1;
+    }
+
+    /* closing fromServer closes the channel */
+    *fromServer = fopencookie( shm, "r", readFuncs );
+    *toServer = fopencookie( shm, "w", writeFuncs );
+    if( *toServer == NULL || *fromServer == NULL ) {
+
+      fprintf( stderr, "ERROR: could not get channel streams\n" );
+      return -1;
+    }
+    return 0;
+  } else {
+
+    sock = connectTo( hostname, port );
+  }
+  if( sock < 0 ) {
+    return -1;
+  }
+
+  *toServer = fdopen( sock, "w" );
+  *fromServer = fdopen( sock, "r" );
+  if( *toServer == NULL || *fromServer == NULL ) {
+
+    fprintf( stderr, "ERROR: could not get socket streams\n" );
+    return -1;
+  }
+
+  return 0;
+}
+
+
+EventLoop *createEventLoop( void *context )
+{
+  EventLoop *loop;
+
+  loop = (EventLoop *)malloc( sizeof( EventLoop ) );
+  if( loop == NULL ) {
+    return NULL;
+  }
+
+  loop->epollFD = epoll_create1( EPOLL_CLOEXEC );
+  if( loop->epollFD < 0 ) {
+
+    free( loop );
+    return NULL;
+  }
+  loop->context = context;
+  loop->numHandlers = 0;
+  loop->removed = NULL;
+
+  return loop;
+}
+
+/* free handlers which were removed, once no events can refer to them */
+static void freeRemovedHandlers( EventLoop *loop )
+{
+  EventHandler *handler;
+
+  while( loop->removed ) {
+
+    handler = loop->removed;
+    loop->removed = handler->nextRemoved;
+    free( handler );
+  }
+}
+
+void destroyEventLoop( EventLoop *loop )
+{
+  freeRemovedHandlers( loop );
+  close( loop->epollFD );
+  free( loop );
+}
+
+EventHandler *addEventHandler( EventLoop *loop, int fd,
+			       EventCallback callback, void *data )
+{
+  EventHandler *handler;
+  struct epoll_event event;
+
+  handler = (EventHandler *)malloc( sizeof( EventHandler ) );
+  if( handler == NULL ) {
+    return NULL;
+  }
+  handler->fd = fd;
+  handler->callback = callback;
+  handler->data = data;
+  handler->nextRemoved = NULL;
+
+  /* level triggered, so input left unread is reported again */
+  memset( &event, 0, sizeof( event ) );
+  event.events = EPOLLIN;
+  event.data.ptr = handler;
+  if( epoll_ctl( loop->epollFD, EPOLL_CTL_ADD, fd, &event ) < 0 ) {
+
+    free( handler );
+    return NULL;
+  }
+  ++loop->numHandlers;
+
+  return handler;
+}
+
+void removeEventHandler( EventLoop *loop, EventHandler *handler )
+{
+  /* the descriptor may already be closed, which removes it from the
+     epoll set, so ignore failure */
+  epoll_ctl( loop->epollFD, EPOLL_CTL_DEL, handler->fd, NULL );
+  --loop->numHandlers;
+
+  /* events for the handler may still be waiting to be dispatched */
+  handler->fd = -1;
+  handler->nextRemoved = loop->removed;
+  loop->removed = handler;
+}
+
+int runEventLoop( EventLoop *loop, int64_t timeoutMicros )
+{
+  int i, n;
+  EventHandler *handler;
+  struct epoll_event events[ MAX_LOOP_EVENTS ];
+
+  while( 1 ) {
+
+    n = epoll_wait( loop->epollFD, events, MAX_LOOP_EVENTS,
+		    timeoutMicros < 0 ? -1 : ( timeoutMicros + 999 ) / 1000 );
+    if( n >= 0 || errno != EINTR ) {
+      break;
+    }
+  }
+  if( n < 0 ) {
+    return -1;
+  }
+
+  for( i = 0; i < n; ++i ) {
+
+    handler = (EventHandler *)events[ i ].data.ptr;
+    if( handler->fd < 0 ) {
+      /* removed by an earlier callback */
+
+      continue;
+    }
+    handler->callback( loop->context, handler->fd, handler->data );
+  }
+  freeRemovedHandlers( loop );
+
+  return n;
+}
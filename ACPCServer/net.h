@@ -13,8 +13,49 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 
 
 #define READBUF_LEN 4096
+/* read buffers start at READBUF_LEN bytes, and grow up to this size
+   while reads keep filling them */
+#define READBUF_MAX_LEN 65536
 #define NUM_PORT_CREATION_ATTEMPTS 10
 
+/* binary frames start with a big-endian count of the bytes after it */
+#define FRAME_LEN_BYTES 2
+
+/* most events handled by one call to runEventLoop() */
+#define MAX_LOOP_EVENTS 64
+
+/* player addresses starting with these connect through a unix socket,
+   or shared memory set up over a unix socket, instead of TCP.  The rest
+   of the address is a path prefix, which the port number is added to */
+#define UNIX_ADDRESS_PREFIX "unix:"
+#define SHM_ADDRESS_PREFIX "shm:"
+
+/* bytes in each direction of a shared memory channel - must be a power
+   of two so the ring positions can wrap around */
+#define SHM_RING_LEN 65536
+
+/* how often a shared memory channel checks whether the other end is
+   still there while waiting */
+#define SHM_CHECK_MICROS 100000
+
+
+/* one direction of a shared memory channel.  Only the writer changes
+   head, and only the reader changes tail, so no locks are needed */
+typedef struct {
+  uint32_t head; /* bytes written, modulo 2^32 */
+  uint32_t tail; /* bytes read, modulo 2^32 */
+  uint32_t waiting; /* non-zero while someone may be in a futex wait */
+  uint32_t closed;
+  char data[ SHM_RING_LEN ];
+} ShmRing;
+
+/* a pair of rings in memory shared by the dealer and a player, with the
+   unix socket used to set it up */
+typedef struct {
+  int sock;
+  ShmRing *in;
+  ShmRing *out;
+} ShmChannel;
 
 /* buffered I/O on file descriptors
 
@@ -25,20 +66,99 @@ typedef struct {
   int fd;
   int bufStart;
   int bufEnd;
-  char buf[ READBUF_LEN ];
+  int bufSize; /* not counting a byte kept for a string terminator */
+
+  /* non-zero if reads only take input which has already arrived,
+     because fd was non-blocking when the buffer was created or
+     setReadBufDontWait() was called */
+  int nonBlocking;
+
+  /* flags for reading with recv(), or 0 to read with read() */
+  int recvFlags;
+
+  /* character at bufStart replaced by getLineView()'s terminator,
+     or -1 if there is none */
+  int savedChar;
+
+  /* if not NULL, data comes from this channel rather than fd */
+  ShmChannel *shm;
+
+  char *buf;
 } ReadBuf;
 
+/* called with the loop's context when fd has input, or has been
+   closed by the other end */
+typedef void (*EventCallback)( void *context, int fd, void *data );
+
+typedef struct EventHandler_struct {
+  int fd; /* -1 once removed */
+  EventCallback callback;
+  void *data;
+  struct EventHandler_struct *nextRemoved;
+} EventHandler;
+
+/* an epoll based event loop, so a process can wait on any number of
+   descriptors without rebuilding an fd_set or the FD_SETSIZE limit */
+typedef struct {
+  int epollFD;
+  int numHandlers;
+  void *context;
+
+  /* handlers to free once the current events have been dispatched */
+  EventHandler *removed;
+} EventLoop;
+
+
+/* current time in microseconds from a monotonic clock, for deadlines
+   which don't jump when the system time is changed */
+int64_t monotonicMicros();
+
+/* make reads and writes on fd return instead of blocking
+   returns 0 on success, -1 on failure */
+int setNonBlocking( int fd );
 
 /* open a socket to hostname/port
    returns file descriptor on success, <0 on failure */
 int connectTo( char *hostname, uint16_t port );
 
+/* open a unix socket to the path prefix followed by port
+   returns file descriptor on success, <0 on failure */
+int connectToUnix( const char *prefix, uint16_t port );
+
 /* try opening a socket suitable for connecting to
    if *desiredPort>0, uses specified port, otherwise use a random port
    returns actual port in *desiredPort
    returns file descriptor for socket, or -1 on failure */
 int getListenSocket( uint16_t *desiredPort );
 
+/* same as getListenSocket, but for a unix socket at the path prefix
+   followed by the port number */
+int getUnixListenSocket( const char *prefix, uint16_t *desiredPort );
+
+/* connect to a dealer at hostname/port, which may be a unix: or shm:
+   address, and open streams for talking to it
+   returns 0 on success, -1 on failure */
+int openDealerStreams( char *hostname, uint16_t port,
+		       FILE **toServer, FILE **fromServer );
+
+
+/* dealer side of a shared memory channel: create the shared memory and
+   send it over the unix socket sock
+   returns NULL on failure */
+ShmChannel *offerShmChannel( int sock );
+
+/* player side of a shared memory channel: receive the shared memory
+   sent by offerShmChannel() on sock
+   returns NULL on failure */
+ShmChannel *acceptShmChannel( int sock );
+
+/* close a channel and its socket, waking up the other end */
+void destroyShmChannel( ShmChannel *shm );
+
+/* write all len bytes to a channel, waiting for space as needed
+   returns len on success, -1 if the channel was closed */
+ssize_t shmWrite( ShmChannel *shm, const void *data, size_t len );
+
 
 /* create a read buffer structure
    returns 0 on failure */
@@ -47,16 +167,72 @@ ReadBuf *createReadBuf( int fd );
 /* destroy a read buffer - like fdopen, it will close the file descriptor */
 void destroyReadBuf( ReadBuf *readBuf );
 
+/* create a read buffer for a shared memory channel, which the buffer
+   then owns
+   returns 0 on failure */
+ReadBuf *createShmReadBuf( ShmChannel *shm );
+
+/* make reads through readBuf, which must be reading a socket, only take
+   input which has already arrived.  The socket itself is left blocking,
+   so writes to it still wait until everything is written */
+void setReadBufDontWait( ReadBuf *readBuf );
+
+/* write all len bytes to whatever readBuf is reading from
+   returns len on success, -1 on failure */
+ssize_t writeToConnection( ReadBuf *readBuf, const void *data, size_t len );
+
 /* get a newline terminated line and place it as a string in 'line'
    terminates the string with a 0 character
    if timeoutMicros is non-negative, do not spend more than
    that number of microseconds waiting to read data
    return number of characters read (including newline, excluding 0)
-   0 on end of file, or -1 on error or timeout */
+   0 on end of file, or -1 on error or timeout.  A partial line is kept
+   for the next call on a timeout, and errno is EAGAIN if a non-blocking
+   descriptor had no more input */
 ssize_t getLine( ReadBuf *readBuf,
 		 size_t maxLen,
 		 char *line,
 		 int64_t timeoutMicros );
 
+/* same as getLine, but instead of copying the line, point 'line' at the
+   line inside the read buffer.  The line is only valid until the next
+   call using readBuf */
+ssize_t getLineView( ReadBuf *readBuf,
+		     size_t maxLen,
+		     const char **line,
+		     int64_t timeoutMicros );
+
+/* get a binary frame, a FRAME_LEN_BYTES length followed by that many
+   bytes, and place it (including the length) in frame
+   if timeoutMicros is non-negative, do not spend more than
+   that number of microseconds waiting to read data
+   return number of bytes read, 0 on end of file, or -1 on error,
+   timeout, or a frame longer than maxLen */
+ssize_t getFrame( ReadBuf *readBuf,
+		  size_t maxLen,
+		  uint8_t *frame,
+		  int64_t timeoutMicros );
+
+
+/* create an event loop, which passes context to every callback
+   returns NULL on failure */
+EventLoop *createEventLoop( void *context );
+
+/* destroy an event loop - does not close any registered descriptors */
+void destroyEventLoop( EventLoop *loop );
+
+/* call callback with data whenever fd has input
+   returns the handler, or NULL on failure */
+EventHandler *addEventHandler( EventLoop *loop, int fd,
+			       EventCallback callback, void *data );
+
+/* stop calling the handler.  This is safe from inside a callback, and
+   should be done before closing the descriptor */
+void removeEventHandler( EventLoop *loop, EventHandler *handler );
+
+/* wait for input on the registered descriptors and call their handlers
+   if timeoutMicros is non-negative, do not wait longer than that
+   returns number of events handled, 0 on timeout, -1 on error */
+int runEventLoop( EventLoop *loop, int64_t timeoutMicros );
 
 #endif
@@ -0,0 +1,53 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _PLAYER_PLUGIN_H
+#define _PLAYER_PLUGIN_H
+
+#include "game.h"
+
+
+/* A player can be built as a shared object and loaded into the dealer
+   with --plugin, so the dealer calls it directly with MatchState structs
+   instead of sending it messages.  The shared object must define the
+   functions named below, with the types below.  It can call anything in
+   game.h and rng.h, which the dealer provides, so it does not need to
+   link those itself.
+
+   Each table gets its own player from PLAYER_PLUGIN_INIT.  When the
+   dealer plays several tables at once, the functions are called from
+   each table's thread, so they must not share state between players
+   without locking it. */
+
+/* void *playerInit( const Game *game, const char *args )
+   args are from the --plugin option, or an empty string
+   returns a new player, or NULL on failure */
+#define PLAYER_PLUGIN_INIT "playerInit"
+typedef void *(*PlayerInitFunc)( const Game *game, const char *args );
+
+/* states passed to a player only have the cards it can see, the same as
+   in the messages sent to other players.  Every other card, such as an
+   opponent's hole cards before a showdown or the board cards of later
+   rounds, is BINARY_UNKNOWN_CARD */
+
+/* int playerAct( void *player, const MatchState *state, Action *action )
+   called when it is the player's turn to act in state.  An invalid
+   action is changed to a call, and counts as an invalid action
+   returns >= 0 if action was set, -1 to end the match */
+#define PLAYER_PLUGIN_ACT "playerAct"
+typedef int (*PlayerActFunc)( void *player, const MatchState *state,
+			      Action *action );
+
+/* void playerObserve( void *player, const MatchState *state )
+   called with every state the player would be sent where it does not
+   act, including the final state of each hand */
+#define PLAYER_PLUGIN_OBSERVE "playerObserve"
+typedef void (*PlayerObserveFunc)( void *player, const MatchState *state );
+
+/* void playerFree( void *player )
+   called once the match is over */
+#define PLAYER_PLUGIN_FREE "playerFree"
+typedef void (*PlayerFreeFunc)( void *player );
+
+#endif
@@ -14,6 +14,10 @@ end
 
 --- Connects over a network socket.
 -- 
+-- A server of the form `unix:prefix` connects to a dealer started with
+-- `--unix prefix`, through the unix socket named by the prefix followed
+-- by the port. The dealer's `--shm` transport is not supported here.
+-- 
 -- @param server the server that sends states to DeepStack, and to which
 -- DeepStack sends actions
 -- @param port the port to connect on
@@ -21,11 +25,29 @@ function ACPCNetworkCommunication:connect(server, port)
   server = server or arguments.acpc_server
   port = port or arguments.acpc_server_port
 
-  self.connection = assert(socket.connect(server, port))
+  local prefix = server:match("^unix:(.*)")
+  if prefix then
+    self.connection = self:_connect_unix(prefix .. port)
+  else
+    assert(not server:match("^shm:"), "shared memory dealers need a C player")
+    self.connection = assert(socket.connect(server, port))
+  end
 
   self:_handshake()
 end
 
+--- Connects to a unix socket.
+-- @param path the path of the socket
+-- @return the connection
+-- @local
+function ACPCNetworkCommunication:_connect_unix(path)
+  local unix = require "socket.unix"
+  -- newer versions of luasocket have separate stream and datagram sockets
+  local connection = assert(type(unix) == "table" and unix.stream() or unix())
+  assert(connection:connect(path))
+  return connection
+end
+
 --- Sends a handshake message to initialize network communication.
 -- @local
 function ACPCNetworkCommunication:_handshake()
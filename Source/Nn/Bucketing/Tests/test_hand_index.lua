@@ -0,0 +1,80 @@
+-- Checks the C hand indexer in ACPCServer/hand_index against the Lua
+-- bucketing IDs. Build it first with `make hand_index` in ACPCServer.
+require 'torch'
+local card_to_string = require 'Game.card_to_string_conversion'
+local flop_tools = require 'Nn.Bucketing.flop_tools'
+local turn_tools = require 'Nn.Bucketing.turn_tools'
+local river_tools = require 'Nn.Bucketing.river_tools'
+
+local hand_index = '../ACPCServer/hand_index'
+local game_file = '../ACPCServer/holdem.nolimit.2p.reverse_blinds.game'
+local hand_count = 10000
+
+torch.manualSeed(0)
+
+-- renames the suits of cards using perm, a permutation of 1..4
+local function permute_suits(cards, perm)
+  local out = cards:clone()
+  for i = 1, cards:size(1) do
+    local rank = math.floor((cards[i] - 1) / 4)
+    out[i] = rank * 4 + perm[(cards[i] - 1) % 4 + 1]
+  end
+  return out
+end
+
+local function hand_string(hole, board)
+  if hole[1] > hole[2] then
+    hole = torch.ByteTensor{hole[2], hole[1]}
+  end
+  return card_to_string:cards_to_string(hole) .. '|' .. card_to_string:cards_to_string(board)
+end
+
+-- every hand is followed by a copy with the suits renamed
+local hands = {}
+local input_file = os.tmpname()
+local input = io.open(input_file, 'w')
+for i = 1, hand_count do
+  local board_count = 3 + (i - 1) % 3
+  local cards = torch.randperm(52):narrow(1, 1, 2 + board_count):byte()
+  local hole = torch.sort(cards:narrow(1, 1, 2))
+  local board = cards:narrow(1, 3, board_count):clone()
+  local perm = torch.randperm(4)
+
+  hands[i] = {hole = hole, board = board}
+  input:write(hand_string(hole, board) .. '\n')
+  input:write(hand_string(permute_suits(hole, perm), permute_suits(board, perm)) .. '\n')
+end
+input:close()
+
+local output = io.popen(hand_index .. ' ' .. game_file .. ' < ' .. input_file)
+local id_errors = 0
+local index_errors = 0
+for i = 1, hand_count do
+  local hand = hands[i]
+  local _, index, id = output:read('*n', '*n', '*n')
+  local _, permuted_index, _ = output:read('*n', '*n', '*n')
+  assert(index ~= nil and permuted_index ~= nil, 'missing output from ' .. hand_index)
+
+  local lua_id
+  if hand.board:size(1) == 3 then
+    lua_id = flop_tools:flopID(hand.hole:clone(), hand.board:clone())
+  elseif hand.board:size(1) == 4 then
+    lua_id = turn_tools:turnID(hand.hole:clone(), hand.board:clone())
+  else
+    lua_id = river_tools:riverID(hand.hole:clone(), hand.board:clone())
+  end
+
+  if lua_id ~= id then
+    id_errors = id_errors + 1
+    print('ID mismatch for ' .. hand_string(hand.hole, hand.board) .. ': ' .. lua_id .. ' ' .. id)
+  end
+  if index ~= permuted_index then
+    index_errors = index_errors + 1
+    print('index changed when renaming suits of ' .. hand_string(hand.hole, hand.board))
+  end
+end
+output:close()
+os.remove(input_file)
+
+print('ID mismatches: ' .. id_errors .. ', index mismatches: ' .. index_errors .. ' in ' .. hand_count .. ' hands')
+assert(id_errors == 0 and index_errors == 0)